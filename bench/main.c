@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file main.c Measures how fast each CPU mode runs a few synthetic programs.
+///
+/// The programs are assembled into a BIOS image, so that they run straight
+/// from reset with nothing else involved: a tight loop which mixes arithmetic
+/// with a load and a store to RAM, and random programs of arithmetic, memory
+/// accesses, divisions and forward branches, repeated in an outer loop. Each
+/// one is run several times per mode, and the best rate is reported.
+///
+/// To measure the decoder tables against the switch they replaced, build once
+/// more with -DPSYCHO_CPU_DECODE_SWITCH=ON and compare the interpreter.
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "prog.h"
+#include "psycho/ctx.h"
+
+// clang-format off
+
+/// @brief The number of times each program is run in each mode unless -r
+/// says otherwise.
+#define BENCH_RUNS_DEFAULT	(5)
+
+/// @brief The number of times the tight loop goes around.
+#define BENCH_LOOP_ITERS	(10000000)
+
+/// @brief The number of times a random program's body is repeated.
+#define BENCH_RAND_ITERS	(200000)
+
+/// @brief The most instructions a program may take before it is considered
+/// stuck.
+#define BENCH_BUDGET		(UINT64_C(1) << 40)
+
+#define BENCH_PROGS_NUM		(3)
+#define BENCH_MODES_NUM		(3)
+
+// clang-format on
+
+struct prog_def {
+	const char *name;
+
+	/// @brief Assembles the program, and returns the address of the
+	/// instruction which ends it.
+	u32 (*assemble)(struct prog *prog, u32 seed);
+
+	u32 seed;
+	u32 pad;
+};
+
+static u32 loop_assemble(struct prog *const prog, const u32 seed)
+{
+	(void)seed;
+	return prog_loop_assemble(prog, BENCH_LOOP_ITERS);
+}
+
+static u32 rand_assemble(struct prog *const prog, const u32 seed)
+{
+	return prog_rand_assemble(prog, seed, BENCH_RAND_ITERS);
+}
+
+static const struct prog_def progs[BENCH_PROGS_NUM] = {
+	{ "tight loop", &loop_assemble, 0, 0 },
+	{ "random program 3", &rand_assemble, 3, 0 },
+	{ "random program 5", &rand_assemble, 5, 0 },
+};
+
+static const char *const mode_names[BENCH_MODES_NUM] = {
+	[PSYCHO_CPU_MODE_INTERP] = "interp",
+	[PSYCHO_CPU_MODE_CACHED] = "cached",
+	[PSYCHO_CPU_MODE_JIT] = "jit",
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / (double)1000000000);
+}
+
+/// @brief Runs the program in a BIOS image several times.
+///
+/// @returns The best rate in MIPS, or a negative value if the program did not
+/// run to its end.
+static double prog_run(const struct psycho_bios *const bios, const u32 end,
+		       const uint mode, const uint runs, const bool fastmem)
+{
+	struct psycho_ctx *const ctx = psycho_ctx_new(bios, NULL, mode);
+
+	if (!ctx) {
+		return -1;
+	}
+
+	if (fastmem && !psycho_ctx_fastmem_enable(ctx)) {
+		fprintf(stderr, "Fastmem is unavailable; using the page "
+				"tables.\n");
+	}
+
+	ctx->stop_pc = end;
+	ctx->stop_pc_enabled = true;
+
+	double best = 0;
+
+	for (uint run = 0; run < runs; ++run) {
+		psycho_ctx_reset(ctx);
+
+		const double beg = now();
+		const uint stop = psycho_ctx_run(ctx, BENCH_BUDGET);
+		const double secs = now() - beg;
+
+		if (stop != PSYCHO_CTX_STOP_PC) {
+			best = -1;
+			break;
+		}
+
+		const u64 instrs = psycho_ctx_cycles(ctx);
+		const double mips = (double)instrs / secs / (double)1000000;
+
+		if (mips > best) {
+			best = mips;
+		}
+	}
+
+	psycho_ctx_free(ctx);
+	return best;
+}
+
+static void usage_output(const char *const argv0)
+{
+	fprintf(stderr,
+		"Syntax: %s [-m interp|cached|jit] [-r runs] [-f]\n"
+		"  -m  the CPU mode to measure (default: all of them)\n"
+		"  -r  the number of runs of each program, of which the best "
+		"counts\n"
+		"  -f  enable fastmem\n",
+		argv0);
+}
+
+int main(int argc, char **argv)
+{
+	bool modes[BENCH_MODES_NUM] = { true, true, true };
+	uint runs = BENCH_RUNS_DEFAULT;
+	bool fastmem = false;
+
+	for (int opt; (opt = getopt(argc, argv, "m:r:f")) != -1;) {
+		switch (opt) {
+		case 'm': {
+			uint mode = 0;
+
+			while ((mode < BENCH_MODES_NUM) &&
+			       strcmp(optarg, mode_names[mode])) {
+				++mode;
+			}
+
+			if (mode == BENCH_MODES_NUM) {
+				usage_output(argv[0]);
+				return EXIT_FAILURE;
+			}
+
+			memset(modes, 0, sizeof(modes));
+			modes[mode] = true;
+			break;
+		}
+
+		case 'r':
+			runs = (uint)strtoul(optarg, NULL, 0);
+			break;
+
+		case 'f':
+			fastmem = true;
+			break;
+
+		default:
+			usage_output(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (runs < 1) {
+		runs = 1;
+	}
+
+	u8 *const image = calloc(1, PSYCHO_BUS_BIOS_SIZE);
+
+	if (!image) {
+		return EXIT_FAILURE;
+	}
+
+	printf("Throughput in MIPS, best of %u runs\n\n%-20s", runs, "");
+
+	for (uint mode = 0; mode < BENCH_MODES_NUM; ++mode) {
+		if (modes[mode]) {
+			printf(" %8s", mode_names[mode]);
+		}
+	}
+	printf("\n");
+
+	bool passed = true;
+
+	for (uint i = 0; i < BENCH_PROGS_NUM; ++i) {
+		struct prog prog = { .image = image, .len = 0, .rnd = 0 };
+		struct psycho_bios bios;
+
+		memset(image, 0, PSYCHO_BUS_BIOS_SIZE);
+		const u32 end = progs[i].assemble(&prog, progs[i].seed);
+
+		if (!psycho_bios_create(&bios, image)) {
+			passed = false;
+			break;
+		}
+
+		printf("%-20s", progs[i].name);
+
+		for (uint mode = 0; mode < BENCH_MODES_NUM; ++mode) {
+			if (!modes[mode]) {
+				continue;
+			}
+
+			const double mips =
+				prog_run(&bios, end, mode, runs, fastmem);
+
+			if (mips < 0) {
+				printf(" %8s", "failed");
+				passed = false;
+			} else {
+				printf(" %8.1f", mips);
+			}
+			fflush(stdout);
+		}
+		printf("\n");
+
+		psycho_bios_close(&bios);
+	}
+
+	free(image);
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file prog.c Assembles the synthetic programs which the benchmark runs, and
+/// which the tests compare across CPU modes.
+
+#include "prog.h"
+
+// clang-format off
+
+/// @brief The number of instruction groups in a random program's body.
+#define PROG_RAND_GROUPS	(300)
+
+/// @brief The offset of root counter 0's value register from $k1 in random
+/// programs which read it.
+#define PROG_RCNT0_VALUE	(0x1100)
+
+#define REG_ZERO	(0)
+#define REG_AT		(1)
+#define REG_T0		(8)
+#define REG_T1		(9)
+#define REG_T2		(10)
+#define REG_T3		(11)
+#define REG_S0		(16)
+#define REG_S2		(18)
+#define REG_S3		(19)
+#define REG_S7		(23)
+#define REG_K0		(26)
+#define REG_K1		(27)
+
+#define OP_SPECIAL	(0x00)
+#define OP_REGIMM	(0x01)
+#define OP_J		(0x02)
+#define OP_BEQ		(0x04)
+#define OP_BNE		(0x05)
+#define OP_BLEZ		(0x06)
+#define OP_BGTZ		(0x07)
+#define OP_ADDIU	(0x09)
+#define OP_SLTI		(0x0A)
+#define OP_SLTIU	(0x0B)
+#define OP_ANDI		(0x0C)
+#define OP_ORI		(0x0D)
+#define OP_LUI		(0x0F)
+#define OP_LB		(0x20)
+#define OP_LW		(0x23)
+#define OP_LBU		(0x24)
+#define OP_SB		(0x28)
+#define OP_SW		(0x2B)
+
+#define FN_SLL		(0x00)
+#define FN_SRL		(0x02)
+#define FN_SRA		(0x03)
+#define FN_MFHI		(0x10)
+#define FN_MFLO		(0x12)
+#define FN_DIV		(0x1A)
+#define FN_DIVU		(0x1B)
+#define FN_ADDU		(0x21)
+#define FN_SUBU		(0x23)
+#define FN_AND		(0x24)
+#define FN_OR		(0x25)
+#define FN_SLT		(0x2A)
+#define FN_SLTU		(0x2B)
+
+// clang-format on
+
+static u32 prog_pc(const struct prog *const prog)
+{
+	return PROG_BASE + (prog->len * 4);
+}
+
+static void emit(struct prog *const prog, const u32 instr)
+{
+	u8 *const dst = &prog->image[prog->len++ * 4];
+
+	dst[0] = (u8)instr;
+	dst[1] = (u8)(instr >> 8);
+	dst[2] = (u8)(instr >> 16);
+	dst[3] = (u8)(instr >> 24);
+}
+
+static void emit_r(struct prog *const prog, const uint fn, const uint rd,
+		   const uint rs, const uint rt, const uint shamt)
+{
+	emit(prog, (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | fn);
+}
+
+static void emit_i(struct prog *const prog, const uint op, const uint rt,
+		   const uint rs, const u32 imm)
+{
+	emit(prog, (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xFFFF));
+}
+
+/// @brief Emits a branch to @p target, which is relative to the branch.
+static void emit_b(struct prog *const prog, const uint op, const uint rs,
+		   const uint rt, const u32 target)
+{
+	emit_i(prog, op, rt, rs, (target - prog_pc(prog) - 4) >> 2);
+}
+
+static void emit_li(struct prog *const prog, const uint rt, const u32 val)
+{
+	emit_i(prog, OP_LUI, rt, REG_ZERO, val >> 16);
+	emit_i(prog, OP_ORI, rt, rt, val);
+}
+
+/// @brief Emits a jump to itself, which ends the program.
+static u32 emit_end(struct prog *const prog)
+{
+	const u32 end = prog_pc(prog);
+
+	emit(prog, (OP_J << 26) | ((end >> 2) & 0x3FFFFFF));
+	emit(prog, 0);
+
+	return end;
+}
+
+static u32 rnd(struct prog *const prog)
+{
+	prog->rnd ^= prog->rnd << 13;
+	prog->rnd ^= prog->rnd >> 17;
+	prog->rnd ^= prog->rnd << 5;
+
+	return prog->rnd;
+}
+
+static uint rnd_below(struct prog *const prog, const uint num)
+{
+	return rnd(prog) % num;
+}
+
+/// @brief Returns a random register which the random programs may clobber.
+static uint rnd_reg(struct prog *const prog)
+{
+	static const u8 regs[] = { 2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12,
+				   13, 14, 15, 16, 17, 18, 19, 20, 21, 22 };
+
+	return regs[rnd_below(prog, sizeof(regs))];
+}
+
+u32 prog_loop_assemble(struct prog *const prog, const u32 iters)
+{
+	emit_li(prog, REG_S0, 0x12345678);
+	emit_li(prog, REG_K0, iters);
+	emit_li(prog, REG_S2, 0x001FFFFC);
+	emit_li(prog, REG_S3, 0x80000000);
+
+	const u32 loop = prog_pc(prog);
+
+	emit_r(prog, FN_SLL, REG_T0, REG_ZERO, REG_S0, 13);
+	emit_r(prog, FN_ADDU, REG_S0, REG_S0, REG_T0, 0);
+	emit_r(prog, FN_SRL, REG_T0, REG_ZERO, REG_S0, 17);
+	emit_r(prog, FN_ADDU, REG_S0, REG_S0, REG_T0, 0);
+	emit_r(prog, FN_SLL, REG_T0, REG_ZERO, REG_S0, 5);
+	emit_r(prog, FN_ADDU, REG_S0, REG_S0, REG_T0, 0);
+	emit_r(prog, FN_AND, REG_T1, REG_S0, REG_S2, 0);
+	emit_r(prog, FN_OR, REG_T1, REG_T1, REG_S3, 0);
+	emit_i(prog, OP_LW, REG_T3, REG_T1, 0);
+	emit_r(prog, FN_ADDU, REG_T2, REG_T2, REG_T3, 0);
+	emit_i(prog, OP_SW, REG_T2, REG_T1, 0);
+	emit_i(prog, OP_ADDIU, REG_K0, REG_K0, (u32)-1);
+	emit_b(prog, OP_BNE, REG_K0, REG_ZERO, loop);
+	emit(prog, 0);
+
+	return emit_end(prog);
+}
+
+/// @brief Emits a load or store of a random register, at a random offset into
+/// the 256 bytes of RAM at $s7.
+static void mem_emit(struct prog *const prog, const uint op)
+{
+	u32 off = rnd_below(prog, 256);
+
+	if ((op == OP_LW) || (op == OP_SW)) {
+		off &= ~3U;
+	}
+	emit_i(prog, op, rnd_reg(prog), REG_S7, off);
+}
+
+/// @brief Emits a group of instructions of one random kind into a random
+/// program.
+static void rand_group_emit(struct prog *const prog)
+{
+	static const u8 alu_fns[] = { FN_ADDU, FN_SUBU, FN_AND,
+				      FN_OR,   FN_SLT,	FN_SLTU };
+	static const u8 shift_fns[] = { FN_SLL, FN_SRL, FN_SRA };
+	static const u8 imm_ops[] = { OP_ADDIU, OP_SLTI, OP_SLTIU, OP_ANDI,
+				      OP_ORI };
+	static const u8 load_ops[] = { OP_LW, OP_LB, OP_LBU };
+	static const u8 store_ops[] = { OP_SW, OP_SB };
+	static const u8 branch_ops[] = { OP_BEQ, OP_BNE, OP_BLEZ, OP_BGTZ,
+					 OP_REGIMM };
+
+	switch (rnd_below(prog, prog->io ? 13 : 12)) {
+	case 0:
+	case 1:
+	case 2:
+	case 3:
+		emit_r(prog, alu_fns[rnd_below(prog, sizeof(alu_fns))],
+		       rnd_reg(prog), rnd_reg(prog), rnd_reg(prog), 0);
+		break;
+
+	case 4:
+		emit_r(prog, shift_fns[rnd_below(prog, sizeof(shift_fns))],
+		       rnd_reg(prog), REG_ZERO, rnd_reg(prog),
+		       rnd_below(prog, 32));
+		break;
+
+	case 5:
+		emit_i(prog, imm_ops[rnd_below(prog, sizeof(imm_ops))],
+		       rnd_reg(prog), rnd_reg(prog), rnd(prog));
+		break;
+
+	case 6:
+		emit_i(prog, OP_LUI, rnd_reg(prog), REG_ZERO, rnd(prog));
+		break;
+
+	case 7:
+		mem_emit(prog, load_ops[rnd_below(prog, sizeof(load_ops))]);
+		break;
+
+	case 8:
+		mem_emit(prog, store_ops[rnd_below(prog, sizeof(store_ops))]);
+		break;
+
+	// A forward branch over up to three instructions, which is taken or
+	// not depending on the data.
+	case 9: {
+		const uint op = branch_ops[rnd_below(prog, sizeof(branch_ops))];
+		const uint skip = rnd_below(prog, 4);
+		const uint rs = rnd_reg(prog);
+		uint rt = rnd_reg(prog);
+
+		if ((op == OP_BLEZ) || (op == OP_BGTZ)) {
+			rt = REG_ZERO;
+		} else if (op == OP_REGIMM) {
+			// BLTZ or BGEZ.
+			rt = rnd(prog) & 1;
+		}
+
+		emit_i(prog, op, rt, rs, 1 + skip);
+		emit_r(prog, FN_ADDU, rnd_reg(prog), rnd_reg(prog),
+		       rnd_reg(prog), 0);
+
+		for (uint i = 0; i < skip; ++i) {
+			emit_i(prog, OP_ADDIU, rnd_reg(prog), rnd_reg(prog),
+			       rnd(prog));
+		}
+		break;
+	}
+
+	// The divisor is made odd so that it is never zero.
+	case 10:
+		emit_i(prog, OP_ORI, REG_AT, rnd_reg(prog), 1);
+		emit_r(prog, (rnd(prog) & 1) ? FN_DIV : FN_DIVU, 0,
+		       rnd_reg(prog), REG_AT, 0);
+		emit_r(prog, FN_MFHI, rnd_reg(prog), 0, 0, 0);
+		emit_r(prog, FN_MFLO, rnd_reg(prog), 0, 0, 0);
+		break;
+
+	case 11:
+		emit_r(prog, FN_MFLO, rnd_reg(prog), 0, 0, 0);
+		emit_r(prog, FN_MFHI, rnd_reg(prog), 0, 0, 0);
+		break;
+
+	// Only drawn when prog->io is set.
+	default:
+		emit_i(prog, OP_LW, rnd_reg(prog), REG_K1, PROG_RCNT0_VALUE);
+		break;
+	}
+}
+
+u32 prog_rand_assemble(struct prog *const prog, const u32 seed,
+		       const u32 iters)
+{
+	prog->rnd = seed * 0x9E3779B9;
+
+	for (uint i = 0; i < 32; ++i) {
+		rnd(prog);
+	}
+
+	emit_li(prog, REG_S7, 0x80000000 | PROG_RAND_DATA);
+
+	if (prog->io) {
+		emit_li(prog, REG_K1, 0xBF800000);
+	}
+
+	for (uint reg = 2; reg <= 22; ++reg) {
+		emit_li(prog, reg, rnd(prog));
+	}
+
+	emit_li(prog, REG_K0, iters);
+
+	const u32 loop = prog_pc(prog);
+
+	for (uint i = 0; i < PROG_RAND_GROUPS; ++i) {
+		rand_group_emit(prog);
+	}
+
+	emit_i(prog, OP_ADDIU, REG_K0, REG_K0, (u32)-1);
+	emit_b(prog, OP_BNE, REG_K0, REG_ZERO, loop);
+	emit(prog, 0);
+
+	return emit_end(prog);
+}
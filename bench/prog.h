@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file prog.h Assembles the synthetic programs which the benchmark runs, and
+/// which the tests compare across CPU modes.
+///
+/// The programs are assembled into a BIOS image, so that they run straight
+/// from reset with nothing else involved. They end with a jump to itself, at
+/// the address the assemblers return.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "psycho/types.h"
+
+// clang-format off
+
+/// @brief The reset vector, in kseg1, which is where the programs start.
+#define PROG_BASE	(UINT32_C(0xBFC00000))
+
+/// @brief The physical address of the 256 bytes of RAM which the random
+/// programs load from and store to.
+#define PROG_RAND_DATA	(UINT32_C(0x00100000))
+
+// clang-format on
+
+/// @brief A program being assembled into a BIOS image.
+struct prog {
+	u8 *image;
+
+	/// @brief The number of instructions assembled so far.
+	u32 len;
+
+	/// @brief The state of the random number generator.
+	u32 rnd;
+
+	/// @brief Whether the random programs also read the value of root
+	/// counter 0, which shows whether every CPU mode lets devices see the
+	/// same cycle.
+	bool io;
+
+	u8 pad[7];
+};
+
+/// @brief Assembles a loop which scrambles a value with shifts, and uses it to
+/// pick a word of RAM to add to a sum and overwrite.
+///
+/// @returns The address of the instruction which ends the program.
+u32 prog_loop_assemble(struct prog *prog, u32 iters);
+
+/// @brief Assembles a random program of arithmetic, memory accesses, divisions
+/// and forward branches, repeated in an outer loop. Only instructions which the
+/// CPU implements are used, since the others do nothing but raise a reserved
+/// instruction exception.
+///
+/// @returns The address of the instruction which ends the program.
+u32 prog_rand_assemble(struct prog *prog, u32 seed, u32 iters);
@@ -34,8 +34,6 @@
 #define WHT "\e[1;37m"
 #define RESET "\x1B[0m"
 
-static u8 exe[PSYCHO_PS_X_SIZE_MAX];
-
 static void gpr_regs_output(const struct psycho_ctx *const ctx)
 {
 	for (uint reg = 0; reg < PSYCHO_CPU_GPR_REGS_NUM; ++reg) {
@@ -92,30 +90,19 @@ static void ctx_config(struct psycho_ctx *const ctx)
 	ctx->cpu.exc_halt = (1 << PSYCHO_CPU_EXC_CODE_RI);
 }
 
-static void bios_file_open(struct psycho_ctx *const ctx, const char *const file)
+static void bios_file_open(struct psycho_bios *const bios,
+			   const char *const file)
 {
-	FILE *fd = fopen(file, "rb");
-
-	if (!fd) {
-		fprintf(stderr, "Error opening BIOS file %s: %s\n", file,
-			strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-
-	const size_t bytes_read =
-		fread(ctx->bus.bios, 1, PSYCHO_BUS_BIOS_SIZE, fd);
-
-	if ((ferror(fd)) || bytes_read != PSYCHO_BUS_BIOS_SIZE) {
+	if (!psycho_bios_open(bios, file)) {
 		fprintf(stderr, "Error reading BIOS file %s: %s\n", file,
 			strerror(errno));
-
-		fclose(fd);
 		exit(EXIT_FAILURE);
 	}
-	fclose(fd);
 }
 
-static void exe_file_open(struct psycho_ctx *const ctx, const char *const file)
+/// @brief Loads a PS-X EXE for injection. The returned buffer is referenced
+/// by the context, so it must outlive the run.
+static u8 *exe_file_open(struct psycho_ctx *const ctx, const char *const file)
 {
 	FILE *fd = fopen(file, "rb");
 
@@ -129,6 +116,16 @@ static void exe_file_open(struct psycho_ctx *const ctx, const char *const file)
 	stat(file, &st);
 	const off_t exe_size = st.st_size;
 
+	u8 *const exe = malloc((ulong)exe_size);
+
+	if (!exe) {
+		fprintf(stderr, "Unable to allocate memory for EXE file %s\n",
+			file);
+
+		fclose(fd);
+		exit(EXIT_FAILURE);
+	}
+
 	const size_t bytes_read = fread(exe, 1, (ulong)exe_size, fd);
 
 	if ((ferror(fd)) || bytes_read != (size_t)exe_size) {
@@ -144,15 +141,11 @@ static void exe_file_open(struct psycho_ctx *const ctx, const char *const file)
 		fprintf(stderr, "The PS-X EXE specified is not valid.\n");
 		exit(EXIT_FAILURE);
 	}
+	return exe;
 }
 
 int main(int argc, char **argv)
 {
-	static u8 ram[PSYCHO_BUS_RAM_SIZE];
-	memset(ram, 0, sizeof(ram));
-
-	memset(exe, 0, sizeof(exe));
-
 	if (argc < 3) {
 		fprintf(stderr, "%s: Missing required argument.\n", argv[0]);
 		fprintf(stderr, "Syntax: %s [bios_file] [exe_file]\n", argv[0]);
@@ -160,18 +153,35 @@ int main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
-	struct psycho_ctx ctx = psycho_ctx_create(ram);
+	struct psycho_bios bios;
+	bios_file_open(&bios, argv[1]);
 
-	ctx_config(&ctx);
-	bios_file_open(&ctx, argv[1]);
-	exe_file_open(&ctx, argv[2]);
+	struct psycho_ctx *const ctx =
+		psycho_ctx_new(&bios, NULL, PSYCHO_CPU_MODE_INTERP);
 
-	for (;;) {
-		//psycho_dbg_disasm_instr(&ctx, ctx.cpu.instr, ctx.cpu.pc);
-		psycho_ctx_step(&ctx);
-		//psycho_dbg_disasm_trace(&ctx);
+	if (!ctx) {
+		fprintf(stderr, "%s: Unable to allocate the context.\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
 
-		//printf("0x%08X\t 0x%08X\t %s\n", ctx.disasm.pc,
-		//       ctx.disasm.instr, ctx.disasm.result);
+	ctx_config(ctx);
+	u8 *const exe = exe_file_open(ctx, argv[2]);
+
+	// To trace every instruction, call psycho_ctx_step() in a loop instead:
+	//
+	//psycho_dbg_disasm_instr(ctx, ctx->cpu.instr, ctx->cpu.pc);
+	//psycho_ctx_step(ctx);
+	//psycho_dbg_disasm_trace(ctx);
+	//
+	//printf("0x%08X\t 0x%08X\t %s\n", ctx->disasm.pc,
+	//       ctx->disasm.instr, ctx->disasm.result);
+	while (psycho_ctx_run(ctx, UINT64_MAX) == PSYCHO_CTX_STOP_BUDGET) {
 	}
+
+	psycho_ctx_free(ctx);
+	psycho_bios_close(&bios);
+	free(exe);
+
+	return EXIT_FAILURE;
 }
@@ -0,0 +1,752 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file main.c Runs many PS-X EXEs at once, each in its own context on a pool
+/// of worker threads, and summarizes how each of them ended.
+///
+/// The BIOS is booted once up front, and every job starts from the state it
+/// leaves behind, so a job costs little more than the EXE itself. Nothing is
+/// shared between workers but that boot state and the BIOS image, both of
+/// which are read-only once the workers start; every context maps the same
+/// copy of the BIOS.
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "psycho/ctx.h"
+#include "psycho/ps_x_exe.h"
+
+// clang-format off
+
+/// @brief The number of instructions a job runs between checks of whether it
+/// has finished.
+#define FARM_SLICE		(UINT64_C(1) << 20)
+
+/// @brief The number of instructions a job may run unless -n says otherwise.
+#define FARM_LIMIT_DEFAULT	(UINT64_C(1000000000))
+
+/// @brief The number of instructions the BIOS may take to boot.
+#define FARM_BOOT_BUDGET	(UINT64_C(500000000))
+
+/// @brief The most TTY output kept per job (in bytes).
+#define FARM_TTY_MAX		(1 << 20)
+
+#define FARM_ERR_MAX		(256)
+
+/// @brief The job parked itself in a loop which branches to itself, which is
+/// how test programs signal that they are done.
+#define JOB_DONE		(0)
+
+/// @brief The job raised an exception in psycho_cpu::exc_halt.
+#define JOB_HALT		(1)
+
+/// @brief The job ran out of instructions.
+#define JOB_LIMIT		(2)
+
+/// @brief The emulator reported an error while running the job, or the job
+/// ended differently when it was run again.
+#define JOB_ERR			(3)
+
+/// @brief The job could not be started.
+#define JOB_BAD			(4)
+
+#define JOB_STATUS_NUM		(5)
+
+// clang-format on
+
+static const char *const job_status_names[JOB_STATUS_NUM] = {
+	[JOB_DONE] = "done",   [JOB_HALT] = "halt", [JOB_LIMIT] = "limit",
+	[JOB_ERR] = "error",   [JOB_BAD] = "bad"
+};
+
+struct job {
+	char *path;
+
+	u64 instrs;
+	double secs;
+
+	/// @brief The part of instrs skipped in idle loops.
+	u64 idle;
+
+	/// @brief One of JOB_*.
+	uint status;
+
+	/// @brief The program counter when the job ended.
+	u32 pc;
+
+	/// @brief Everything the job wrote to standard output.
+	char *tty;
+	size_t tty_len;
+	size_t tty_cap;
+
+	/// @brief The first error reported for the job, if any.
+	char err[FARM_ERR_MAX];
+};
+
+struct farm {
+	/// @brief The BIOS image, which every context maps.
+	struct psycho_bios bios;
+
+	/// @brief The state every job starts from, or NULL if each job boots
+	/// the BIOS itself.
+	struct psycho_ctx_boot *boot;
+
+	u64 limit;
+	uint mode;
+	bool fastmem;
+	bool idle;
+
+	/// @brief Whether every job is run twice, to check that nothing left
+	/// behind by one job changes how the next one runs.
+	bool check;
+	u8 pad;
+
+	struct job *jobs;
+	size_t jobs_num;
+
+	/// @brief The index of the next job to hand out.
+	atomic_size_t next;
+};
+
+struct worker {
+	struct farm *farm;
+	struct psycho_ctx *ctx;
+
+	/// @brief The job being run, or NULL between jobs.
+	struct job *job;
+
+	pthread_t thread;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (double)ts.tv_sec + ((double)ts.tv_nsec / (double)1000000000);
+}
+
+static void ctx_log_msg(void *const udata, const uint level, char *const str)
+{
+	const struct worker *const w = udata;
+
+	if (level != PSYCHO_DBG_LOG_LEVEL_ERR) {
+		return;
+	}
+
+	if (w->job && !w->job->err[0]) {
+		snprintf(w->job->err, sizeof(w->job->err), "%s", str);
+	}
+}
+
+static void tty_put(void *const udata, const char c)
+{
+	struct job *const job = udata;
+
+	if (job->tty_len == job->tty_cap) {
+		if (job->tty_cap == FARM_TTY_MAX) {
+			return;
+		}
+
+		const size_t cap = job->tty_cap ? (job->tty_cap * 2) : 256;
+		char *const tty = realloc(job->tty, cap);
+
+		if (!tty) {
+			return;
+		}
+		job->tty = tty;
+		job->tty_cap = cap;
+	}
+	job->tty[job->tty_len++] = c;
+}
+
+/// @brief Reads a whole file.
+///
+/// @returns The contents, which the caller frees, or NULL on failure.
+static u8 *file_read(const char *const path, size_t *const len,
+		     char *const err, const size_t err_size)
+{
+	FILE *const fd = fopen(path, "rb");
+
+	if (!fd) {
+		snprintf(err, err_size, "Error opening %s: %s", path,
+			 strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+
+	if ((fstat(fileno(fd), &st) != 0) || (st.st_size <= 0)) {
+		snprintf(err, err_size, "Error reading %s", path);
+		fclose(fd);
+		return NULL;
+	}
+
+	*len = (size_t)st.st_size;
+	u8 *const data = malloc(*len);
+
+	if (!data || (fread(data, 1, *len, fd) != *len)) {
+		snprintf(err, err_size, "Error reading %s", path);
+		free(data);
+		fclose(fd);
+		return NULL;
+	}
+	fclose(fd);
+
+	return data;
+}
+
+/// @brief Returns whether the instruction at a virtual address branches to
+/// itself: "b ." or "j .".
+static bool branch_self(const struct psycho_ctx *const ctx, const u32 vaddr)
+{
+	const u32 paddr = vaddr & 0x1FFFFFFF;
+	u32 instr;
+
+	if (paddr < PSYCHO_BUS_RAM_MIRRORS_SIZE) {
+		memcpy(&instr, &ctx->bus.ram[paddr & (PSYCHO_BUS_RAM_SIZE - 1)],
+		       sizeof(instr));
+	} else if ((paddr >= PSYCHO_BUS_BIOS_BEG) &&
+		   (paddr <= PSYCHO_BUS_BIOS_END)) {
+		const u8 *const bios = ctx->bus.bios->data;
+
+		memcpy(&instr, &bios[paddr - PSYCHO_BUS_BIOS_BEG],
+		       sizeof(instr));
+	} else {
+		return false;
+	}
+
+	const uint op = instr >> 26;
+	const uint rs = (instr >> 21) & 0x1F;
+	const uint rt = (instr >> 16) & 0x1F;
+
+	// beq rs, rs, -1
+	if ((op == 0x04) && (rs == rt) && ((instr & 0xFFFF) == 0xFFFF)) {
+		return true;
+	}
+
+	// j vaddr
+	return (op == 0x02) &&
+	       (((instr & 0x03FFFFFF) << 2) == (vaddr & 0x0FFFFFFF));
+}
+
+/// @brief Returns whether the job is parked in a loop branching to itself. It
+/// may have been stopped in the loop's delay slot.
+static bool job_parked(const struct psycho_ctx *const ctx)
+{
+	return branch_self(ctx, ctx->cpu.pc) ||
+	       branch_self(ctx, ctx->cpu.pc - 4);
+}
+
+static void job_run(struct worker *const w, struct job *const job)
+{
+	const struct farm *const farm = w->farm;
+	struct psycho_ctx *const ctx = w->ctx;
+
+	job->err[0] = '\0';
+
+	size_t len;
+	u8 *const exe = file_read(job->path, &len, job->err, sizeof(job->err));
+
+	if (!exe) {
+		return;
+	}
+
+	bool valid;
+
+	if (farm->boot) {
+		valid = psycho_ctx_ps_x_exe_boot_run(ctx, farm->boot, exe, len);
+	} else {
+		valid = psycho_ctx_ps_x_exe_run(ctx, exe, len);
+	}
+
+	if (!valid) {
+		snprintf(job->err, sizeof(job->err), "Not a valid PS-X EXE");
+		free(exe);
+		return;
+	}
+
+	ctx->hle.udata = job;
+	w->job = job;
+
+	job->status = JOB_LIMIT;
+
+	const double beg = now();
+	const u64 idle_beg = ctx->cpu.idle.cycles;
+
+	while (job->instrs < farm->limit) {
+		const u64 left = farm->limit - job->instrs;
+		const u64 slice = (left < FARM_SLICE) ? left : FARM_SLICE;
+		const uint stop = psycho_ctx_run(ctx, slice);
+
+		job->instrs += slice - (u64)ctx->cpu.run_left;
+
+		if (stop == PSYCHO_CTX_STOP_EXC) {
+			job->status = JOB_HALT;
+			break;
+		}
+
+		if (job->err[0]) {
+			job->status = JOB_ERR;
+			break;
+		}
+
+		if (job_parked(ctx)) {
+			job->status = JOB_DONE;
+			break;
+		}
+	}
+
+	job->secs = now() - beg;
+	job->idle = ctx->cpu.idle.cycles - idle_beg;
+	job->pc = ctx->cpu.pc;
+
+	w->job = NULL;
+	ctx->hle.udata = NULL;
+	ctx->ps_x_exe = NULL;
+
+	free(exe);
+}
+
+/// @brief Runs a job again in the same context, and marks it as an error if it
+/// did not end the same way as the first time. Jobs have to start from the
+/// same state whichever job the context ran before.
+static void job_check(struct worker *const w, struct job *const job)
+{
+	struct job again;
+	memset(&again, 0, sizeof(again));
+
+	again.path = job->path;
+	again.status = JOB_BAD;
+
+	job_run(w, &again);
+
+	const bool same = (again.status == job->status) &&
+			  (again.instrs == job->instrs) &&
+			  (again.pc == job->pc) &&
+			  (again.tty_len == job->tty_len) &&
+			  (!job->tty_len ||
+			   !memcmp(again.tty, job->tty, job->tty_len)) &&
+			  !strcmp(again.err, job->err);
+
+	free(again.tty);
+
+	if (!same) {
+		job->status = JOB_ERR;
+		snprintf(job->err, sizeof(job->err),
+			 "Ended differently when run again");
+	}
+}
+
+static void *worker_main(void *const arg)
+{
+	struct worker *const w = arg;
+	struct farm *const farm = w->farm;
+	struct psycho_ctx *const ctx =
+		psycho_ctx_new(&farm->bios, NULL, farm->mode);
+
+	if (!ctx) {
+		return NULL;
+	}
+
+	if (farm->fastmem && !psycho_ctx_fastmem_enable(ctx)) {
+		fprintf(stderr, "Fastmem is unavailable; using the page "
+				"tables.\n");
+	}
+
+	ctx->log.level = PSYCHO_DBG_LOG_LEVEL_ERR;
+	ctx->log.udata = w;
+	ctx->log.cb = &ctx_log_msg;
+	ctx->cpu.exc_halt = (1 << PSYCHO_CPU_EXC_CODE_RI);
+	ctx->hle.flags = PSYCHO_HLE_LIB;
+	ctx->hle.tty_cb = &tty_put;
+	ctx->cpu.idle.enabled = farm->idle;
+
+	// Every worker has a context of its own, so the CPUs are busy enough.
+	ctx->gpu.bands = 1;
+
+	w->ctx = ctx;
+
+	for (;;) {
+		const size_t i = atomic_fetch_add(&farm->next, 1);
+
+		if (i >= farm->jobs_num) {
+			break;
+		}
+		job_run(w, &farm->jobs[i]);
+
+		if (farm->check) {
+			job_check(w, &farm->jobs[i]);
+		}
+	}
+
+	psycho_ctx_free(ctx);
+	return NULL;
+}
+
+/// @brief Boots the BIOS once, so that jobs can start from where it injects
+/// PS-X EXEs.
+///
+/// @returns The boot state, or NULL if it could not be taken.
+static struct psycho_ctx_boot *boot_take(const struct farm *const farm)
+{
+	struct psycho_ctx *const ctx =
+		psycho_ctx_new(&farm->bios, NULL, farm->mode);
+	struct psycho_ctx_boot *boot = malloc(sizeof(*boot));
+
+	if (ctx && boot) {
+		ctx->cpu.exc_halt = (1 << PSYCHO_CPU_EXC_CODE_RI);
+
+		if (!psycho_ctx_boot_take(ctx, boot, FARM_BOOT_BUDGET)) {
+			free(boot);
+			boot = NULL;
+		}
+	} else {
+		free(boot);
+		boot = NULL;
+	}
+
+	psycho_ctx_free(ctx);
+	return boot;
+}
+
+static bool job_add(struct farm *const farm, const char *const path)
+{
+	struct job *const jobs =
+		realloc(farm->jobs, (farm->jobs_num + 1) * sizeof(*jobs));
+
+	if (!jobs) {
+		return false;
+	}
+	farm->jobs = jobs;
+
+	struct job *const job = &jobs[farm->jobs_num];
+	memset(job, 0, sizeof(*job));
+
+	job->path = strdup(path);
+	job->status = JOB_BAD;
+	snprintf(job->err, sizeof(job->err), "Not run");
+
+	if (!job->path) {
+		return false;
+	}
+
+	farm->jobs_num++;
+	return true;
+}
+
+static int name_cmp(const void *const a, const void *const b)
+{
+	return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/// @brief Adds every file ending in ".exe" in a directory, in name order.
+static bool dir_add(struct farm *const farm, const char *const dir)
+{
+	DIR *const d = opendir(dir);
+
+	if (!d) {
+		fprintf(stderr, "Error opening directory %s: %s\n", dir,
+			strerror(errno));
+		return false;
+	}
+
+	char **names = NULL;
+	size_t names_num = 0;
+	bool ok = true;
+
+	for (const struct dirent *ent; ok && (ent = readdir(d));) {
+		const size_t len = strlen(ent->d_name);
+
+		if ((len < 4) ||
+		    (strcasecmp(&ent->d_name[len - 4], ".exe") != 0)) {
+			continue;
+		}
+
+		char **const grown =
+			realloc(names, (names_num + 1) * sizeof(*names));
+
+		if (!grown) {
+			ok = false;
+			break;
+		}
+		names = grown;
+
+		const size_t size = strlen(dir) + 1 + len + 1;
+		names[names_num] = malloc(size);
+
+		if (!names[names_num]) {
+			ok = false;
+			break;
+		}
+
+		snprintf(names[names_num], size, "%s/%s", dir, ent->d_name);
+		names_num++;
+	}
+	closedir(d);
+
+	qsort(names, names_num, sizeof(*names), &name_cmp);
+
+	for (size_t i = 0; i < names_num; ++i) {
+		ok = ok && job_add(farm, names[i]);
+		free(names[i]);
+	}
+	free(names);
+
+	return ok;
+}
+
+static double mips_get(const u64 instrs, const double secs)
+{
+	return (secs > 0) ? ((double)instrs / secs / (double)1000000) : 0;
+}
+
+static void summary_output(const struct farm *const farm, const double secs,
+			   const bool tty)
+{
+	uint counts[JOB_STATUS_NUM] = { 0 };
+	u64 instrs = 0;
+	u64 idle = 0;
+
+	for (size_t i = 0; tty && (i < farm->jobs_num); ++i) {
+		const struct job *const job = &farm->jobs[i];
+
+		printf("=============== %s ===============\n", job->path);
+		fwrite(job->tty, 1, job->tty_len, stdout);
+
+		if (job->tty_len && (job->tty[job->tty_len - 1] != '\n')) {
+			putchar('\n');
+		}
+	}
+
+	printf("%-6s %14s %9s %9s %10s  %s\n", "STATUS", "INSTRUCTIONS",
+	       "SECONDS", "MIPS", "PC", "EXE");
+
+	for (size_t i = 0; i < farm->jobs_num; ++i) {
+		const struct job *const job = &farm->jobs[i];
+		counts[job->status]++;
+		instrs += job->instrs;
+		idle += job->idle;
+
+		printf("%-6s %14llu %9.3f %9.1f 0x%08X  %s\n",
+		       job_status_names[job->status],
+		       (unsigned long long)job->instrs, job->secs,
+		       mips_get(job->instrs, job->secs),
+		       job->pc, job->path);
+
+		if (job->err[0]) {
+			printf("       %s\n", job->err);
+		}
+	}
+
+	printf("\n%zu jobs: %u done, %u halted, %u hit the limit, %u errors, "
+	       "%u bad\n",
+	       farm->jobs_num, counts[JOB_DONE], counts[JOB_HALT],
+	       counts[JOB_LIMIT], counts[JOB_ERR], counts[JOB_BAD]);
+
+	printf("%.3f seconds, %.1f MIPS in total\n", secs,
+	       mips_get(instrs, secs));
+
+	if (farm->idle) {
+		printf("%llu instructions skipped in idle loops\n",
+		       (unsigned long long)idle);
+	}
+}
+
+static void usage_output(const char *const argv0)
+{
+	fprintf(stderr,
+		"Syntax: %s [-j threads] [-n limit] [-m interp|cached|jit] "
+		"[-f] [-i] [-s] [-t] [-c] [bios_file] [exe_file|dir]...\n"
+		"  -j  the number of worker threads (default: one per core)\n"
+		"  -n  the number of instructions each EXE may run\n"
+		"  -m  the CPU mode (default: jit)\n"
+		"  -f  enable fastmem\n"
+		"  -i  skip idle loops (cached and jit only)\n"
+		"  -s  boot the BIOS for each EXE, rather than once\n"
+		"  -t  print the TTY output of each EXE\n"
+		"  -c  run each EXE twice and check that both runs match\n",
+		argv0);
+}
+
+int main(int argc, char **argv)
+{
+	struct farm farm;
+	memset(&farm, 0, sizeof(farm));
+
+	farm.limit = FARM_LIMIT_DEFAULT;
+	farm.mode = PSYCHO_CPU_MODE_JIT;
+	atomic_init(&farm.next, 0);
+
+	long threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+	bool boot_once = true;
+	bool tty = false;
+
+	for (int opt; (opt = getopt(argc, argv, "j:n:m:fistc")) != -1;) {
+		switch (opt) {
+		case 'j':
+			threads_num = strtol(optarg, NULL, 0);
+			break;
+
+		case 'n':
+			farm.limit = strtoull(optarg, NULL, 0);
+			break;
+
+		case 'm':
+			if (!strcmp(optarg, "interp")) {
+				farm.mode = PSYCHO_CPU_MODE_INTERP;
+			} else if (!strcmp(optarg, "cached")) {
+				farm.mode = PSYCHO_CPU_MODE_CACHED;
+			} else if (!strcmp(optarg, "jit")) {
+				farm.mode = PSYCHO_CPU_MODE_JIT;
+			} else {
+				usage_output(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+
+		case 'f':
+			farm.fastmem = true;
+			break;
+
+		case 'i':
+			farm.idle = true;
+			break;
+
+		case 's':
+			boot_once = false;
+			break;
+
+		case 't':
+			tty = true;
+			break;
+
+		case 'c':
+			farm.check = true;
+			break;
+
+		default:
+			usage_output(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if ((argc - optind) < 2) {
+		fprintf(stderr, "%s: Missing required argument.\n", argv[0]);
+		usage_output(argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	if (!psycho_bios_open(&farm.bios, argv[optind])) {
+		fprintf(stderr, "Error reading BIOS file %s: %s\n",
+			argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	for (int i = optind + 1; i < argc; ++i) {
+		struct stat st;
+
+		const bool ok = ((stat(argv[i], &st) == 0) &&
+				 S_ISDIR(st.st_mode)) ?
+					dir_add(&farm, argv[i]) :
+					job_add(&farm, argv[i]);
+
+		if (!ok) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!farm.jobs_num) {
+		fprintf(stderr, "%s: No PS-X EXEs to run.\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const double beg = now();
+
+	if (boot_once) {
+		farm.boot = boot_take(&farm);
+
+		if (!farm.boot) {
+			fprintf(stderr, "The BIOS could not be booted ahead of "
+					"time; booting it for each EXE.\n");
+		}
+	}
+
+	if (threads_num < 1) {
+		threads_num = 1;
+	}
+
+	if ((size_t)threads_num > farm.jobs_num) {
+		threads_num = (long)farm.jobs_num;
+	}
+
+	struct worker *const workers =
+		calloc((size_t)threads_num, sizeof(*workers));
+
+	if (!workers) {
+		return EXIT_FAILURE;
+	}
+
+	long started = 0;
+
+	for (; started < threads_num; ++started) {
+		workers[started].farm = &farm;
+
+		if (pthread_create(&workers[started].thread, NULL, &worker_main,
+				   &workers[started]) != 0) {
+			break;
+		}
+	}
+
+	for (long i = 0; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	summary_output(&farm, now() - beg, tty);
+
+	bool passed = (started > 0);
+
+	for (size_t i = 0; i < farm.jobs_num; ++i) {
+		passed = passed && (farm.jobs[i].status == JOB_DONE);
+
+		free(farm.jobs[i].path);
+		free(farm.jobs[i].tty);
+	}
+
+	free(workers);
+	free(farm.jobs);
+	free(farm.boot);
+	psycho_bios_close(&farm.bios);
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file bios.h Provides BIOS images, which any number of contexts can share.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/// @brief A BIOS image of PSYCHO_BUS_BIOS_SIZE bytes, mapped read-only.
+struct psycho_bios {
+	const u8 *data;
+
+	/// @brief The file or memfd backing data, or -1 if data is plain
+	/// memory. Fastmem maps this directly rather than copying the image.
+	int fd;
+	u32 pad;
+};
+
+/// @brief Maps a BIOS image from a file.
+///
+/// @returns true if the image was mapped, false if the file could not be read
+/// or is not the size of the BIOS; errno then says why.
+bool psycho_bios_open(struct psycho_bios *bios, const char *path);
+
+/// @brief Creates a BIOS image from memory.
+///
+/// @param data PSYCHO_BUS_BIOS_SIZE bytes to copy, or NULL for an image which
+/// is all zeroes, for running without a BIOS.
+/// @returns true if the image was created, false otherwise.
+bool psycho_bios_create(struct psycho_bios *bios, const u8 *data);
+
+/// @brief Releases a BIOS image. No context may still be using it.
+void psycho_bios_close(struct psycho_bios *bios);
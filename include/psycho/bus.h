@@ -22,21 +22,127 @@
 
 #pragma once
 
+#include <stdbool.h>
+
+#include "bios.h"
 #include "types.h"
 
 // clang-format off
 
 #define PSYCHO_BUS_RAM_BEG	(0x00000000)
-#define PSYCHO_BUS_RAM_END	(0x00200000)
-#define PSYCHO_BUS_RAM_SIZE	((PSYCHO_BUS_RAM_END - PSYCHO_BUS_RAM_BEG) - 1)
+#define PSYCHO_BUS_RAM_END	(0x001FFFFF)
+#define PSYCHO_BUS_RAM_SIZE	((PSYCHO_BUS_RAM_END - PSYCHO_BUS_RAM_BEG) + 1)
+
+/// @brief RAM is mirrored across the first 8 MiB of the physical address space.
+#define PSYCHO_BUS_RAM_MIRRORS_SIZE	(0x00800000)
 
 #define PSYCHO_BUS_BIOS_BEG	(0x1FC00000)
 #define PSYCHO_BUS_BIOS_END	(0x1FC7FFFF)
-#define PSYCHO_BUS_BIOS_SIZE	((PSYCHO_BUS_BIOS_END - PSYCHO_BUS_BIOS_BEG) - 1)
+#define PSYCHO_BUS_BIOS_SIZE	((PSYCHO_BUS_BIOS_END - PSYCHO_BUS_BIOS_BEG) + 1)
+
+/// @brief The size of a page of the physical address space (in bytes),
+/// expressed as a shift.
+#define PSYCHO_BUS_PAGE_SHIFT	(16)
+
+/// @brief The number of pages covering the 512 MiB physical address space.
+#define PSYCHO_BUS_PAGES_NUM	((0x1FFFFFFF >> PSYCHO_BUS_PAGE_SHIFT) + 1)
+
+#define PSYCHO_BUS_SCRATCHPAD_BEG	(0x1F800000)
+#define PSYCHO_BUS_SCRATCHPAD_END	(0x1F8003FF)
+#define PSYCHO_BUS_SCRATCHPAD_SIZE	\
+	((PSYCHO_BUS_SCRATCHPAD_END - PSYCHO_BUS_SCRATCHPAD_BEG) + 1)
+
+/// @brief The first physical address of the I/O register block.
+#define PSYCHO_BUS_IO_BEG	(0x1F801000)
+#define PSYCHO_BUS_IO_END	(0x1F802FFF)
+#define PSYCHO_BUS_IO_SIZE	((PSYCHO_BUS_IO_END - PSYCHO_BUS_IO_BEG) + 1)
+
+/// @brief The number of word-sized registers in the I/O register block.
+#define PSYCHO_BUS_IO_REGS_NUM	(PSYCHO_BUS_IO_SIZE / 4)
+
+/// @brief The size of a page of RAM tracked by psycho_bus::ram_dirty (in
+/// bytes), expressed as a shift. This matches the pages of the code cache.
+#define PSYCHO_BUS_RAM_DIRTY_SHIFT	(12)
+
+/// @brief The number of pages of RAM tracked by psycho_bus::ram_dirty.
+#define PSYCHO_BUS_RAM_DIRTY_NUM	\
+	(PSYCHO_BUS_RAM_SIZE >> PSYCHO_BUS_RAM_DIRTY_SHIFT)
+
+///@{
+/// @brief The width of an access, indexing psycho_bus_io::read and
+/// psycho_bus_io::write.
+#define PSYCHO_BUS_WIDTH_BYTE	(0)
+#define PSYCHO_BUS_WIDTH_HALF	(1)
+#define PSYCHO_BUS_WIDTH_WORD	(2)
+#define PSYCHO_BUS_WIDTH_NUM	(3)
+///@}
 
 // clang-format on
 
+struct psycho_ctx;
+
+/// @brief The handlers for a range of I/O registers. A NULL handler leaves
+/// accesses of that width unhandled.
+struct psycho_bus_io {
+	/// @brief Returns the value at a physical address, in the low bits.
+	u32 (*read[PSYCHO_BUS_WIDTH_NUM])(struct psycho_ctx *ctx, u32 paddr);
+
+	/// @brief Stores a value, given in the low bits, at a physical address.
+	void (*write[PSYCHO_BUS_WIDTH_NUM])(struct psycho_ctx *ctx, u32 paddr,
+					    u32 data);
+
+	/// @brief Whether the registers read differently as time passes or
+	/// as they are read, so that a loop polling them is not idle.
+	bool timed;
+
+	u8 pad[7];
+};
+
 struct psycho_bus {
-	u8 bios[PSYCHO_BUS_BIOS_SIZE];
+	/// @brief The BIOS image, which may be shared with other contexts and
+	/// must outlive this one.
+	const struct psycho_bios *bios;
+
 	u8 *ram;
+
+	/// @brief The 1 KiB data cache used as fast RAM. The CPU reaches it
+	/// through its own fast path, as it is not part of the physical address
+	/// space seen by the page tables.
+	u8 scratchpad[PSYCHO_BUS_SCRATCHPAD_SIZE];
+
+	/// @brief The memfd backing RAM, or -1 if RAM is plain memory. If it is
+	/// valid, RAM is mapped once per mirror into one 8 MiB window starting
+	/// at ram.
+	int ram_fd;
+
+	/// @brief Whether ram was allocated by the context, which releases it.
+	bool ram_owned;
+
+	/// @brief Set by every load from a timed I/O register; see
+	/// psycho_bus_io::timed.
+	bool timed_read;
+
+	u8 pad[2];
+
+	/// @brief One bit per page of RAM, set by every store to the page since
+	/// the bitmap was last cleared.
+	u64 ram_dirty[PSYCHO_BUS_RAM_DIRTY_NUM / 64];
+
+	/// @brief The host memory backing each page for loads, or NULL if
+	/// accesses to the page are handled by the slow path.
+	///
+	/// These are built by psycho_ctx_reset() and point into the context, so
+	/// the context must not be moved afterwards.
+	const u8 *read_pages[PSYCHO_BUS_PAGES_NUM];
+
+	/// @brief Likewise, for stores. Only RAM is mapped here.
+	u8 *write_pages[PSYCHO_BUS_PAGES_NUM];
+
+	/// @brief The handlers of each word of the I/O register block, or NULL
+	/// if nothing is registered there. Registrations survive resets.
+	const struct psycho_bus_io *io[PSYCHO_BUS_IO_REGS_NUM];
+
+	/// @brief The base of the host region the physical address space is
+	/// mapped into, or NULL if fastmem is disabled.
+	u8 *fastmem;
 };
@@ -24,13 +24,70 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "cpu_defs.h"
 #include "types.h"
 
+// clang-format off
+
+/// @brief Every instruction is fetched, decoded and executed one at a time.
+#define PSYCHO_CPU_MODE_INTERP	(0)
+
+/// @brief Basic blocks are decoded once, cached, and replayed on subsequent
+/// visits.
+#define PSYCHO_CPU_MODE_CACHED	(1)
+
+/// @brief Basic blocks are translated into native code and linked together.
+/// This is only available on x86-64 hosts; elsewhere it behaves exactly like
+/// PSYCHO_CPU_MODE_CACHED.
+#define PSYCHO_CPU_MODE_JIT	(2)
+
+/// @brief The size of a block cache page (in bytes), expressed as a shift.
+#define PSYCHO_CPU_CACHE_PAGE_SHIFT	(12)
+
+/// @brief The number of block cache pages; this covers 2 MiB of RAM followed by
+/// 512 KiB of BIOS.
+#define PSYCHO_CPU_CACHE_PAGES_NUM	(640)
+
+// clang-format on
+
+struct psycho_cpu_cache_page;
+
+/// @brief Skipping of idle loops: loops which only poll memory or I/O
+/// registers that nothing but a scheduled event can change, such as the BIOS
+/// waiting for an interrupt. Once one iteration of such a loop shows that it
+/// cannot make progress, the rest of the slice of execution is skipped, so that
+/// the next event fires immediately. Loops are only recognised in cached code,
+/// so PSYCHO_CPU_MODE_INTERP never skips them.
+struct psycho_cpu_idle {
+	/// @brief The number of times an idle loop was skipped.
+	u64 skips;
+
+	/// @brief The number of cycles skipped in total.
+	u64 cycles;
+
+	/// @brief Whether idle loops are skipped. It may be changed between
+	/// calls to psycho_ctx_run().
+	bool enabled;
+
+	/// @brief The value of enabled the links between translated blocks
+	/// were made under.
+	bool jit_enabled;
+
+	u8 pad[6];
+};
+
 struct psycho_cpu {
 	u32 gpr[PSYCHO_CPU_GPR_REGS_NUM];
 	u32 cp0_cpr[PSYCHO_CPU_CP0_CPR_REGS_NUM];
 
+	/// @brief The GTE's data and control registers. Registers narrower
+	/// than 32 bits are kept sign or zero-extended, as they read back.
+	u32 cp2_cpr[PSYCHO_CPU_CP2_CPR_REGS_NUM];
+	u32 cp2_ccr[PSYCHO_CPU_CP2_CCR_REGS_NUM];
+
 	u32 instr;
 	u32 pc;
 	u32 npc;
@@ -38,5 +95,50 @@ struct psycho_cpu {
 	u32 hi;
 	u32 lo;
 
+	/// @brief psycho_ctx_run() stops once the program counter reaches this
+	/// address.
+	u32 bp;
+
+	/// @brief The execution mode; one of PSYCHO_CPU_MODE_*.
+	uint mode;
+
 	u16 exc_halt;
+
+	/// @brief Set when an exception in exc_halt was raised.
+	bool halted;
+
+	/// @brief Set when a store invalidated cached code, an event was
+	/// scheduled within the current slice, or execution was halted, so
+	/// that the block currently executing (if any) stops as soon as
+	/// possible.
+	bool block_exit;
+
+	/// @brief The number of cycles left in the current slice of
+	/// execution, which the execution loops count down; see psycho_sched.
+	s64 run_left;
+
+	struct psycho_cpu_idle idle;
+
+	/// @brief The decoded blocks for each page of executable memory, or
+	/// NULL if no code has been cached from that page yet.
+	struct psycho_cpu_cache_page *cache_pages[PSYCHO_CPU_CACHE_PAGES_NUM];
+
+	/// @brief The executable memory holding translated code.
+	u8 *jit_buf;
+
+	/// @brief The number of bytes of jit_buf in use.
+	size_t jit_buf_used;
+
+	/// @brief The translated block which most recently returned control,
+	/// if it can be linked to the next one.
+	void *jit_last;
+
+	/// @brief Incremented whenever translated code is discarded; links
+	/// made under an older generation are never followed.
+	u32 jit_gen;
+
+	/// @brief The number of instructions the running translated block has
+	/// been charged for in run_left but not executed yet, as of the last
+	/// instruction which calls out of it; see sched_now().
+	u32 jit_ahead;
 };
@@ -31,6 +31,29 @@
 #include "cpu.h"
 #include "dbg_disasm.h"
 #include "dbg_log.h"
+#include "gpu.h"
+#include "hle.h"
+#include "irq.h"
+#include "rcnt.h"
+#include "sched.h"
+
+// clang-format off
+
+/// @brief psycho_ctx_run() executed as many instructions as it was allowed to.
+#define PSYCHO_CTX_STOP_BUDGET	(0)
+
+/// @brief psycho_ctx_run() reached psycho_ctx::stop_pc.
+#define PSYCHO_CTX_STOP_PC	(1)
+
+/// @brief psycho_ctx_run() raised an exception which is in
+/// psycho_cpu::exc_halt.
+#define PSYCHO_CTX_STOP_EXC	(2)
+
+/// @brief psycho_ctx_save() compresses the state. This trades some speed for a
+/// much smaller state, as most of RAM is usually zero or repetitive.
+#define PSYCHO_CTX_STATE_COMPRESS	(1 << 0)
+
+// clang-format on
 
 /// @brief Defines the emulator context.
 struct psycho_ctx {
@@ -38,15 +61,163 @@ struct psycho_ctx {
 	struct psycho_bus bus;
 	struct psycho_cpu cpu;
 	struct psycho_dbg_log log;
+	struct psycho_sched sched;
+	struct psycho_irq irq;
+	struct psycho_rcnt rcnt[PSYCHO_RCNT_NUM];
+	struct psycho_gpu gpu;
+
+	/// @brief Which BIOS calls are serviced natively, and their state. It
+	/// may be changed between calls to psycho_ctx_run().
+	struct psycho_hle hle;
 
 	/// @brief The PS-X EXE which will be injected.
 	const u8 *ps_x_exe;
+
+	/// @brief If stop_pc_enabled is set, psycho_ctx_run() stops before
+	/// executing the instruction at this address.
+	u32 stop_pc;
+	bool stop_pc_enabled;
+	u8 pad[3];
+};
+
+/// @brief The size of a boot state: RAM, the scratchpad and VRAM, with room to
+/// spare for the rest of the machine.
+#define PSYCHO_CTX_BOOT_STATE_SIZE                                             \
+	(PSYCHO_BUS_RAM_SIZE + PSYCHO_BUS_SCRATCHPAD_SIZE +                    \
+	 PSYCHO_GPU_VRAM_SIZE + 0x10000)
+
+/// @brief The state the BIOS leaves behind once the kernel is set up and it
+/// is about to run the shell, which is where PS-X EXEs are injected. It is
+/// taken once with psycho_ctx_boot_take(), and restored for every EXE by
+/// psycho_ctx_ps_x_exe_boot_run() instead of running the boot sequence again.
+struct psycho_ctx_boot {
+	/// @brief The whole machine as saved by psycho_ctx_save(), devices
+	/// included, so that they are left as the BIOS set them up too.
+	u8 state[PSYCHO_CTX_BOOT_STATE_SIZE];
+	size_t size;
 };
 
-struct psycho_ctx psycho_ctx_create(u8 *ram);
+/// @brief Allocates a context.
+///
+/// @param bios The BIOS image, which may be shared by any number of contexts
+/// and must outlive this one.
+/// @param ram The memory to use as RAM, which must outlive the context. If
+/// NULL, the context allocates RAM itself and releases it in psycho_ctx_free().
+/// @param cpu_mode How the CPU executes instructions; one of
+/// PSYCHO_CPU_MODE_*.
+/// @returns The context, or NULL if memory could not be allocated.
+struct psycho_ctx *psycho_ctx_new(const struct psycho_bios *bios, u8 *ram,
+				  uint cpu_mode);
+
+/// @brief Releases a context and any resources it acquired, including RAM it
+/// allocated. The BIOS image is left alone.
+void psycho_ctx_free(struct psycho_ctx *ctx);
+
+/// @brief Maps the physical address space into one host region, so that
+/// loads and stores become single host accesses. Accesses to anything but RAM
+/// and the BIOS fault, and a SIGSEGV handler completes them through the slow
+/// path.
+///
+/// This is only supported on x86-64 Linux. It must be called before
+/// psycho_ctx_reset(). Unless RAM is already backed by a memfd, its contents
+/// are moved into one the context owns, and psycho_bus::ram is updated to
+/// point at them.
+///
+/// @returns true if fastmem is enabled, false otherwise.
+bool psycho_ctx_fastmem_enable(struct psycho_ctx *ctx);
 
 void psycho_ctx_reset(struct psycho_ctx *ctx);
+
+/// @brief Executes instructions until the budget is exhausted, the program
+/// counter reaches psycho_ctx::stop_pc, or an exception which halts execution
+/// is raised. Unless the budget is 0, at least one instruction is executed,
+/// even if the program counter is already at psycho_ctx::stop_pc.
+///
+/// Every instruction takes one cycle, so the budget, psycho_cpu::run_left and
+/// psycho_ctx_cycles() all count instructions. Idle loops which are skipped
+/// count as the instructions they would have executed.
+///
+/// Devices' events due in the meantime fire between slices of execution. On
+/// return, psycho_cpu::run_left holds the unused part of the budget. An
+/// instruction which raises a halting exception counts as executed.
+///
+/// @param budget The maximum number of instructions to execute. If it is 0,
+/// nothing is executed and PSYCHO_CTX_STOP_BUDGET is returned.
+/// @returns Why execution stopped; one of PSYCHO_CTX_STOP_*.
+uint psycho_ctx_run(struct psycho_ctx *ctx, u64 budget);
+
+/// @brief Executes the next instruction.
 void psycho_ctx_step(struct psycho_ctx *ctx);
 
+/// @brief Returns the number of cycles executed since the last reset.
+u64 psycho_ctx_cycles(const struct psycho_ctx *ctx);
+
+/// @brief Waits for the GPU to draw every command sent so far, and returns
+/// VRAM, as rows of PSYCHO_GPU_VRAM_WIDTH pixels. It must not be written to,
+/// and only stays up to date until the context runs again.
+const u16 *psycho_ctx_vram(struct psycho_ctx *ctx);
+
 bool psycho_ctx_ps_x_exe_run(struct psycho_ctx *ctx, const u8 *data,
 			     size_t len);
+
+/// @brief Resets the context and boots the BIOS up to the point where PS-X EXEs
+/// are injected, then records the resulting state in @p boot. The state only
+/// depends on the BIOS, so it can be shared by any number of contexts using
+/// the same one.
+///
+/// @param budget The maximum number of instructions the boot may take.
+/// @returns true if the injection point was reached and the state saved,
+/// false otherwise.
+bool psycho_ctx_boot_take(struct psycho_ctx *ctx, struct psycho_ctx_boot *boot,
+			  u64 budget);
+
+/// @brief Like psycho_ctx_ps_x_exe_run(), but restores @p boot instead of
+/// running the BIOS, so that the EXE is injected immediately and its entry
+/// point is the next instruction executed.
+bool psycho_ctx_ps_x_exe_boot_run(struct psycho_ctx *ctx,
+				  const struct psycho_ctx_boot *boot,
+				  const u8 *data, size_t len);
+
+/// @brief Returns a buffer size which is always enough for psycho_ctx_save().
+size_t psycho_ctx_state_size_max(void);
+
+/// @brief Saves the state of the machine: the CPU, RAM, the scratchpad, the
+/// HLE kernel, the devices, and the cycle counter with the pending events. The
+/// BIOS and the configuration of the context (the CPU mode, breakpoints,
+/// logging and which calls are serviced natively) are not part of it.
+///
+/// @param flags Any of PSYCHO_CTX_STATE_*.
+/// @returns The size of the state, or 0 if it did not fit in the buffer.
+size_t psycho_ctx_save(struct psycho_ctx *ctx, void *buf, size_t size,
+		       uint flags);
+
+/// @brief Restores a state saved by psycho_ctx_save(). Any PS-X EXE waiting to
+/// be injected is dropped.
+///
+/// The state is checked in full, compressed data included, before the context
+/// is touched; if it is rejected, the context is left as it was.
+///
+/// @returns true if the state was restored, false otherwise.
+bool psycho_ctx_load(struct psycho_ctx *ctx, const void *buf, size_t size);
+
+/// @brief Restores a state saved by psycho_ctx_save() like psycho_ctx_load(),
+/// but copies back only the pages of RAM marked dirty, and keeps the code
+/// cached from the others.
+///
+/// This is only correct if RAM has not changed outside of the dirty pages
+/// since it last matched the state, i.e. if the dirty bitmap was cleared when
+/// the state was saved, or was last loaded. Resetting the machine to a fixed
+/// snapshot repeatedly is then much cheaper than a full load. A compressed RAM
+/// section is restored in full.
+///
+/// @returns true if the state was restored, false otherwise.
+bool psycho_ctx_load_dirty(struct psycho_ctx *ctx, const void *buf,
+			   size_t size);
+
+/// @brief Returns whether a page of RAM, of (1 << PSYCHO_BUS_RAM_DIRTY_SHIFT)
+/// bytes, was written since the dirty bitmap was last cleared. Pages past the
+/// end of RAM never are.
+bool psycho_ctx_ram_page_dirty(const struct psycho_ctx *ctx, uint page);
+
+/// @brief Marks every page of RAM clean. Loading a state does this too.
+void psycho_ctx_ram_dirty_clear(struct psycho_ctx *ctx);
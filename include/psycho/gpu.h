@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu.h Provides public information about the GPU.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+// clang-format off
+
+/// @brief GP0 (commands and VRAM data) when written, GPUREAD when read.
+#define PSYCHO_GPU_GP0_ADDR	(0x1F801810)
+
+/// @brief GP1 (control commands) when written, GPUSTAT when read.
+#define PSYCHO_GPU_GP1_ADDR	(0x1F801814)
+
+#define PSYCHO_GPU_VRAM_WIDTH	(1024)
+#define PSYCHO_GPU_VRAM_HEIGHT	(512)
+
+/// @brief The size of VRAM (in bytes); each pixel is a half-word.
+#define PSYCHO_GPU_VRAM_SIZE	\
+	(PSYCHO_GPU_VRAM_WIDTH * PSYCHO_GPU_VRAM_HEIGHT * 2)
+
+/// @brief The length of the longest GP0 command (in words): a shaded,
+/// textured quadrilateral.
+#define PSYCHO_GPU_PKT_MAX	(12)
+
+/// @brief The most threads the frame may be split across.
+#define PSYCHO_GPU_BANDS_MAX	(8)
+
+// clang-format on
+
+/// @brief The drawing threads and the ring which feeds them; see gpu_render.c.
+struct psycho_gpu_render;
+
+/// @brief A rectangle of VRAM being transferred to or from the CPU.
+struct psycho_gpu_xfer {
+	u16 x;
+	u16 y;
+	u16 w;
+	u16 h;
+
+	/// @brief The number of pixels transferred so far.
+	u32 pos;
+
+	/// @brief The number of pixels left, or 0 if no transfer is in
+	/// progress.
+	u32 left;
+};
+
+/// @brief Defines the GPU as the CPU sees it.
+///
+/// Drawing commands are not executed as they are written, but queued for the
+/// drawing threads. Everything here is only touched by the CPU's thread; the
+/// drawing threads keep their own copy of the drawing state.
+struct psycho_gpu {
+	/// @brief VRAM, as rows of PSYCHO_GPU_VRAM_WIDTH pixels. It is written
+	/// by the drawing threads, so psycho_ctx_vram() must be used to look at
+	/// it.
+	u16 *vram;
+
+	struct psycho_gpu_render *render;
+
+	/// @brief The number of horizontal bands the frame is split into, each
+	/// drawn by its own thread, or 0 for one per online CPU besides the one
+	/// running the CPU. It is read when the drawing threads are started, by
+	/// the first psycho_ctx_reset().
+	uint bands;
+
+	/// @brief The bits of GPUSTAT set by GP1 commands and GP0(1Fh); the
+	/// rest are derived from the drawing state when it is read.
+	u32 stat;
+
+	///@{
+	/// @brief The parameters of GP0(E1h) to GP0(E6h): the drawing mode, the
+	/// texture window, the drawing area's corners, the drawing offset and
+	/// the mask bit setting.
+	u32 draw_mode;
+	u32 tex_window;
+	u32 area_tl;
+	u32 area_br;
+	u32 offset;
+	u32 mask;
+	///@}
+
+	///@{
+	/// @brief The parameters of GP1(05h) to GP1(08h), which describe the
+	/// displayed part of VRAM.
+	u32 disp_start;
+	u32 disp_h;
+	u32 disp_v;
+	u32 disp_mode;
+	///@}
+
+	/// @brief What GPUREAD returns outside of VRAM to CPU transfers.
+	u32 read;
+
+	/// @brief The words of the GP0 command being received.
+	u32 pkt[PSYCHO_GPU_PKT_MAX];
+	u32 pkt_len;
+
+	struct psycho_gpu_xfer upload;
+	struct psycho_gpu_xfer download;
+
+	/// @brief Whether a polyline is being received, and the words in pkt
+	/// continue its last line.
+	bool polyline;
+
+	/// @brief Whether GP0(E1h) may disable texturing; set by GP1(09h).
+	bool tex_disable;
+	u8 pad[6];
+};
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file hle.h Provides public information about high-level emulation of the
+/// BIOS kernel calls.
+
+#pragma once
+
+#include "types.h"
+
+// clang-format off
+
+/// @brief Services the BIOS library routines natively: the string and memory
+/// functions, the heap, and standard output.
+#define PSYCHO_HLE_LIB		(1 << 0)
+
+/// @brief Services the kernel's event and file calls with stubs backed by host
+/// state. This must not be combined with a real BIOS kernel, as the two would
+/// keep separate event tables; it is meant for running without a BIOS image.
+#define PSYCHO_HLE_KERNEL	(1 << 1)
+
+/// @brief The number of events PSYCHO_HLE_KERNEL can have open at once.
+#define PSYCHO_HLE_EVENTS_NUM	(16)
+
+// clang-format on
+
+struct psycho_hle_event {
+	u32 cls;
+	u32 spec;
+	u32 mode;
+
+	/// @brief One of the kernel's event states; 0 if the slot is free.
+	u32 status;
+};
+
+struct psycho_hle {
+	/// @brief Receives each character written to standard output.
+	void *udata;
+	void (*tty_cb)(void *udata, char c);
+
+	/// @brief Which calls are serviced; any of PSYCHO_HLE_*. Calls which
+	/// are not serviced run the BIOS code as usual.
+	uint flags;
+
+	/// @brief The heap set up by InitHeap(), as virtual addresses.
+	u32 heap_beg;
+	u32 heap_end;
+
+	/// @brief The state of rand().
+	u32 rand_seed;
+
+	struct psycho_hle_event events[PSYCHO_HLE_EVENTS_NUM];
+};
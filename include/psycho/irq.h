@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file irq.h Provides public information about the interrupt controller.
+
+#pragma once
+
+#include "types.h"
+
+// clang-format off
+
+#define PSYCHO_IRQ_STAT_ADDR	(0x1F801070)
+#define PSYCHO_IRQ_MASK_ADDR	(0x1F801074)
+
+///@{
+/// @brief The interrupt lines, as bits of I_STAT and I_MASK.
+#define PSYCHO_IRQ_VBLANK	(1 << 0)
+#define PSYCHO_IRQ_GPU		(1 << 1)
+#define PSYCHO_IRQ_CDROM	(1 << 2)
+#define PSYCHO_IRQ_DMA		(1 << 3)
+#define PSYCHO_IRQ_RCNT0	(1 << 4)
+#define PSYCHO_IRQ_RCNT1	(1 << 5)
+#define PSYCHO_IRQ_RCNT2	(1 << 6)
+#define PSYCHO_IRQ_PAD		(1 << 7)
+#define PSYCHO_IRQ_SIO		(1 << 8)
+#define PSYCHO_IRQ_SPU		(1 << 9)
+#define PSYCHO_IRQ_LIGHTPEN	(1 << 10)
+///@}
+
+/// @brief The bits of I_STAT and I_MASK which exist.
+#define PSYCHO_IRQ_LINES	(0x7FF)
+
+// clang-format on
+
+struct psycho_irq {
+	/// @brief I_STAT: the interrupts requested and not yet acknowledged.
+	u32 stat;
+
+	/// @brief I_MASK: the interrupts which are passed on to the CPU.
+	u32 mask;
+};
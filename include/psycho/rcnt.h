@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file rcnt.h Provides public information about the root counters, the
+/// three timers of the I/O register block.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "types.h"
+
+// clang-format off
+
+/// @brief The number of root counters.
+#define PSYCHO_RCNT_NUM		(3)
+
+/// @brief The address of the first root counter's registers; each counter has
+/// a value, a mode and a target register, 4 bytes apart.
+#define PSYCHO_RCNT_BEG		(0x1F801100)
+#define PSYCHO_RCNT_END		(0x1F80112F)
+
+/// @brief The distance between the registers of two root counters.
+#define PSYCHO_RCNT_STRIDE	(0x10)
+
+// clang-format on
+
+/// @brief A root counter. Its value is not counted up as the CPU runs; it is
+/// brought up to date from the cycle counter whenever it is accessed, or one of
+/// its interrupts is due.
+struct psycho_rcnt {
+	/// @brief The cycle the counter was last brought up to date at.
+	u64 base;
+
+	/// @brief The part of a tick which had elapsed at base, in units of the
+	/// counter's clock source; see rcnt.c.
+	u32 frac;
+
+	/// @brief The value of the counter at base.
+	u16 value;
+
+	u16 mode;
+	u16 target;
+
+	/// @brief Whether a one-shot interrupt was raised since the mode was
+	/// last written.
+	bool irq_done;
+	u8 pad[5];
+};
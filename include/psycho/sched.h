@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file sched.h Provides public information about the event scheduler, which
+/// keeps time for the whole machine.
+
+#pragma once
+
+#include "types.h"
+
+// clang-format off
+
+/// @brief The frequency of the CPU clock, which is what cycles count.
+#define PSYCHO_SCHED_CLOCK_HZ	(33868800)
+
+/// @brief The number of event slots; each source of events has its own.
+#define PSYCHO_SCHED_EVENTS_NUM	(16)
+
+// clang-format on
+
+struct psycho_ctx;
+
+struct psycho_sched_event {
+	/// @brief The cycle the event is due at.
+	u64 when;
+
+	/// @brief Called once the event is due, with the cycle it was due at.
+	/// Events fire between slices of CPU execution, so this may be a little
+	/// before the current cycle. It is set when the context is created, and
+	/// neither resets nor save states change it.
+	void (*cb)(struct psycho_ctx *ctx, u64 when);
+};
+
+/// @brief Counts cycles, and fires events at the cycles they are due.
+///
+/// The CPU runs in slices which end at the next event due, counting down
+/// psycho_cpu::run_left; nothing is polled while a slice runs. One instruction
+/// is counted as one cycle.
+struct psycho_sched {
+	/// @brief The cycle the CPU's current slice started at.
+	u64 cycles;
+
+	/// @brief The length of the current slice. The current cycle is cycles
+	/// plus this, less psycho_cpu::run_left.
+	s64 slice;
+
+	struct psycho_sched_event events[PSYCHO_SCHED_EVENTS_NUM];
+
+	/// @brief The pending events, as a binary min-heap of indices into
+	/// events ordered by when.
+	u8 heap[PSYCHO_SCHED_EVENTS_NUM];
+
+	/// @brief One more than the index of each event in heap, or 0 if it is
+	/// not pending.
+	u8 pos[PSYCHO_SCHED_EVENTS_NUM];
+
+	uint heap_len;
+	u32 pad;
+};
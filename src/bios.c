@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file bios.c Maps BIOS images read-only, so that every context using one
+/// shares the same host memory.
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "psycho/bios.h"
+#include "psycho/bus.h"
+
+// clang-format off
+
+#define BIOS_SIZE	(PSYCHO_BUS_BIOS_SIZE)
+
+// clang-format on
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// @brief Maps an image from a file descriptor, which the image then owns.
+static NODISCARD bool bios_map(struct psycho_bios *const bios, const int fd)
+{
+	const void *const data =
+		mmap(NULL, BIOS_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (data == MAP_FAILED) {
+		const int err = errno;
+
+		close(fd);
+		errno = err;
+
+		return false;
+	}
+
+	bios->data = data;
+	bios->fd = fd;
+
+	return true;
+}
+
+NODISCARD bool psycho_bios_open(struct psycho_bios *const bios,
+				const char *const path)
+{
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		const int err = errno;
+
+		close(fd);
+		errno = err;
+
+		return false;
+	}
+
+	if (st.st_size != BIOS_SIZE) {
+		close(fd);
+		errno = EINVAL;
+
+		return false;
+	}
+	return bios_map(bios, fd);
+}
+
+NODISCARD bool psycho_bios_create(struct psycho_bios *const bios,
+				  const u8 *const data)
+{
+	const int fd = memfd_create("psycho-bios", MFD_CLOEXEC);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	if (ftruncate(fd, BIOS_SIZE) != 0) {
+		close(fd);
+		return false;
+	}
+
+	if (data) {
+		for (size_t off = 0; off < BIOS_SIZE;) {
+			const ssize_t n = pwrite(fd, &data[off],
+						 BIOS_SIZE - off, (off_t)off);
+
+			if (n <= 0) {
+				close(fd);
+				return false;
+			}
+			off += (size_t)n;
+		}
+	}
+	return bios_map(bios, fd);
+}
+
+void psycho_bios_close(struct psycho_bios *const bios)
+{
+	munmap((void *)(uintptr_t)bios->data, BIOS_SIZE);
+	close(bios->fd);
+
+	bios->data = NULL;
+	bios->fd = -1;
+}
+
+#else // __linux__
+
+NODISCARD bool psycho_bios_open(struct psycho_bios *const bios,
+				const char *const path)
+{
+	FILE *const fd = fopen(path, "rb");
+
+	if (!fd) {
+		return false;
+	}
+
+	u8 *const data = malloc(BIOS_SIZE + 1);
+
+	if (!data || (fread(data, 1, BIOS_SIZE + 1, fd) != BIOS_SIZE)) {
+		free(data);
+		fclose(fd);
+		errno = EINVAL;
+
+		return false;
+	}
+	fclose(fd);
+
+	bios->data = data;
+	bios->fd = -1;
+
+	return true;
+}
+
+NODISCARD bool psycho_bios_create(struct psycho_bios *const bios,
+				  const u8 *const data)
+{
+	u8 *const copy = calloc(1, BIOS_SIZE);
+
+	if (!copy) {
+		return false;
+	}
+
+	if (data) {
+		memcpy(copy, data, BIOS_SIZE);
+	}
+
+	bios->data = copy;
+	bios->fd = -1;
+
+	return true;
+}
+
+void psycho_bios_close(struct psycho_bios *const bios)
+{
+	free((void *)(uintptr_t)bios->data);
+
+	bios->data = NULL;
+	bios->fd = -1;
+}
+
+#endif // __linux__
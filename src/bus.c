@@ -20,105 +20,123 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <stdbool.h>
 #include <string.h>
+
 #include "bus.h"
+#include "compiler.h"
 #include "dbg_log.h"
 
 // clang-format off
 
 #define RAM_BEG		(PSYCHO_BUS_RAM_BEG)
-#define RAM_END		(PSYCHO_BUS_RAM_END)
+#define RAM_SIZE	(PSYCHO_BUS_RAM_SIZE)
+
+#define RAM_MIRRORS_SIZE	(PSYCHO_BUS_RAM_MIRRORS_SIZE)
 
 #define BIOS_BEG	(PSYCHO_BUS_BIOS_BEG)
-#define BIOS_END	(PSYCHO_BUS_BIOS_END)
-#define BIOS_MASK	(0x000FFFFF)
+#define BIOS_SIZE	(PSYCHO_BUS_BIOS_SIZE)
+
+#define IO_BEG		(PSYCHO_BUS_IO_BEG)
+#define IO_SIZE		(PSYCHO_BUS_IO_SIZE)
+
+#define WIDTH_BYTE	(PSYCHO_BUS_WIDTH_BYTE)
+#define WIDTH_HALF	(PSYCHO_BUS_WIDTH_HALF)
+#define WIDTH_WORD	(PSYCHO_BUS_WIDTH_WORD)
+
+#define PAGE_SHIFT	(PSYCHO_BUS_PAGE_SHIFT)
+#define PAGE_SIZE	(1U << PAGE_SHIFT)
 
 // clang-format on
 
-u32 bus_lw(const struct psycho_ctx *const ctx, const u32 paddr)
+/// @brief Maps a region of host memory into the page tables for loads,
+/// repeating it as many times as necessary to fill the physical region.
+static void pages_map(struct psycho_bus *const bus, const u32 beg,
+		      const u32 size, const u8 *const host,
+		      const u32 host_size)
 {
-	u32 word = 0xFFFFFFFF;
-
-	switch (paddr) {
-	case RAM_BEG ... RAM_END:
-		memcpy(&word, &ctx->bus.ram[paddr], sizeof(u32));
-		break;
-
-	case BIOS_BEG ... BIOS_END:
-		memcpy(&word, &ctx->bus.bios[paddr & BIOS_MASK], sizeof(u32));
-		break;
-
-	default:
-		LOG_WARN("Unknown physical address 0x%08X when attempting to "
-			 "load word; returning 0xFFFF'FFFF",
-			 paddr);
-		return word;
+	for (u32 off = 0; off < size; off += PAGE_SIZE) {
+		bus->read_pages[(beg + off) >> PAGE_SHIFT] =
+			&host[off % host_size];
 	}
-
-	LOG_TRACE("Loaded word 0x%08X from physical address 0x%08X", word,
-		  paddr);
-	return word;
 }
 
-u8 bus_lb(const struct psycho_ctx *const ctx, const u32 paddr)
+/// @brief Likewise, for loads and stores.
+static void pages_map_writable(struct psycho_bus *const bus, const u32 beg,
+			       const u32 size, u8 *const host,
+			       const u32 host_size)
 {
-	u8 byte = 0xFF;
-
-	switch (paddr) {
-	case RAM_BEG ... RAM_END:
-		byte = ctx->bus.ram[paddr];
-		break;
-
-	case BIOS_BEG ... BIOS_END:
-		byte = ctx->bus.bios[paddr & BIOS_MASK];
-		break;
-
-	default:
-		LOG_WARN("Unknown physical address 0x%08X when attempting to "
-			 "load byte; returning 0xFF",
-			 paddr);
-		return byte;
+	pages_map(bus, beg, size, host, host_size);
+
+	for (u32 off = 0; off < size; off += PAGE_SIZE) {
+		bus->write_pages[(beg + off) >> PAGE_SHIFT] =
+			&host[off % host_size];
 	}
+}
 
-	LOG_TRACE("Loaded byte 0x%02X from 0x%08X", byte, paddr);
-	return byte;
+/// @brief Returns the handlers of the I/O register at a physical address, or
+/// NULL if there are none.
+static ALWAYS_INLINE NODISCARD const struct psycho_bus_io *
+io_get(const struct psycho_ctx *const ctx, const u32 paddr)
+{
+	const u32 off = paddr - IO_BEG;
+	return (off < IO_SIZE) ? ctx->bus.io[off >> 2] : NULL;
 }
 
-void bus_sw(struct psycho_ctx *const ctx, const u32 paddr, const u32 word)
+void bus_io_register(struct psycho_ctx *const ctx, const u32 beg,
+		     const u32 end, const struct psycho_bus_io *const io)
 {
-	switch (paddr) {
-	case RAM_BEG ... RAM_END:
-		memcpy(&ctx->bus.ram[paddr], &word, sizeof(u32));
-		break;
-
-	default:
-		LOG_WARN("Unknown physical address 0x%08X when attempting to "
-			 "store word 0x%08X; ignoring",
-			 paddr, word);
-		return;
+	const u32 last = (end - IO_BEG) >> 2;
+
+	for (u32 reg = (beg - IO_BEG) >> 2; reg <= last; ++reg) {
+		ctx->bus.io[reg] = io;
 	}
-	LOG_TRACE("Stored word 0x%08X at 0x%08X", word, paddr);
 }
 
-void bus_sh(struct psycho_ctx *const ctx, const u32 paddr, const u16 hword)
+void bus_reset(struct psycho_ctx *const ctx)
 {
-	LOG_WARN("Unknown physical address 0x%08X when attempting to store "
-		 "half-word 0x%04X; ignoring",
-		 paddr, hword);
+	memset(ctx->bus.read_pages, 0, sizeof(ctx->bus.read_pages));
+	memset(ctx->bus.write_pages, 0, sizeof(ctx->bus.write_pages));
+
+	// A mirrored window already repeats RAM; plain memory has to be
+	// repeated here.
+	pages_map_writable(&ctx->bus, RAM_BEG, RAM_MIRRORS_SIZE, ctx->bus.ram,
+			   (ctx->bus.ram_fd >= 0) ? RAM_MIRRORS_SIZE :
+						    RAM_SIZE);
+	pages_map(&ctx->bus, BIOS_BEG, BIOS_SIZE, ctx->bus.bios->data,
+		  BIOS_SIZE);
 }
 
-void bus_sb(struct psycho_ctx *const ctx, const u32 paddr, const u8 byte)
-{
-	switch (paddr) {
-	case RAM_BEG ... RAM_END:
-		ctx->bus.ram[paddr] = byte;
-		break;
-
-	default:
-		LOG_WARN("Unknown physical address 0x%08X when attempting to "
-			 "store byte 0x%02X; ignoring",
-			 paddr, byte);
-		break;
+/// @brief Defines the slow path of the accessors for one width.
+#define SLOW_DEFINE(sfx, type, width, name)                                    \
+	type bus_l##sfx##_slow(struct psycho_ctx *const ctx, const u32 paddr)  \
+	{                                                                      \
+		const struct psycho_bus_io *const io = io_get(ctx, paddr);     \
+                                                                               \
+		if (io && io->read[WIDTH_##width]) {                           \
+			ctx->bus.timed_read |= io->timed;                      \
+			return (type)io->read[WIDTH_##width](ctx, paddr);      \
+		}                                                              \
+                                                                               \
+		LOG_WARN("Unknown physical address 0x%08X when attempting to " \
+			 "load " name "; returning 0x%X",                      \
+			 paddr, (uint)(type)~0U);                              \
+		return (type)~0U;                                              \
+	}                                                                      \
+                                                                               \
+	void bus_s##sfx##_slow(struct psycho_ctx *const ctx, const u32 paddr,  \
+			       const type data)                                \
+	{                                                                      \
+		const struct psycho_bus_io *const io = io_get(ctx, paddr);     \
+                                                                               \
+		if (io && io->write[WIDTH_##width]) {                          \
+			io->write[WIDTH_##width](ctx, paddr, data);            \
+			return;                                                \
+		}                                                              \
+                                                                               \
+		LOG_WARN("Unknown physical address 0x%08X when attempting to " \
+			 "store " name " 0x%X; ignoring",                      \
+			 paddr, (uint)data);                                   \
 	}
-	LOG_TRACE("Stored byte 0x%02X at 0x%08X", byte, paddr);
-}
+
+BUS_WIDTHS(SLOW_DEFINE)
@@ -22,11 +22,108 @@
 
 #pragma once
 
+#include <string.h>
+
+#include "bus_fastmem.h"
+#include "compiler.h"
+#include "cpu_cache.h"
 #include "psycho/ctx.h"
 
-u32 bus_lw(const struct psycho_ctx *ctx, u32 paddr);
-u8 bus_lb(const struct psycho_ctx *ctx, u32 paddr);
+// clang-format off
+
+/// @brief Lists each access width as its accessor suffix, its type, its
+/// PSYCHO_BUS_WIDTH_* name and its name in messages.
+#define BUS_WIDTHS(X)				\
+	X(b, u8,  BYTE, "byte")			\
+	X(h, u16, HALF, "half-word")		\
+	X(w, u32, WORD, "word")
+
+#define BUS_PAGE_MASK	((1U << PSYCHO_BUS_PAGE_SHIFT) - 1)
+#define BUS_RAM_MASK	(PSYCHO_BUS_RAM_SIZE - 1)
+
+// clang-format on
+
+/// @brief Registers handlers for the I/O registers from beg to end, inclusive.
+/// Both must lie within the I/O register block, and are rounded out to whole
+/// words.
+void bus_io_register(struct psycho_ctx *ctx, u32 beg, u32 end,
+		     const struct psycho_bus_io *io);
+
+/// @brief Builds the page tables; this must be called before any access.
+void bus_reset(struct psycho_ctx *ctx);
+
+/// @brief Records a store to RAM at an offset into it: marks the page dirty,
+/// and invalidates any code cached from it.
+///
+/// This must be called on every write to RAM.
+static ALWAYS_INLINE void bus_ram_written(struct psycho_ctx *const ctx,
+					  const u32 off)
+{
+	const uint page = off >> PSYCHO_BUS_RAM_DIRTY_SHIFT;
+
+	ctx->bus.ram_dirty[page / 64] |= UINT64_C(1) << (page % 64);
+	cpu_cache_ram_written(ctx, off);
+}
+
+/// @brief Declares the slow path of each accessor, which handles whatever
+/// neither the page tables nor fastmem map: I/O registers, and stores to the
+/// BIOS. The fastmem fault handler completes rejected accesses with these too.
+#define BUS_SLOW_DECLARE(sfx, type, width, name)                   \
+	type bus_l##sfx##_slow(struct psycho_ctx *ctx, u32 paddr); \
+	void bus_s##sfx##_slow(struct psycho_ctx *ctx, u32 paddr, type data);
+
+BUS_WIDTHS(BUS_SLOW_DECLARE)
+
+/// @brief Defines the accessors for one width: bus_lb(), bus_lh() and
+/// bus_lw() for loads, bus_sb(), bus_sh() and bus_sw() for stores. Accesses to
+/// RAM and the BIOS are handled inline, through fastmem if it is enabled and
+/// through the page tables otherwise.
+#define BUS_ACCESSORS_DEFINE(sfx, type, width, name)                          \
+	static ALWAYS_INLINE NODISCARD type bus_l##sfx(                       \
+		struct psycho_ctx *const ctx, const u32 paddr)                \
+	{                                                                     \
+		if (ctx->bus.fastmem) {                                       \
+			return bus_fastmem_l##sfx(ctx->bus.fastmem, paddr);   \
+		}                                                             \
+                                                                              \
+		const u8 *const page =                                        \
+			ctx->bus.read_pages[paddr >> PSYCHO_BUS_PAGE_SHIFT];  \
+                                                                              \
+		if (!page) {                                                  \
+			return bus_l##sfx##_slow(ctx, paddr);                 \
+		}                                                             \
+                                                                              \
+		type data;                                                    \
+		memcpy(&data, &page[paddr & BUS_PAGE_MASK], sizeof(data));    \
+                                                                              \
+		return data;                                                  \
+	}                                                                     \
+                                                                              \
+	static ALWAYS_INLINE void bus_s##sfx(struct psycho_ctx *const ctx,    \
+					     const u32 paddr,                 \
+					     const type data)                 \
+	{                                                                     \
+		if (ctx->bus.fastmem) {                                       \
+			bus_fastmem_s##sfx(ctx->bus.fastmem, paddr, data);    \
+                                                                              \
+			/* Anything else faulted into the slow path. */       \
+			if (paddr < PSYCHO_BUS_RAM_MIRRORS_SIZE) {            \
+				bus_ram_written(ctx,                          \
+						paddr & BUS_RAM_MASK);        \
+			}                                                     \
+			return;                                               \
+		}                                                             \
+                                                                              \
+		u8 *const page =                                              \
+			ctx->bus.write_pages[paddr >> PSYCHO_BUS_PAGE_SHIFT]; \
+                                                                              \
+		if (!page) {                                                  \
+			bus_s##sfx##_slow(ctx, paddr, data);                  \
+			return;                                               \
+		}                                                             \
+                                                                              \
+		memcpy(&page[paddr & BUS_PAGE_MASK], &data, sizeof(data));    \
+		bus_ram_written(ctx, paddr & BUS_RAM_MASK);                   \
+	}
 
-void bus_sw(struct psycho_ctx *ctx, u32 paddr, u32 word);
-void bus_sh(struct psycho_ctx *ctx, u32 paddr, u16 hword);
-void bus_sb(struct psycho_ctx *ctx, u32 paddr, u8 byte);
+BUS_WIDTHS(BUS_ACCESSORS_DEFINE)
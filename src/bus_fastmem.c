@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file bus_fastmem.c Maps the physical address space into one host
+/// reservation, and completes the accesses the host MMU rejects through the
+/// slow path.
+///
+/// The reservation covers 4 GiB so that any 32-bit offset from its base stays
+/// inside it. RAM's memfd is mapped once per mirror, so every mirror aliases
+/// the context's own RAM. The BIOS is mapped read-only, from the same file as
+/// every other context sharing it where possible, and everything else, I/O
+/// included, is left inaccessible.
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "bus.h"
+#include "bus_fastmem.h"
+#include "dbg_log.h"
+#include "mem.h"
+
+#if defined(__linux__) && defined(__x86_64__)
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+// clang-format off
+
+#define RAM_BEG			(PSYCHO_BUS_RAM_BEG)
+#define RAM_SIZE		(PSYCHO_BUS_RAM_SIZE)
+
+#define BIOS_BEG		(PSYCHO_BUS_BIOS_BEG)
+#define BIOS_SIZE		(PSYCHO_BUS_BIOS_SIZE)
+
+/// @brief The size of the host reservation (in bytes).
+#define REGION_SIZE		(UINT64_C(1) << 32)
+
+///@{
+/// @brief The kinds of access the fault handler completes.
+#define ACCESS_LB		(0)
+#define ACCESS_LH		(1)
+#define ACCESS_LW		(2)
+#define ACCESS_SB		(3)
+#define ACCESS_SH		(4)
+#define ACCESS_SW		(5)
+///@}
+
+// clang-format on
+
+/// @brief An encoding of an access, as emitted by bus_fastmem.h and the
+/// recompiler.
+struct access {
+	u8 bytes[4];
+	u8 len;
+	u8 kind;
+};
+
+static const struct access accesses[] = {
+	// movzx eax, byte [rdi + rsi]
+	{ .bytes = { 0x0F, 0xB6, 0x04, 0x37 }, .len = 4, .kind = ACCESS_LB },
+
+	// movzx eax, word [rdi + rsi]
+	{ .bytes = { 0x0F, 0xB7, 0x04, 0x37 }, .len = 4, .kind = ACCESS_LH },
+
+	// mov eax, [rdi + rsi]
+	{ .bytes = { 0x8B, 0x04, 0x37 }, .len = 3, .kind = ACCESS_LW },
+
+	// mov [rdi + rsi], dl
+	{ .bytes = { 0x88, 0x14, 0x37 }, .len = 3, .kind = ACCESS_SB },
+
+	// mov [rdi + rsi], dx
+	{ .bytes = { 0x66, 0x89, 0x14, 0x37 }, .len = 4, .kind = ACCESS_SH },
+
+	// mov [rdi + rsi], edx
+	{ .bytes = { 0x89, 0x14, 0x37 }, .len = 3, .kind = ACCESS_SW },
+};
+
+/// @brief The context whose faults this thread handles, which is only set while
+/// the thread is running it.
+static _Thread_local struct psycho_ctx *fault_ctx;
+
+/// @brief The SIGSEGV action which was installed before ours.
+static struct sigaction fault_prev;
+
+/// @brief Serializes installing the handler, as contexts may enable fastmem
+/// from several threads at once. Otherwise, one of them could record our own
+/// handler as fault_prev.
+static atomic_flag fault_lock = ATOMIC_FLAG_INIT;
+
+static NODISCARD const struct access *access_find(const u8 *const rip)
+{
+	for (size_t i = 0; i < (sizeof(accesses) / sizeof(accesses[0])); ++i) {
+		const struct access *const access = &accesses[i];
+
+		if (!memcmp(rip, access->bytes, access->len)) {
+			return access;
+		}
+	}
+	return NULL;
+}
+
+/// @brief Completes a rejected access through the slow path, then resumes
+/// after the host instruction.
+///
+/// @returns true if the fault was ours to handle.
+static NODISCARD bool fault_complete(ucontext_t *const uc,
+				     const void *const addr)
+{
+	struct psycho_ctx *const ctx = fault_ctx;
+
+	if (!ctx || !ctx->bus.fastmem) {
+		return false;
+	}
+
+	greg_t *const regs = uc->uc_mcontext.gregs;
+	const uintptr_t base = (uintptr_t)ctx->bus.fastmem;
+
+	if ((((uintptr_t)addr - base) >= REGION_SIZE) ||
+	    ((uintptr_t)regs[REG_RDI] != base)) {
+		return false;
+	}
+
+	const struct access *const access =
+		access_find((const u8 *)(uintptr_t)regs[REG_RIP]);
+
+	if (!access) {
+		return false;
+	}
+
+	const u32 paddr = (u32)regs[REG_RSI];
+
+	switch (access->kind) {
+	case ACCESS_LB:
+		regs[REG_RAX] = bus_lb_slow(ctx, paddr);
+		break;
+
+	case ACCESS_LH:
+		regs[REG_RAX] = bus_lh_slow(ctx, paddr);
+		break;
+
+	case ACCESS_LW:
+		regs[REG_RAX] = bus_lw_slow(ctx, paddr);
+		break;
+
+	case ACCESS_SB:
+		bus_sb_slow(ctx, paddr, (u8)regs[REG_RDX]);
+		break;
+
+	case ACCESS_SH:
+		bus_sh_slow(ctx, paddr, (u16)regs[REG_RDX]);
+		break;
+
+	case ACCESS_SW:
+		bus_sw_slow(ctx, paddr, (u32)regs[REG_RDX]);
+		break;
+
+	default:
+		return false;
+	}
+
+	regs[REG_RIP] += access->len;
+	return true;
+}
+
+static void fault_handle(const int sig, siginfo_t *const info, void *const uc)
+{
+	if (fault_complete(uc, info->si_addr)) {
+		return;
+	}
+
+	// Not ours; hand it to whoever was installed before us. With the
+	// default action restored, returning faults again and terminates.
+	if (fault_prev.sa_flags & SA_SIGINFO) {
+		fault_prev.sa_sigaction(sig, info, uc);
+	} else if ((fault_prev.sa_handler == SIG_DFL) ||
+		   (fault_prev.sa_handler == SIG_IGN)) {
+		signal(sig, SIG_DFL);
+	} else {
+		fault_prev.sa_handler(sig);
+	}
+}
+
+static NODISCARD bool fault_handler_install_locked(void)
+{
+	struct sigaction cur;
+
+	if (sigaction(SIGSEGV, NULL, &cur) != 0) {
+		return false;
+	}
+
+	if ((cur.sa_flags & SA_SIGINFO) && (cur.sa_sigaction == fault_handle)) {
+		return true;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+
+	sa.sa_sigaction = fault_handle;
+	sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+
+	return sigaction(SIGSEGV, &sa, &fault_prev) == 0;
+}
+
+static NODISCARD bool fault_handler_install(void)
+{
+	while (atomic_flag_test_and_set_explicit(&fault_lock,
+						 memory_order_acquire)) {
+	}
+
+	const bool installed = fault_handler_install_locked();
+
+	atomic_flag_clear_explicit(&fault_lock, memory_order_release);
+	return installed;
+}
+
+/// @brief Moves RAM which is plain memory, either the caller's or the
+/// context's own, into a memfd the context owns, so that it can be mapped into
+/// the region.
+static NODISCARD bool ram_adopt(struct psycho_ctx *const ctx)
+{
+	int fd;
+	u8 *const ram = mem_ram_alloc(&fd, true);
+
+	if (!ram) {
+		return false;
+	}
+
+	memcpy(ram, ctx->bus.ram, RAM_SIZE);
+
+	if (ctx->bus.ram_owned) {
+		mem_ram_free(ctx->bus.ram, ctx->bus.ram_fd);
+	}
+
+	ctx->bus.ram = ram;
+	ctx->bus.ram_fd = fd;
+	ctx->bus.ram_owned = true;
+
+	return true;
+}
+
+/// @brief Maps the BIOS read-only into the region. An image backed by a file
+/// descriptor is shared with every other mapping of it; otherwise, it has to
+/// be copied.
+static NODISCARD bool bios_map(const struct psycho_ctx *const ctx,
+			       u8 *const at)
+{
+	const struct psycho_bios *const bios = ctx->bus.bios;
+
+	if (bios->fd >= 0) {
+		return mmap(at, BIOS_SIZE, PROT_READ, MAP_SHARED | MAP_FIXED,
+			    bios->fd, 0) != MAP_FAILED;
+	}
+
+	if (mmap(at, BIOS_SIZE, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+		 0) == MAP_FAILED) {
+		return false;
+	}
+
+	memcpy(at, bios->data, BIOS_SIZE);
+	return mprotect(at, BIOS_SIZE, PROT_READ) == 0;
+}
+
+NODISCARD bool bus_fastmem_enable(struct psycho_ctx *const ctx)
+{
+	if (ctx->bus.fastmem) {
+		return true;
+	}
+
+	if ((ctx->bus.ram_fd < 0) && !ram_adopt(ctx)) {
+		return false;
+	}
+
+	// RAM may be backed by huge pages, which can only be mapped at an
+	// aligned address.
+	u8 *const base = mem_reserve(REGION_SIZE);
+
+	if (!base) {
+		return false;
+	}
+
+	if (!mem_ram_map(ctx->bus.ram_fd, &base[RAM_BEG]) ||
+	    !bios_map(ctx, &base[BIOS_BEG]) || !fault_handler_install()) {
+		LOG_WARN("Unable to map the physical address space; fastmem "
+			 "stays disabled");
+
+		mem_release(base, REGION_SIZE);
+		return false;
+	}
+
+	ctx->bus.fastmem = base;
+
+	LOG_INFO("Fastmem enabled at %p", (void *)base);
+	return true;
+}
+
+void bus_fastmem_bind(struct psycho_ctx *const ctx)
+{
+	fault_ctx = ctx;
+}
+
+void bus_fastmem_unbind(struct psycho_ctx *const ctx)
+{
+	if (fault_ctx == ctx) {
+		fault_ctx = NULL;
+	}
+}
+
+void bus_fastmem_destroy(struct psycho_ctx *const ctx)
+{
+	bus_fastmem_unbind(ctx);
+
+	mem_release(ctx->bus.fastmem, REGION_SIZE);
+	ctx->bus.fastmem = NULL;
+}
+
+#else // defined(__linux__) && defined(__x86_64__)
+
+NODISCARD bool bus_fastmem_enable(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+	return false;
+}
+
+void bus_fastmem_bind(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+}
+
+void bus_fastmem_unbind(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+}
+
+void bus_fastmem_destroy(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+}
+
+#endif // defined(__linux__) && defined(__x86_64__)
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file bus_fastmem.h Provides "fastmem": the physical address space mapped
+/// into one host reservation, so that a load or store is a single host access.
+/// Accesses the host MMU rejects are completed through the slow path by a
+/// SIGSEGV handler.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "psycho/ctx.h"
+
+// Every access to the reservation takes its base in RDI and the physical
+// address in RSI, and loads into EAX or stores from EDX. The fault handler
+// only has to recognise these few encodings, which the recompiler emits too.
+
+// clang-format off
+
+/// @brief Lists each access width as its accessor suffix, its type, and the
+/// instructions loading and storing it.
+#define BUS_FASTMEM_WIDTHS(X)					\
+	X(b, u8,  "movzbl (%%rdi,%%rsi), %%eax",		\
+		  "movb %%dl, (%%rdi,%%rsi)")			\
+	X(h, u16, "movzwl (%%rdi,%%rsi), %%eax",		\
+		  "movw %%dx, (%%rdi,%%rsi)")			\
+	X(w, u32, "movl (%%rdi,%%rsi), %%eax",			\
+		  "movl %%edx, (%%rdi,%%rsi)")
+
+// clang-format on
+
+#if defined(__linux__) && defined(__x86_64__)
+
+#define BUS_FASTMEM_ACCESSORS_DEFINE(sfx, type, load, store)             \
+	static ALWAYS_INLINE NODISCARD type bus_fastmem_l##sfx(          \
+		const u8 *const base, const u32 paddr)                   \
+	{                                                                \
+		u32 data;                                                \
+                                                                         \
+		__asm__ volatile(load                                    \
+				 : "=a"(data)                            \
+				 : "D"(base), "S"((u64)paddr)            \
+				 : "memory");                            \
+		return (type)data;                                       \
+	}                                                                \
+                                                                         \
+	static ALWAYS_INLINE void bus_fastmem_s##sfx(                    \
+		u8 *const base, const u32 paddr, const type data)        \
+	{                                                                \
+		__asm__ volatile(store                                   \
+				 :                                       \
+				 : "D"(base), "S"((u64)paddr), "d"(data) \
+				 : "memory");                            \
+	}
+
+#else // defined(__linux__) && defined(__x86_64__)
+
+// Fastmem is never enabled on other hosts; these only keep the callers simple.
+
+#define BUS_FASTMEM_ACCESSORS_DEFINE(sfx, type, load, store)      \
+	static ALWAYS_INLINE NODISCARD type bus_fastmem_l##sfx(   \
+		const u8 *const base, const u32 paddr)            \
+	{                                                         \
+		(void)base;                                       \
+		(void)paddr;                                      \
+                                                                  \
+		return (type)~0U;                                 \
+	}                                                         \
+                                                                  \
+	static ALWAYS_INLINE void bus_fastmem_s##sfx(             \
+		u8 *const base, const u32 paddr, const type data) \
+	{                                                         \
+		(void)base;                                       \
+		(void)paddr;                                      \
+		(void)data;                                       \
+	}
+
+#endif // defined(__linux__) && defined(__x86_64__)
+
+BUS_FASTMEM_WIDTHS(BUS_FASTMEM_ACCESSORS_DEFINE)
+
+/// @brief Reserves the host region, maps RAM and the BIOS into it and installs
+/// the fault handler. RAM the caller supplied is first moved into memory the
+/// context owns.
+///
+/// @returns true if fastmem is enabled, false if the host does not support it.
+NODISCARD bool bus_fastmem_enable(struct psycho_ctx *ctx);
+
+/// @brief Makes the context the one whose faults the calling thread handles,
+/// until bus_fastmem_unbind() is called.
+void bus_fastmem_bind(struct psycho_ctx *ctx);
+
+/// @brief Stops the calling thread from handling the context's faults, if it
+/// was.
+void bus_fastmem_unbind(struct psycho_ctx *ctx);
+
+/// @brief Releases the host region.
+void bus_fastmem_destroy(struct psycho_ctx *ctx);
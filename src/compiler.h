@@ -32,4 +32,15 @@
 /// @brief The return value of this function should not be discarded.
 #define NODISCARD __attribute__((warn_unused_result))
 
+/// @brief This function has no effects other than its return value, which
+/// only depends on its arguments and on memory they point to.
+#define PURE __attribute__((pure))
+
+/// @brief This function has no effects other than its return value, which
+/// only depends on its arguments; it reads no memory at all.
+#define CONST __attribute__((const))
+
+/// @brief The pointer this function returns does not alias anything else.
+#define MALLOC __attribute__((malloc))
+
 #define FORMAT_CHK(index, first) __attribute__((format(printf, index, first)))
@@ -24,56 +24,18 @@
 #include <string.h>
 
 #include "cpu.h"
+#include "cpu_cache.h"
 #include "cpu_defs.h"
+#include "cpu_mem.h"
 #include "bus.h"
 #include "dbg_log.h"
+#include "gte.h"
+#include "hle.h"
 
 // clang-format off
 
 #define ra	(CPU_GPR_ra)
 
-#define GROUP_SPECIAL	(CPU_OP_GROUP_SPECIAL)
-#define GROUP_BCOND	(CPU_OP_GROUP_BCOND)
-#define GROUP_COP0	(CPU_OP_GROUP_COP0)
-
-#define ADD	(CPU_OP_ADD)
-#define ADDI	(CPU_OP_ADDI)
-#define ADDIU	(CPU_OP_ADDIU)
-#define ADDU	(CPU_OP_ADDU)
-#define AND	(CPU_OP_AND)
-#define ANDI	(CPU_OP_ANDI)
-#define BEQ	(CPU_OP_BEQ)
-#define BGTZ	(CPU_OP_BGTZ)
-#define BLEZ	(CPU_OP_BLEZ)
-#define BNE	(CPU_OP_BNE)
-#define DIV	(CPU_OP_DIV)
-#define DIVU	(CPU_OP_DIVU)
-#define J	(CPU_OP_J)
-#define JAL	(CPU_OP_JAL)
-#define JALR	(CPU_OP_JALR)
-#define JR	(CPU_OP_JR)
-#define OR	(CPU_OP_OR)
-#define ORI	(CPU_OP_ORI)
-#define LB	(CPU_OP_LB)
-#define LBU	(CPU_OP_LBU)
-#define LUI	(CPU_OP_LUI)
-#define LW	(CPU_OP_LW)
-#define MF	(CPU_OP_MF)
-#define MFHI	(CPU_OP_MFHI)
-#define MFLO	(CPU_OP_MFLO)
-#define MT	(CPU_OP_MT)
-#define SB	(CPU_OP_SB)
-#define SH	(CPU_OP_SH)
-#define SLL	(CPU_OP_SLL)
-#define SLT	(CPU_OP_SLT)
-#define SLTI	(CPU_OP_SLTI)
-#define SLTIU	(CPU_OP_SLTIU)
-#define SLTU	(CPU_OP_SLTU)
-#define SRA	(CPU_OP_SRA)
-#define SRL	(CPU_OP_SRL)
-#define SUBU	(CPU_OP_SUBU)
-#define SW	(CPU_OP_SW)
-
 #define NPC	(ctx->cpu.npc)
 #define PC 	(ctx->cpu.pc)
 #define GPR	(ctx->cpu.gpr)
@@ -83,13 +45,11 @@
 #define RI	(PSYCHO_CPU_EXC_CODE_RI)
 
 #define EXC_RAISE(exc_code)	(exc_raise(ctx, (exc_code)))
-#define BRANCH_IF(cond)		(branch_if(ctx, (cond)))
+#define BRANCH_IF(cond)		(branch_if(ctx, op, (cond)))
 
 #define HI	(ctx->cpu.hi)
 #define LO	(ctx->cpu.lo)
 
-#define base (cpu_instr_base_get(ctx->cpu.instr))
-
 #define SR	(CP0_CPR[CPU_CP0_CPR_REG_SR])
 #define IsC	(CPU_CP0_CPR_REG_SR_IsC)
 
@@ -97,13 +57,6 @@
 
 const char *const exc_code_names[] = { [RI] = "Reserved instruction" };
 
-static void branch_if(struct psycho_ctx *const ctx, const bool condition_met)
-{
-	if (condition_met) {
-		NPC = cpu_branch_tgt_get(ctx->cpu.instr, PC);
-	}
-}
-
 static void exc_raise(struct psycho_ctx *const ctx, const uint exc_code)
 {
 	// Note that in an emulation context, we may not want to actually
@@ -120,259 +73,535 @@ static void exc_raise(struct psycho_ctx *const ctx, const uint exc_code)
 	// determine what exceptions actually *halt* execution.
 	if (ctx->cpu.exc_halt & (1 << exc_code)) {
 		LOG_ERR("%s exception raised!", exc_code_names[exc_code]);
+
+		ctx->cpu.halted = true;
+		ctx->cpu.block_exit = true;
+
 		return;
 	}
 }
 
-static ALWAYS_INLINE NODISCARD u32 vaddr_get(struct psycho_ctx *const ctx)
+static ALWAYS_INLINE void branch_if(struct psycho_ctx *const ctx,
+				    const struct cpu_op *const op,
+				    const bool condition_met)
+{
+	if (condition_met) {
+		NPC = (op->imm << 2) + PC + sizeof(u32);
+	}
+}
+
+static ALWAYS_INLINE NODISCARD u32 vaddr_get(struct psycho_ctx *const ctx,
+					     const struct cpu_op *const op)
 {
-	const u32 offset = cpu_instr_offset_get(ctx->cpu.instr);
-	return GPR[base] + offset;
+	return GPR[op->rs] + op->imm;
 }
 
-static ALWAYS_INLINE NODISCARD u32 instr_fetch(struct psycho_ctx *const ctx)
+NODISCARD u32 cpu_instr_fetch(struct psycho_ctx *const ctx)
 {
 	const u32 paddr = cpu_vaddr_to_paddr(PC);
 	return bus_lw(ctx, paddr);
 }
 
-void cpu_reset(struct psycho_ctx *const ctx)
+static void op_ri(struct psycho_ctx *const ctx, const struct cpu_op *const op)
 {
-	memset(GPR, 0, sizeof(GPR));
-	PC = CPU_VEC_RST;
-	NPC = PC + sizeof(u32);
+	ctx->cpu.instr = op->instr;
+	EXC_RAISE(RI);
+}
 
-	ctx->cpu.instr = instr_fetch(ctx);
-	LOG_INFO("CPU reset!");
+static void op_sll(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rt] << op->shamt;
 }
 
-void cpu_step(struct psycho_ctx *const ctx)
+static void op_srl(struct psycho_ctx *const ctx, const struct cpu_op *const op)
 {
-#define op (cpu_instr_op_get(ctx->cpu.instr))
-#define rt (cpu_instr_rt_get(ctx->cpu.instr))
-#define rs (cpu_instr_rs_get(ctx->cpu.instr))
-#define rd (cpu_instr_rd_get(ctx->cpu.instr))
-#define funct (cpu_instr_funct_get(ctx->cpu.instr))
-#define shamt (cpu_instr_shamt_get(ctx->cpu.instr))
-#define ZEXT_IMM (cpu_instr_zext_imm_get(ctx->cpu.instr))
-#define SEXT_IMM (cpu_instr_sext_imm_get(ctx->cpu.instr))
+	GPR[op->rd] = GPR[op->rt] >> op->shamt;
+}
 
-	PC = (u32)(NPC - sizeof(u32));
-	NPC += sizeof(u32);
+static void op_sra(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = (u32)((s32)GPR[op->rt] >> op->shamt);
+}
 
-	switch (op) {
-	case GROUP_SPECIAL:
-		switch (funct) {
-		case SLL:
-			GPR[rd] = GPR[rt] << shamt;
-			break;
+static void op_jr(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	NPC = GPR[op->rs];
+}
 
-		case SRL:
-			GPR[rd] = GPR[rt] >> shamt;
-			break;
+static void op_jalr(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	const u32 jump_target = GPR[op->rs];
 
-		case SRA:
-			GPR[rd] = (u32)((s32)GPR[rt] >> shamt);
-			break;
+	GPR[op->rd] = PC + 8;
+	NPC = jump_target;
+}
 
-		case JR:
-			NPC = GPR[rs];
-			break;
+static void op_mfhi(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = HI;
+}
 
-		case JALR: {
-			const u32 jump_target = GPR[rs];
+static void op_mflo(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = LO;
+}
 
-			GPR[rd] = PC + 8;
+static void op_div(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	LO = (u32)((s32)GPR[op->rs] / (s32)GPR[op->rt]);
+	HI = (u32)((s32)GPR[op->rs] % (s32)GPR[op->rt]);
+}
 
-			NPC = jump_target;
-			break;
-		}
+static void op_divu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	LO = GPR[op->rs] / GPR[op->rt];
+	HI = GPR[op->rs] % GPR[op->rt];
+}
 
-		case MFHI:
-			GPR[rd] = HI;
-			break;
+static void op_addu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rs] + GPR[op->rt];
+}
 
-		case MFLO:
-			GPR[rd] = LO;
-			break;
+static void op_subu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rs] - GPR[op->rt];
+}
 
-		case DIV:
-			LO = (u32)((s32)GPR[rs] / (s32)GPR[rt]);
-			HI = (u32)((s32)GPR[rs] % (s32)GPR[rt]);
+static void op_and(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rs] & GPR[op->rt];
+}
 
-			break;
+static void op_or(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rs] | GPR[op->rt];
+}
 
-		case DIVU:
-			LO = GPR[rs] / GPR[rt];
-			HI = GPR[rs] % GPR[rt];
+static void op_slt(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = (s32)GPR[op->rs] < (s32)GPR[op->rt];
+}
 
-			break;
+static void op_sltu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rd] = GPR[op->rs] < GPR[op->rt];
+}
 
-		case ADD:
-		case ADDU:
-			GPR[rd] = GPR[rs] + GPR[rt];
-			break;
+static void op_bcond(struct psycho_ctx *const ctx,
+		     const struct cpu_op *const op)
+{
+	const bool cond_met = ((s32)GPR[op->rs] < 0) ^ (op->rt & 1);
 
-		case SUBU:
-			GPR[rd] = GPR[rs] - GPR[rt];
-			break;
+	if ((op->rt >> 4) & 1) {
+		GPR[ra] = PC + 8;
+	}
+	BRANCH_IF(cond_met);
+}
 
-		case AND:
-			GPR[rd] = GPR[rs] & GPR[rt];
-			break;
+static void op_j(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	NPC = op->imm | (PC & 0xF0000000);
+}
 
-		case OR:
-			GPR[rd] = GPR[rs] | GPR[rt];
-			break;
+static void op_jal(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[ra] = PC + 8;
+	NPC = op->imm | (PC & 0xF0000000);
+}
 
-		case SLT:
-			GPR[rd] = (s32)GPR[rs] < (s32)GPR[rt];
-			break;
+static void op_beq(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	BRANCH_IF(GPR[op->rs] == GPR[op->rt]);
+}
 
-		case SLTU:
-			GPR[rd] = GPR[rs] < GPR[rt];
-			break;
+static void op_bne(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	BRANCH_IF(GPR[op->rs] != GPR[op->rt]);
+}
 
-		default:
-			EXC_RAISE(RI);
-			break;
-		}
-		break;
+static void op_blez(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	BRANCH_IF((s32)GPR[op->rs] <= 0);
+}
 
-	case GROUP_BCOND: {
-		const bool cond_met = ((s32)GPR[rs] < 0) ^ (rt & 1);
+static void op_bgtz(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	BRANCH_IF((s32)GPR[op->rs] > 0);
+}
 
-		if ((rt >> 4) & 1) {
-			GPR[ra] = PC + 8;
-		}
+static void op_ori(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = GPR[op->rs] | op->imm;
+}
 
-		BRANCH_IF(cond_met);
-		break;
-	}
+static void op_addiu(struct psycho_ctx *const ctx,
+		     const struct cpu_op *const op)
+{
+	GPR[op->rt] = GPR[op->rs] + op->imm;
+}
 
-	case J:
-		NPC = cpu_jmp_tgt_get(ctx->cpu.instr, PC);
-		break;
+static void op_slti(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = (s32)GPR[op->rs] < (s32)op->imm;
+}
 
-	case JAL:
-		GPR[ra] = PC + 8;
-		NPC = cpu_jmp_tgt_get(ctx->cpu.instr, PC);
+static void op_sltiu(struct psycho_ctx *const ctx,
+		     const struct cpu_op *const op)
+{
+	GPR[op->rt] = GPR[op->rs] < op->imm;
+}
 
-		break;
+static void op_andi(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = GPR[op->rs] & op->imm;
+}
 
-	case BEQ:
-		BRANCH_IF(GPR[rs] == GPR[rt]);
-		break;
+static void op_lui(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = op->imm;
+}
 
-	case BNE:
-		BRANCH_IF(GPR[rs] != GPR[rt]);
-		break;
+static void op_mfc0(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = CP0_CPR[op->rd];
+}
 
-	case BLEZ:
-		BRANCH_IF((s32)GPR[rs] <= 0);
-		break;
+static void op_mtc0(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	CP0_CPR[op->rd] = GPR[op->rt];
+}
 
-	case BGTZ:
-		BRANCH_IF((s32)GPR[rs] > 0);
-		break;
+static void op_mfc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = gte_data_read(ctx, op->rd);
+}
 
-	case ORI:
-		GPR[rt] = GPR[rs] | ZEXT_IMM;
-		break;
+static void op_cfc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = gte_ctrl_read(ctx, op->rd);
+}
 
-	case ADDI:
-	case ADDIU:
-		GPR[rt] = GPR[rs] + SEXT_IMM;
-		break;
+static void op_mtc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	gte_data_write(ctx, op->rd, GPR[op->rt]);
+}
 
-	case SLTI:
-		GPR[rt] = (s32)GPR[rs] < (s32)SEXT_IMM;
-		break;
+static void op_ctc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	gte_ctrl_write(ctx, op->rd, GPR[op->rt]);
+}
 
-	case SLTIU:
-		GPR[rt] = GPR[rs] < SEXT_IMM;
-		break;
+/// @brief Executes any GTE command, which decodes its own fields.
+static void op_gte(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	gte_cmd(ctx, op->instr);
+}
 
-	case ANDI:
-		GPR[rt] = GPR[rs] & ZEXT_IMM;
-		break;
+static void op_lb(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = (u32)(s8)cpu_mem_lb(ctx, vaddr_get(ctx, op));
+}
 
-	case LUI:
-		GPR[rt] = ZEXT_IMM << 16;
-		break;
+static void op_lh(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = (u32)(s16)cpu_mem_lh(ctx, vaddr_get(ctx, op));
+}
 
-	case GROUP_COP0:
-		switch (rs) {
-		case MF:
-			GPR[rt] = CP0_CPR[rd];
-			break;
+static void op_lwl(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	const u32 vaddr = vaddr_get(ctx, op);
+	const u32 word = cpu_mem_lw(ctx, vaddr & ~3U);
+	const u32 shift = (vaddr & 3) * 8;
 
-		case MT:
-			CP0_CPR[rd] = GPR[rt];
-			break;
+	GPR[op->rt] = (GPR[op->rt] & (0x00FFFFFF >> shift)) |
+		      (word << (24 - shift));
+}
 
-		default:
-			EXC_RAISE(RI);
-			break;
-		}
-		break;
+static void op_lw(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = cpu_mem_lw(ctx, vaddr_get(ctx, op));
+}
 
-	case LB: {
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+static void op_lbu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = cpu_mem_lb(ctx, vaddr_get(ctx, op));
+}
 
-		GPR[rt] = (u32)(s8)bus_lb(ctx, paddr);
-		break;
-	}
+static void op_lhu(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	GPR[op->rt] = cpu_mem_lh(ctx, vaddr_get(ctx, op));
+}
+
+static void op_lwr(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	const u32 vaddr = vaddr_get(ctx, op);
+	const u32 word = cpu_mem_lw(ctx, vaddr & ~3U);
+	const u32 shift = (vaddr & 3) * 8;
 
-	case LW: {
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+	GPR[op->rt] = (GPR[op->rt] & ~(0xFFFFFFFF >> shift)) | (word >> shift);
+}
 
-		GPR[rt] = bus_lw(ctx, paddr);
-		break;
+static void op_lwc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	gte_data_write(ctx, op->rt, cpu_mem_lw(ctx, vaddr_get(ctx, op)));
+}
+
+static void op_sb(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	cpu_mem_sb(ctx, vaddr_get(ctx, op), (u8)GPR[op->rt]);
+}
+
+static void op_sh(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	cpu_mem_sh(ctx, vaddr_get(ctx, op), (u16)GPR[op->rt]);
+}
+
+static void op_swl(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	if (SR & IsC) {
+		return;
 	}
 
-	case LBU: {
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+	const u32 vaddr = vaddr_get(ctx, op);
+	const u32 word = cpu_mem_lw(ctx, vaddr & ~3U);
+	const u32 shift = (vaddr & 3) * 8;
 
-		GPR[rt] = bus_lb(ctx, paddr);
-		break;
+	cpu_mem_sw(ctx, vaddr & ~3U,
+	       (word & (0xFFFFFF00 << shift)) | (GPR[op->rt] >> (24 - shift)));
+}
+
+static void op_sw(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	if (SR & IsC) {
+		return;
+	}
+	cpu_mem_sw(ctx, vaddr_get(ctx, op), GPR[op->rt]);
+}
+
+static void op_swr(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	if (SR & IsC) {
+		return;
 	}
 
-	case SB: {
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+	const u32 vaddr = vaddr_get(ctx, op);
+	const u32 word = cpu_mem_lw(ctx, vaddr & ~3U);
+	const u32 shift = (vaddr & 3) * 8;
 
-		bus_sb(ctx, paddr, (u8)GPR[rt]);
-		break;
+	cpu_mem_sw(ctx, vaddr & ~3U,
+	       (word & (0x00FFFFFF >> (24 - shift))) | (GPR[op->rt] << shift));
+}
+
+static void op_swc2(struct psycho_ctx *const ctx, const struct cpu_op *const op)
+{
+	if (SR & IsC) {
+		return;
 	}
+	cpu_mem_sw(ctx, vaddr_get(ctx, op), gte_data_read(ctx, op->rt));
+}
+
+///@{
+/// @brief Instructions which are not implemented yet, and the instructions
+/// which are implemented the same way as another one for now.
+#define op_add		op_addu
+#define op_addi		op_addiu
+#define op_break	op_ri
+#define op_mthi		op_ri
+#define op_mtlo		op_ri
+#define op_mult		op_ri
+#define op_multu	op_ri
+#define op_nor		op_ri
+#define op_rfe		op_ri
+#define op_sllv		op_ri
+#define op_srav		op_ri
+#define op_srlv		op_ri
+#define op_sub		op_ri
+#define op_syscall	op_ri
+#define op_xor		op_ri
+#define op_xori		op_ri
+///@}
+
+// clang-format off
 
-	case SH: {
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+// Every GTE command goes through op_gte(), which leaves the rest to the GTE.
+#define HANDLER_PRIMARY(fn)	&(fn)
+#define HANDLER_SPECIAL(fn)	&(fn)
+#define HANDLER_COP0(fn)	&(fn)
+#define HANDLER_COP0_CO(fn)	&(fn)
+#define HANDLER_COP2(fn)	&(fn)
+#define HANDLER_COP2_CO(fn)	&op_gte
 
-		bus_sh(ctx, paddr, (u16)GPR[rt]);
+#define HANDLER(tbl, name, mnemonic, fmt) \
+	[CPU_TBL_##tbl + CPU_OP_##name] = HANDLER_##tbl(op_##mnemonic),
+
+#define FMT(tbl, name, mnemonic, fmt) \
+	[CPU_TBL_##tbl + CPU_OP_##name] = CPU_FMT_##fmt,
+
+#define CASE(tbl, name, mnemonic, fmt_)			\
+	case CPU_TBL_##tbl + CPU_OP_##name:		\
+		fn = HANDLER_##tbl(op_##mnemonic);	\
+		fmt = CPU_FMT_##fmt_;			\
 		break;
-	}
 
-	case SW: {
-		if (SR & IsC) {
-			break;
-		}
+// clang-format on
+
+const u8 cpu_instr_fmts[CPU_TBL_SIZE] = { CPU_INSTR_LIST(FMT) };
+
+#ifdef PSYCHO_CPU_DECODE_SWITCH
 
-		const u32 vaddr = vaddr_get(ctx);
-		const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+// Only kept to measure the tables against; see PSYCHO_CPU_DECODE_SWITCH in the
+// top-level CMakeLists.txt.
+bool cpu_decode(struct cpu_op *const op, const u32 instr)
+{
+	cpu_op_fn fn = &op_ri;
+	uint fmt = CPU_FMT_NONE;
+
+	switch (cpu_instr_index_get(instr)) {
+		CPU_INSTR_LIST(CASE)
 
-		bus_sw(ctx, paddr, GPR[rt]);
+	default:
 		break;
 	}
 
+	op->fn = fn;
+	op->instr = instr;
+	op->rs = (u8)cpu_instr_rs_get(instr);
+	op->rt = (u8)cpu_instr_rt_get(instr);
+	op->rd = (u8)cpu_instr_rd_get(instr);
+	op->shamt = (u8)cpu_instr_shamt_get(instr);
+
+	switch (fmt) {
+	case CPU_FMT_JUMP:
+		op->imm = cpu_instr_target_get(instr) << 2;
+		return true;
+
+	case CPU_FMT_ALU_ZEXT_IMM:
+		op->imm = cpu_instr_zext_imm_get(instr);
+		return false;
+
+	case CPU_FMT_LUI:
+		op->imm = cpu_instr_zext_imm_get(instr) << 16;
+		return false;
+
+	case CPU_FMT_JR:
+	case CPU_FMT_JALR:
+	case CPU_FMT_BCOND:
+	case CPU_FMT_BRANCH_REG:
+	case CPU_FMT_BRANCH:
+		op->imm = cpu_instr_sext_imm_get(instr);
+		return true;
+
 	default:
-		EXC_RAISE(RI);
-		break;
+		op->imm = cpu_instr_sext_imm_get(instr);
+		return false;
 	}
-	PC += sizeof(u32);
-	ctx->cpu.instr = instr_fetch(ctx);
+}
+
+#else // PSYCHO_CPU_DECODE_SWITCH
+
+/// @brief Describes how the operands of each instruction format are decoded.
+/// The immediate is ((instr & imm_mask) ^ imm_sign) - imm_sign, shifted left by
+/// imm_shift, which covers sign extension without branching.
+static const struct {
+	u32 imm_mask;
+	u32 imm_sign;
+	u8 imm_shift;
+
+	/// @brief Whether the instruction has a delay slot.
+	bool branch;
+
+	u8 pad[2];
+} fmts[CPU_FMT_NUM] = {
+	[CPU_FMT_NONE] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_SHIFT_IMM] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_SHIFT_REG] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_JR] = { 0xFFFF, 0x8000, 0, true },
+	[CPU_FMT_JALR] = { 0xFFFF, 0x8000, 0, true },
+	[CPU_FMT_MF_HI_LO] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MT_HI_LO] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MULT_DIV] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_ALU_REG] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_BCOND] = { 0xFFFF, 0x8000, 0, true },
+	[CPU_FMT_JUMP] = { 0x3FFFFFF, 0, 2, true },
+	[CPU_FMT_BRANCH_REG] = { 0xFFFF, 0x8000, 0, true },
+	[CPU_FMT_BRANCH] = { 0xFFFF, 0x8000, 0, true },
+	[CPU_FMT_ALU_SEXT_IMM] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_ALU_ZEXT_IMM] = { 0xFFFF, 0, 0, false },
+	[CPU_FMT_LUI] = { 0xFFFF, 0, 16, false },
+	[CPU_FMT_LOAD] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_STORE] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MFC0] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MTC0] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MFC2] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_CFC2] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_MTC2] = { 0xFFFF, 0x8000, 0, false },
+	[CPU_FMT_CTC2] = { 0xFFFF, 0x8000, 0, false },
+};
+
+/// @brief The handler of each instruction, or NULL for reserved instructions.
+static const cpu_op_fn handlers[CPU_TBL_SIZE] = { CPU_INSTR_LIST(HANDLER) };
+
+bool cpu_decode(struct cpu_op *const op, const u32 instr)
+{
+	const uint index = cpu_instr_index_get(instr);
+	const cpu_op_fn fn = handlers[index];
+	const uint fmt = cpu_instr_fmts[index];
+
+	const u32 imm = ((instr & fmts[fmt].imm_mask) ^ fmts[fmt].imm_sign) -
+			fmts[fmt].imm_sign;
+
+	op->fn = fn ? fn : &op_ri;
+	op->instr = instr;
+	op->imm = imm << fmts[fmt].imm_shift;
+	op->rs = (u8)cpu_instr_rs_get(instr);
+	op->rt = (u8)cpu_instr_rt_get(instr);
+	op->rd = (u8)cpu_instr_rd_get(instr);
+	op->shamt = (u8)cpu_instr_shamt_get(instr);
+
+	return fmts[fmt].branch;
+}
+
+#endif // PSYCHO_CPU_DECODE_SWITCH
+
+#undef HANDLER_PRIMARY
+#undef HANDLER_SPECIAL
+#undef HANDLER_COP0
+#undef HANDLER_COP0_CO
+#undef HANDLER_COP2
+#undef HANDLER_COP2_CO
+#undef HANDLER
+#undef FMT
+#undef CASE
+
+void cpu_reset(struct psycho_ctx *const ctx)
+{
+	cpu_cache_flush(ctx);
+
+	memset(GPR, 0, sizeof(GPR));
+	gte_reset(ctx);
+
+	PC = CPU_VEC_RST;
+	NPC = PC + sizeof(u32);
+
+	ctx->cpu.instr = cpu_instr_fetch(ctx);
+	LOG_INFO("CPU reset!");
+}
+
+void cpu_step(struct psycho_ctx *const ctx)
+{
+	struct cpu_op op;
+
+	cpu_decode(&op, ctx->cpu.instr);
+	cpu_op_exec(ctx, &op);
+
+	ctx->cpu.instr = cpu_instr_fetch(ctx);
+}
+
+void cpu_run(struct psycho_ctx *const ctx)
+{
+	do {
+		cpu_step(ctx);
+	} while ((--ctx->cpu.run_left > 0) && (ctx->cpu.pc != ctx->cpu.bp) &&
+		 !ctx->cpu.halted && !hle_pending(ctx));
 }
@@ -22,8 +22,80 @@
 
 #pragma once
 
+#include <stdbool.h>
+
+#include "compiler.h"
 #include "psycho/ctx.h"
 
+// clang-format off
+
+/// @brief The bits of a virtual address which select the scratchpad. It is
+/// reachable through KUSEG and KSEG0, but not through KSEG1 or KSEG2.
+#define CPU_SCRATCHPAD_SEG_MASK	(0x7FFFFFFF & ~(PSYCHO_BUS_SCRATCHPAD_SIZE - 1))
+
+// clang-format on
+
+struct cpu_op;
+
+/// @brief Executes a single pre-decoded instruction.
+typedef void (*cpu_op_fn)(struct psycho_ctx *ctx, const struct cpu_op *op);
+
+/// @brief Defines a pre-decoded instruction.
+///
+/// Every field the handler needs is unpacked ahead of time so that executing
+/// the instruction never has to touch the raw instruction word again.
+struct cpu_op {
+	/// @brief The handler which executes this instruction.
+	cpu_op_fn fn;
+
+	/// @brief The raw instruction word, kept for diagnostics.
+	u32 instr;
+
+	/// @brief The immediate, already zero or sign-extended (or shifted) as
+	/// the instruction requires.
+	u32 imm;
+
+	u8 rs;
+	u8 rt;
+	u8 rd;
+	u8 shamt;
+	u32 pad;
+};
+
 void cpu_reset(struct psycho_ctx *ctx);
 
+/// @brief Decodes an instruction.
+///
+/// @param op The pre-decoded instruction to fill in.
+/// @param instr The instruction to decode.
+///
+/// @returns true if the instruction transfers control (i.e., a branch or jump
+/// with a delay slot), false otherwise.
+bool cpu_decode(struct cpu_op *op, u32 instr);
+
+NODISCARD u32 cpu_instr_fetch(struct psycho_ctx *ctx);
+
+/// @brief Returns whether a virtual address lies in the scratchpad.
+static ALWAYS_INLINE NODISCARD bool cpu_vaddr_scratchpad(const u32 vaddr)
+{
+	return (vaddr & CPU_SCRATCHPAD_SEG_MASK) == PSYCHO_BUS_SCRATCHPAD_BEG;
+}
+
+/// @brief Executes a pre-decoded instruction, advancing the program counters
+/// exactly as cpu_step() does.
+ALWAYS_INLINE void cpu_op_exec(struct psycho_ctx *const ctx,
+			       const struct cpu_op *const op)
+{
+	ctx->cpu.pc = (u32)(ctx->cpu.npc - sizeof(u32));
+	ctx->cpu.npc += sizeof(u32);
+
+	op->fn(ctx, op);
+	ctx->cpu.pc += sizeof(u32);
+}
+
 void cpu_step(struct psycho_ctx *ctx);
+
+/// @brief Steps at least once, and then until psycho_cpu::run_left is
+/// exhausted, the program counter reaches psycho_cpu::bp, execution is halted,
+/// or a kernel call may be serviced natively.
+void cpu_run(struct psycho_ctx *ctx);
@@ -0,0 +1,372 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_cache.c Defines the implementation of the block cache.
+///
+/// A basic block is decoded into an array of pre-decoded instructions the
+/// first time it is executed; every later visit simply calls the handler of
+/// each instruction in turn, skipping the fetch, field extraction and nested
+/// dispatch that cpu_step() has to perform.
+///
+/// Blocks are keyed by the physical address of their first instruction and
+/// grouped into pages. Blocks never cross a page boundary, which lets a write
+/// to RAM discard every block of the page it lands in without having to track
+/// which blocks overlap which addresses.
+///
+/// The program counters are advanced exactly as cpu_step() would, so the
+/// architectural state at the end of a block is identical to having stepped
+/// through it one instruction at a time.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "cpu_cache.h"
+#include "cpu_defs.h"
+#include "cpu_jit.h"
+#include "hle.h"
+
+// clang-format off
+
+#define PAGE_SHIFT	(PSYCHO_CPU_CACHE_PAGE_SHIFT)
+#define PAGE_SIZE	(1U << PAGE_SHIFT)
+#define PAGE_MASK	(PAGE_SIZE - 1)
+#define PAGE_SLOTS_NUM	(PAGE_SIZE / sizeof(u32))
+
+#define RAM_PAGES_NUM	(PSYCHO_BUS_RAM_SIZE >> PAGE_SHIFT)
+
+#define BLOCK_LEN_MAX	(CPU_CACHE_BLOCK_LEN_MAX)
+
+// clang-format on
+
+struct psycho_cpu_cache_page {
+	/// @brief The block starting at each word of this page, if any.
+	struct cpu_block *blocks[PAGE_SLOTS_NUM];
+};
+
+static NODISCARD int page_index_get(const u32 paddr)
+{
+	if (paddr <= PSYCHO_BUS_RAM_END) {
+		return (int)(paddr >> PAGE_SHIFT);
+	}
+
+	if ((paddr >= PSYCHO_BUS_BIOS_BEG) && (paddr <= PSYCHO_BUS_BIOS_END)) {
+		return (int)(RAM_PAGES_NUM +
+			     ((paddr - PSYCHO_BUS_BIOS_BEG) >> PAGE_SHIFT));
+	}
+	return -1;
+}
+
+/// @brief Returns whether a block is an idle loop.
+///
+/// The block must end with a branch back to its start, and be made of nothing
+/// but loads, arithmetic and that branch. Every register it reads must either
+/// be left alone by it, or be written earlier in the same iteration, so that no
+/// state carries from one iteration to the next. An iteration then computes
+/// the same thing as the one before it unless memory changes, which only a
+/// store or an event can do.
+static NODISCARD bool block_idle(const struct cpu_op *const ops,
+				 const uint len, const u32 paddr)
+{
+	u32 written = 0;
+	u32 read_first = 0;
+
+	if (len < 2) {
+		return false;
+	}
+
+	for (uint i = 0; i < len; ++i) {
+		const struct cpu_op *const op = &ops[i];
+		const uint index = cpu_instr_index_get(op->instr);
+		const bool branch = (i == (len - 2));
+		const bool jump = (index == (CPU_TBL_PRIMARY + CPU_OP_J));
+		u32 reads = 0;
+		u32 writes = 0;
+
+		switch (cpu_instr_fmts[index]) {
+		case CPU_FMT_SHIFT_IMM:
+			reads = 1U << op->rt;
+			writes = 1U << op->rd;
+			break;
+
+		case CPU_FMT_SHIFT_REG:
+		case CPU_FMT_ALU_REG:
+			reads = (1U << op->rs) | (1U << op->rt);
+			writes = 1U << op->rd;
+			break;
+
+		case CPU_FMT_ALU_SEXT_IMM:
+		case CPU_FMT_ALU_ZEXT_IMM:
+			reads = 1U << op->rs;
+			writes = 1U << op->rt;
+			break;
+
+		case CPU_FMT_LUI:
+			writes = 1U << op->rt;
+			break;
+
+		case CPU_FMT_LOAD:
+			// LWL and LWR merge into what is already there.
+			reads = 1U << op->rs;
+
+			if ((index == (CPU_TBL_PRIMARY + CPU_OP_LWL)) ||
+			    (index == (CPU_TBL_PRIMARY + CPU_OP_LWR))) {
+				reads |= 1U << op->rt;
+			}
+			writes = 1U << op->rt;
+			break;
+
+		case CPU_FMT_MF_HI_LO:
+			writes = 1U << op->rd;
+			break;
+
+		case CPU_FMT_BCOND:
+			// The linking forms write the return address.
+			if (!branch || (op->rt & 0x10)) {
+				return false;
+			}
+			reads = 1U << op->rs;
+			break;
+
+		case CPU_FMT_BRANCH_REG:
+			if (!branch) {
+				return false;
+			}
+			reads = (1U << op->rs) | (1U << op->rt);
+			break;
+
+		case CPU_FMT_BRANCH:
+			if (!branch) {
+				return false;
+			}
+			reads = 1U << op->rs;
+			break;
+
+		case CPU_FMT_JUMP:
+			if (!branch || !jump) {
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		// The branch must be the one which ended the block, and lead
+		// back to its start.
+		if (branch) {
+			const u32 off = (u32)((i + 1) * sizeof(u32)) +
+					(op->imm << 2);
+
+			if (jump ? (op->imm != (paddr & 0x0FFFFFFF)) : off) {
+				return false;
+			}
+		}
+
+		read_first |= reads & ~written;
+		written |= writes;
+	}
+
+	// r0 reads as zero whatever is written to it.
+	return !(read_first & written & ~1U);
+}
+
+static NODISCARD struct cpu_block *block_compile(struct psycho_ctx *const ctx,
+						 u32 paddr)
+{
+	struct cpu_op ops[BLOCK_LEN_MAX];
+	const u32 page_end = (paddr | PAGE_MASK) + 1;
+
+	uint len = 0;
+	bool delay_slot = false;
+	const u32 beg = paddr;
+
+	// A block ends after the delay slot of the first branch or jump, at the
+	// end of the page, or when it is full, whichever comes first. A block
+	// which ends on a branch leaves its delay slot to be stepped.
+	do {
+		const bool branch = cpu_decode(&ops[len++], bus_lw(ctx, paddr));
+		paddr += sizeof(u32);
+
+		if (delay_slot) {
+			break;
+		}
+		delay_slot = branch;
+	} while ((len < BLOCK_LEN_MAX) && (paddr != page_end));
+
+	struct cpu_block *const blk =
+		malloc(sizeof(*blk) + (len * sizeof(struct cpu_op)));
+
+	if (!blk) {
+		return NULL;
+	}
+
+	blk->code = NULL;
+	blk->link_sites[0] = NULL;
+	blk->link_sites[1] = NULL;
+	blk->len = len;
+	blk->idle = delay_slot && block_idle(ops, len, beg);
+
+	memcpy(blk->ops, ops, len * sizeof(struct cpu_op));
+
+	return blk;
+}
+
+static NODISCARD struct cpu_block *block_get(struct psycho_ctx *const ctx,
+					     const u32 paddr)
+{
+	const int index = page_index_get(paddr);
+
+	if (index < 0) {
+		return NULL;
+	}
+
+	struct psycho_cpu_cache_page *page = ctx->cpu.cache_pages[index];
+
+	if (!page) {
+		page = calloc(1, sizeof(*page));
+
+		if (!page) {
+			return NULL;
+		}
+		ctx->cpu.cache_pages[index] = page;
+	}
+
+	const uint slot = (paddr & PAGE_MASK) / sizeof(u32);
+
+	if (!page->blocks[slot]) {
+		page->blocks[slot] = block_compile(ctx, paddr);
+	}
+	return page->blocks[slot];
+}
+
+void cpu_cache_page_flush(struct psycho_ctx *const ctx, const uint page)
+{
+	struct psycho_cpu_cache_page *const p = ctx->cpu.cache_pages[page];
+
+	for (uint slot = 0; slot < PAGE_SLOTS_NUM; ++slot) {
+		free(p->blocks[slot]);
+	}
+
+	free(p);
+
+	ctx->cpu.cache_pages[page] = NULL;
+	ctx->cpu.block_exit = true;
+
+	cpu_jit_unlink(ctx);
+}
+
+void cpu_cache_flush(struct psycho_ctx *const ctx)
+{
+	for (uint page = 0; page < PSYCHO_CPU_CACHE_PAGES_NUM; ++page) {
+		if (ctx->cpu.cache_pages[page]) {
+			cpu_cache_page_flush(ctx, page);
+		}
+	}
+}
+
+static void block_run(struct psycho_ctx *const ctx)
+{
+	// If we are about to execute a delay slot, the instruction after it is
+	// not the next one in the block; step it on its own.
+	if (ctx->cpu.npc != (ctx->cpu.pc + sizeof(u32))) {
+		cpu_step(ctx);
+		ctx->cpu.run_left--;
+
+		return;
+	}
+
+	// This must happen before looking up the block, as it may discard
+	// every block there is.
+	const bool jit =
+		(ctx->cpu.mode == PSYCHO_CPU_MODE_JIT) && cpu_jit_prepare(ctx);
+
+	const u32 paddr = cpu_vaddr_to_paddr(ctx->cpu.pc);
+	struct cpu_block *const blk = block_get(ctx, paddr);
+
+	if (!blk) {
+		cpu_step(ctx);
+		ctx->cpu.run_left--;
+
+		return;
+	}
+
+	// Only run as much of the block as the budget allows, and stop short
+	// of the breakpoint if it lies within the block. If we are already at
+	// the breakpoint, we have been asked to move past it.
+	uint len = blk->len;
+	const u32 bp_dist = (ctx->cpu.bp - ctx->cpu.pc) / sizeof(u32);
+
+	if (bp_dist < len) {
+		len = (bp_dist != 0) ? bp_dist : 1;
+	}
+
+	if (ctx->cpu.run_left < len) {
+		len = (uint)ctx->cpu.run_left;
+	}
+
+	ctx->cpu.block_exit = false;
+
+	// The block may be freed while it runs, so decide this up front.
+	const u32 pc = ctx->cpu.pc;
+	const bool idle =
+		blk->idle && ctx->cpu.idle.enabled && (len == blk->len);
+
+	ctx->bus.timed_read = false;
+
+	if (!jit || (len != blk->len) || !cpu_jit_run(ctx, blk)) {
+		const struct cpu_op *const ops = blk->ops;
+		uint n = 0;
+
+		// If an instruction invalidated cached code, this block may
+		// have just been freed; stop without touching it again. The
+		// budget is counted down per instruction, as the interpreter
+		// does, so that devices see the same cycle.
+		do {
+			cpu_op_exec(ctx, &ops[n++]);
+			ctx->cpu.run_left--;
+		} while (!ctx->cpu.block_exit && (n != len));
+	}
+
+	// A whole iteration which went back to the start proves that the loop
+	// is stuck until an event changes what it polls; skip to the end of
+	// the slice, which is where the next event is due.
+	if (idle && !ctx->cpu.block_exit && (ctx->cpu.pc == pc) &&
+	    (pc != ctx->cpu.bp) && !ctx->bus.timed_read &&
+	    (ctx->cpu.run_left > 0)) {
+		ctx->cpu.idle.skips++;
+		ctx->cpu.idle.cycles += (u64)ctx->cpu.run_left;
+		ctx->cpu.run_left = 0;
+	}
+
+	ctx->cpu.instr = cpu_instr_fetch(ctx);
+}
+
+void cpu_cache_run(struct psycho_ctx *const ctx)
+{
+	do {
+		block_run(ctx);
+	} while ((ctx->cpu.run_left > 0) && (ctx->cpu.pc != ctx->cpu.bp) &&
+		 !ctx->cpu.halted && !hle_pending(ctx));
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_cache.h Provides the interface for the block cache, which decodes
+/// basic blocks once and replays them on subsequent visits.
+
+#pragma once
+
+#include "compiler.h"
+#include "cpu.h"
+#include "psycho/ctx.h"
+
+/// @brief The maximum number of instructions in a block.
+#define CPU_CACHE_BLOCK_LEN_MAX (64)
+
+struct cpu_block {
+	/// @brief The translated code of this block, if it has been translated.
+	void (*code)(struct psycho_ctx *ctx);
+
+	/// @brief The patchable exits of the translated code, if any.
+	u8 *link_sites[2];
+
+	/// @brief The program counter each exit is linked to.
+	u32 link_pcs[2];
+
+	/// @brief The value of psycho_cpu::jit_gen when each exit was linked.
+	u32 link_gens[2];
+
+	/// @brief The number of instructions in this block.
+	uint len;
+
+	/// @brief Whether this block is an idle loop: it branches back to its
+	/// own start, and an iteration which does so leaves the machine as it
+	/// found it unless memory changes under it.
+	bool idle;
+	u8 pad[3];
+
+	/// @brief The pre-decoded instructions of this block.
+	struct cpu_op ops[];
+};
+
+void cpu_cache_page_flush(struct psycho_ctx *ctx, uint page);
+void cpu_cache_flush(struct psycho_ctx *ctx);
+
+/// @brief Executes at least one instruction, and then whole basic blocks (which
+/// are decoded and cached first if necessary) until psycho_cpu::run_left is
+/// exhausted, the program counter reaches psycho_cpu::bp, execution is halted,
+/// or a kernel call may be serviced natively.
+void cpu_cache_run(struct psycho_ctx *ctx);
+
+/// @brief Invalidates any cached code in RAM covering a physical address.
+///
+/// This must be called on every write to RAM; it is a single load and branch
+/// if no code has been cached from the page in question.
+ALWAYS_INLINE void cpu_cache_ram_written(struct psycho_ctx *const ctx,
+					 const u32 paddr)
+{
+	const uint page = paddr >> PSYCHO_CPU_CACHE_PAGE_SHIFT;
+
+	if (ctx->cpu.cache_pages[page]) {
+		cpu_cache_page_flush(ctx, page);
+	}
+}
@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include "compiler.h"
 #include "psycho/types.h"
 
@@ -123,6 +125,151 @@
 #define CPU_OP_XOR	(0x26)
 #define CPU_OP_XORI	(0x0E)
 
+///@{
+/// @brief Instructions are identified by their index into a single table,
+/// which is made up of the following sub-tables, each indexed by a different
+/// field of the instruction.
+#define CPU_TBL_PRIMARY		(0)	// op
+#define CPU_TBL_SPECIAL		(64)	// funct, if op is SPECIAL
+#define CPU_TBL_COP0		(128)	// rs, if op is COP0 and CO is clear
+#define CPU_TBL_COP0_CO		(144)	// funct, if op is COP0 and CO is set
+#define CPU_TBL_COP2		(208)	// rs, if op is COP2 and CO is clear
+#define CPU_TBL_COP2_CO		(224)	// funct, if op is COP2 and CO is set
+#define CPU_TBL_SIZE		(288)
+///@}
+
+/// @brief The bit of a coprocessor instruction which marks it as a command to
+/// the coprocessor rather than a register transfer.
+#define CPU_INSTR_CO		(1 << 25)
+
+///@{
+/// @brief Instruction formats, which determine how the operands of an
+/// instruction are decoded and disassembled.
+#define CPU_FMT_NONE		(0)	// (none)
+#define CPU_FMT_SHIFT_IMM	(1)	// rd, rt, shamt
+#define CPU_FMT_SHIFT_REG	(2)	// rd, rt, rs
+#define CPU_FMT_JR		(3)	// rs
+#define CPU_FMT_JALR		(4)	// rd, rs
+#define CPU_FMT_MF_HI_LO	(5)	// rd
+#define CPU_FMT_MT_HI_LO	(6)	// rs
+#define CPU_FMT_MULT_DIV	(7)	// rs, rt
+#define CPU_FMT_ALU_REG		(8)	// rd, rs, rt
+#define CPU_FMT_BCOND		(9)	// rs, offset
+#define CPU_FMT_JUMP		(10)	// target
+#define CPU_FMT_BRANCH_REG	(11)	// rs, rt, offset
+#define CPU_FMT_BRANCH		(12)	// rs, offset
+#define CPU_FMT_ALU_SEXT_IMM	(13)	// rt, rs, sign-extended immediate
+#define CPU_FMT_ALU_ZEXT_IMM	(14)	// rt, rs, zero-extended immediate
+#define CPU_FMT_LUI		(15)	// rt, immediate
+#define CPU_FMT_LOAD		(16)	// rt, offset(base)
+#define CPU_FMT_STORE		(17)	// rt, offset(base)
+#define CPU_FMT_MFC0		(18)	// rt, rd
+#define CPU_FMT_MTC0		(19)	// rt, rd
+#define CPU_FMT_MFC2		(20)	// rt, rd
+#define CPU_FMT_CFC2		(21)	// rt, rd
+#define CPU_FMT_MTC2		(22)	// rt, rd
+#define CPU_FMT_CTC2		(23)	// rt, rd
+#define CPU_FMT_NUM		(24)
+///@}
+
+/// @brief Lists every instruction as X(table, name, mnemonic, format), where
+/// the instruction's index is CPU_TBL_<table> + CPU_OP_<name>, and its format
+/// is CPU_FMT_<format>.
+///
+/// Anything which needs to know the set of instructions (the interpreter's
+/// dispatch tables, the disassembler, etc.) is generated from this list, so
+/// they cannot disagree with each other.
+#define CPU_INSTR_LIST(X)					\
+	X(PRIMARY, GROUP_BCOND,	bcond,		BCOND)		\
+	X(PRIMARY, J,		j,		JUMP)		\
+	X(PRIMARY, JAL,		jal,		JUMP)		\
+	X(PRIMARY, BEQ,		beq,		BRANCH_REG)	\
+	X(PRIMARY, BNE,		bne,		BRANCH_REG)	\
+	X(PRIMARY, BLEZ,	blez,		BRANCH)		\
+	X(PRIMARY, BGTZ,	bgtz,		BRANCH)		\
+	X(PRIMARY, ADDI,	addi,		ALU_SEXT_IMM)	\
+	X(PRIMARY, ADDIU,	addiu,		ALU_SEXT_IMM)	\
+	X(PRIMARY, SLTI,	slti,		ALU_SEXT_IMM)	\
+	X(PRIMARY, SLTIU,	sltiu,		ALU_SEXT_IMM)	\
+	X(PRIMARY, ANDI,	andi,		ALU_ZEXT_IMM)	\
+	X(PRIMARY, ORI,		ori,		ALU_ZEXT_IMM)	\
+	X(PRIMARY, XORI,	xori,		ALU_ZEXT_IMM)	\
+	X(PRIMARY, LUI,		lui,		LUI)		\
+	X(PRIMARY, LB,		lb,		LOAD)		\
+	X(PRIMARY, LH,		lh,		LOAD)		\
+	X(PRIMARY, LWL,		lwl,		LOAD)		\
+	X(PRIMARY, LW,		lw,		LOAD)		\
+	X(PRIMARY, LBU,		lbu,		LOAD)		\
+	X(PRIMARY, LHU,		lhu,		LOAD)		\
+	X(PRIMARY, LWR,		lwr,		LOAD)		\
+	X(PRIMARY, SB,		sb,		STORE)		\
+	X(PRIMARY, SH,		sh,		STORE)		\
+	X(PRIMARY, SWL,		swl,		STORE)		\
+	X(PRIMARY, SW,		sw,		STORE)		\
+	X(PRIMARY, SWR,		swr,		STORE)		\
+	X(PRIMARY, LWC2,	lwc2,		NONE)		\
+	X(PRIMARY, SWC2,	swc2,		NONE)		\
+								\
+	X(SPECIAL, SLL,		sll,		SHIFT_IMM)	\
+	X(SPECIAL, SRL,		srl,		SHIFT_IMM)	\
+	X(SPECIAL, SRA,		sra,		SHIFT_IMM)	\
+	X(SPECIAL, SLLV,	sllv,		SHIFT_REG)	\
+	X(SPECIAL, SRLV,	srlv,		SHIFT_REG)	\
+	X(SPECIAL, SRAV,	srav,		SHIFT_REG)	\
+	X(SPECIAL, JR,		jr,		JR)		\
+	X(SPECIAL, JALR,	jalr,		JALR)		\
+	X(SPECIAL, SYSCALL,	syscall,	NONE)		\
+	X(SPECIAL, BREAK,	break,		NONE)		\
+	X(SPECIAL, MFHI,	mfhi,		MF_HI_LO)	\
+	X(SPECIAL, MTHI,	mthi,		MT_HI_LO)	\
+	X(SPECIAL, MFLO,	mflo,		MF_HI_LO)	\
+	X(SPECIAL, MTLO,	mtlo,		MT_HI_LO)	\
+	X(SPECIAL, MULT,	mult,		MULT_DIV)	\
+	X(SPECIAL, MULTU,	multu,		MULT_DIV)	\
+	X(SPECIAL, DIV,		div,		MULT_DIV)	\
+	X(SPECIAL, DIVU,	divu,		MULT_DIV)	\
+	X(SPECIAL, ADD,		add,		ALU_REG)	\
+	X(SPECIAL, ADDU,	addu,		ALU_REG)	\
+	X(SPECIAL, SUB,		sub,		ALU_REG)	\
+	X(SPECIAL, SUBU,	subu,		ALU_REG)	\
+	X(SPECIAL, AND,		and,		ALU_REG)	\
+	X(SPECIAL, OR,		or,		ALU_REG)	\
+	X(SPECIAL, XOR,		xor,		ALU_REG)	\
+	X(SPECIAL, NOR,		nor,		ALU_REG)	\
+	X(SPECIAL, SLT,		slt,		ALU_REG)	\
+	X(SPECIAL, SLTU,	sltu,		ALU_REG)	\
+								\
+	X(COP0,	   MF,		mfc0,		MFC0)		\
+	X(COP0,	   MT,		mtc0,		MTC0)		\
+	X(COP0_CO, RFE,		rfe,		NONE)		\
+								\
+	X(COP2,	   MF,		mfc2,		MFC2)		\
+	X(COP2,	   CF,		cfc2,		CFC2)		\
+	X(COP2,	   MT,		mtc2,		MTC2)		\
+	X(COP2,	   CT,		ctc2,		CTC2)		\
+	X(COP2_CO, RTPS,	rtps,		NONE)		\
+	X(COP2_CO, NCLIP,	nclip,		NONE)		\
+	X(COP2_CO, OP,		op,		NONE)		\
+	X(COP2_CO, DPCS,	dpcs,		NONE)		\
+	X(COP2_CO, INTPL,	intpl,		NONE)		\
+	X(COP2_CO, MVMVA,	mvmva,		NONE)		\
+	X(COP2_CO, NCDS,	ncds,		NONE)		\
+	X(COP2_CO, CDP,		cdp,		NONE)		\
+	X(COP2_CO, NCDT,	ncdt,		NONE)		\
+	X(COP2_CO, NCCS,	nccs,		NONE)		\
+	X(COP2_CO, CC,		cc,		NONE)		\
+	X(COP2_CO, NCS,		ncs,		NONE)		\
+	X(COP2_CO, NCT,		nct,		NONE)		\
+	X(COP2_CO, SQR,		sqr,		NONE)		\
+	X(COP2_CO, DCPL,	dcpl,		NONE)		\
+	X(COP2_CO, DPCT,	dpct,		NONE)		\
+	X(COP2_CO, AVSZ3,	avsz3,		NONE)		\
+	X(COP2_CO, AVSZ4,	avsz4,		NONE)		\
+	X(COP2_CO, RTPT,	rtpt,		NONE)		\
+	X(COP2_CO, GPF,		gpf,		NONE)		\
+	X(COP2_CO, GPL,		gpl,		NONE)		\
+	X(COP2_CO, NCCT,	ncct,		NONE)
+
 #define CPU_GPR_zero	(0)
 #define CPU_GPR_at	(1)
 #define CPU_GPR_v0	(2)
@@ -244,6 +391,9 @@
 #define CPU_CP0_CPR_REG_SR	(12)
 #define CPU_CP0_CPR_REG_SR_IsC	(1 << 16)
 
+/// @brief The interrupt pending bit the interrupt controller drives.
+#define CPU_CP0_CPR_REG_Cause_IP2	(1 << 10)
+
 // clang-format on
 
 /// @brief Retrieves the 6-bit operation code from an instruction.
@@ -351,6 +501,33 @@ ALWAYS_INLINE NODISCARD u32 cpu_instr_offset_get(const u32 instr)
 	return cpu_instr_sext_imm_get(instr);
 }
 
+/// @brief Retrieves the index of an instruction into the tables generated from
+/// CPU_INSTR_LIST.
+/// @param instr The instruction in question.
+/// @returns The index of the instruction; entries no instruction is listed for
+/// are reserved instructions.
+ALWAYS_INLINE NODISCARD uint cpu_instr_index_get(const u32 instr)
+{
+	const uint op = cpu_instr_op_get(instr);
+	const bool co = instr & CPU_INSTR_CO;
+
+	switch (op) {
+	case CPU_OP_GROUP_SPECIAL:
+		return CPU_TBL_SPECIAL + cpu_instr_funct_get(instr);
+
+	case CPU_OP_GROUP_COP0:
+		return co ? (CPU_TBL_COP0_CO + cpu_instr_funct_get(instr)) :
+			    (CPU_TBL_COP0 + cpu_instr_rs_get(instr));
+
+	case CPU_OP_GROUP_COP2:
+		return co ? (CPU_TBL_COP2_CO + cpu_instr_funct_get(instr)) :
+			    (CPU_TBL_COP2 + cpu_instr_rs_get(instr));
+
+	default:
+		return CPU_TBL_PRIMARY + op;
+	}
+}
+
 ALWAYS_INLINE NODISCARD u32 cpu_jmp_tgt_get(const u32 instr, const u32 pc)
 {
 	return (cpu_instr_target_get(instr) << 2) | (pc & 0xF0000000);
@@ -367,3 +544,6 @@ ALWAYS_INLINE NODISCARD u32 cpu_vaddr_to_paddr(const u32 vaddr)
 }
 
 extern const char *const exc_code_names[];
+
+/// @brief The format of each instruction; one of CPU_FMT_*.
+extern const u8 cpu_instr_fmts[CPU_TBL_SIZE];
@@ -0,0 +1,1151 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_jit.c Defines the implementation of the x86-64 dynamic recompiler.
+///
+/// The recompiler works on the blocks produced by the block cache. Most
+/// instructions are translated into native code operating directly on the
+/// registers stored in the context; loads and stores call the bus, and
+/// anything else calls the instruction's handler, so every instruction the
+/// interpreter supports is supported here as well.
+///
+/// The program counters are only written back when something could observe
+/// them (a call, a branch, or the end of the block), but always with the values
+/// cpu_step() would have produced, so the architectural state after a block is
+/// identical to interpreting it.
+///
+/// A translated block ends with two patchable exits. Once the dispatcher sees
+/// which block follows another, the first block's exit is patched to compare
+/// the program counter against the one observed and jump straight into the
+/// next block's code, so hot paths run without returning to the dispatcher.
+/// Exits are only followed while psycho_cpu::jit_gen matches the value it had
+/// when they were patched, which lets us break every link at once when code is
+/// discarded, and while psycho_cpu::run_left can pay for the whole of the next
+/// block. If a block stops early, the instructions it did not execute are
+/// given back, so the budget is always exact.
+/// Before calling out to anything which may read the current cycle, a block
+/// records how much of what it was charged lies ahead, so that devices see the
+/// same cycle as they would with the interpreter.
+///
+/// Generated code keeps the context in RBX; everything else is scratch.
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "bus.h"
+#include "cpu.h"
+#include "cpu_cache.h"
+#include "cpu_defs.h"
+#include "cpu_jit.h"
+#include "hle.h"
+
+// clang-format off
+
+/// @brief The size of the code buffer (in bytes).
+#define BUF_SIZE	(32 * 1024 * 1024)
+
+/// @brief An upper bound on the amount of code one block translates to (in
+/// bytes).
+#define BLOCK_CODE_MAX	(64 * 1024)
+
+// clang-format on
+
+#ifdef __x86_64__
+
+// clang-format off
+
+#define ra	(CPU_GPR_ra)
+
+#define GROUP_SPECIAL	(CPU_OP_GROUP_SPECIAL)
+#define GROUP_BCOND	(CPU_OP_GROUP_BCOND)
+#define GROUP_COP0	(CPU_OP_GROUP_COP0)
+
+#define ADD	(CPU_OP_ADD)
+#define ADDI	(CPU_OP_ADDI)
+#define ADDIU	(CPU_OP_ADDIU)
+#define ADDU	(CPU_OP_ADDU)
+#define AND	(CPU_OP_AND)
+#define ANDI	(CPU_OP_ANDI)
+#define BEQ	(CPU_OP_BEQ)
+#define BGTZ	(CPU_OP_BGTZ)
+#define BLEZ	(CPU_OP_BLEZ)
+#define BNE	(CPU_OP_BNE)
+#define J	(CPU_OP_J)
+#define JAL	(CPU_OP_JAL)
+#define JALR	(CPU_OP_JALR)
+#define JR	(CPU_OP_JR)
+#define OR	(CPU_OP_OR)
+#define ORI	(CPU_OP_ORI)
+#define LB	(CPU_OP_LB)
+#define LBU	(CPU_OP_LBU)
+#define LH	(CPU_OP_LH)
+#define LHU	(CPU_OP_LHU)
+#define LUI	(CPU_OP_LUI)
+#define LW	(CPU_OP_LW)
+#define MF	(CPU_OP_MF)
+#define MFHI	(CPU_OP_MFHI)
+#define MFLO	(CPU_OP_MFLO)
+#define MT	(CPU_OP_MT)
+#define SB	(CPU_OP_SB)
+#define SH	(CPU_OP_SH)
+#define SLL	(CPU_OP_SLL)
+#define SLT	(CPU_OP_SLT)
+#define SLTI	(CPU_OP_SLTI)
+#define SLTIU	(CPU_OP_SLTIU)
+#define SLTU	(CPU_OP_SLTU)
+#define SRA	(CPU_OP_SRA)
+#define SRL	(CPU_OP_SRL)
+#define SUBU	(CPU_OP_SUBU)
+#define SW	(CPU_OP_SW)
+
+#define EAX	(0)
+#define ECX	(1)
+#define EDX	(2)
+#define EBX	(3)
+#define ESI	(6)
+
+///@{
+/// @brief The /digit of each group 1 (opcode 0x81) instruction.
+#define GRP1_ADD	(0)
+#define GRP1_OR		(1)
+#define GRP1_AND	(4)
+#define GRP1_SUB	(5)
+#define GRP1_CMP	(7)
+///@}
+
+///@{
+/// @brief The opcode of each "op r32, r/m32" instruction.
+#define RM_ADD		(0x03)
+#define RM_OR		(0x0B)
+#define RM_AND		(0x23)
+#define RM_SUB		(0x2B)
+#define RM_CMP		(0x3B)
+#define RM_STORE	(0x89)
+#define RM_LOAD		(0x8B)
+///@}
+
+///@{
+/// @brief The second byte of each "shift r32, imm8" instruction on EAX.
+#define SHIFT_SHL	(0xE0)
+#define SHIFT_SHR	(0xE8)
+#define SHIFT_SAR	(0xF8)
+///@}
+
+///@{
+/// @brief The second byte of each "setcc r8" instruction.
+#define SET_B		(0x92)
+#define SET_L		(0x9C)
+///@}
+
+///@{
+/// @brief The opcode of each short conditional jump.
+#define JCC_E		(0x74)
+#define JCC_NE		(0x75)
+#define JCC_L		(0x7C)
+#define JCC_LE		(0x7E)
+#define JCC_G		(0x7F)
+///@}
+
+/// @brief The opcode of the short unconditional jump; it is patched the same
+/// way.
+#define JMP_SHORT	(0xEB)
+
+///@{
+/// @brief The second byte of each zero or sign extension instruction.
+#define EXT_NONE	(0x00)
+#define EXT_ZX8		(0xB6)
+#define EXT_ZX16	(0xB7)
+#define EXT_SX8		(0xBE)
+#define EXT_SX16	(0xBF)
+///@}
+
+#define OFF_GPR(reg)	((u32)offsetof(struct psycho_ctx, cpu.gpr[(reg)]))
+#define OFF_CP0(reg)	((u32)offsetof(struct psycho_ctx, cpu.cp0_cpr[(reg)]))
+#define OFF_PC		((u32)offsetof(struct psycho_ctx, cpu.pc))
+#define OFF_NPC		((u32)offsetof(struct psycho_ctx, cpu.npc))
+#define OFF_HI		((u32)offsetof(struct psycho_ctx, cpu.hi))
+#define OFF_LO		((u32)offsetof(struct psycho_ctx, cpu.lo))
+#define OFF_EXIT	((u32)offsetof(struct psycho_ctx, cpu.block_exit))
+#define OFF_LAST	((u32)offsetof(struct psycho_ctx, cpu.jit_last))
+#define OFF_GEN		((u32)offsetof(struct psycho_ctx, cpu.jit_gen))
+#define OFF_LEFT	((u32)offsetof(struct psycho_ctx, cpu.run_left))
+#define OFF_AHEAD	((u32)offsetof(struct psycho_ctx, cpu.jit_ahead))
+#define OFF_SCRATCHPAD	((u32)offsetof(struct psycho_ctx, bus.scratchpad))
+
+/// @brief The size of the prologue; links jump just past it.
+#define PROLOGUE_SIZE	(4)
+
+///@{
+/// @brief The layout of a patchable exit.
+#define SITE_PC		(1)
+#define SITE_GEN	(13)
+#define SITE_LEN_CMP	(26)
+#define SITE_LEN_SUB	(39)
+#define SITE_REL	(44)
+#define SITE_SIZE	(48)
+///@}
+
+// clang-format on
+
+struct jit {
+	/// @brief The current write position.
+	u8 *p;
+
+	/// @brief The rel32 fields which must be patched to jump to the
+	/// epilogue.
+	u8 *exits[CPU_CACHE_BLOCK_LEN_MAX];
+	uint exits_num;
+
+	/// @brief The number of instructions left unexecuted by each exit.
+	u32 exits_left[CPU_CACHE_BLOCK_LEN_MAX];
+
+	/// @brief The values of the program counters in memory, relative to the
+	/// program counter the block was entered with.
+	u32 pc_off;
+	u32 npc_off;
+
+	/// @brief The number of instructions of the block from the one being
+	/// translated to the end.
+	u32 ahead;
+
+	/// @brief The base of the fastmem region, or NULL if loads must call
+	/// the bus.
+	const u8 *fastmem;
+};
+
+static void emit8(struct jit *const j, const uint byte)
+{
+	*j->p++ = (u8)byte;
+}
+
+static void emit32(struct jit *const j, const u32 word)
+{
+	memcpy(j->p, &word, sizeof(word));
+	j->p += sizeof(word);
+}
+
+static void emit64(struct jit *const j, const u64 dword)
+{
+	memcpy(j->p, &dword, sizeof(dword));
+	j->p += sizeof(dword);
+}
+
+/// @brief Emits "op reg, [rbx + disp]" or "op [rbx + disp], reg".
+static void emit_rm(struct jit *const j, const uint opcode, const uint reg,
+		    const u32 disp)
+{
+	emit8(j, opcode);
+	emit8(j, 0x80 | (reg << 3) | EBX);
+	emit32(j, disp);
+}
+
+/// @brief Emits "op dword [rbx + disp], imm32".
+static void emit_mi(struct jit *const j, const uint opcode, const uint digit,
+		    const u32 disp, const u32 imm)
+{
+	emit8(j, opcode);
+	emit8(j, 0x80 | (digit << 3) | EBX);
+	emit32(j, disp);
+	emit32(j, imm);
+}
+
+/// @brief Emits "op reg, imm32" for a group 1 instruction.
+static void emit_ri(struct jit *const j, const uint digit, const uint reg,
+		    const u32 imm)
+{
+	emit8(j, 0x81);
+	emit8(j, 0xC0 | (digit << 3) | reg);
+	emit32(j, imm);
+}
+
+static void emit_add_mem(struct jit *const j, const u32 disp, const u32 imm)
+{
+	if (imm != 0) {
+		emit_mi(j, 0x81, GRP1_ADD, disp, imm);
+	}
+}
+
+/// @brief Emits a short conditional jump to be patched by jcc_patch().
+static NODISCARD u8 *emit_jcc(struct jit *const j, const uint opcode)
+{
+	emit8(j, opcode);
+	emit8(j, 0x00);
+
+	return j->p;
+}
+
+static void jcc_patch(const struct jit *const j, u8 *const end)
+{
+	end[-1] = (u8)(j->p - end);
+}
+
+/// @brief Emits a call to a function taking the context as its first argument.
+static void emit_call(struct jit *const j, const void *const fn)
+{
+	// mov rdi, rbx
+	emit8(j, 0x48);
+	emit8(j, 0x89);
+	emit8(j, 0xDF);
+
+	// mov rax, imm64
+	emit8(j, 0x48);
+	emit8(j, 0xB8);
+	emit64(j, (u64)(uintptr_t)fn);
+
+	// call rax
+	emit8(j, 0xFF);
+	emit8(j, 0xD0);
+}
+
+/// @brief Emits a jump to the epilogue if the block must stop early.
+///
+/// @param left The number of instructions of the block after this point.
+static void emit_exit_chk(struct jit *const j, const u32 left)
+{
+	// cmp byte [rbx + OFF_EXIT], 0
+	emit8(j, 0x80);
+	emit8(j, 0x80 | (GRP1_CMP << 3) | EBX);
+	emit32(j, OFF_EXIT);
+	emit8(j, 0x00);
+
+	// jne rel32
+	emit8(j, 0x0F);
+	emit8(j, 0x85);
+	emit32(j, 0);
+
+	j->exits[j->exits_num] = j->p;
+	j->exits_left[j->exits_num++] = left;
+}
+
+/// @brief Records how far ahead of the current instruction the block was
+/// charged for, before calling out to code which may read the current cycle.
+static void emit_ahead(struct jit *const j)
+{
+	// mov dword [rbx + OFF_AHEAD], imm32
+	emit_mi(j, 0xC7, 0, OFF_AHEAD, j->ahead);
+}
+
+/// @brief Writes back the program counters, given relative to the program
+/// counter the block was entered with.
+static void pcs_sync(struct jit *const j, const u32 pc, const u32 npc)
+{
+	emit_add_mem(j, OFF_PC, pc - j->pc_off);
+	emit_add_mem(j, OFF_NPC, npc - j->npc_off);
+
+	j->pc_off = pc;
+	j->npc_off = npc;
+}
+
+/// @brief Advances the program counters for the instruction in a delay slot,
+/// exactly as cpu_op_exec() does; the branch left them unknown to us.
+static void emit_delay_slot_pcs(struct jit *const j)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_NPC);
+
+	// lea ecx, [rax - 4]
+	emit8(j, 0x8D);
+	emit8(j, 0x48);
+	emit8(j, 0xFC);
+
+	emit_rm(j, RM_STORE, ECX, OFF_PC);
+	emit_ri(j, GRP1_ADD, EAX, sizeof(u32));
+	emit_rm(j, RM_STORE, EAX, OFF_NPC);
+}
+
+static void emit_shift(struct jit *const j, const struct cpu_op *const op,
+		       const uint shift)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rt));
+
+	emit8(j, 0xC1);
+	emit8(j, shift);
+	emit8(j, op->shamt);
+
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(op->rd));
+}
+
+static void emit_alu_reg(struct jit *const j, const struct cpu_op *const op,
+			 const uint opcode)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+	emit_rm(j, opcode, EAX, OFF_GPR(op->rt));
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(op->rd));
+}
+
+static void emit_alu_imm(struct jit *const j, const struct cpu_op *const op,
+			 const uint digit)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+	emit_ri(j, digit, EAX, op->imm);
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(op->rt));
+}
+
+static void emit_setcc(struct jit *const j, const uint setcc, const uint reg)
+{
+	// setcc al
+	emit8(j, 0x0F);
+	emit8(j, setcc);
+	emit8(j, 0xC0);
+
+	// movzx eax, al
+	emit8(j, 0x0F);
+	emit8(j, EXT_ZX8);
+	emit8(j, 0xC0);
+
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(reg));
+}
+
+static void emit_set_reg(struct jit *const j, const struct cpu_op *const op,
+			 const uint setcc)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+	emit_rm(j, RM_CMP, EAX, OFF_GPR(op->rt));
+	emit_setcc(j, setcc, op->rd);
+}
+
+static void emit_set_imm(struct jit *const j, const struct cpu_op *const op,
+			 const uint setcc)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+	emit_ri(j, GRP1_CMP, EAX, op->imm);
+	emit_setcc(j, setcc, op->rt);
+}
+
+static void emit_move(struct jit *const j, const u32 dst, const u32 src)
+{
+	emit_rm(j, RM_LOAD, EAX, src);
+	emit_rm(j, RM_STORE, EAX, dst);
+}
+
+/// @brief Returns the size of an access made with the given extension.
+static NODISCARD u32 ext_size(const uint ext)
+{
+	switch (ext) {
+	case EXT_ZX8:
+	case EXT_SX8:
+		return sizeof(u8);
+
+	case EXT_ZX16:
+	case EXT_SX16:
+		return sizeof(u16);
+
+	default:
+		return sizeof(u32);
+	}
+}
+
+/// @brief Emits code to compute the virtual address of a load or store into
+/// EAX.
+static void emit_vaddr(struct jit *const j, const struct cpu_op *const op)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+	emit_ri(j, GRP1_ADD, EAX, op->imm);
+}
+
+/// @brief Emits code to test whether the virtual address in EAX lies in the
+/// scratchpad. If it does, EAX is turned into the offset of an access of
+/// @p size bytes; otherwise, the returned jump is taken.
+static NODISCARD u8 *emit_scratchpad_test(struct jit *const j, const u32 size)
+{
+	// mov ecx, eax
+	emit8(j, 0x89);
+	emit8(j, 0xC1);
+
+	emit_ri(j, GRP1_AND, ECX, CPU_SCRATCHPAD_SEG_MASK);
+	emit_ri(j, GRP1_CMP, ECX, PSYCHO_BUS_SCRATCHPAD_BEG);
+
+	u8 *const miss = emit_jcc(j, JCC_NE);
+
+	emit_ri(j, GRP1_AND, EAX, PSYCHO_BUS_SCRATCHPAD_SIZE - size);
+	return miss;
+}
+
+/// @brief Emits code to turn the virtual address in EAX into a physical one,
+/// and copy it to ESI, the second argument register.
+static void emit_paddr(struct jit *const j)
+{
+	emit_ri(j, GRP1_AND, EAX, 0x1FFFFFFF);
+
+	// mov esi, eax
+	emit8(j, 0x89);
+	emit8(j, 0xC6);
+}
+
+/// @brief Loads the base of the fastmem region into RDI. Together with the
+/// physical address in RSI, this is the form the fault handler expects.
+static void emit_fastmem_base(struct jit *const j)
+{
+	// mov rdi, imm64
+	emit8(j, 0x48);
+	emit8(j, 0xBF);
+	emit64(j, (u64)(uintptr_t)j->fastmem);
+}
+
+static void emit_load(struct jit *const j, const struct cpu_op *const op,
+		      const void *const fn, const uint ext)
+{
+	const uint zx = ((ext == EXT_ZX16) || (ext == EXT_SX16)) ? EXT_ZX16 :
+								   EXT_ZX8;
+
+	emit_vaddr(j, op);
+
+	u8 *const miss = emit_scratchpad_test(j, ext_size(ext));
+
+	// mov{,zx} eax, [rbx + rax + OFF_SCRATCHPAD]
+	if (ext == EXT_NONE) {
+		emit8(j, 0x8B);
+	} else {
+		emit8(j, 0x0F);
+		emit8(j, zx);
+	}
+	emit8(j, 0x84);
+	emit8(j, 0x03);
+	emit32(j, OFF_SCRATCHPAD);
+
+	u8 *const hit = emit_jcc(j, JMP_SHORT);
+
+	// Accesses which fault with fastmem reach the devices too.
+	jcc_patch(j, miss);
+	emit_ahead(j);
+	emit_paddr(j);
+
+	if (!j->fastmem) {
+		emit_call(j, fn);
+	} else if (ext == EXT_NONE) {
+		emit_fastmem_base(j);
+
+		// mov eax, [rdi + rsi]
+		emit8(j, 0x8B);
+		emit8(j, 0x04);
+		emit8(j, 0x37);
+	} else {
+		emit_fastmem_base(j);
+
+		// movzx eax, {byte,word} [rdi + rsi]
+		emit8(j, 0x0F);
+		emit8(j, zx);
+		emit8(j, 0x04);
+		emit8(j, 0x37);
+	}
+	jcc_patch(j, hit);
+
+	if (ext != EXT_NONE) {
+		// mov{zx,sx} eax, {al,ax}
+		emit8(j, 0x0F);
+		emit8(j, ext);
+		emit8(j, 0xC0);
+	}
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(op->rt));
+}
+
+static void emit_store(struct jit *const j, const struct cpu_op *const op,
+		       const void *const fn, const uint ext)
+{
+	emit_vaddr(j, op);
+	emit_rm(j, RM_LOAD, EDX, OFF_GPR(op->rt));
+
+	if (ext != EXT_NONE) {
+		// movzx edx, {dl,dx}
+		emit8(j, 0x0F);
+		emit8(j, ext);
+		emit8(j, 0xD2);
+	}
+
+	u8 *const miss = emit_scratchpad_test(j, ext_size(ext));
+
+	// mov [rbx + rax + OFF_SCRATCHPAD], {dl,dx,edx}
+	if (ext == EXT_ZX8) {
+		emit8(j, 0x88);
+	} else {
+		if (ext == EXT_ZX16) {
+			emit8(j, 0x66);
+		}
+		emit8(j, 0x89);
+	}
+	emit8(j, 0x94);
+	emit8(j, 0x03);
+	emit32(j, OFF_SCRATCHPAD);
+
+	u8 *const hit = emit_jcc(j, JMP_SHORT);
+
+	jcc_patch(j, miss);
+	emit_ahead(j);
+	emit_paddr(j);
+	emit_call(j, fn);
+	jcc_patch(j, hit);
+}
+
+/// @brief Emits code to set the next program counter to the program counter
+/// plus an offset.
+static void emit_npc_rel(struct jit *const j, const u32 offset)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_PC);
+	emit_ri(j, GRP1_ADD, EAX, offset);
+	emit_rm(j, RM_STORE, EAX, OFF_NPC);
+}
+
+static void emit_branch(struct jit *const j, const struct cpu_op *const op,
+			const uint jcc_skip)
+{
+	u8 *const skip = emit_jcc(j, jcc_skip);
+
+	emit_npc_rel(j, (op->imm << 2) + sizeof(u32));
+	jcc_patch(j, skip);
+}
+
+static void emit_jmp(struct jit *const j, const struct cpu_op *const op)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_PC);
+	emit_ri(j, GRP1_AND, EAX, 0xF0000000);
+	emit_ri(j, GRP1_OR, EAX, op->imm);
+	emit_rm(j, RM_STORE, EAX, OFF_NPC);
+}
+
+static void emit_link(struct jit *const j, const uint reg)
+{
+	emit_rm(j, RM_LOAD, EAX, OFF_PC);
+	emit_ri(j, GRP1_ADD, EAX, 8);
+	emit_rm(j, RM_STORE, EAX, OFF_GPR(reg));
+}
+
+/// @brief Translates an instruction which neither calls out nor observes the
+/// program counters.
+///
+/// @returns true if the instruction was translated, false otherwise.
+static NODISCARD bool translate_pure(struct jit *const j,
+				     const struct cpu_op *const op)
+{
+	switch (cpu_instr_op_get(op->instr)) {
+	case GROUP_SPECIAL:
+		switch (cpu_instr_funct_get(op->instr)) {
+		case SLL:
+			emit_shift(j, op, SHIFT_SHL);
+			return true;
+
+		case SRL:
+			emit_shift(j, op, SHIFT_SHR);
+			return true;
+
+		case SRA:
+			emit_shift(j, op, SHIFT_SAR);
+			return true;
+
+		case MFHI:
+			emit_move(j, OFF_GPR(op->rd), OFF_HI);
+			return true;
+
+		case MFLO:
+			emit_move(j, OFF_GPR(op->rd), OFF_LO);
+			return true;
+
+		case ADD:
+		case ADDU:
+			emit_alu_reg(j, op, RM_ADD);
+			return true;
+
+		case SUBU:
+			emit_alu_reg(j, op, RM_SUB);
+			return true;
+
+		case AND:
+			emit_alu_reg(j, op, RM_AND);
+			return true;
+
+		case OR:
+			emit_alu_reg(j, op, RM_OR);
+			return true;
+
+		case SLT:
+			emit_set_reg(j, op, SET_L);
+			return true;
+
+		case SLTU:
+			emit_set_reg(j, op, SET_B);
+			return true;
+
+		default:
+			return false;
+		}
+
+	case ORI:
+		emit_alu_imm(j, op, GRP1_OR);
+		return true;
+
+	case ADDI:
+	case ADDIU:
+		emit_alu_imm(j, op, GRP1_ADD);
+		return true;
+
+	case ANDI:
+		emit_alu_imm(j, op, GRP1_AND);
+		return true;
+
+	case SLTI:
+		emit_set_imm(j, op, SET_L);
+		return true;
+
+	case SLTIU:
+		emit_set_imm(j, op, SET_B);
+		return true;
+
+	case LUI:
+		emit_mi(j, 0xC7, 0, OFF_GPR(op->rt), op->imm);
+		return true;
+
+	case GROUP_COP0:
+		switch (op->rs) {
+		case MF:
+			emit_move(j, OFF_GPR(op->rt), OFF_CP0(op->rd));
+			return true;
+
+		case MT:
+			emit_move(j, OFF_CP0(op->rd), OFF_GPR(op->rt));
+			return true;
+
+		default:
+			return false;
+		}
+
+	default:
+		return false;
+	}
+}
+
+/// @brief Translates an instruction which calls out or observes the program
+/// counters, falling back to calling its handler.
+///
+/// @returns true if the instruction may have invalidated cached code, false
+/// otherwise.
+static bool translate_impure(struct jit *const j,
+			     const struct cpu_op *const op)
+{
+	switch (cpu_instr_op_get(op->instr)) {
+	case GROUP_SPECIAL:
+		switch (cpu_instr_funct_get(op->instr)) {
+		case JR:
+			emit_move(j, OFF_NPC, OFF_GPR(op->rs));
+			return false;
+
+		case JALR:
+			emit_rm(j, RM_LOAD, ECX, OFF_GPR(op->rs));
+			emit_link(j, op->rd);
+			emit_rm(j, RM_STORE, ECX, OFF_NPC);
+
+			return false;
+
+		default:
+			break;
+		}
+		break;
+
+	case J:
+		emit_jmp(j, op);
+		return false;
+
+	case JAL:
+		emit_link(j, ra);
+		emit_jmp(j, op);
+
+		return false;
+
+	case BEQ:
+		emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+		emit_rm(j, RM_CMP, EAX, OFF_GPR(op->rt));
+		emit_branch(j, op, JCC_NE);
+
+		return false;
+
+	case BNE:
+		emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+		emit_rm(j, RM_CMP, EAX, OFF_GPR(op->rt));
+		emit_branch(j, op, JCC_E);
+
+		return false;
+
+	case BLEZ:
+	case BGTZ:
+		emit_rm(j, RM_LOAD, EAX, OFF_GPR(op->rs));
+
+		// test eax, eax
+		emit8(j, 0x85);
+		emit8(j, 0xC0);
+
+		emit_branch(j, op,
+			    (cpu_instr_op_get(op->instr) == BLEZ) ? JCC_G :
+								    JCC_LE);
+		return false;
+
+	case LB:
+		emit_load(j, op, &bus_lb, EXT_SX8);
+		return false;
+
+	case LBU:
+		emit_load(j, op, &bus_lb, EXT_ZX8);
+		return false;
+
+	case LH:
+		emit_load(j, op, &bus_lh, EXT_SX16);
+		return false;
+
+	case LHU:
+		emit_load(j, op, &bus_lh, EXT_ZX16);
+		return false;
+
+	case LW:
+		emit_load(j, op, &bus_lw, EXT_NONE);
+		return false;
+
+	case SB:
+		emit_store(j, op, &bus_sb, EXT_ZX8);
+		return true;
+
+	case SH:
+		emit_store(j, op, &bus_sh, EXT_ZX16);
+		return true;
+
+	case SW: {
+		// Stores are ignored while the cache is isolated.
+		emit_mi(j, 0xF7, 0, OFF_CP0(CPU_CP0_CPR_REG_SR),
+			CPU_CP0_CPR_REG_SR_IsC);
+
+		u8 *const isolated = emit_jcc(j, JCC_NE);
+
+		emit_store(j, op, &bus_sw, EXT_NONE);
+		jcc_patch(j, isolated);
+
+		return true;
+	}
+
+	default:
+		break;
+	}
+
+	emit_ahead(j);
+
+	// mov rsi, imm64
+	emit8(j, 0x48);
+	emit8(j, 0xBE);
+	emit64(j, (u64)(uintptr_t)op);
+
+	emit_call(j, op->fn);
+	return true;
+}
+
+/// @brief Emits a patchable exit.
+///
+/// @returns The end of the jump taken when the budget cannot pay for the next
+/// block, to be patched by jcc_patch().
+static NODISCARD u8 *emit_exit_site(struct jit *const j,
+				    struct cpu_block *const blk,
+				    const uint index, const u32 gen)
+{
+	blk->link_sites[index] = j->p;
+	blk->link_pcs[index] = 0xFFFFFFFF;
+	blk->link_gens[index] = gen;
+
+	// cmp eax, imm32
+	emit8(j, 0x3D);
+	emit32(j, blk->link_pcs[index]);
+
+	u8 *const pc_mismatch = emit_jcc(j, JCC_NE);
+
+	// cmp dword [rbx + OFF_GEN], imm32
+	emit_mi(j, 0x81, GRP1_CMP, OFF_GEN, blk->link_gens[index]);
+	u8 *const gen_mismatch = emit_jcc(j, JCC_NE);
+
+	// cmp qword [rbx + OFF_LEFT], imm32
+	emit8(j, 0x48);
+	emit_mi(j, 0x81, GRP1_CMP, OFF_LEFT, 0);
+
+	u8 *const exhausted = emit_jcc(j, JCC_L);
+
+	// sub qword [rbx + OFF_LEFT], imm32
+	emit8(j, 0x48);
+	emit_mi(j, 0x81, GRP1_SUB, OFF_LEFT, 0);
+
+	// jmp rel32; until linked, this simply continues with the next exit.
+	emit8(j, 0xE9);
+	emit32(j, 0);
+
+	jcc_patch(j, pc_mismatch);
+	jcc_patch(j, gen_mismatch);
+
+	return exhausted;
+}
+
+static void translate(struct psycho_ctx *const ctx, struct cpu_block *const blk)
+{
+	struct jit j = { .p = &ctx->cpu.jit_buf[ctx->cpu.jit_buf_used],
+			 .exits_num = 0,
+			 .pc_off = 0,
+			 .npc_off = sizeof(u32),
+			 .fastmem = ctx->bus.fastmem };
+
+	u8 *const code = j.p;
+
+	// push rbx
+	emit8(&j, 0x53);
+
+	// mov rbx, rdi
+	emit8(&j, 0x48);
+	emit8(&j, 0x89);
+	emit8(&j, 0xFB);
+
+	bool branch = false;
+	bool delay_slot = false;
+
+	for (uint i = 0; i < blk->len; ++i) {
+		const struct cpu_op *const op = &blk->ops[i];
+
+		delay_slot = branch;
+
+		struct cpu_op decoded;
+		branch = cpu_decode(&decoded, op->instr);
+
+		// Nothing can observe the program counters here, so they are
+		// left to be written back later.
+		if (!delay_slot && translate_pure(&j, op)) {
+			continue;
+		}
+
+		bool inval = false;
+		j.ahead = blk->len - i;
+
+		if (delay_slot) {
+			emit_delay_slot_pcs(&j);
+
+			if (!translate_pure(&j, op)) {
+				inval = translate_impure(&j, op);
+			}
+		} else {
+			const u32 pc = (u32)(i * sizeof(u32));
+
+			pcs_sync(&j, pc, pc + (2 * sizeof(u32)));
+			inval = translate_impure(&j, op);
+		}
+
+		emit_add_mem(&j, OFF_PC, sizeof(u32));
+		j.pc_off += sizeof(u32);
+
+		if (inval) {
+			emit_exit_chk(&j, blk->len - i - 1);
+		}
+	}
+
+	// If the block ends on a branch, the instruction which follows it is
+	// not necessarily the one at the program counter, so it cannot be
+	// linked to whatever comes next.
+	if (!branch) {
+		if (!delay_slot) {
+			const u32 pc = (u32)(blk->len * sizeof(u32));
+			pcs_sync(&j, pc, pc + sizeof(u32));
+		}
+
+		emit_rm(&j, RM_LOAD, EAX, OFF_PC);
+
+		// Exits are patched under the current generation, so start
+		// them off under an older one.
+		const u32 gen = ctx->cpu.jit_gen - 1;
+
+		u8 *const exhausted[2] = { emit_exit_site(&j, blk, 0, gen),
+					   emit_exit_site(&j, blk, 1, gen) };
+
+		u8 *const exit = j.p;
+
+		for (uint i = 0; i < 2; ++i) {
+			u8 *const site = blk->link_sites[i];
+			const u32 rel = (u32)(exit - &site[SITE_SIZE]);
+
+			memcpy(&site[SITE_REL], &rel, sizeof(rel));
+			exhausted[i][-1] = (u8)(exit - exhausted[i]);
+		}
+
+		// mov rax, imm64
+		emit8(&j, 0x48);
+		emit8(&j, 0xB8);
+		emit64(&j, (u64)(uintptr_t)blk);
+
+		// mov [rbx + OFF_LAST], rax
+		emit8(&j, 0x48);
+		emit_rm(&j, RM_STORE, EAX, OFF_LAST);
+	} else {
+		blk->link_sites[0] = NULL;
+		blk->link_sites[1] = NULL;
+	}
+
+	u8 *const epilogue = j.p;
+
+	// pop rbx; ret
+	emit8(&j, 0x5B);
+	emit8(&j, 0xC3);
+
+	for (uint i = 0; i < j.exits_num; ++i) {
+		u8 *target = epilogue;
+
+		// Give back the part of the budget the block did not use.
+		if (j.exits_left[i] != 0) {
+			target = j.p;
+
+			// add qword [rbx + OFF_LEFT], imm32
+			emit8(&j, 0x48);
+			emit_mi(&j, 0x81, GRP1_ADD, OFF_LEFT, j.exits_left[i]);
+
+			// jmp rel32
+			emit8(&j, 0xE9);
+			emit32(&j, (u32)(epilogue - (j.p + sizeof(u32))));
+		}
+
+		const u32 rel = (u32)(target - j.exits[i]);
+		memcpy(&j.exits[i][-4], &rel, sizeof(rel));
+	}
+
+	ctx->cpu.jit_buf_used += (size_t)(j.p - code);
+	blk->code = (void (*)(struct psycho_ctx *))(void *)code;
+}
+
+static void block_link(struct psycho_ctx *const ctx,
+		       struct cpu_block *const from,
+		       const struct cpu_block *const to)
+{
+	// Idle loops must come back after every iteration to be skipped.
+	if (!from->link_sites[0] || hle_vector(ctx->cpu.pc) ||
+	    (to->idle && ctx->cpu.idle.enabled)) {
+		return;
+	}
+
+	uint slot = 2;
+
+	for (uint i = 0; i < 2; ++i) {
+		if (from->link_gens[i] != ctx->cpu.jit_gen) {
+			slot = i;
+		} else if (from->link_pcs[i] == ctx->cpu.pc) {
+			// Already linked; we only got here because the
+			// budget could not pay for the next block.
+			return;
+		}
+	}
+
+	if (slot == 2) {
+		return;
+	}
+
+	u8 *const site = from->link_sites[slot];
+	const u8 *const target = (const u8 *)(const void *)to->code;
+
+	from->link_pcs[slot] = ctx->cpu.pc;
+	from->link_gens[slot] = ctx->cpu.jit_gen;
+
+	const u32 rel = (u32)(&target[PROLOGUE_SIZE] - &site[SITE_SIZE]);
+	const u32 len = to->len;
+
+	memcpy(&site[SITE_PC], &from->link_pcs[slot], sizeof(u32));
+	memcpy(&site[SITE_GEN], &from->link_gens[slot], sizeof(u32));
+	memcpy(&site[SITE_LEN_CMP], &len, sizeof(len));
+	memcpy(&site[SITE_LEN_SUB], &len, sizeof(len));
+	memcpy(&site[SITE_REL], &rel, sizeof(rel));
+}
+
+NODISCARD bool cpu_jit_prepare(struct psycho_ctx *const ctx)
+{
+	if (!ctx->cpu.jit_buf) {
+		void *const buf = mmap(NULL, BUF_SIZE,
+				       PROT_READ | PROT_WRITE | PROT_EXEC,
+				       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (buf == MAP_FAILED) {
+			// Don't try again; carry on with the block cache.
+			ctx->cpu.mode = PSYCHO_CPU_MODE_CACHED;
+			return false;
+		}
+
+		ctx->cpu.jit_buf = buf;
+		ctx->cpu.jit_buf_used = 0;
+	}
+
+	if ((BUF_SIZE - ctx->cpu.jit_buf_used) < BLOCK_CODE_MAX) {
+		cpu_cache_flush(ctx);
+		ctx->cpu.jit_buf_used = 0;
+	}
+	return true;
+}
+
+NODISCARD bool cpu_jit_run(struct psycho_ctx *const ctx,
+			   struct cpu_block *const blk)
+{
+	if (!blk->code) {
+		translate(ctx, blk);
+	}
+
+	struct cpu_block *const last = ctx->cpu.jit_last;
+
+	if (last) {
+		block_link(ctx, last, blk);
+	}
+
+	ctx->cpu.jit_last = NULL;
+	ctx->cpu.run_left -= blk->len;
+
+	blk->code(ctx);
+	ctx->cpu.jit_ahead = 0;
+
+	return true;
+}
+
+void cpu_jit_destroy(struct psycho_ctx *const ctx)
+{
+	if (ctx->cpu.jit_buf) {
+		munmap(ctx->cpu.jit_buf, BUF_SIZE);
+		ctx->cpu.jit_buf = NULL;
+	}
+}
+
+#else // __x86_64__
+
+NODISCARD bool cpu_jit_prepare(struct psycho_ctx *const ctx)
+{
+	ctx->cpu.mode = PSYCHO_CPU_MODE_CACHED;
+	return false;
+}
+
+NODISCARD bool cpu_jit_run(struct psycho_ctx *const ctx,
+			   struct cpu_block *const blk)
+{
+	(void)ctx;
+	(void)blk;
+
+	return false;
+}
+
+void cpu_jit_destroy(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+}
+
+#endif // __x86_64__
+
+void cpu_jit_unlink(struct psycho_ctx *const ctx)
+{
+	ctx->cpu.jit_gen++;
+	ctx->cpu.jit_last = NULL;
+}
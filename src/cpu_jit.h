@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_jit.h Provides the interface for the dynamic recompiler, which
+/// translates cached blocks into native code.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "cpu_cache.h"
+#include "psycho/ctx.h"
+
+/// @brief Prepares the recompiler for translating another block, discarding
+/// every cached block if the code buffer is close to full.
+///
+/// @returns true if blocks may be translated, false otherwise.
+NODISCARD bool cpu_jit_prepare(struct psycho_ctx *ctx);
+
+/// @brief Executes a block through its translated code, translating it first
+/// if necessary.
+///
+/// @returns true if the block was executed, false if it could not be
+/// translated and must be interpreted instead.
+NODISCARD bool cpu_jit_run(struct psycho_ctx *ctx, struct cpu_block *blk);
+
+/// @brief Breaks every link between translated blocks.
+void cpu_jit_unlink(struct psycho_ctx *ctx);
+
+/// @brief Releases the code buffer.
+void cpu_jit_destroy(struct psycho_ctx *ctx);
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_mem.h Defines the accessors the CPU uses for loads and stores,
+/// which take virtual addresses.
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+#include "bus.h"
+#include "compiler.h"
+#include "cpu.h"
+#include "cpu_defs.h"
+#include "psycho/ctx.h"
+
+/// @brief Returns where an access of @p size bytes to @p vaddr lands in the
+/// scratchpad. The offset is aligned down to the access size, so no access can
+/// run past its end.
+static ALWAYS_INLINE NODISCARD u8 *
+cpu_mem_scratchpad(struct psycho_ctx *const ctx, const u32 vaddr,
+		   const size_t size)
+{
+	return &ctx->bus.scratchpad[vaddr &
+				    (u32)(PSYCHO_BUS_SCRATCHPAD_SIZE - size)];
+}
+
+/// @brief Defines the accessors for one width: cpu_mem_lb(), cpu_mem_lh() and
+/// cpu_mem_lw() for loads, cpu_mem_sb(), cpu_mem_sh() and cpu_mem_sw() for
+/// stores. They serve the scratchpad before handing anything else to the bus.
+#define CPU_MEM_ACCESSORS_DEFINE(sfx, type, width, name)                       \
+	static ALWAYS_INLINE NODISCARD type cpu_mem_l##sfx(                    \
+		struct psycho_ctx *const ctx, const u32 vaddr)                 \
+	{                                                                      \
+		if (cpu_vaddr_scratchpad(vaddr)) {                             \
+			const u8 *const src =                                  \
+				cpu_mem_scratchpad(ctx, vaddr, sizeof(type));  \
+			type data;                                             \
+                                                                               \
+			memcpy(&data, src, sizeof(data));                      \
+			return data;                                           \
+		}                                                              \
+		return bus_l##sfx(ctx, cpu_vaddr_to_paddr(vaddr));             \
+	}                                                                      \
+                                                                               \
+	static ALWAYS_INLINE void cpu_mem_s##sfx(struct psycho_ctx *const ctx, \
+						 const u32 vaddr,              \
+						 const type data)              \
+	{                                                                      \
+		if (cpu_vaddr_scratchpad(vaddr)) {                             \
+			u8 *const dst =                                        \
+				cpu_mem_scratchpad(ctx, vaddr, sizeof(type));  \
+                                                                               \
+			memcpy(dst, &data, sizeof(data));                      \
+			return;                                                \
+		}                                                              \
+		bus_s##sfx(ctx, cpu_vaddr_to_paddr(vaddr), data);              \
+	}
+
+BUS_WIDTHS(CPU_MEM_ACCESSORS_DEFINE)
@@ -20,16 +20,34 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "bus.h"
+#include "bus_fastmem.h"
 #include "cpu.h"
+#include "cpu_cache.h"
+#include "cpu_jit.h"
 #include "cpu_defs.h"
 #include "dbg_log.h"
+#include "gpu.h"
+#include "hle.h"
+#include "irq.h"
+#include "mem.h"
 #include "ps_x_exe.h"
+#include "rcnt.h"
+#include "sched.h"
 
 #include "psycho/ctx.h"
 
-#define PS_X_EXE_INJECT_ADDR (0x80030000)
+// clang-format off
+
+#define PS_X_EXE_INJECT_ADDR	(0x80030000)
+
+/// @brief A breakpoint which is never hit, as instructions are word aligned.
+#define BP_NONE			(0xFFFFFFFF)
+
+// clang-format on
 
 static void ps_x_exe_inject(struct psycho_ctx *const ctx)
 {
@@ -40,17 +58,21 @@ static void ps_x_exe_inject(struct psycho_ctx *const ctx)
 
 	const uint eof = PS_X_EXE_OFFSET_DATA + size;
 
+	// RAM repeats across its mirrors, like it does for the bus accessors.
 	for (uint off = PS_X_EXE_OFFSET_DATA; off != eof;
 	     off += sizeof(u32), dest += sizeof(u32)) {
-		const u32 paddr = cpu_vaddr_to_paddr(dest);
-		memcpy(&ctx->bus.ram[paddr], &ctx->ps_x_exe[off], sizeof(u32));
+		const u32 ram_off = cpu_vaddr_to_paddr(dest) & BUS_RAM_MASK;
+
+		memcpy(&ctx->bus.ram[ram_off], &ctx->ps_x_exe[off],
+		       sizeof(u32));
+		bus_ram_written(ctx, ram_off);
 	}
 
 	ctx->cpu.pc = ps_x_exe_pc_get(ctx->ps_x_exe);
 	ctx->cpu.npc = ctx->cpu.pc + sizeof(u32);
 
-	const u32 paddr = cpu_vaddr_to_paddr(ctx->cpu.pc);
-	memcpy(&ctx->cpu.instr, &ctx->bus.ram[paddr], sizeof(u32));
+	const u32 ram_off = cpu_vaddr_to_paddr(ctx->cpu.pc) & BUS_RAM_MASK;
+	memcpy(&ctx->cpu.instr, &ctx->bus.ram[ram_off], sizeof(u32));
 
 	ctx->cpu.gpr[CPU_GPR_gp] = ps_x_exe_gp_get(ctx->ps_x_exe);
 
@@ -64,28 +86,188 @@ static void ps_x_exe_inject(struct psycho_ctx *const ctx)
 	ctx->ps_x_exe = NULL;
 }
 
-NODISCARD struct psycho_ctx psycho_ctx_create(u8 *const ram)
+NODISCARD struct psycho_ctx *
+psycho_ctx_new(const struct psycho_bios *const bios, u8 *const ram,
+	       const uint cpu_mode)
 {
-	struct psycho_ctx ctx;
-	memset(&ctx, 0, sizeof(ctx));
+	struct psycho_ctx *const ctx = calloc(1, sizeof(*ctx));
+
+	if (!ctx) {
+		return NULL;
+	}
+
+	ctx->bus.bios = bios;
+	ctx->bus.ram = ram;
+	ctx->bus.ram_fd = -1;
+	ctx->cpu.mode = cpu_mode;
+
+	if (!ram) {
+		ctx->bus.ram = mem_ram_alloc(&ctx->bus.ram_fd, false);
+		ctx->bus.ram_owned = true;
+
+		if (!ctx->bus.ram) {
+			free(ctx);
+			return NULL;
+		}
+	}
+
+	if (!gpu_init(ctx)) {
+		if (ctx->bus.ram_owned) {
+			mem_ram_free(ctx->bus.ram, ctx->bus.ram_fd);
+		}
+		free(ctx);
+		return NULL;
+	}
 
-	ctx.bus.ram = ram;
+	irq_init(ctx);
+	rcnt_init(ctx);
 	return ctx;
 }
 
+void psycho_ctx_free(struct psycho_ctx *const ctx)
+{
+	if (!ctx) {
+		return;
+	}
+
+	gpu_free(ctx);
+	cpu_cache_flush(ctx);
+	cpu_jit_destroy(ctx);
+
+	if (ctx->bus.fastmem) {
+		bus_fastmem_destroy(ctx);
+	}
+
+	if (ctx->bus.ram_owned) {
+		mem_ram_free(ctx->bus.ram, ctx->bus.ram_fd);
+	}
+	free(ctx);
+}
+
+NODISCARD bool psycho_ctx_fastmem_enable(struct psycho_ctx *const ctx)
+{
+	return bus_fastmem_enable(ctx);
+}
+
 void psycho_ctx_reset(struct psycho_ctx *const ctx)
 {
+	sched_reset(ctx);
+	bus_reset(ctx);
+	irq_reset(ctx);
+	rcnt_reset(ctx);
+	gpu_reset(ctx);
+	hle_reset(ctx);
 	cpu_reset(ctx);
 	LOG_INFO("System reset!");
 }
 
-void psycho_ctx_step(struct psycho_ctx *const ctx)
+/// @brief Sets the single breakpoint the execution loops check for: the PS-X
+/// EXE injection point while an EXE is pending, otherwise the frontend's stop
+/// address, if any. Translated code is relinked if either this or whether idle
+/// loops are skipped changed.
+static void bp_arm(struct psycho_ctx *const ctx)
+{
+	u32 bp = BP_NONE;
+
+	if (ctx->ps_x_exe) {
+		bp = PS_X_EXE_INJECT_ADDR;
+	} else if (ctx->stop_pc_enabled) {
+		bp = ctx->stop_pc;
+	}
+
+	if (bp != ctx->cpu.bp) {
+		ctx->cpu.bp = bp;
+
+		// Existing links may run straight past the new breakpoint.
+		cpu_jit_unlink(ctx);
+	}
+
+	// Likewise, past idle loops which should be skipped.
+	if (ctx->cpu.idle.enabled != ctx->cpu.idle.jit_enabled) {
+		ctx->cpu.idle.jit_enabled = ctx->cpu.idle.enabled;
+		cpu_jit_unlink(ctx);
+	}
+}
+
+/// @brief Implements psycho_ctx_run() once fastmem faults are bound to the
+/// context.
+static NODISCARD uint run(struct psycho_ctx *const ctx, const u64 budget)
 {
-	cpu_step(ctx);
+	const u64 beg = sched_now(ctx);
+	const u64 len = (budget > INT64_MAX) ? INT64_MAX : budget;
+	const u64 end = (beg > (UINT64_MAX - len)) ? UINT64_MAX : (beg + len);
+
+	ctx->cpu.halted = false;
 
-	if ((ctx->ps_x_exe) && ctx->cpu.pc == PS_X_EXE_INJECT_ADDR) {
+	while (sched_now(ctx) < end) {
+		sched_slice_begin(ctx, end);
+		bp_arm(ctx);
+
+		// A serviced kernel call counts as one instruction. Otherwise,
+		// the BIOS runs it; the execution loops always step at least
+		// once, so they do not stop at the vector again.
+		if (hle_pending(ctx) && hle_call(ctx)) {
+			ctx->cpu.run_left--;
+		} else {
+			switch (ctx->cpu.mode) {
+			case PSYCHO_CPU_MODE_JIT:
+			case PSYCHO_CPU_MODE_CACHED:
+				cpu_cache_run(ctx);
+				break;
+
+			default:
+				cpu_run(ctx);
+				break;
+			}
+
+			if (ctx->cpu.halted) {
+				sched_slice_end(ctx, end);
+				return PSYCHO_CTX_STOP_EXC;
+			}
+		}
+
+		if (ctx->cpu.pc != ctx->cpu.bp) {
+			continue;
+		}
+
+		// The injection breakpoint is one-shot; bp_arm() moves on to
+		// the frontend's stop address once the EXE is gone.
+		if (!ctx->ps_x_exe) {
+			sched_slice_end(ctx, end);
+			return PSYCHO_CTX_STOP_PC;
+		}
 		ps_x_exe_inject(ctx);
+
+		// The EXE's entry point may itself be the stop address.
+		if (ctx->stop_pc_enabled && (ctx->cpu.pc == ctx->stop_pc)) {
+			sched_slice_end(ctx, end);
+			return PSYCHO_CTX_STOP_PC;
+		}
 	}
+
+	sched_slice_end(ctx, end);
+	return PSYCHO_CTX_STOP_BUDGET;
+}
+
+uint psycho_ctx_run(struct psycho_ctx *const ctx, const u64 budget)
+{
+	// The thread only handles the context's faults while it runs it, so
+	// that it never holds on to a context another thread may free.
+	bus_fastmem_bind(ctx);
+	const uint stop = run(ctx, budget);
+	bus_fastmem_unbind(ctx);
+
+	return stop;
+}
+
+void psycho_ctx_step(struct psycho_ctx *const ctx)
+{
+	(void)psycho_ctx_run(ctx, 1);
+}
+
+NODISCARD PURE u64 psycho_ctx_cycles(const struct psycho_ctx *const ctx)
+{
+	return sched_now(ctx);
 }
 
 NODISCARD bool psycho_ctx_ps_x_exe_run(struct psycho_ctx *const ctx,
@@ -101,3 +283,76 @@ NODISCARD bool psycho_ctx_ps_x_exe_run(struct psycho_ctx *const ctx,
 	LOG_INFO("PS-X EXE will be injected!");
 	return true;
 }
+
+NODISCARD bool psycho_ctx_boot_take(struct psycho_ctx *const ctx,
+				    struct psycho_ctx_boot *const boot,
+				    const u64 budget)
+{
+	const u32 stop_pc = ctx->stop_pc;
+	const bool stop_pc_enabled = ctx->stop_pc_enabled;
+
+	psycho_ctx_reset(ctx);
+	ctx->ps_x_exe = NULL;
+	ctx->stop_pc = PS_X_EXE_INJECT_ADDR;
+	ctx->stop_pc_enabled = true;
+
+	const uint stop = psycho_ctx_run(ctx, budget);
+
+	ctx->stop_pc = stop_pc;
+	ctx->stop_pc_enabled = stop_pc_enabled;
+
+	if (stop != PSYCHO_CTX_STOP_PC) {
+		LOG_WARN("BIOS did not reach the PS-X EXE injection point");
+		return false;
+	}
+
+	boot->size = psycho_ctx_save(ctx, boot->state, sizeof(boot->state), 0);
+
+	if (boot->size == 0) {
+		LOG_WARN("Boot state does not fit");
+		return false;
+	}
+
+	LOG_INFO("Boot state taken");
+	return true;
+}
+
+NODISCARD bool
+psycho_ctx_ps_x_exe_boot_run(struct psycho_ctx *const ctx,
+			     const struct psycho_ctx_boot *const boot,
+			     const u8 *const data, const size_t len)
+{
+	if (!ps_x_exe_valid(data, len)) {
+		return false;
+	}
+
+	// Resetting maps the bus and clears what a state does not hold, such
+	// as the CPU's internal state; the state restores everything else.
+	psycho_ctx_reset(ctx);
+
+	if (!psycho_ctx_load(ctx, boot->state, boot->size)) {
+		return false;
+	}
+
+	// RAM matches the boot state, not any state the frontend holds.
+	memset(ctx->bus.ram_dirty, 0xFF, sizeof(ctx->bus.ram_dirty));
+
+	ctx->ps_x_exe = data;
+	ps_x_exe_inject(ctx);
+
+	return true;
+}
+
+PURE bool psycho_ctx_ram_page_dirty(const struct psycho_ctx *const ctx,
+				    const uint page)
+{
+	if (page >= PSYCHO_BUS_RAM_DIRTY_NUM) {
+		return false;
+	}
+	return (ctx->bus.ram_dirty[page / 64] >> (page % 64)) & 1;
+}
+
+void psycho_ctx_ram_dirty_clear(struct psycho_ctx *const ctx)
+{
+	memset(ctx->bus.ram_dirty, 0, sizeof(ctx->bus.ram_dirty));
+}
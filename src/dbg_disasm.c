@@ -52,95 +52,6 @@
 #include <string.h>
 
 // clang-format off
-#define GROUP_SPECIAL	(CPU_OP_GROUP_SPECIAL)
-#define GROUP_BCOND	(CPU_OP_GROUP_BCOND)
-#define GROUP_COP0	(CPU_OP_GROUP_COP0)
-#define GROUP_COP2	(CPU_OP_GROUP_COP2)
-
-#define ADD 	(CPU_OP_ADD)
-#define ADDI	(CPU_OP_ADDI)
-#define ADDIU	(CPU_OP_ADDIU)
-#define ADDU	(CPU_OP_ADDU)
-#define AND	(CPU_OP_AND)
-#define ANDI	(CPU_OP_ANDI)
-#define AVSZ3	(CPU_OP_AVSZ3)
-#define AVSZ4	(CPU_OP_AVSZ4)
-#define BEQ	(CPU_OP_BEQ)
-#define BGTZ	(CPU_OP_BGTZ)
-#define BLEZ	(CPU_OP_BLEZ)
-#define BNE	(CPU_OP_BNE)
-#define BREAK	(CPU_OP_BREAK)
-#define CC	(CPU_OP_CC)
-#define CDP	(CPU_OP_CDP)
-#define CF	(CPU_OP_CF)
-#define CT	(CPU_OP_CT)
-#define DCPL	(CPU_OP_DCPL)
-#define DIV	(CPU_OP_DIV)
-#define DIVU	(CPU_OP_DIVU)
-#define DPCS	(CPU_OP_DPCS)
-#define DPCT	(CPU_OP_DPCT)
-#define GPF	(CPU_OP_GPF)
-#define GPL	(CPU_OP_GPL)
-#define INTPL	(CPU_OP_INTPL)
-#define J	(CPU_OP_J)
-#define JAL	(CPU_OP_JAL)
-#define JALR	(CPU_OP_JALR)
-#define JR	(CPU_OP_JR)
-#define LB	(CPU_OP_LB)
-#define LBU	(CPU_OP_LBU)
-#define LH	(CPU_OP_LH)
-#define LHU	(CPU_OP_LHU)
-#define LUI	(CPU_OP_LUI)
-#define LW	(CPU_OP_LW)
-#define LWC2	(CPU_OP_LWC2)
-#define LWL	(CPU_OP_LWL)
-#define LWR	(CPU_OP_LWR)
-#define MF	(CPU_OP_MF)
-#define MFHI	(CPU_OP_MFHI)
-#define MFLO	(CPU_OP_MFLO)
-#define MT	(CPU_OP_MT)
-#define MTHI	(CPU_OP_MTHI)
-#define MTLO	(CPU_OP_MTLO)
-#define MULT	(CPU_OP_MULT)
-#define MULTU	(CPU_OP_MULTU)
-#define MVMVA	(CPU_OP_MVMVA)
-#define NCCS	(CPU_OP_NCCS)
-#define NCCT	(CPU_OP_NCCT)
-#define NCDS	(CPU_OP_NCDS)
-#define NCDT	(CPU_OP_NCDT)
-#define NCLIP	(CPU_OP_NCLIP)
-#define NCS	(CPU_OP_NCS)
-#define NCT	(CPU_OP_NCT)
-#define NOR	(CPU_OP_NOR)
-#define OP	(CPU_OP_OP)
-#define OR	(CPU_OP_OR)
-#define ORI	(CPU_OP_ORI)
-#define RFE	(CPU_OP_RFE)
-#define RTPS	(CPU_OP_RTPS)
-#define RTPT	(CPU_OP_RTPT)
-#define SB	(CPU_OP_SB)
-#define SH	(CPU_OP_SH)
-#define SLL	(CPU_OP_SLL)
-#define SLLV	(CPU_OP_SLLV)
-#define SLT	(CPU_OP_SLT)
-#define SLTI	(CPU_OP_SLTI)
-#define SLTIU	(CPU_OP_SLTIU)
-#define SLTU	(CPU_OP_SLTU)
-#define SQR	(CPU_OP_SQR)
-#define SRA	(CPU_OP_SRA)
-#define SRAV	(CPU_OP_SRAV)
-#define SRL	(CPU_OP_SRL)
-#define SRLV	(CPU_OP_SRLV)
-#define SUB	(CPU_OP_SUB)
-#define SUBU	(CPU_OP_SUBU)
-#define SW	(CPU_OP_SW)
-#define SWC2	(CPU_OP_SWC2)
-#define SWL	(CPU_OP_SWL)
-#define SWR	(CPU_OP_SWR)
-#define SYSCALL	(CPU_OP_SYSCALL)
-#define XOR	(CPU_OP_XOR)
-#define XORI	(CPU_OP_XORI)
-
 #define zero	(CPU_GPR_zero)
 #define at	(CPU_GPR_at)
 #define v0	(CPU_GPR_v0)
@@ -346,12 +257,13 @@ const char *const psycho_cpu_cp2_ccr_names[PSYCHO_CPU_CP2_CCR_REGS_NUM] = {
 #define CP2_CCR	(psycho_cpu_cp2_ccr_names)
 // clang-format on
 
-static ALWAYS_INLINE void res_set(struct psycho_ctx *const ctx,
-				  const char *const str, const size_t len)
-{
-	memcpy(ctx->disasm.result, str, len);
-	ctx->disasm.len = (int)len - 1;
-}
+#define MNEMONIC(tbl, name, mnemonic, fmt) \
+	[CPU_TBL_##tbl + CPU_OP_##name] = #mnemonic,
+
+/// @brief The mnemonic of each instruction, or NULL for reserved instructions.
+static const char *const mnemonics[CPU_TBL_SIZE] = { CPU_INSTR_LIST(MNEMONIC) };
+
+#undef MNEMONIC
 
 static void output_comment(struct psycho_ctx *const ctx, const uint comment)
 {
@@ -424,16 +336,12 @@ void psycho_dbg_disasm_instr(struct psycho_ctx *const ctx, const u32 instr,
 {
 #define FORMAT(args...) (ctx->disasm.len = sprintf(ctx->disasm.result, args))
 
-#define RES_SET(str) (res_set(ctx, (str), sizeof(str)))
-
 #define base (cpu_instr_base_get(instr))
-#define op (cpu_instr_op_get(instr))
 #define rd (cpu_instr_rd_get(instr))
 #define rt (cpu_instr_rt_get(instr))
 #define rs (cpu_instr_rs_get(instr))
 #define offset ((s16)cpu_instr_offset_get(instr))
 #define shamt (cpu_instr_shamt_get(instr))
-#define funct (cpu_instr_funct_get(instr))
 #define target (cpu_instr_target_get(instr))
 #define ZEXT_IMM (cpu_instr_zext_imm_get(instr))
 #define SEXT_IMM (offset)
@@ -441,73 +349,74 @@ void psycho_dbg_disasm_instr(struct psycho_ctx *const ctx, const u32 instr,
 #define COMMENT_ADD(comment) \
 	(ctx->disasm.comments[ctx->disasm.num_comments++] = comment)
 
-#define FORMAT_SHIFT_VAR(op_name)                                     \
-	({                                                            \
-		FORMAT(op_name " %s,%s,%u", GPR[rd], GPR[rt], shamt); \
-		COMMENT_ADD(COMMENT_GPR_RD);                          \
+#define FORMAT_SHIFT_VAR                                                       \
+	({                                                                     \
+		FORMAT("%s %s,%s,%u", mnemonic, GPR[rd], GPR[rt], shamt);      \
+		COMMENT_ADD(COMMENT_GPR_RD);                                   \
 	})
 
-#define FORMAT_SHIFT_REG(op_name)                                       \
-	({                                                              \
-		FORMAT(op_name " %s,%s,%s", GPR[rd], GPR[rt], GPR[rs]); \
-		COMMENT_ADD(COMMENT_GPR_RD);                            \
+#define FORMAT_SHIFT_REG                                                       \
+	({                                                                     \
+		FORMAT("%s %s,%s,%s", mnemonic, GPR[rd], GPR[rt], GPR[rs]);    \
+		COMMENT_ADD(COMMENT_GPR_RD);                                   \
 	})
 
-#define FORMAT_MULT_DIV(op_name)                            \
-	({                                                  \
-		FORMAT(op_name " %s,%s", GPR[rs], GPR[rt]); \
-		COMMENT_ADD(COMMENT_LO);                    \
-		COMMENT_ADD(COMMENT_HI);                    \
+#define FORMAT_MULT_DIV                                          \
+	({                                                       \
+		FORMAT("%s %s,%s", mnemonic, GPR[rs], GPR[rt]); \
+		COMMENT_ADD(COMMENT_LO);                         \
+		COMMENT_ADD(COMMENT_HI);                         \
 	})
 
-#define FORMAT_ARITH_REG(op_name)                                       \
-	({                                                              \
-		FORMAT(op_name " %s,%s,%s", GPR[rd], GPR[rs], GPR[rt]); \
-		COMMENT_ADD(COMMENT_GPR_RD);                            \
+#define FORMAT_ARITH_REG                                                       \
+	({                                                                     \
+		FORMAT("%s %s,%s,%s", mnemonic, GPR[rd], GPR[rs], GPR[rt]);    \
+		COMMENT_ADD(COMMENT_GPR_RD);                                   \
 	})
 
-#define FORMAT_BRANCH_REG(op_name)                                   \
-	({                                                           \
-		FORMAT(op_name " %s,%s,%s0x%04hX", GPR[rs], GPR[rt], \
-		       (offset < 0) ? "-" : "", offset);             \
-		COMMENT_ADD(COMMENT_BRANCH);                         \
+#define FORMAT_BRANCH_REG                                                  \
+	({                                                                 \
+		FORMAT("%s %s,%s,%s0x%04hX", mnemonic, GPR[rs], GPR[rt],   \
+		       (offset < 0) ? "-" : "", offset);                   \
+		COMMENT_ADD(COMMENT_BRANCH);                               \
 	})
 
-#define FORMAT_BRANCH(op_name)                           \
-	({                                               \
-		FORMAT(op_name " %s,%s0x%04hX", GPR[rs], \
-		       (offset < 0) ? "-" : "", offset); \
-		COMMENT_ADD(COMMENT_BRANCH);             \
+#define FORMAT_BRANCH                                                 \
+	({                                                            \
+		FORMAT("%s %s,%s0x%04hX", mnemonic, GPR[rs],          \
+		       (offset < 0) ? "-" : "", offset);              \
+		COMMENT_ADD(COMMENT_BRANCH);                          \
 	})
 
-#define FORMAT_LOAD_STORE(op_name)                                            \
-	FORMAT(op_name " %s,%s0x%04hX(%s)", GPR[rt], (offset < 0) ? "-" : "", \
-	       offset, GPR[base]);
+#define FORMAT_LOAD_STORE                                                      \
+	FORMAT("%s %s,%s0x%04hX(%s)", mnemonic, GPR[rt],                       \
+	       (offset < 0) ? "-" : "", offset, GPR[base]);
 
-#define FORMAT_LOAD(op_name)                 \
+#define FORMAT_LOAD                          \
 	({                                   \
-		FORMAT_LOAD_STORE(op_name);  \
+		FORMAT_LOAD_STORE;           \
 		COMMENT_ADD(COMMENT_GPR_RT); \
 		COMMENT_ADD(COMMENT_PADDR);  \
 	})
 
-#define FORMAT_STORE(op_name)               \
+#define FORMAT_STORE                        \
 	({                                  \
-		FORMAT_LOAD_STORE(op_name); \
+		FORMAT_LOAD_STORE;          \
 		COMMENT_ADD(COMMENT_PADDR); \
 	})
 
-#define FORMAT_ARITH_ZEXT_IMM(op_name)                                       \
-	({                                                                   \
-		FORMAT(op_name " %s,%s,0x%04X", GPR[rt], GPR[rs], ZEXT_IMM); \
-		COMMENT_ADD(COMMENT_GPR_RT);                                 \
+#define FORMAT_ARITH_ZEXT_IMM                                                  \
+	({                                                                     \
+		FORMAT("%s %s,%s,0x%04X", mnemonic, GPR[rt], GPR[rs],          \
+		       ZEXT_IMM);                                              \
+		COMMENT_ADD(COMMENT_GPR_RT);                                   \
 	})
 
-#define FORMAT_ARITH_SEXT_IMM(op_name)                               \
-	({                                                           \
-		FORMAT(op_name " %s,%s,%s0x%04hX", GPR[rt], GPR[rs], \
-		       (SEXT_IMM < 0) ? "-" : "", SEXT_IMM);         \
-		COMMENT_ADD(COMMENT_GPR_RT);                         \
+#define FORMAT_ARITH_SEXT_IMM                                                  \
+	({                                                                     \
+		FORMAT("%s %s,%s,%s0x%04hX", mnemonic, GPR[rt], GPR[rs],       \
+		       (SEXT_IMM < 0) ? "-" : "", SEXT_IMM);                   \
+		COMMENT_ADD(COMMENT_GPR_RT);                                   \
 	})
 
 #define ILLEGAL (FORMAT("illegal 0x%08X", instr))
@@ -518,393 +427,121 @@ void psycho_dbg_disasm_instr(struct psycho_ctx *const ctx, const u32 instr,
 	ctx->disasm.num_comments = 0;
 	ctx->disasm.len = 0;
 
-	switch (op) {
-	case GROUP_SPECIAL:
-		switch (funct) {
-		case SLL:
-			FORMAT_SHIFT_VAR("sll");
-			return;
-
-		case SRL:
-			FORMAT_SHIFT_VAR("srl");
-			return;
-
-		case SRA:
-			FORMAT_SHIFT_VAR("sra");
-			return;
-
-		case SLLV:
-			FORMAT_SHIFT_REG("sllv");
-			return;
-
-		case SRLV:
-			FORMAT_SHIFT_REG("srlv");
-			return;
-
-		case SRAV:
-			FORMAT_SHIFT_REG("srav");
-			return;
-
-		case JR:
-			FORMAT("jr %s", GPR[rs]);
-			return;
-
-		case JALR:
-			FORMAT("jalr %s,%s", GPR[rd], GPR[rs]);
-			COMMENT_ADD(COMMENT_GPR_RD);
-
-			return;
-
-		case SYSCALL:
-			RES_SET("syscall");
-			return;
-
-		case BREAK:
-			RES_SET("break");
-			return;
-
-		case MFHI:
-			FORMAT("mfhi %s", GPR[rd]);
-			COMMENT_ADD(COMMENT_GPR_RD);
-
-			return;
-
-		case MTHI:
-			FORMAT("mthi %s", GPR[rs]);
-			return;
-
-		case MFLO:
-			FORMAT("mflo %s", GPR[rd]);
-			COMMENT_ADD(COMMENT_GPR_RD);
-
-			return;
-
-		case MTLO:
-			FORMAT("mtlo %s", GPR[rs]);
-			return;
-
-		case MULT:
-			FORMAT_MULT_DIV("mult");
-			return;
-
-		case MULTU:
-			FORMAT_MULT_DIV("multu");
-			return;
-
-		case DIV:
-			FORMAT_MULT_DIV("div");
-			return;
-
-		case DIVU:
-			FORMAT_MULT_DIV("divu");
-			return;
-
-		case ADD:
-			FORMAT_ARITH_REG("add");
-			return;
-
-		case ADDU:
-			FORMAT_ARITH_REG("addu");
-			return;
-
-		case SUB:
-			FORMAT_ARITH_REG("sub");
-			return;
-
-		case SUBU:
-			FORMAT_ARITH_REG("subu");
-			return;
-
-		case AND:
-			FORMAT_ARITH_REG("and");
-			return;
-
-		case OR:
-			FORMAT_ARITH_REG("or");
-			return;
-
-		case XOR:
-			FORMAT_ARITH_REG("xor");
-			return;
-
-		case NOR:
-			FORMAT_ARITH_REG("nor");
-			return;
-
-		case SLT:
-			FORMAT_ARITH_REG("slt");
-			return;
+	const uint index = cpu_instr_index_get(instr);
+	const char *const mnemonic = mnemonics[index];
 
-		case SLTU:
-			FORMAT_ARITH_REG("sltu");
-			return;
-
-		default:
-			ILLEGAL;
-			return;
-		}
-
-	case GROUP_BCOND: {
-		const char *const opcode = (rt & 1) ? "bgez" : "bltz";
-		const char *const link = ((rt >> 4) & 1) ? "al" : "";
-
-		FORMAT("%s%s %s,%s0x%04hX", opcode, link, GPR[rs],
-		       (offset < 0) ? "-" : "", offset);
+	if (!mnemonic) {
+		ILLEGAL;
 		return;
 	}
 
-	case J:
-		FORMAT("j 0x%08X", target);
-		COMMENT_ADD(COMMENT_JUMP);
-
+	switch (cpu_instr_fmts[index]) {
+	case CPU_FMT_NONE:
+		FORMAT("%s", mnemonic);
 		return;
 
-	case JAL:
-		FORMAT("jal 0x%08X", target);
-		COMMENT_ADD(COMMENT_JUMP);
-
+	case CPU_FMT_SHIFT_IMM:
+		FORMAT_SHIFT_VAR;
 		return;
 
-	case BEQ:
-		FORMAT_BRANCH_REG("beq");
+	case CPU_FMT_SHIFT_REG:
+		FORMAT_SHIFT_REG;
 		return;
 
-	case BNE:
-		FORMAT_BRANCH_REG("bne");
+	case CPU_FMT_JR:
+		FORMAT("%s %s", mnemonic, GPR[rs]);
 		return;
 
-	case BLEZ:
-		FORMAT_BRANCH("blez");
-		return;
+	case CPU_FMT_JALR:
+		FORMAT("%s %s,%s", mnemonic, GPR[rd], GPR[rs]);
+		COMMENT_ADD(COMMENT_GPR_RD);
 
-	case BGTZ:
-		FORMAT_BRANCH("bgtz");
 		return;
 
-	case ADDI:
-		FORMAT_ARITH_SEXT_IMM("addi");
-		return;
+	case CPU_FMT_MF_HI_LO:
+		FORMAT("%s %s", mnemonic, GPR[rd]);
+		COMMENT_ADD(COMMENT_GPR_RD);
 
-	case ADDIU:
-		FORMAT_ARITH_SEXT_IMM("addiu");
 		return;
 
-	case SLTI:
-		FORMAT_ARITH_SEXT_IMM("slti");
+	case CPU_FMT_MT_HI_LO:
+		FORMAT("%s %s", mnemonic, GPR[rs]);
 		return;
 
-	case SLTIU:
-		FORMAT_ARITH_SEXT_IMM("sltiu");
+	case CPU_FMT_MULT_DIV:
+		FORMAT_MULT_DIV;
 		return;
 
-	case ANDI:
-		FORMAT_ARITH_ZEXT_IMM("andi");
+	case CPU_FMT_ALU_REG:
+		FORMAT_ARITH_REG;
 		return;
 
-	case ORI:
-		FORMAT_ARITH_ZEXT_IMM("ori");
-		return;
+	case CPU_FMT_BCOND: {
+		const char *const opcode = (rt & 1) ? "bgez" : "bltz";
+		const char *const link = ((rt >> 4) & 1) ? "al" : "";
 
-	case XORI:
-		FORMAT_ARITH_ZEXT_IMM("xori");
+		FORMAT("%s%s %s,%s0x%04hX", opcode, link, GPR[rs],
+		       (offset < 0) ? "-" : "", offset);
 		return;
+	}
 
-	case LUI:
-		FORMAT("lui %s,0x%04X", GPR[rt], ZEXT_IMM);
-		COMMENT_ADD(COMMENT_GPR_RT);
+	case CPU_FMT_JUMP:
+		FORMAT("%s 0x%08X", mnemonic, target);
+		COMMENT_ADD(COMMENT_JUMP);
 
 		return;
 
-	case GROUP_COP0:
-		switch (rs) {
-		case MF:
-			FORMAT("mfc0 %s,%s", GPR[rt], CP0_CPR[rd]);
-			return;
-
-		case MT:
-			FORMAT("mtc0 %s,%s", GPR[rt], CP0_CPR[rd]);
-			COMMENT_ADD(COMMENT_CP0_CPR_RD);
-
-			return;
-
-		default:
-			switch (funct) {
-			case RFE:
-				RES_SET("rfe");
-				return;
-
-			default:
-				ILLEGAL;
-				return;
-			}
-		}
-
-	case GROUP_COP2:
-		switch (rs) {
-		case MF:
-			FORMAT("mfc2 %s,%s", GPR[rt], CP2_CPR[rd]);
-			return;
-
-		case CF:
-			FORMAT("cfc2 %s,%s", GPR[rt], CP2_CCR[rd]);
-			return;
-
-		case MT:
-			FORMAT("mtc2 %s,%s", GPR[rt], CP2_CPR[rd]);
-			return;
-
-		case CT:
-			FORMAT("ctc2 %s,%s", GPR[rd], CP2_CCR[rd]);
-			return;
-
-		default:
-			switch (funct) {
-			case RTPS:
-				RES_SET("rtps");
-				return;
-
-			case NCLIP:
-				RES_SET("nclip");
-				return;
-
-			case OP:
-				RES_SET("op");
-				return;
-
-			case DPCS:
-				RES_SET("dpcs");
-				return;
-
-			case INTPL:
-				RES_SET("intpl");
-				return;
-
-			case MVMVA:
-				RES_SET("mvmva");
-				return;
-
-			case NCDS:
-				RES_SET("ncds");
-				return;
-
-			case CDP:
-				RES_SET("cdp");
-				return;
-
-			case NCDT:
-				RES_SET("ncdt");
-				return;
-
-			case NCCS:
-				RES_SET("nccs");
-				return;
-
-			case CC:
-				RES_SET("cc");
-				return;
-
-			case NCS:
-				RES_SET("ncs");
-				return;
-
-			case NCT:
-				RES_SET("nct");
-				return;
-
-			case SQR:
-				RES_SET("sqr");
-				return;
-
-			case DCPL:
-				RES_SET("dcpl");
-				return;
-
-			case DPCT:
-				RES_SET("dpct");
-				return;
-
-			case AVSZ3:
-				RES_SET("avsz3");
-				return;
-
-			case AVSZ4:
-				RES_SET("avsz4");
-				return;
-
-			case RTPT:
-				RES_SET("rtpt");
-				return;
-
-			case GPF:
-				RES_SET("gpf");
-				return;
-
-			case GPL:
-				RES_SET("gpl");
-				return;
-
-			case NCCT:
-				RES_SET("ncct");
-				return;
-
-			default:
-				ILLEGAL;
-				return;
-			}
-		}
-
-	case LB:
-		FORMAT_LOAD("lb");
+	case CPU_FMT_BRANCH_REG:
+		FORMAT_BRANCH_REG;
 		return;
 
-	case LH:
-		FORMAT_LOAD("lh");
+	case CPU_FMT_BRANCH:
+		FORMAT_BRANCH;
 		return;
 
-	case LWL:
-		FORMAT_LOAD("lwl");
+	case CPU_FMT_ALU_SEXT_IMM:
+		FORMAT_ARITH_SEXT_IMM;
 		return;
 
-	case LW:
-		FORMAT_LOAD("lw");
+	case CPU_FMT_ALU_ZEXT_IMM:
+		FORMAT_ARITH_ZEXT_IMM;
 		return;
 
-	case LBU:
-		FORMAT_LOAD("lbu");
-		return;
+	case CPU_FMT_LUI:
+		FORMAT("%s %s,0x%04X", mnemonic, GPR[rt], ZEXT_IMM);
+		COMMENT_ADD(COMMENT_GPR_RT);
 
-	case LHU:
-		FORMAT_LOAD("lhu");
 		return;
 
-	case LWR:
-		FORMAT_LOAD("lwr");
+	case CPU_FMT_LOAD:
+		FORMAT_LOAD;
 		return;
 
-	case SB:
-		FORMAT_STORE("sb");
+	case CPU_FMT_STORE:
+		FORMAT_STORE;
 		return;
 
-	case SH:
-		FORMAT_STORE("sh");
+	case CPU_FMT_MFC0:
+		FORMAT("%s %s,%s", mnemonic, GPR[rt], CP0_CPR[rd]);
 		return;
 
-	case SWL:
-		FORMAT_STORE("swl");
-		return;
+	case CPU_FMT_MTC0:
+		FORMAT("%s %s,%s", mnemonic, GPR[rt], CP0_CPR[rd]);
+		COMMENT_ADD(COMMENT_CP0_CPR_RD);
 
-	case SW:
-		FORMAT_STORE("sw");
 		return;
 
-	case SWR:
-		FORMAT_STORE("swr");
+	case CPU_FMT_MFC2:
+	case CPU_FMT_MTC2:
+		FORMAT("%s %s,%s", mnemonic, GPR[rt], CP2_CPR[rd]);
 		return;
 
-	case LWC2:
+	case CPU_FMT_CFC2:
+		FORMAT("%s %s,%s", mnemonic, GPR[rt], CP2_CCR[rd]);
 		return;
 
-	case SWC2:
+	case CPU_FMT_CTC2:
+		FORMAT("%s %s,%s", mnemonic, GPR[rd], CP2_CCR[rd]);
 		return;
 
 	default:
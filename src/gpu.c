@@ -0,0 +1,566 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu.c Implements the GPU's registers.
+///
+/// GP0 commands are gathered here a word at a time, and handed to the drawing
+/// threads once complete, along with the data of CPU to VRAM transfers; see
+/// gpu_render.c. Polylines are handed over one line at a time. The drawing
+/// state is tracked on both sides, so that GPUSTAT and GP1(10h) never wait for
+/// drawing to catch up.
+///
+/// The CPU only waits for the drawing threads to read VRAM, for VRAM to CPU
+/// transfers and GP1 commands which abort drawing, or if the ring is full.
+/// GPUSTAT reports the GPU ready to take commands in the meantime, so nothing
+/// the CPU sees depends on how far the drawing threads got.
+
+#include <string.h>
+
+#include "bus.h"
+#include "gpu.h"
+#include "gpu_render.h"
+#include "irq.h"
+#include "mem.h"
+
+// clang-format off
+
+///@{
+/// @brief The bits of GPUSTAT.
+#define STAT_REVERSE		(1U << 14)
+#define STAT_FIELD		(1U << 13)
+#define STAT_HRES2		(1U << 16)
+#define STAT_DISP_MODE_SHIFT	(17)
+#define STAT_DISP_OFF		(1U << 23)
+#define STAT_IRQ		(1U << 24)
+#define STAT_DMA_REQ		(1U << 25)
+#define STAT_READY_CMD		(1U << 26)
+#define STAT_READY_READ		(1U << 27)
+#define STAT_READY_DMA		(1U << 28)
+#define STAT_DMA_DIR_SHIFT	(29)
+///@}
+
+/// @brief The bits of GPUSTAT set by GP1(08h).
+#define STAT_DISP_MODE	\
+	((0x3FU << STAT_DISP_MODE_SHIFT) | STAT_HRES2 | STAT_REVERSE)
+
+///@{
+/// @brief The DMA directions set by GP1(04h).
+#define DMA_DIR_OFF		(0)
+#define DMA_DIR_FIFO		(1)
+#define DMA_DIR_TO_GPU		(2)
+#define DMA_DIR_FROM_GPU	(3)
+///@}
+
+///@{
+/// @brief The GP1 commands, without their mirrors.
+#define GP1_RESET		(0x00)
+#define GP1_CMD_RESET		(0x01)
+#define GP1_IRQ_ACK		(0x02)
+#define GP1_DISP_ENABLE		(0x03)
+#define GP1_DMA_DIR		(0x04)
+#define GP1_DISP_START		(0x05)
+#define GP1_DISP_H		(0x06)
+#define GP1_DISP_V		(0x07)
+#define GP1_DISP_MODE		(0x08)
+#define GP1_TEX_DISABLE		(0x09)
+#define GP1_INFO		(0x10)
+///@}
+
+/// @brief The words which end a polyline, where its next vertex would start.
+#define POLYLINE_END_MASK	(0xF000F000)
+#define POLYLINE_END		(0x50005000)
+
+/// @brief The version GP1(10h) reports, that of the later 208-pin GPUs.
+#define GPU_VERSION		(2)
+
+// clang-format on
+
+static NODISCARD u32 stat_get(const struct psycho_gpu *const gpu)
+{
+	u32 stat = gpu->stat | (gpu->draw_mode & 0x7FF) |
+		   ((gpu->mask & 3) << 11) |
+		   ((gpu->draw_mode & GPU_DRAW_MODE_TEX_OFF) << 4) |
+		   STAT_READY_CMD | STAT_READY_DMA;
+
+	if (gpu->download.left != 0) {
+		stat |= STAT_READY_READ;
+	}
+
+	switch ((stat >> STAT_DMA_DIR_SHIFT) & 3) {
+	case DMA_DIR_FIFO:
+	case DMA_DIR_TO_GPU:
+		stat |= STAT_DMA_REQ;
+		break;
+
+	case DMA_DIR_FROM_GPU:
+		stat |= (stat & STAT_READY_READ) ? STAT_DMA_REQ : 0;
+		break;
+
+	default:
+		break;
+	}
+	return stat;
+}
+
+static u32 reg_read(struct psycho_ctx *const ctx, const u32 paddr)
+{
+	const uint shift = (paddr & 3) * 8;
+	u32 val;
+
+	if ((paddr & ~3U) == PSYCHO_GPU_GP0_ADDR) {
+		gpu_gpuread(ctx, &val, 1);
+	} else {
+		val = stat_get(&ctx->gpu);
+	}
+	return val >> shift;
+}
+
+/// @brief Handles GP0(E1h) to GP0(E6h).
+///
+/// @returns The command as handed to the drawing threads.
+static NODISCARD u32 env_write(struct psycho_gpu *const gpu, const u32 word)
+{
+	const u32 param = word & 0xFFFFFF;
+	u32 *reg;
+
+	switch (word >> 24) {
+	case 0xE1:
+		reg = &gpu->draw_mode;
+		*reg = param & 0x3FFF;
+
+		if (!gpu->tex_disable) {
+			*reg &= ~GPU_DRAW_MODE_TEX_OFF;
+		}
+		break;
+
+	case 0xE2:
+		reg = &gpu->tex_window;
+		*reg = param & 0xFFFFF;
+		break;
+
+	case 0xE3:
+		reg = &gpu->area_tl;
+		*reg = param & 0x7FFFF;
+		break;
+
+	case 0xE4:
+		reg = &gpu->area_br;
+		*reg = param & 0x7FFFF;
+		break;
+
+	case 0xE5:
+		reg = &gpu->offset;
+		*reg = param & 0x3FFFFF;
+		break;
+
+	default:
+		reg = &gpu->mask;
+		*reg = param & 3;
+		break;
+	}
+	return (word & 0xFF000000) | *reg;
+}
+
+/// @brief Hands over a polyline's current line, and keeps its last vertex as
+/// the first of the next one.
+static void polyline_exec(struct psycho_gpu *const gpu)
+{
+	u32 *const pkt = gpu->pkt;
+	const u32 cmd = pkt[0] & 0xFF000000;
+	u32 line[4];
+
+	line[0] = pkt[0] & ~((u32)GPU_CMD_POLYLINE << 24);
+
+	for (uint i = 1; i < gpu->pkt_len; ++i) {
+		line[i] = pkt[i];
+	}
+	gpu_render_push(gpu->render, line, gpu->pkt_len);
+
+	if (gpu->pkt_len == 4) {
+		pkt[0] = cmd | (pkt[2] & 0xFFFFFF);
+		pkt[1] = pkt[3];
+	} else {
+		pkt[1] = pkt[2];
+	}
+	gpu->pkt_len = 2;
+	gpu->polyline = true;
+}
+
+static void pkt_exec(struct psycho_ctx *const ctx)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+	u32 *const pkt = gpu->pkt;
+	const uint len = gpu->pkt_len;
+	const uint cmd = pkt[0] >> 24;
+
+	gpu->pkt_len = 0;
+
+	switch (cmd >> 5) {
+	case GPU_CMD_GROUP_POLY:
+		if (cmd & GPU_CMD_TEXTURED) {
+			u32 *const uv1 = &pkt[(cmd & GPU_CMD_SHADED) ? 5 : 4];
+
+			if (!gpu->tex_disable) {
+				*uv1 &= ~(GPU_DRAW_MODE_TEX_OFF << 16);
+			}
+
+			// The polygon's texture page replaces that of the
+			// drawing mode.
+			gpu->draw_mode =
+				(gpu->draw_mode & ~GPU_DRAW_MODE_TPAGE) |
+				((*uv1 >> 16) & GPU_DRAW_MODE_TPAGE);
+		}
+		gpu_render_push(gpu->render, pkt, len);
+		break;
+
+	case GPU_CMD_GROUP_LINE:
+		if (cmd & GPU_CMD_POLYLINE) {
+			gpu->pkt_len = len;
+			polyline_exec(gpu);
+		} else {
+			gpu_render_push(gpu->render, pkt, len);
+		}
+		break;
+
+	case GPU_CMD_GROUP_RECT:
+	case GPU_CMD_GROUP_COPY:
+		gpu_render_push(gpu->render, pkt, len);
+		break;
+
+	case GPU_CMD_GROUP_UPLOAD:
+		gpu->upload = gpu_xfer_get(pkt[1], pkt[2]);
+		gpu_render_push(gpu->render, pkt, len);
+		break;
+
+	case GPU_CMD_GROUP_DOWNLOAD:
+		gpu->download = gpu_xfer_get(pkt[1], pkt[2]);
+		break;
+
+	case GPU_CMD_GROUP_ENV:
+		if ((cmd >= 0xE1) && (cmd <= 0xE6)) {
+			pkt[0] = env_write(gpu, pkt[0]);
+			gpu_render_push(gpu->render, pkt, len);
+		}
+		break;
+
+	default:
+		if (cmd == GPU_CMD_FILL) {
+			gpu_render_push(gpu->render, pkt, len);
+		} else if ((cmd == GPU_CMD_IRQ) && !(gpu->stat & STAT_IRQ)) {
+			gpu->stat |= STAT_IRQ;
+			irq_raise(ctx, PSYCHO_IRQ_GPU);
+		}
+		break;
+	}
+}
+
+/// @brief Handles a word written to GP0 outside of a CPU to VRAM transfer.
+static void cmd_write(struct psycho_ctx *const ctx, const u32 word)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	if (gpu->polyline && (gpu->pkt_len == 2) &&
+	    ((word & POLYLINE_END_MASK) == POLYLINE_END)) {
+		gpu->pkt_len = 0;
+		gpu->polyline = false;
+		return;
+	}
+
+	gpu->pkt[gpu->pkt_len++] = word;
+
+	if (gpu->pkt_len == gpu_pkt_len(gpu->pkt[0])) {
+		pkt_exec(ctx);
+	}
+}
+
+/// @brief Drops the command being received and any transfer in progress.
+static void cmd_reset(struct psycho_ctx *const ctx)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	gpu_sync(ctx);
+	gpu->pkt_len = 0;
+	gpu->polyline = false;
+	gpu->upload.left = 0;
+	gpu->download.left = 0;
+	gpu_restore(ctx);
+}
+
+static void gp1_reset(struct psycho_ctx *const ctx)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	gpu->stat = STAT_FIELD | STAT_DISP_OFF;
+	gpu->draw_mode = 0;
+	gpu->tex_window = 0;
+	gpu->area_tl = 0;
+	gpu->area_br = 0;
+	gpu->offset = 0;
+	gpu->mask = 0;
+	gpu->disp_start = 0;
+	gpu->disp_h = 0x200 | (0xC00 << 12);
+	gpu->disp_v = 0x10 | (0x100 << 10);
+	gpu->disp_mode = 0;
+	gpu->tex_disable = false;
+	cmd_reset(ctx);
+}
+
+static void gp1_write(struct psycho_ctx *const ctx, const u32 word)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+	const u32 param = word & 0xFFFFFF;
+	const uint cmd = (word >> 24) & 0x3F;
+
+	switch ((cmd >= GP1_INFO) ? GP1_INFO : cmd) {
+	case GP1_RESET:
+		gp1_reset(ctx);
+		break;
+
+	case GP1_CMD_RESET:
+		cmd_reset(ctx);
+		break;
+
+	case GP1_IRQ_ACK:
+		gpu->stat &= ~STAT_IRQ;
+		break;
+
+	case GP1_DISP_ENABLE:
+		gpu->stat = (gpu->stat & ~STAT_DISP_OFF) | ((param & 1) << 23);
+		break;
+
+	case GP1_DMA_DIR:
+		gpu->stat = (gpu->stat & ~(3U << STAT_DMA_DIR_SHIFT)) |
+			    ((param & 3) << STAT_DMA_DIR_SHIFT);
+		break;
+
+	case GP1_DISP_START:
+		gpu->disp_start = param & 0x7FFFF;
+		break;
+
+	case GP1_DISP_H:
+		gpu->disp_h = param;
+		break;
+
+	case GP1_DISP_V:
+		gpu->disp_v = param & 0xFFFFF;
+		break;
+
+	case GP1_DISP_MODE:
+		gpu->disp_mode = param & 0xFF;
+		gpu->stat = (gpu->stat & ~STAT_DISP_MODE) |
+			    ((param & 0x3F) << STAT_DISP_MODE_SHIFT) |
+			    ((param & 0x40) << 10) | ((param & 0x80) << 7);
+		break;
+
+	case GP1_TEX_DISABLE:
+		gpu->tex_disable = param & 1;
+		break;
+
+	case GP1_INFO:
+		switch (param & 7) {
+		case 2:
+			gpu->read = gpu->tex_window;
+			break;
+
+		case 3:
+			gpu->read = gpu->area_tl;
+			break;
+
+		case 4:
+			gpu->read = gpu->area_br;
+			break;
+
+		case 5:
+			gpu->read = gpu->offset;
+			break;
+
+		case 7:
+			gpu->read = GPU_VERSION;
+			break;
+
+		default:
+			break;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void reg_write_w(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	if (paddr == PSYCHO_GPU_GP0_ADDR) {
+		gpu_gp0_write(ctx, &data, 1);
+	} else {
+		gp1_write(ctx, data);
+	}
+}
+
+// GPUSTAT only changes with the state of the GPU, but every read of GPUREAD
+// moves a download along, so a loop polling it is not idle.
+static const struct psycho_bus_io io_gp0 = {
+	.read = { reg_read, reg_read, reg_read },
+	.write = { NULL, NULL, reg_write_w },
+	.timed = true,
+};
+
+static const struct psycho_bus_io io_gp1 = {
+	.read = { reg_read, reg_read, reg_read },
+	.write = { NULL, NULL, reg_write_w },
+	.timed = false,
+};
+
+NODISCARD bool gpu_init(struct psycho_ctx *const ctx)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	// Rows are 2 KiB, so VRAM is 2 MiB-aligned like any other block.
+	gpu->vram = (u16 *)(void *)mem_huge_alloc(PSYCHO_GPU_VRAM_SIZE);
+
+	if (!gpu->vram) {
+		return false;
+	}
+
+	gpu->render = gpu_render_new(gpu->vram);
+
+	if (!gpu->render) {
+		mem_huge_free((u8 *)gpu->vram, PSYCHO_GPU_VRAM_SIZE);
+		return false;
+	}
+
+	bus_io_register(ctx, PSYCHO_GPU_GP0_ADDR, PSYCHO_GPU_GP0_ADDR + 3,
+			&io_gp0);
+	bus_io_register(ctx, PSYCHO_GPU_GP1_ADDR, PSYCHO_GPU_GP1_ADDR + 3,
+			&io_gp1);
+	return true;
+}
+
+void gpu_free(struct psycho_ctx *const ctx)
+{
+	gpu_render_free(ctx->gpu.render);
+	mem_huge_free((u8 *)ctx->gpu.vram, PSYCHO_GPU_VRAM_SIZE);
+}
+
+void gpu_reset(struct psycho_ctx *const ctx)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	gpu_render_start(gpu->render, gpu->bands);
+	gpu_sync(ctx);
+
+	memset(gpu->vram, 0, PSYCHO_GPU_VRAM_SIZE);
+	gpu->read = 0;
+	gp1_reset(ctx);
+}
+
+void gpu_gp0_write(struct psycho_ctx *const ctx, const u32 *const words,
+		   const uint n)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+	uint i = 0;
+
+	while (i < n) {
+		struct psycho_gpu_xfer *const x = &gpu->upload;
+
+		if (x->left == 0) {
+			cmd_write(ctx, words[i++]);
+			continue;
+		}
+
+		const u32 want = (x->left + 1) / 2;
+		const uint len = (want < (n - i)) ? want : (n - i);
+		const u32 px = ((len * 2) < x->left) ? (len * 2) : x->left;
+
+		x->pos += px;
+		x->left -= px;
+		gpu_render_push(gpu->render, &words[i], len);
+		i += len;
+	}
+}
+
+void gpu_gpuread(struct psycho_ctx *const ctx, u32 *const words, const uint n)
+{
+	struct psycho_gpu *const gpu = &ctx->gpu;
+	struct psycho_gpu_xfer *const x = &gpu->download;
+	uint i = 0;
+
+	if (x->left != 0) {
+		u8 *dst = (u8 *)words;
+		u32 left = ((n * 2) < x->left) ? (n * 2) : x->left;
+		uint col = x->pos % x->w;
+		uint y = x->y + (x->pos / x->w);
+
+		x->pos += left;
+		x->left -= left;
+
+		// The high half of a word past the end of the transfer is 0.
+		i = (left + 1) / 2;
+		words[i - 1] = 0;
+
+		// Commands sent since the transfer started may have drawn over
+		// it.
+		gpu_sync(ctx);
+
+		while (left != 0) {
+			const u16 *const row =
+				&gpu->vram[(y & GPU_VRAM_Y_MASK) *
+					   PSYCHO_GPU_VRAM_WIDTH];
+			const uint px = (x->x + col) & GPU_VRAM_X_MASK;
+			const uint rest = x->w - col;
+			const uint len = (rest < left) ? rest : left;
+			const uint first = PSYCHO_GPU_VRAM_WIDTH - px;
+			const uint a = (len < first) ? len : first;
+
+			memcpy(dst, &row[px], a * sizeof(u16));
+			memcpy(&dst[a * sizeof(u16)], row,
+			       (len - a) * sizeof(u16));
+			dst += len * sizeof(u16);
+			left -= len;
+			col = 0;
+			y++;
+		}
+		gpu->read = words[i - 1];
+	}
+
+	// Past the end of the transfer, what was last read is read again.
+	for (; i < n; ++i) {
+		words[i] = gpu->read;
+	}
+}
+
+void gpu_sync(struct psycho_ctx *const ctx)
+{
+	gpu_render_sync(ctx->gpu.render);
+}
+
+void gpu_restore(struct psycho_ctx *const ctx)
+{
+	gpu_render_restore(ctx->gpu.render, &ctx->gpu);
+}
+
+NODISCARD const u16 *psycho_ctx_vram(struct psycho_ctx *const ctx)
+{
+	gpu_sync(ctx);
+	return ctx->gpu.vram;
+}
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu.h Provides the GPU.
+
+#pragma once
+
+#include "compiler.h"
+#include "psycho/ctx.h"
+
+// clang-format off
+
+///@{
+/// @brief The bits of the first word of a drawing command.
+#define GPU_CMD_RAW		(1 << 0)
+#define GPU_CMD_SEMI		(1 << 1)
+#define GPU_CMD_TEXTURED	(1 << 2)
+#define GPU_CMD_QUAD		(1 << 3)
+#define GPU_CMD_POLYLINE	(1 << 3)
+#define GPU_CMD_SHADED		(1 << 4)
+#define GPU_CMD_SIZE_SHIFT	(3)
+///@}
+
+///@{
+/// @brief The groups of GP0 commands, as the top 3 bits of the command.
+#define GPU_CMD_GROUP_MISC	(0)
+#define GPU_CMD_GROUP_POLY	(1)
+#define GPU_CMD_GROUP_LINE	(2)
+#define GPU_CMD_GROUP_RECT	(3)
+#define GPU_CMD_GROUP_COPY	(4)
+#define GPU_CMD_GROUP_UPLOAD	(5)
+#define GPU_CMD_GROUP_DOWNLOAD	(6)
+#define GPU_CMD_GROUP_ENV	(7)
+///@}
+
+#define GPU_CMD_FILL		(0x02)
+#define GPU_CMD_IRQ		(0x1F)
+
+/// @brief The bit of GP0(E1h) which disables texturing, if GP1(09h) allows it.
+#define GPU_DRAW_MODE_TEX_OFF	(1U << 11)
+
+/// @brief The bits of GP0(E1h) replaced by the texture page of a polygon.
+#define GPU_DRAW_MODE_TPAGE	(0x9FFU)
+
+#define GPU_VRAM_X_MASK		(PSYCHO_GPU_VRAM_WIDTH - 1)
+#define GPU_VRAM_Y_MASK		(PSYCHO_GPU_VRAM_HEIGHT - 1)
+
+// clang-format on
+
+/// @brief Returns the length of a GP0 command (in words) from its first word.
+/// VRAM transfers are counted without their data, and polylines as one line.
+static ALWAYS_INLINE NODISCARD uint gpu_pkt_len(const u32 word)
+{
+	const uint cmd = word >> 24;
+	const uint shaded = (cmd & GPU_CMD_SHADED) ? 1 : 0;
+
+	switch (cmd >> 5) {
+	case GPU_CMD_GROUP_POLY: {
+		const uint verts = (cmd & GPU_CMD_QUAD) ? 4 : 3;
+		const uint textured = (cmd & GPU_CMD_TEXTURED) ? 1 : 0;
+
+		return 1 + (verts * (1 + textured)) + (shaded * (verts - 1));
+	}
+
+	case GPU_CMD_GROUP_LINE:
+		return 3 + shaded;
+
+	case GPU_CMD_GROUP_RECT: {
+		const uint textured = (cmd & GPU_CMD_TEXTURED) ? 1 : 0;
+		const uint sized = ((cmd >> GPU_CMD_SIZE_SHIFT) & 3) ? 0 : 1;
+
+		return 2 + textured + sized;
+	}
+
+	case GPU_CMD_GROUP_COPY:
+		return 4;
+
+	case GPU_CMD_GROUP_UPLOAD:
+	case GPU_CMD_GROUP_DOWNLOAD:
+		return 3;
+
+	default:
+		return (cmd == GPU_CMD_FILL) ? 3 : 1;
+	}
+}
+
+/// @brief Returns the rectangle a VRAM transfer command moves, from its
+/// position and size words. Sizes of 0 stand for the whole width or height of
+/// VRAM.
+static ALWAYS_INLINE NODISCARD struct psycho_gpu_xfer
+gpu_xfer_get(const u32 pos, const u32 size)
+{
+	const u16 w = (u16)((((size & 0x3FF) - 1) & 0x3FF) + 1);
+	const u16 h = (u16)(((((size >> 16) & 0x1FF) - 1) & 0x1FF) + 1);
+
+	return (struct psycho_gpu_xfer){ .x = (u16)(pos & GPU_VRAM_X_MASK),
+					 .y = (u16)((pos >> 16) &
+						    GPU_VRAM_Y_MASK),
+					 .w = w,
+					 .h = h,
+					 .pos = 0,
+					 .left = (u32)w * h };
+}
+
+/// @brief Allocates VRAM and the drawing threads' state, and registers the
+/// GPU's I/O registers.
+///
+/// @returns true if memory could be allocated, false otherwise.
+NODISCARD bool gpu_init(struct psycho_ctx *ctx);
+
+/// @brief Releases what gpu_init() allocated, stopping the drawing threads.
+void gpu_free(struct psycho_ctx *ctx);
+
+/// @brief Resets the GPU and clears VRAM. The drawing threads are started
+/// the first time.
+void gpu_reset(struct psycho_ctx *ctx);
+
+/// @brief Writes words to GP0 in one go, as a block transfer of DMA channel 2
+/// would. The data of a CPU to VRAM transfer is queued as a whole, rather than
+/// a word at a time.
+void gpu_gp0_write(struct psycho_ctx *ctx, const u32 *words, uint n);
+
+/// @brief Reads words from GPUREAD in one go, as a block transfer of DMA
+/// channel 2 would. The pixels of a VRAM to CPU transfer are copied a row at a
+/// time.
+void gpu_gpuread(struct psycho_ctx *ctx, u32 *words, uint n);
+
+/// @brief Waits until every command sent so far has been drawn.
+void gpu_sync(struct psycho_ctx *ctx);
+
+/// @brief Hands the drawing state over to the drawing threads after it was
+/// changed behind their back, e.g. by loading a save state. gpu_sync() must
+/// be called before it was changed.
+void gpu_restore(struct psycho_ctx *ctx);
@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_draw.c Implements the rasterizer.
+///
+/// Primitives are drawn a row at a time, and only on the rows of the band
+/// being drawn, so that several threads can draw the same primitives at once
+/// without touching the same pixels. Pixel centres lie on integer
+/// coordinates; a triangle covers the pixels on its top and left edges, but
+/// not those on its bottom and right ones. Colours and texture coordinates are
+/// interpolated across triangles from their plane equations, in 16.16 fixed
+/// point. The pixels of each row are drawn by the span kernels.
+
+#include <stdlib.h>
+
+#include "gpu.h"
+#include "gpu_draw.h"
+#include "gpu_span.h"
+
+// clang-format off
+
+#define FRAC_SHIFT	GPU_SPAN_FRAC_SHIFT
+#define FRAC_ONE	(1 << FRAC_SHIFT)
+
+/// @brief Rounds interpolated values to the nearest integer.
+#define FRAC_HALF	(1 << (FRAC_SHIFT - 1))
+
+/// @brief The steepest gradient kept. Values only span 256 units, so a
+/// triangle any steeper is at most a pixel wide, and stepping past its last
+/// pixel must not overflow.
+#define GRAD_MAX	(1 << 26)
+
+// clang-format on
+
+static ALWAYS_INLINE NODISCARD s32 max_s32(const s32 a, const s32 b)
+{
+	return (a > b) ? a : b;
+}
+
+static ALWAYS_INLINE NODISCARD s32 min_s32(const s32 a, const s32 b)
+{
+	return (a < b) ? a : b;
+}
+
+/// @brief Returns where an edge crosses a row, rounded up to the first pixel
+/// centre on or to the right of it. The row must lie between the ends of the
+/// edge, excluding the bottom one.
+static ALWAYS_INLINE NODISCARD s32 edge_x(const struct gpu_vtx *const a,
+					  const struct gpu_vtx *const b,
+					  const s32 y)
+{
+	const s32 n = (b->x - a->x) * (y - a->y);
+	const s32 d = b->y - a->y;
+
+	return a->x + ((n >= 0) ? ((n + d - 1) / d) : -((-n) / d));
+}
+
+static void attrs_get(const struct gpu_vtx *const v, s32 a[GPU_ATTRS_NUM])
+{
+	a[GPU_ATTR_R] = v->r;
+	a[GPU_ATTR_G] = v->g;
+	a[GPU_ATTR_B] = v->b;
+	a[GPU_ATTR_U] = v->u;
+	a[GPU_ATTR_V] = v->v;
+}
+
+static void tri_draw(u16 *const vram, const gpu_span_fn *const spans,
+		     const struct gpu_prim *const p, const u8 *const band_of,
+		     const uint band)
+{
+	const struct gpu_env *const e = &p->env;
+	const struct gpu_vtx *v0 = &p->v[0];
+	const struct gpu_vtx *v1 = &p->v[1];
+	const struct gpu_vtx *v2 = &p->v[2];
+	const struct gpu_vtx *t;
+
+	// Sort the vertices from top to bottom.
+	if (v1->y < v0->y) {
+		t = v0, v0 = v1, v1 = t;
+	}
+
+	if (v2->y < v1->y) {
+		t = v1, v1 = v2, v2 = t;
+	}
+
+	if (v1->y < v0->y) {
+		t = v0, v0 = v1, v1 = t;
+	}
+
+	const s64 ex1 = v1->x - v0->x;
+	const s64 ey1 = v1->y - v0->y;
+	const s64 ex2 = v2->x - v0->x;
+	const s64 ey2 = v2->y - v0->y;
+	const s64 area = (ex1 * ey2) - (ex2 * ey1);
+
+	if (area == 0) {
+		return;
+	}
+
+	s32 a0[GPU_ATTRS_NUM];
+	s32 a1[GPU_ATTRS_NUM];
+	s32 a2[GPU_ATTRS_NUM];
+	s64 dx[GPU_ATTRS_NUM];
+	s64 dy[GPU_ATTRS_NUM];
+	s32 step[GPU_ATTRS_NUM];
+
+	attrs_get(v0, a0);
+	attrs_get(v1, a1);
+	attrs_get(v2, a2);
+
+	for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+		const s64 d1 = a1[i] - a0[i];
+		const s64 d2 = a2[i] - a0[i];
+
+		dx[i] = (((d1 * ey2) - (d2 * ey1)) * FRAC_ONE) / area;
+		dy[i] = (((d2 * ex1) - (d1 * ex2)) * FRAC_ONE) / area;
+
+		step[i] = (s32)((dx[i] > GRAD_MAX) ?
+					GRAD_MAX :
+					((dx[i] < -GRAD_MAX) ? -GRAD_MAX :
+							       dx[i]));
+	}
+
+	uint kind = GPU_SPAN_FLAT;
+
+	if (p->flags & GPU_PRIM_TEXTURED) {
+		kind = e->tex ? GPU_SPAN_DECODED : (GPU_SPAN_TEX + e->depth);
+	} else if (step[GPU_ATTR_R] || step[GPU_ATTR_G] || step[GPU_ATTR_B]) {
+		kind = GPU_SPAN_GOURAUD;
+	}
+
+	const s32 y_beg = max_s32(v0->y, e->y1);
+	const s32 y_end = min_s32(v2->y, e->y2 + 1);
+
+	for (s32 y = y_beg; y < y_end; ++y) {
+		if (band_of[y] != band) {
+			continue;
+		}
+
+		s32 xl = edge_x(v0, v2, y);
+		s32 xr = (y < v1->y) ? edge_x(v0, v1, y) : edge_x(v1, v2, y);
+
+		if (xl > xr) {
+			const s32 x = xl;
+
+			xl = xr;
+			xr = x;
+		}
+
+		xl = max_s32(xl, e->x1);
+		xr = min_s32(xr, e->x2 + 1);
+
+		if (xl >= xr) {
+			continue;
+		}
+
+		// The first pixel lies within the triangle, so its values do
+		// too.
+		s32 val[GPU_ATTRS_NUM];
+
+		for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+			val[i] = (s32)(((s64)a0[i] * FRAC_ONE) + FRAC_HALF +
+				       (dx[i] * (xl - v0->x)) +
+				       (dy[i] * (y - v0->y)));
+		}
+		spans[kind](vram, p, (uint)y, (uint)xl, (uint)xr, val, step);
+	}
+}
+
+static void rect_draw(u16 *const vram, const gpu_span_fn *const spans,
+		      const struct gpu_prim *const p, const u8 *const band_of,
+		      const uint band)
+{
+	const struct gpu_env *const e = &p->env;
+	const struct gpu_vtx *const v = &p->v[0];
+	const s32 du = (p->flags & GPU_PRIM_FLIP_X) ? -1 : 1;
+	const s32 dv = (p->flags & GPU_PRIM_FLIP_Y) ? -1 : 1;
+	const s32 x_beg = max_s32(v->x, e->x1);
+	const s32 x_end = min_s32(v->x + p->v[1].x, e->x2 + 1);
+	const s32 y_beg = max_s32(v->y, e->y1);
+	const s32 y_end = min_s32(v->y + p->v[1].y, e->y2 + 1);
+	const bool textured = p->flags & GPU_PRIM_TEXTURED;
+	uint kind = GPU_SPAN_FLAT;
+
+	if (textured) {
+		kind = e->tex ? GPU_SPAN_DECODED : (GPU_SPAN_TEX + e->depth);
+	}
+
+	s32 step[GPU_ATTRS_NUM] = { 0 };
+	s32 val[GPU_ATTRS_NUM] = { v->r * FRAC_ONE, v->g * FRAC_ONE,
+				   v->b * FRAC_ONE };
+
+	step[GPU_ATTR_U] = du * FRAC_ONE;
+
+	for (s32 y = y_beg; y < y_end; ++y) {
+		if (band_of[y] != band) {
+			continue;
+		}
+
+		const s32 tv = (v->v + (dv * (y - v->y))) & 0xFF;
+
+		val[GPU_ATTR_V] = tv * FRAC_ONE;
+
+		// Texture coordinates wrap around, so a row is drawn in runs
+		// within which they do not.
+		for (s32 x = x_beg; x < x_end;) {
+			const s32 tu = (v->u + (du * (x - v->x))) & 0xFF;
+			const s32 run = (du > 0) ? (256 - tu) : (tu + 1);
+			const s32 end = textured ? min_s32(x + run, x_end) :
+						   x_end;
+
+			val[GPU_ATTR_U] = tu * FRAC_ONE;
+			spans[kind](vram, p, (uint)y, (uint)x, (uint)end, val,
+				    step);
+			x = end;
+		}
+	}
+}
+
+/// @brief Draws a line, both ends included, stepping one pixel at a time
+/// along its major axis.
+static void line_draw(u16 *const vram, const gpu_span_fn *const spans,
+		      const struct gpu_prim *const p, const u8 *const band_of,
+		      const uint band)
+{
+	const struct gpu_env *const e = &p->env;
+	const struct gpu_vtx *const a = &p->v[0];
+	const struct gpu_vtx *const b = &p->v[1];
+	const s32 dx = b->x - a->x;
+	const s32 dy = b->y - a->y;
+	const s32 n = max_s32(abs(dx), abs(dy));
+
+	s32 pos_x = (a->x * FRAC_ONE) + FRAC_HALF;
+	s32 pos_y = (a->y * FRAC_ONE) + FRAC_HALF;
+	s32 step_x = 0;
+	s32 step_y = 0;
+	s32 val[GPU_ATTRS_NUM] = { (a->r * FRAC_ONE) + FRAC_HALF,
+				   (a->g * FRAC_ONE) + FRAC_HALF,
+				   (a->b * FRAC_ONE) + FRAC_HALF };
+	s32 step[GPU_ATTRS_NUM] = { 0 };
+
+	if (n != 0) {
+		step_x = (dx * FRAC_ONE) / n;
+		step_y = (dy * FRAC_ONE) / n;
+		step[GPU_ATTR_R] = ((b->r - a->r) * FRAC_ONE) / n;
+		step[GPU_ATTR_G] = ((b->g - a->g) * FRAC_ONE) / n;
+		step[GPU_ATTR_B] = ((b->b - a->b) * FRAC_ONE) / n;
+	}
+
+	for (s32 i = 0; i <= n; ++i) {
+		const s32 x = pos_x >> FRAC_SHIFT;
+		const s32 y = pos_y >> FRAC_SHIFT;
+
+		// Each pixel is a span of its own.
+		if ((x >= e->x1) && (x <= e->x2) && (y >= e->y1) &&
+		    (y <= e->y2) && (band_of[y] == band)) {
+			spans[GPU_SPAN_GOURAUD](vram, p, (uint)y, (uint)x,
+						(uint)x + 1, val, step);
+		}
+		pos_x += step_x;
+		pos_y += step_y;
+
+		for (uint j = 0; j < GPU_ATTRS_NUM; ++j) {
+			val[j] += step[j];
+		}
+	}
+}
+
+/// @brief Fills a rectangle with a colour, wrapping around the edges of VRAM.
+/// Neither the drawing area nor the mask bit setting apply.
+static void fill_draw(u16 *const vram, const struct gpu_prim *const p,
+		      const u8 *const band_of, const uint band)
+{
+	const struct gpu_vtx *const v = &p->v[0];
+	const u16 c = (u16)((v->r >> 3) | ((v->g >> 3) << 5) |
+			    ((v->b >> 3) << 10));
+
+	for (s32 j = 0; j < p->v[1].y; ++j) {
+		const uint y = (uint)(v->y + j) & GPU_VRAM_Y_MASK;
+		u16 *const row = &vram[y * PSYCHO_GPU_VRAM_WIDTH];
+
+		if (band_of[y] != band) {
+			continue;
+		}
+
+		for (s32 i = 0; i < p->v[1].x; ++i) {
+			row[(uint)(v->x + i) & GPU_VRAM_X_MASK] = c;
+		}
+	}
+}
+
+void gpu_draw(u16 *const vram, const gpu_span_fn *const spans,
+	      const struct gpu_prim *const p, const u8 *const band_of,
+	      const uint band)
+{
+	switch (p->type) {
+	case GPU_PRIM_TRI:
+		tri_draw(vram, spans, p, band_of, band);
+		break;
+
+	case GPU_PRIM_RECT:
+		rect_draw(vram, spans, p, band_of, band);
+		break;
+
+	case GPU_PRIM_LINE:
+		line_draw(vram, spans, p, band_of, band);
+		break;
+
+	default:
+		fill_draw(vram, p, band_of, band);
+		break;
+	}
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_draw.h Provides the rasterizer, which draws primitives decoded
+/// from GP0 commands into VRAM.
+
+#pragma once
+
+#include "gpu_span.h"
+#include "psycho/types.h"
+
+// clang-format off
+
+///@{
+/// @brief The kinds of primitives.
+#define GPU_PRIM_TRI	(0)
+#define GPU_PRIM_RECT	(1)
+#define GPU_PRIM_LINE	(2)
+#define GPU_PRIM_FILL	(3)
+///@}
+
+///@{
+/// @brief How a primitive is drawn.
+#define GPU_PRIM_SHADED		(1 << 0)
+#define GPU_PRIM_TEXTURED	(1 << 1)
+#define GPU_PRIM_RAW		(1 << 2)
+#define GPU_PRIM_SEMI		(1 << 3)
+#define GPU_PRIM_DITHER		(1 << 4)
+#define GPU_PRIM_FLIP_X		(1 << 5)
+#define GPU_PRIM_FLIP_Y		(1 << 6)
+///@}
+
+///@{
+/// @brief The colour depths of texture pages.
+#define GPU_DEPTH_4BPP	(0)
+#define GPU_DEPTH_8BPP	(1)
+#define GPU_DEPTH_15BPP	(2)
+///@}
+
+/// @brief The bit of a pixel which is the mask bit.
+#define GPU_MASK_BIT	(0x8000)
+
+// clang-format on
+
+/// @brief The drawing state a primitive is drawn with.
+struct gpu_env {
+	/// @brief The texture page decoded through the CLUT, or NULL if texels
+	/// are read from VRAM.
+	const u16 *tex;
+
+	///@{
+	/// @brief The drawing area, inclusive.
+	s16 x1;
+	s16 y1;
+	s16 x2;
+	s16 y2;
+	///@}
+
+	///@{
+	/// @brief The texture page and the CLUT, in pixels.
+	u16 tp_x;
+	u16 tp_y;
+	u16 clut_x;
+	u16 clut_y;
+	///@}
+
+	///@{
+	/// @brief The texture window: texture coordinates are ANDed with the
+	/// first two, then ORed with the others.
+	u8 tw_and_u;
+	u8 tw_and_v;
+	u8 tw_or_u;
+	u8 tw_or_v;
+	///@}
+
+	/// @brief One of GPU_DEPTH_*.
+	u8 depth;
+
+	/// @brief The semi-transparency mode.
+	u8 semi;
+
+	/// @brief GPU_MASK_BIT if pixels with the mask bit set are left alone,
+	/// 0 otherwise.
+	u16 mask_check;
+
+	/// @brief Set in every pixel drawn.
+	u16 mask_set;
+	u8 pad[6];
+};
+
+struct gpu_vtx {
+	s32 x;
+	s32 y;
+	u8 r;
+	u8 g;
+	u8 b;
+	u8 u;
+	u8 v;
+	u8 pad[3];
+};
+
+/// @brief A primitive, in VRAM coordinates. Rectangles and fills give their
+/// top-left corner in the first vertex and their size in the second.
+struct gpu_prim {
+	struct gpu_env env;
+	struct gpu_vtx v[3];
+
+	/// @brief One of GPU_PRIM_TRI, GPU_PRIM_RECT, GPU_PRIM_LINE or
+	/// GPU_PRIM_FILL.
+	u8 type;
+
+	/// @brief Any of GPU_PRIM_SHADED to GPU_PRIM_FLIP_Y.
+	u8 flags;
+	u8 pad[6];
+};
+
+/// @brief Draws the rows of a primitive which belong to a band.
+///
+/// @param spans The span kernels to draw with, from gpu_span_get().
+/// @param band_of The band each row of VRAM belongs to.
+void gpu_draw(u16 *vram, const gpu_span_fn *spans, const struct gpu_prim *p,
+	      const u8 *band_of, uint band);
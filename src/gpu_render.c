@@ -0,0 +1,1118 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_render.c Implements the drawing threads.
+///
+/// The CPU's thread writes GP0 commands into a single-producer,
+/// single-consumer ring, and publishes them a whole command at a time, so a
+/// command is never seen half-written. The render thread reads them, decodes
+/// drawing commands into primitives, and gathers those into a batch. A batch
+/// is drawn once it is full, once the ring runs dry, or before a command which
+/// reads VRAM it may have drawn to.
+///
+/// VRAM is split into strips of rows, which are dealt out to the bands in
+/// turn. Each band has its own thread (the render thread draws the first one),
+/// which draws every primitive of the batch, but only on its own rows. Pixels
+/// are therefore drawn in order, with no locking, and the bands stay balanced
+/// wherever on screen the primitives are. A band may still read texels from
+/// another band's rows, so a batch never both draws to a row and reads texels
+/// from it.
+///
+/// The ring is lock-free; a thread only locks to go to sleep when it has
+/// nothing to do, or to wake the other one.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpu.h"
+#include "gpu_draw.h"
+#include "gpu_render.h"
+#include "gpu_tex.h"
+
+// clang-format off
+
+/// @brief The size of the ring (in words), which must be a power of two.
+#define RING_SIZE	(UINT32_C(1) << 16)
+#define RING_MASK	(RING_SIZE - 1)
+
+/// @brief The most words queued at once.
+#define PUSH_MAX	(RING_SIZE / 4)
+
+/// @brief The most primitives drawn at once.
+#define BATCH_MAX	(512)
+
+/// @brief The height of a strip (in rows), expressed as a shift.
+#define STRIP_SHIFT	(3)
+
+#define ROWS_WORDS	(PSYCHO_GPU_VRAM_HEIGHT / 64)
+
+///@{
+/// @brief The bits of GP0(E1h) the rasterizer needs, besides the texture page.
+#define DRAW_MODE_DITHER	(1U << 9)
+#define DRAW_MODE_FLIP_X	(1U << 12)
+#define DRAW_MODE_FLIP_Y	(1U << 13)
+///@}
+
+// clang-format on
+
+struct worker {
+	struct psycho_gpu_render *r;
+	pthread_t thread;
+	uint band;
+	u32 pad;
+};
+
+struct psycho_gpu_render {
+	u32 ring[RING_SIZE];
+
+	/// @brief Where the CPU's thread writes the next word. Only whole
+	/// commands are published.
+	atomic_uint head;
+
+	/// @brief Keeps head and tail on cache lines of their own, as they are
+	/// written by different threads.
+	u8 head_pad[64 - sizeof(atomic_uint)];
+
+	/// @brief Where the render thread reads the next word.
+	atomic_uint tail;
+
+	/// @brief The position up to which every word has been drawn.
+	atomic_uint retired;
+
+	/// @brief Whether the render thread is waiting for work, or about to.
+	/// The push which wakes it clears this.
+	atomic_bool sleeping;
+
+	bool quit;
+
+	/// @brief Whether the render thread is running. If not, words are drawn
+	/// as soon as they are published.
+	bool threaded;
+	u8 pad[5];
+
+	/// @brief Guards the render thread going to sleep, and waking up.
+	pthread_mutex_t lock;
+
+	/// @brief Signalled when words are published to a sleeping render
+	/// thread.
+	pthread_cond_t work;
+
+	/// @brief Broadcast when retired moves.
+	pthread_cond_t idle;
+
+	pthread_t thread;
+
+	u16 *vram;
+
+	/// @brief The span kernels for the host, picked once.
+	const gpu_span_fn *spans;
+
+	struct gpu_tex *tex;
+
+	///@{
+	/// @brief The drawing state, as in psycho_gpu.
+	u32 draw_mode;
+	u32 tex_window;
+	u32 area_tl;
+	u32 area_br;
+	u32 offset;
+	u32 mask;
+	///@}
+
+	/// @brief The drawing state decoded for primitives, and the drawing
+	/// offset.
+	struct gpu_env env;
+	s32 off_x;
+	s32 off_y;
+
+	struct psycho_gpu_xfer upload;
+
+	struct gpu_prim batch[BATCH_MAX];
+	uint batch_len;
+
+	/// @brief Whether the batch is a single primitive which reads texels
+	/// from rows it draws to. It is drawn by one thread, as the result
+	/// depends on the order the rows are drawn in.
+	bool batch_solo;
+	u8 batch_pad[3];
+
+	///@{
+	/// @brief One bit per row drawn to, and per row texels are read from,
+	/// by the batch. These are only kept if there is more than one band.
+	u64 batch_drawn[ROWS_WORDS];
+	u64 batch_read[ROWS_WORDS];
+	///@}
+
+	uint bands;
+	u32 bands_pad;
+
+	/// @brief The band each row belongs to.
+	u8 band_of[PSYCHO_GPU_VRAM_HEIGHT];
+
+	/// @brief The threads drawing the bands after the first.
+	struct worker workers[PSYCHO_GPU_BANDS_MAX];
+
+	/// @brief Guards the fields below.
+	pthread_mutex_t band_lock;
+
+	/// @brief Broadcast when a batch is ready to draw.
+	pthread_cond_t band_go;
+
+	/// @brief Signalled when the last band is drawn.
+	pthread_cond_t band_done;
+
+	/// @brief Counts the batches handed to the workers.
+	uint band_gen;
+
+	/// @brief The number of workers still drawing the current batch.
+	uint band_left;
+
+	bool band_quit;
+	u8 band_pad[7];
+};
+
+/// @brief Puts every row in the first band.
+static const u8 band_all[PSYCHO_GPU_VRAM_HEIGHT];
+
+/// @brief Sign-extends an 11-bit coordinate.
+static ALWAYS_INLINE NODISCARD s32 sext11(const u32 v)
+{
+	return (s32)((v & 0x7FF) ^ 0x400) - 0x400;
+}
+
+static void bands_set(struct psycho_gpu_render *const r, const uint bands)
+{
+	r->bands = bands;
+
+	for (uint y = 0; y < PSYCHO_GPU_VRAM_HEIGHT; ++y) {
+		r->band_of[y] = (u8)((y >> STRIP_SHIFT) % bands);
+	}
+}
+
+/// @brief Draws the batch, in every band at once.
+static void batch_flush(struct psycho_gpu_render *const r)
+{
+	if (r->batch_len == 0) {
+		return;
+	}
+
+	if (r->batch_solo) {
+		gpu_draw(r->vram, r->spans, &r->batch[0], band_all, 0);
+	} else {
+		if (r->bands > 1) {
+			pthread_mutex_lock(&r->band_lock);
+			r->band_gen++;
+			r->band_left = r->bands - 1;
+			pthread_cond_broadcast(&r->band_go);
+			pthread_mutex_unlock(&r->band_lock);
+		}
+
+		for (uint i = 0; i < r->batch_len; ++i) {
+			gpu_draw(r->vram, r->spans, &r->batch[i], r->band_of,
+				 0);
+		}
+
+		if (r->bands > 1) {
+			pthread_mutex_lock(&r->band_lock);
+
+			while (r->band_left != 0) {
+				pthread_cond_wait(&r->band_done,
+						  &r->band_lock);
+			}
+			pthread_mutex_unlock(&r->band_lock);
+		}
+	}
+	memset(r->batch_drawn, 0, sizeof(r->batch_drawn));
+	memset(r->batch_read, 0, sizeof(r->batch_read));
+	gpu_tex_flushed(r->tex);
+	r->batch_len = 0;
+	r->batch_solo = false;
+}
+
+static void *worker_main(void *const arg)
+{
+	const struct worker *const w = arg;
+	struct psycho_gpu_render *const r = w->r;
+	uint gen = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&r->band_lock);
+
+		while (!r->band_quit && (r->band_gen == gen)) {
+			pthread_cond_wait(&r->band_go, &r->band_lock);
+		}
+
+		if (r->band_quit) {
+			pthread_mutex_unlock(&r->band_lock);
+			break;
+		}
+		gen = r->band_gen;
+		pthread_mutex_unlock(&r->band_lock);
+
+		for (uint i = 0; i < r->batch_len; ++i) {
+			gpu_draw(r->vram, r->spans, &r->batch[i], r->band_of,
+				 w->band);
+		}
+
+		pthread_mutex_lock(&r->band_lock);
+
+		if (--r->band_left == 0) {
+			pthread_cond_signal(&r->band_done);
+		}
+		pthread_mutex_unlock(&r->band_lock);
+	}
+	return NULL;
+}
+
+/// @brief Sets the bits of a set of rows for n rows from y, wrapping around
+/// the bottom of VRAM.
+static void rows_add(u64 rows[ROWS_WORDS], uint y, uint n)
+{
+	while (n != 0) {
+		const uint bit = y % 64;
+		const uint len = (n < (64 - bit)) ? n : (64 - bit);
+		const u64 bits = (len == 64) ? UINT64_MAX :
+					       ((UINT64_C(1) << len) - 1);
+
+		rows[y / 64] |= bits << bit;
+		y = (y + len) & GPU_VRAM_Y_MASK;
+		n -= len;
+	}
+}
+
+static NODISCARD bool rows_overlap(const u64 a[ROWS_WORDS],
+				   const u64 b[ROWS_WORDS])
+{
+	u64 any = 0;
+
+	for (uint i = 0; i < ROWS_WORDS; ++i) {
+		any |= a[i] & b[i];
+	}
+	return any != 0;
+}
+
+/// @brief Adds a primitive to the batch, drawing the batch first if it must.
+///
+/// @param x, y The first column and row drawn to.
+/// @param w, n The number of columns and rows drawn to.
+/// @returns The primitive, with only its environment, type and flags set.
+static NODISCARD struct gpu_prim *
+prim_add(struct psycho_gpu_render *const r, const struct gpu_env *const e,
+	 const uint type, const uint flags, const uint x, const uint y,
+	 const uint w, const uint n)
+{
+	if (r->batch_len == BATCH_MAX) {
+		batch_flush(r);
+	}
+
+	// Whichever comes first, a band must not draw to rows another band
+	// reads texels from. A primitive which reads rows it draws to itself
+	// is drawn by one thread, in the order a single band would draw it.
+	if (r->bands > 1) {
+		u64 drawn[ROWS_WORDS] = { 0 };
+		u64 read[ROWS_WORDS] = { 0 };
+
+		rows_add(drawn, y, n);
+
+		if (flags & GPU_PRIM_TEXTURED) {
+			rows_add(read, e->tp_y, 256);
+
+			if (e->depth != GPU_DEPTH_15BPP) {
+				rows_add(read, e->clut_y, 1);
+			}
+		}
+
+		const bool solo = rows_overlap(read, drawn);
+
+		if (solo || r->batch_solo ||
+		    rows_overlap(read, r->batch_drawn) ||
+		    rows_overlap(drawn, r->batch_read)) {
+			batch_flush(r);
+		}
+		r->batch_solo = solo;
+
+		for (uint i = 0; i < ROWS_WORDS; ++i) {
+			r->batch_drawn[i] |= drawn[i];
+			r->batch_read[i] |= read[i];
+		}
+	}
+
+	const u16 *tex = NULL;
+
+	if ((flags & GPU_PRIM_TEXTURED) && (e->depth != GPU_DEPTH_15BPP)) {
+		tex = gpu_tex_get(r->tex, r->vram, e, x, y, w, n);
+	}
+	gpu_tex_written(r->tex, x, y, w, n, true);
+
+	struct gpu_prim *const p = &r->batch[r->batch_len++];
+
+	p->env = *e;
+	p->env.tex = tex;
+	p->type = (u8)type;
+	p->flags = (u8)flags;
+	return p;
+}
+
+/// @brief Decodes the drawing state into the environment of primitives.
+static void env_update(struct psycho_gpu_render *const r)
+{
+	struct gpu_env *const e = &r->env;
+	const u32 depth = (r->draw_mode >> 7) & 3;
+	const u32 tw = r->tex_window;
+	const u32 mask_u = (tw & 0x1F) * 8;
+	const u32 mask_v = ((tw >> 5) & 0x1F) * 8;
+
+	e->x1 = (s16)(r->area_tl & 0x3FF);
+	e->y1 = (s16)((r->area_tl >> 10) & 0x1FF);
+	e->x2 = (s16)(r->area_br & 0x3FF);
+	e->y2 = (s16)((r->area_br >> 10) & 0x1FF);
+
+	e->tp_x = (u16)((r->draw_mode & 0xF) * 64);
+	e->tp_y = (u16)(((r->draw_mode >> 4) & 1) * 256);
+	e->semi = (u8)((r->draw_mode >> 5) & 3);
+	e->depth = (u8)((depth > GPU_DEPTH_15BPP) ? GPU_DEPTH_15BPP : depth);
+
+	e->tw_and_u = (u8)~mask_u;
+	e->tw_and_v = (u8)~mask_v;
+	e->tw_or_u = (u8)((((tw >> 10) & 0x1F) * 8) & mask_u);
+	e->tw_or_v = (u8)((((tw >> 15) & 0x1F) * 8) & mask_v);
+
+	e->mask_set = (u16)((r->mask & 1) ? GPU_MASK_BIT : 0);
+	e->mask_check = (u16)((r->mask & 2) ? GPU_MASK_BIT : 0);
+
+	r->off_x = sext11(r->offset);
+	r->off_y = sext11(r->offset >> 11);
+}
+
+/// @brief Sets the CLUT of a primitive's environment from the upper half of
+/// its first texture coordinate word.
+static void clut_set(struct gpu_env *const e, const u32 uv)
+{
+	e->clut_x = (u16)(((uv >> 16) & 0x3F) * 16);
+	e->clut_y = (u16)((uv >> 22) & 0x1FF);
+}
+
+static void vtx_set(const struct psycho_gpu_render *const r,
+		    struct gpu_vtx *const v, const u32 color, const u32 pos)
+{
+	v->x = sext11((u32)(sext11(pos) + r->off_x));
+	v->y = sext11((u32)(sext11(pos >> 16) + r->off_y));
+	v->r = (u8)color;
+	v->g = (u8)(color >> 8);
+	v->b = (u8)(color >> 16);
+}
+
+/// @brief Returns whether a primitive is clipped away entirely, or too large
+/// to be drawn at all.
+static NODISCARD bool prim_cull(const struct gpu_env *const e, const s32 x1,
+				const s32 y1, const s32 x2, const s32 y2)
+{
+	return ((x2 - x1) >= PSYCHO_GPU_VRAM_WIDTH) ||
+	       ((y2 - y1) >= PSYCHO_GPU_VRAM_HEIGHT) || (x2 < e->x1) ||
+	       (x1 > e->x2) || (y2 < e->y1) || (y1 > e->y2) ||
+	       (e->x1 > e->x2) || (e->y1 > e->y2);
+}
+
+/// @brief Returns the first row of a primitive within the drawing area.
+static ALWAYS_INLINE NODISCARD uint row_beg(const struct gpu_env *const e,
+					    const s32 y)
+{
+	return (uint)((y > e->y1) ? y : e->y1);
+}
+
+/// @brief Returns the number of rows of a primitive within the drawing area.
+static ALWAYS_INLINE NODISCARD uint rows_num(const struct gpu_env *const e,
+					     const s32 y1, const s32 y2)
+{
+	return (uint)(((y2 < e->y2) ? y2 : e->y2) - (s32)row_beg(e, y1)) + 1;
+}
+
+/// @brief Returns the first column of a primitive within the drawing area.
+static ALWAYS_INLINE NODISCARD uint col_beg(const struct gpu_env *const e,
+					    const s32 x)
+{
+	return (uint)((x > e->x1) ? x : e->x1);
+}
+
+/// @brief Returns the number of columns of a primitive within the drawing
+/// area.
+static ALWAYS_INLINE NODISCARD uint cols_num(const struct gpu_env *const e,
+					     const s32 x1, const s32 x2)
+{
+	return (uint)(((x2 < e->x2) ? x2 : e->x2) - (s32)col_beg(e, x1)) + 1;
+}
+
+static void tri_add(struct psycho_gpu_render *const r,
+		    const struct gpu_env *const e, const uint flags,
+		    const struct gpu_vtx *const v0,
+		    const struct gpu_vtx *const v1,
+		    const struct gpu_vtx *const v2)
+{
+	const s32 x1 = (v0->x < v1->x) ? ((v0->x < v2->x) ? v0->x : v2->x) :
+					 ((v1->x < v2->x) ? v1->x : v2->x);
+	const s32 x2 = (v0->x > v1->x) ? ((v0->x > v2->x) ? v0->x : v2->x) :
+					 ((v1->x > v2->x) ? v1->x : v2->x);
+	const s32 y1 = (v0->y < v1->y) ? ((v0->y < v2->y) ? v0->y : v2->y) :
+					 ((v1->y < v2->y) ? v1->y : v2->y);
+	const s32 y2 = (v0->y > v1->y) ? ((v0->y > v2->y) ? v0->y : v2->y) :
+					 ((v1->y > v2->y) ? v1->y : v2->y);
+
+	if (prim_cull(e, x1, y1, x2, y2)) {
+		return;
+	}
+
+	struct gpu_prim *const p =
+		prim_add(r, e, GPU_PRIM_TRI, flags, col_beg(e, x1),
+			 row_beg(e, y1), cols_num(e, x1, x2),
+			 rows_num(e, y1, y2));
+
+	p->v[0] = *v0;
+	p->v[1] = *v1;
+	p->v[2] = *v2;
+}
+
+static void poly_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	const uint cmd = pkt[0] >> 24;
+	const uint verts = (cmd & GPU_CMD_QUAD) ? 4 : 3;
+	const bool shaded = cmd & GPU_CMD_SHADED;
+	const bool textured = cmd & GPU_CMD_TEXTURED;
+	struct gpu_vtx v[4] = { 0 };
+	struct gpu_env e;
+	uint flags = 0;
+	u32 color = pkt[0];
+
+	for (uint i = 0, w = 1; i < verts; ++i) {
+		if (shaded && (i != 0)) {
+			color = pkt[w++];
+		}
+		vtx_set(r, &v[i], color, pkt[w++]);
+
+		if (textured) {
+			v[i].u = (u8)pkt[w];
+			v[i].v = (u8)(pkt[w] >> 8);
+			w++;
+		}
+	}
+
+	if (textured) {
+		// The texture page of the polygon replaces that of the drawing
+		// mode.
+		const u32 uv1 = pkt[shaded ? 5 : 4];
+
+		r->draw_mode = (r->draw_mode & ~GPU_DRAW_MODE_TPAGE) |
+			       ((uv1 >> 16) & GPU_DRAW_MODE_TPAGE);
+		env_update(r);
+	}
+
+	e = r->env;
+
+	if (textured && !(r->draw_mode & GPU_DRAW_MODE_TEX_OFF)) {
+		clut_set(&e, pkt[2]);
+		flags |= GPU_PRIM_TEXTURED;
+		flags |= (cmd & GPU_CMD_RAW) ? GPU_PRIM_RAW : 0;
+	}
+
+	if (shaded) {
+		flags |= GPU_PRIM_SHADED;
+	}
+
+	if (cmd & GPU_CMD_SEMI) {
+		flags |= GPU_PRIM_SEMI;
+	}
+
+	// Only colours which are interpolated or blended are dithered.
+	if ((r->draw_mode & DRAW_MODE_DITHER) &&
+	    (shaded || ((flags & GPU_PRIM_TEXTURED) &&
+			!(flags & GPU_PRIM_RAW)))) {
+		flags |= GPU_PRIM_DITHER;
+	}
+
+	tri_add(r, &e, flags, &v[0], &v[1], &v[2]);
+
+	if (verts == 4) {
+		tri_add(r, &e, flags, &v[1], &v[2], &v[3]);
+	}
+}
+
+static void line_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	const uint cmd = pkt[0] >> 24;
+	const bool shaded = cmd & GPU_CMD_SHADED;
+	struct gpu_vtx a = { 0 };
+	struct gpu_vtx b = { 0 };
+	uint flags = 0;
+
+	vtx_set(r, &a, pkt[0], pkt[1]);
+	vtx_set(r, &b, shaded ? pkt[2] : pkt[0], pkt[shaded ? 3 : 2]);
+
+	if (shaded) {
+		flags |= GPU_PRIM_SHADED;
+
+		if (r->draw_mode & DRAW_MODE_DITHER) {
+			flags |= GPU_PRIM_DITHER;
+		}
+	}
+
+	if (cmd & GPU_CMD_SEMI) {
+		flags |= GPU_PRIM_SEMI;
+	}
+
+	const s32 x1 = (a.x < b.x) ? a.x : b.x;
+	const s32 x2 = (a.x < b.x) ? b.x : a.x;
+	const s32 y1 = (a.y < b.y) ? a.y : b.y;
+	const s32 y2 = (a.y < b.y) ? b.y : a.y;
+
+	if (prim_cull(&r->env, x1, y1, x2, y2)) {
+		return;
+	}
+
+	const struct gpu_env *const e = &r->env;
+	struct gpu_prim *const p =
+		prim_add(r, e, GPU_PRIM_LINE, flags, col_beg(e, x1),
+			 row_beg(e, y1), cols_num(e, x1, x2),
+			 rows_num(e, y1, y2));
+
+	p->v[0] = a;
+	p->v[1] = b;
+}
+
+static void rect_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	const uint cmd = pkt[0] >> 24;
+	const bool textured = (cmd & GPU_CMD_TEXTURED) &&
+			      !(r->draw_mode & GPU_DRAW_MODE_TEX_OFF);
+	const uint size_words = (cmd & GPU_CMD_TEXTURED) ? 3 : 2;
+	struct gpu_vtx v = { 0 };
+	struct gpu_env e = r->env;
+	uint flags = 0;
+	s32 w;
+	s32 h;
+
+	vtx_set(r, &v, pkt[0], pkt[1]);
+
+	switch ((cmd >> GPU_CMD_SIZE_SHIFT) & 3) {
+	case 0:
+		w = (s32)(pkt[size_words] & 0x3FF);
+		h = (s32)((pkt[size_words] >> 16) & 0x1FF);
+		break;
+
+	case 1:
+		w = h = 1;
+		break;
+
+	case 2:
+		w = h = 8;
+		break;
+
+	default:
+		w = h = 16;
+		break;
+	}
+
+	if (textured) {
+		v.u = (u8)pkt[2];
+		v.v = (u8)(pkt[2] >> 8);
+		clut_set(&e, pkt[2]);
+		flags |= GPU_PRIM_TEXTURED;
+		flags |= (cmd & GPU_CMD_RAW) ? GPU_PRIM_RAW : 0;
+	}
+
+	if (cmd & GPU_CMD_SEMI) {
+		flags |= GPU_PRIM_SEMI;
+	}
+
+	if (r->draw_mode & DRAW_MODE_FLIP_X) {
+		flags |= GPU_PRIM_FLIP_X;
+	}
+
+	if (r->draw_mode & DRAW_MODE_FLIP_Y) {
+		flags |= GPU_PRIM_FLIP_Y;
+	}
+
+	if ((w == 0) || (h == 0) ||
+	    prim_cull(&e, v.x, v.y, v.x + w - 1, v.y + h - 1)) {
+		return;
+	}
+
+	struct gpu_prim *const p =
+		prim_add(r, &e, GPU_PRIM_RECT, flags, col_beg(&e, v.x),
+			 row_beg(&e, v.y), cols_num(&e, v.x, v.x + w - 1),
+			 rows_num(&e, v.y, v.y + h - 1));
+
+	p->v[0] = v;
+	p->v[1] = (struct gpu_vtx){ .x = w, .y = h };
+}
+
+static void fill_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	struct gpu_vtx v = { 0 };
+	const u32 w = ((pkt[2] & 0x3FF) + 0xF) & ~0xFU;
+	const u32 h = (pkt[2] >> 16) & 0x1FF;
+
+	vtx_set(r, &v, pkt[0], 0);
+	v.x = (s32)(pkt[1] & 0x3F0);
+	v.y = (s32)((pkt[1] >> 16) & GPU_VRAM_Y_MASK);
+
+	if ((w == 0) || (h == 0)) {
+		return;
+	}
+
+	struct gpu_prim *const p = prim_add(r, &r->env, GPU_PRIM_FILL, 0,
+					    (uint)v.x, (uint)v.y, w, h);
+
+	p->v[0] = v;
+	p->v[1] = (struct gpu_vtx){ .x = (s32)w, .y = (s32)h };
+}
+
+/// @brief Stores pixels into VRAM, which are copied as they are unless the
+/// mask bit of the pixels stored to must be checked.
+///
+/// @param src The pixels, which need not be aligned.
+static void pixels_store(const struct psycho_gpu_render *const r,
+			 u16 *const dst, const u8 *const src, const uint n)
+{
+	const u16 mask_check = r->env.mask_check;
+	const u16 mask_set = r->env.mask_set;
+
+	if (!mask_check) {
+		memcpy(dst, src, n * sizeof(u16));
+
+		if (mask_set) {
+			for (uint i = 0; i < n; ++i) {
+				dst[i] |= mask_set;
+			}
+		}
+		return;
+	}
+
+	for (uint i = 0; i < n; ++i) {
+		u16 c;
+
+		memcpy(&c, &src[i * sizeof(u16)], sizeof(c));
+
+		if (!(dst[i] & mask_check)) {
+			dst[i] = c | mask_set;
+		}
+	}
+}
+
+/// @brief Stores pixels into a row of VRAM, starting at column x and wrapping
+/// around its right edge.
+static void row_store(const struct psycho_gpu_render *const r, u16 *const row,
+		      const uint x, const void *const src, const uint n)
+{
+	const uint first = PSYCHO_GPU_VRAM_WIDTH - x;
+	const uint len = (n < first) ? n : first;
+
+	pixels_store(r, &row[x], src, len);
+	pixels_store(r, row, (const u8 *)src + (len * sizeof(u16)), n - len);
+}
+
+/// @brief Copies a rectangle of VRAM, a row at a time through a buffer so
+/// that overlapping rectangles are copied as the GPU does.
+static void copy_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	const struct psycho_gpu_xfer src = gpu_xfer_get(pkt[1], pkt[3]);
+	const struct psycho_gpu_xfer dst = gpu_xfer_get(pkt[2], pkt[3]);
+	const uint first = PSYCHO_GPU_VRAM_WIDTH - src.x;
+	const uint len = (src.w < first) ? src.w : first;
+	u16 row[PSYCHO_GPU_VRAM_WIDTH];
+
+	gpu_tex_written(r->tex, dst.x, dst.y, dst.w, dst.h, false);
+
+	for (uint j = 0; j < src.h; ++j) {
+		const u16 *const s = &r->vram[((src.y + j) & GPU_VRAM_Y_MASK) *
+					      PSYCHO_GPU_VRAM_WIDTH];
+		u16 *const d = &r->vram[((dst.y + j) & GPU_VRAM_Y_MASK) *
+					PSYCHO_GPU_VRAM_WIDTH];
+
+		memcpy(row, &s[src.x], len * sizeof(u16));
+		memcpy(&row[len], s, (src.w - len) * sizeof(u16));
+		row_store(r, d, dst.x, row, src.w);
+	}
+}
+
+/// @brief Stores words of the current CPU to VRAM transfer, two pixels each,
+/// a row at a time.
+static void upload_store(struct psycho_gpu_render *const r,
+			 const u32 *const words, const uint n)
+{
+	struct psycho_gpu_xfer *const x = &r->upload;
+	const u8 *src = (const u8 *)words;
+	uint left = ((n * 2) < x->left) ? (n * 2) : x->left;
+	uint col = x->pos % x->w;
+	uint y = x->y + (x->pos / x->w);
+
+	x->pos += left;
+	x->left -= left;
+
+	while (left != 0) {
+		const uint rest = x->w - col;
+		const uint len = (rest < left) ? rest : left;
+
+		row_store(r,
+			  &r->vram[(y & GPU_VRAM_Y_MASK) *
+				   PSYCHO_GPU_VRAM_WIDTH],
+			  (x->x + col) & GPU_VRAM_X_MASK, src, len);
+		src += len * sizeof(u16);
+		left -= len;
+		col = 0;
+		y++;
+	}
+}
+
+static void env_exec(struct psycho_gpu_render *const r, const u32 word)
+{
+	const u32 param = word & 0xFFFFFF;
+
+	switch (word >> 24) {
+	case 0xE1:
+		r->draw_mode = param;
+		break;
+
+	case 0xE2:
+		r->tex_window = param;
+		break;
+
+	case 0xE3:
+		r->area_tl = param;
+		break;
+
+	case 0xE4:
+		r->area_br = param;
+		break;
+
+	case 0xE5:
+		r->offset = param;
+		break;
+
+	default:
+		r->mask = param;
+		break;
+	}
+	env_update(r);
+}
+
+static void pkt_exec(struct psycho_gpu_render *const r, const u32 *const pkt)
+{
+	const uint cmd = pkt[0] >> 24;
+
+	switch (cmd >> 5) {
+	case GPU_CMD_GROUP_POLY:
+		poly_exec(r, pkt);
+		break;
+
+	case GPU_CMD_GROUP_LINE:
+		line_exec(r, pkt);
+		break;
+
+	case GPU_CMD_GROUP_RECT:
+		rect_exec(r, pkt);
+		break;
+
+	case GPU_CMD_GROUP_COPY:
+		batch_flush(r);
+		copy_exec(r, pkt);
+		break;
+
+	case GPU_CMD_GROUP_UPLOAD:
+		batch_flush(r);
+		r->upload = gpu_xfer_get(pkt[1], pkt[2]);
+		gpu_tex_written(r->tex, r->upload.x, r->upload.y, r->upload.w,
+				r->upload.h, false);
+		break;
+
+	case GPU_CMD_GROUP_ENV:
+		env_exec(r, pkt[0]);
+		break;
+
+	default:
+		fill_exec(r, pkt);
+		break;
+	}
+}
+
+/// @brief Executes the words of the ring from tail up to head.
+///
+/// @returns The new tail.
+static NODISCARD u32 consume(struct psycho_gpu_render *const r, u32 tail,
+			     const u32 head)
+{
+	while (tail != head) {
+		const u32 word = r->ring[tail & RING_MASK];
+
+		// Take as much of a transfer as is contiguous in the ring.
+		if (r->upload.left != 0) {
+			const u32 ring_left = RING_SIZE - (tail & RING_MASK);
+			u32 n = (r->upload.left + 1) / 2;
+
+			n = (n < (head - tail)) ? n : (head - tail);
+			n = (n < ring_left) ? n : ring_left;
+			upload_store(r, &r->ring[tail & RING_MASK], n);
+			tail += n;
+			continue;
+		}
+
+		u32 pkt[PSYCHO_GPU_PKT_MAX];
+		const uint len = gpu_pkt_len(word);
+
+		for (uint i = 0; i < len; ++i) {
+			pkt[i] = r->ring[(tail + i) & RING_MASK];
+		}
+		tail += len;
+		pkt_exec(r, pkt);
+	}
+	return tail;
+}
+
+/// @brief Draws everything published, on the calling thread.
+static void drain(struct psycho_gpu_render *const r)
+{
+	const u32 head = atomic_load(&r->head);
+	const u32 tail = consume(r, atomic_load(&r->tail), head);
+
+	batch_flush(r);
+	atomic_store(&r->tail, tail);
+	atomic_store(&r->retired, tail);
+}
+
+static void *render_main(void *const arg)
+{
+	struct psycho_gpu_render *const r = arg;
+	u32 tail = atomic_load(&r->tail);
+
+	for (;;) {
+		const u32 head =
+			atomic_load_explicit(&r->head, memory_order_acquire);
+
+		if (tail != head) {
+			tail = consume(r, tail, head);
+			atomic_store_explicit(&r->tail, tail,
+					      memory_order_release);
+			continue;
+		}
+
+		// The ring ran dry; finish drawing, and wait for more.
+		batch_flush(r);
+
+		pthread_mutex_lock(&r->lock);
+		atomic_store(&r->retired, tail);
+		pthread_cond_broadcast(&r->idle);
+
+		// Either the CPU's thread sees this and wakes us up, or we see
+		// the words it published. The push which woke us may have been
+		// for words we already saw, so this is set again before waiting
+		// again.
+		atomic_store(&r->sleeping, true);
+
+		while (!r->quit && (atomic_load(&r->head) == tail)) {
+			pthread_cond_wait(&r->work, &r->lock);
+			atomic_store(&r->sleeping, true);
+		}
+		atomic_store(&r->sleeping, false);
+
+		const bool quit = r->quit;
+
+		pthread_mutex_unlock(&r->lock);
+
+		if (quit) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+NODISCARD struct psycho_gpu_render *gpu_render_new(u16 *const vram)
+{
+	struct psycho_gpu_render *const r = calloc(1, sizeof(*r));
+
+	if (!r) {
+		return NULL;
+	}
+
+	r->tex = gpu_tex_new();
+
+	if (!r->tex) {
+		free(r);
+		return NULL;
+	}
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->work, NULL);
+	pthread_cond_init(&r->idle, NULL);
+	pthread_mutex_init(&r->band_lock, NULL);
+	pthread_cond_init(&r->band_go, NULL);
+	pthread_cond_init(&r->band_done, NULL);
+
+	r->vram = vram;
+	r->spans = gpu_span_get(gpu_span_isa_best());
+	bands_set(r, 1);
+	env_update(r);
+	return r;
+}
+
+void gpu_render_free(struct psycho_gpu_render *const r)
+{
+	if (!r) {
+		return;
+	}
+
+	if (r->threaded) {
+		pthread_mutex_lock(&r->lock);
+		r->quit = true;
+		pthread_cond_signal(&r->work);
+		pthread_mutex_unlock(&r->lock);
+		pthread_join(r->thread, NULL);
+	}
+
+	pthread_mutex_lock(&r->band_lock);
+	r->band_quit = true;
+	pthread_cond_broadcast(&r->band_go);
+	pthread_mutex_unlock(&r->band_lock);
+
+	for (uint band = 1; band < r->bands; ++band) {
+		pthread_join(r->workers[band].thread, NULL);
+	}
+
+	pthread_cond_destroy(&r->band_done);
+	pthread_cond_destroy(&r->band_go);
+	pthread_mutex_destroy(&r->band_lock);
+	pthread_cond_destroy(&r->idle);
+	pthread_cond_destroy(&r->work);
+	pthread_mutex_destroy(&r->lock);
+	gpu_tex_free(r->tex);
+	free(r);
+}
+
+void gpu_render_start(struct psycho_gpu_render *const r, uint bands)
+{
+	if (r->threaded) {
+		return;
+	}
+
+	if (bands == 0) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		bands = (cpus > 2) ? (uint)(cpus - 1) : 1;
+	}
+
+	if (bands > PSYCHO_GPU_BANDS_MAX) {
+		bands = PSYCHO_GPU_BANDS_MAX;
+	}
+
+	if (pthread_create(&r->thread, NULL, render_main, r) != 0) {
+		return;
+	}
+	r->threaded = true;
+
+	// The render thread only looks at the bands once it is handed words.
+	uint band = 1;
+
+	for (; band < bands; ++band) {
+		struct worker *const w = &r->workers[band];
+
+		w->r = r;
+		w->band = band;
+
+		if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+			break;
+		}
+	}
+	bands_set(r, band);
+}
+
+/// @brief Queues words, no more than fit in the ring.
+static void ring_push(struct psycho_gpu_render *const r, const u32 *const words,
+		      const uint n)
+{
+	const u32 head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	const u32 used =
+		head - atomic_load_explicit(&r->tail, memory_order_acquire);
+
+	if ((RING_SIZE - used) < n) {
+		gpu_render_sync(r);
+	}
+
+	for (uint i = 0; i < n; ++i) {
+		r->ring[(head + i) & RING_MASK] = words[i];
+	}
+
+	atomic_store(&r->head, head + n);
+
+	if (!r->threaded) {
+		drain(r);
+	} else if (atomic_exchange(&r->sleeping, false)) {
+		// Only the first push to see the render thread asleep wakes it;
+		// the rest would only contend for the lock while it wakes up.
+		pthread_mutex_lock(&r->lock);
+		pthread_cond_signal(&r->work);
+		pthread_mutex_unlock(&r->lock);
+	}
+}
+
+void gpu_render_push(struct psycho_gpu_render *const r, const u32 *const words,
+		     const uint n)
+{
+	// Large transfers go a part of the ring at a time, so that the render
+	// thread starts on them while the rest are queued.
+	for (uint i = 0; i < n; i += PUSH_MAX) {
+		const uint left = n - i;
+
+		ring_push(r, &words[i], (left < PUSH_MAX) ? left : PUSH_MAX);
+	}
+}
+
+void gpu_render_sync(struct psycho_gpu_render *const r)
+{
+	const u32 head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	if (atomic_load(&r->retired) == head) {
+		return;
+	}
+
+	pthread_mutex_lock(&r->lock);
+
+	while (atomic_load(&r->retired) != head) {
+		pthread_cond_wait(&r->idle, &r->lock);
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+void gpu_render_restore(struct psycho_gpu_render *const r,
+			const struct psycho_gpu *const gpu)
+{
+	r->draw_mode = gpu->draw_mode;
+	r->tex_window = gpu->tex_window;
+	r->area_tl = gpu->area_tl;
+	r->area_br = gpu->area_br;
+	r->offset = gpu->offset;
+	r->mask = gpu->mask;
+	r->upload = gpu->upload;
+	env_update(r);
+
+	// VRAM may have been replaced as a whole.
+	gpu_tex_invalidate(r->tex);
+}
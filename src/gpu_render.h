@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_render.h Provides the drawing threads, and the ring through which
+/// the CPU's thread sends them commands.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "psycho/gpu.h"
+
+/// @brief Allocates the drawing threads' state, drawing into @p vram. Nothing
+/// is started yet; until gpu_render_start() is called, commands are drawn by
+/// the thread which sends them.
+///
+/// @returns The state, or NULL if memory could not be allocated.
+NODISCARD struct psycho_gpu_render *gpu_render_new(u16 *vram);
+
+/// @brief Stops the drawing threads, if any, and releases their state.
+void gpu_render_free(struct psycho_gpu_render *r);
+
+/// @brief Starts the drawing threads, unless they are already running. If
+/// threads cannot be created, fewer bands are used; with none at all,
+/// commands keep being drawn by the thread which sends them.
+///
+/// @param bands The number of bands to split the frame into, or 0 for one
+/// per online CPU besides the one sending commands.
+void gpu_render_start(struct psycho_gpu_render *r, uint bands);
+
+/// @brief Queues words for the drawing threads: whole GP0 commands, or the
+/// data of a CPU to VRAM transfer, of any length. This only waits if the ring
+/// is full.
+void gpu_render_push(struct psycho_gpu_render *r, const u32 *words, uint n);
+
+/// @brief Waits until every word queued so far has been drawn.
+void gpu_render_sync(struct psycho_gpu_render *r);
+
+/// @brief Replaces the drawing threads' drawing state and CPU to VRAM
+/// transfer with those of @p gpu. gpu_render_sync() must be called first.
+void gpu_render_restore(struct psycho_gpu_render *r,
+			const struct psycho_gpu *gpu);
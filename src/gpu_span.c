@@ -0,0 +1,813 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_span.c Implements the span kernels.
+///
+/// The scalar kernel draws a pixel at a time, and is the reference the others
+/// are held to. The SSE4.1 and AVX2 kernels draw groups of 4 and 8 pixels, one
+/// to a 32-bit lane. They load and store a whole group at once, writing the
+/// pixels past the end of a span back unchanged; those belong to the same row,
+/// and so to the same thread. A group never runs past the end of a row, so the
+/// scalar kernel draws what is left of a span there.
+
+#include <string.h>
+
+#include "gpu.h"
+#include "gpu_draw.h"
+#include "gpu_span.h"
+#include "gpu_tex.h"
+
+#if defined(PSYCHO_GPU_SIMD) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// clang-format off
+
+/// @brief log2(PSYCHO_GPU_VRAM_WIDTH), to turn rows into offsets.
+#define ROW_SHIFT	(10)
+
+///@{
+/// @brief The pixels drawn at once by the vectorized kernels.
+#define SSE41_LANES	(4)
+#define AVX2_LANES	(8)
+///@}
+
+// clang-format on
+
+/// @brief The offsets added to 8-bit channels before they are truncated to 5
+/// bits, by the position of the pixel within a 4x4 block.
+static const s8 dither[4][4] = {
+	{ -4, +0, -3, +1 },
+	{ +2, -2, +3, -1 },
+	{ -3, +1, -4, +0 },
+	{ +3, -1, +2, -2 },
+};
+
+/// @brief Returns the texel at a pair of texture coordinates, or 0 if it is
+/// transparent.
+static ALWAYS_INLINE NODISCARD u16 texel_get(const u16 *const vram,
+					     const struct gpu_env *const e,
+					     uint u, uint v)
+{
+	u = (u & e->tw_and_u) | e->tw_or_u;
+	v = (v & e->tw_and_v) | e->tw_or_v;
+
+	if (e->tex) {
+		return e->tex[(v * GPU_TEX_PAGE_DIM) + u];
+	}
+
+	const uint y = (e->tp_y + v) & GPU_VRAM_Y_MASK;
+	const u16 *const row = &vram[y * PSYCHO_GPU_VRAM_WIDTH];
+	const u16 *const clut = &vram[e->clut_y * PSYCHO_GPU_VRAM_WIDTH];
+
+	switch (e->depth) {
+	case GPU_DEPTH_4BPP: {
+		const uint word = row[(e->tp_x + (u / 4)) & GPU_VRAM_X_MASK];
+		const uint idx = (word >> ((u % 4) * 4)) & 0xF;
+
+		return clut[(e->clut_x + idx) & GPU_VRAM_X_MASK];
+	}
+
+	case GPU_DEPTH_8BPP: {
+		const uint word = row[(e->tp_x + (u / 2)) & GPU_VRAM_X_MASK];
+		const uint idx = (word >> ((u % 2) * 8)) & 0xFF;
+
+		return clut[(e->clut_x + idx) & GPU_VRAM_X_MASK];
+	}
+
+	default:
+		return row[(e->tp_x + u) & GPU_VRAM_X_MASK];
+	}
+}
+
+/// @brief Truncates an 8-bit channel to 5 bits, after adding a dithering
+/// offset to it.
+static ALWAYS_INLINE NODISCARD uint chan(const uint c, const int d)
+{
+	const int v = (int)c + d;
+
+	return (uint)((v < 0) ? 0 : ((v > 0xFF) ? 0xFF : v)) >> 3;
+}
+
+/// @brief Blends a 5-bit channel into the one behind it.
+static ALWAYS_INLINE NODISCARD uint blend(const uint back, const uint front,
+					  const uint mode)
+{
+	uint c;
+
+	switch (mode) {
+	case 0:
+		return (back + front) / 2;
+
+	case 1:
+		c = back + front;
+		break;
+
+	case 2:
+		return (back > front) ? (back - front) : 0;
+
+	default:
+		c = back + (front / 4);
+		break;
+	}
+	return (c > 31) ? 31 : c;
+}
+
+/// @brief Draws a pixel of a primitive, in an 8-bit per channel colour. The
+/// texture coordinates are ignored unless the primitive is textured.
+static ALWAYS_INLINE void pixel(u16 *const vram,
+				const struct gpu_prim *const p, const uint x,
+				const uint y, const uint r, const uint g,
+				const uint b, const uint u, const uint v)
+{
+	const struct gpu_env *const e = &p->env;
+	u16 *const dst = &vram[(y * PSYCHO_GPU_VRAM_WIDTH) + x];
+	const uint back = *dst;
+
+	if (back & e->mask_check) {
+		return;
+	}
+
+	const int d = (p->flags & GPU_PRIM_DITHER) ? dither[y % 4][x % 4] : 0;
+	bool semi = p->flags & GPU_PRIM_SEMI;
+	uint mask = 0;
+	uint cr;
+	uint cg;
+	uint cb;
+
+	if (p->flags & GPU_PRIM_TEXTURED) {
+		const uint t = texel_get(vram, e, u, v);
+		const uint tr = t & 31;
+		const uint tg = (t >> 5) & 31;
+		const uint tb = (t >> 10) & 31;
+
+		if (t == 0) {
+			return;
+		}
+
+		// Only texels with the mask bit set are semi-transparent.
+		mask = t & GPU_MASK_BIT;
+		semi = semi && mask;
+
+		if (p->flags & GPU_PRIM_RAW) {
+			cr = tr;
+			cg = tg;
+			cb = tb;
+		} else {
+			cr = chan((tr * r) >> 4, d);
+			cg = chan((tg * g) >> 4, d);
+			cb = chan((tb * b) >> 4, d);
+		}
+	} else {
+		cr = chan(r, d);
+		cg = chan(g, d);
+		cb = chan(b, d);
+	}
+
+	if (semi) {
+		cr = blend(back & 31, cr, e->semi);
+		cg = blend((back >> 5) & 31, cg, e->semi);
+		cb = blend((back >> 10) & 31, cb, e->semi);
+	}
+	*dst = (u16)(cr | (cg << 5) | (cb << 10) | mask | e->mask_set);
+}
+
+/// @brief Returns an interpolated value as an 8-bit one.
+static ALWAYS_INLINE NODISCARD uint attr_get(const s32 val)
+{
+	const s32 v = val >> GPU_SPAN_FRAC_SHIFT;
+
+	return (uint)((v < 0) ? 0 : ((v > 0xFF) ? 0xFF : v));
+}
+
+static void span_scalar(u16 *const vram, const struct gpu_prim *const p,
+			const uint y, const uint x_beg, const uint x_end,
+			const s32 val[GPU_ATTRS_NUM],
+			const s32 step[GPU_ATTRS_NUM])
+{
+	s32 v[GPU_ATTRS_NUM];
+
+	memcpy(v, val, sizeof(v));
+
+	for (uint x = x_beg; x < x_end; ++x) {
+		pixel(vram, p, x, y, attr_get(v[GPU_ATTR_R]),
+		      attr_get(v[GPU_ATTR_G]), attr_get(v[GPU_ATTR_B]),
+		      attr_get(v[GPU_ATTR_U]), attr_get(v[GPU_ATTR_V]));
+
+		for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+			v[i] += step[i];
+		}
+	}
+}
+
+static const gpu_span_fn spans_scalar[GPU_SPANS_NUM] = {
+	span_scalar, span_scalar, span_scalar,
+	span_scalar, span_scalar, span_scalar,
+};
+
+#if defined(PSYCHO_GPU_SIMD) && defined(__x86_64__)
+
+/// @brief The rows of @ref dither, repeated so that the offsets of 8 pixels in
+/// a row can be loaded starting from any column.
+static const s32 dither_wide[4][12] = {
+	{ -4, +0, -3, +1, -4, +0, -3, +1, -4, +0, -3, +1 },
+	{ +2, -2, +3, -1, +2, -2, +3, -1, +2, -2, +3, -1 },
+	{ -3, +1, -4, +0, -3, +1, -4, +0, -3, +1, -4, +0 },
+	{ +3, -1, +2, -2, +3, -1, +2, -2, +3, -1, +2, -2 },
+};
+
+/// @brief Returns whether the columns from x_beg up to x_end overlap n columns
+/// from x, wrapping around the edges of VRAM.
+static ALWAYS_INLINE NODISCARD bool cols_overlap(const uint x_beg,
+						 const uint x_end, const uint x,
+						 const uint n)
+{
+	return (((x_beg - x) & GPU_VRAM_X_MASK) < n) ||
+	       (((x - x_beg) & GPU_VRAM_X_MASK) < (x_end - x_beg));
+}
+
+/// @brief Returns whether a span may read texels from the pixels it draws.
+/// The vectorized kernels read the texels of a group before drawing any of
+/// it, so they leave such spans to the scalar kernel.
+static ALWAYS_INLINE NODISCARD bool self_read(const struct gpu_env *const e,
+					      const uint y, const uint x_beg,
+					      const uint x_end, const uint kind)
+{
+	// A decoded page is never drawn to while it is in use.
+	if ((kind < GPU_SPAN_TEX) || (kind == GPU_SPAN_DECODED)) {
+		return false;
+	}
+
+	const uint depth = kind - GPU_SPAN_TEX;
+
+	// A texture page is 256 texels square, of 4, 8 or 16 bits each.
+	if ((((y - e->tp_y) & GPU_VRAM_Y_MASK) < 256) &&
+	    cols_overlap(x_beg, x_end, e->tp_x, 64U << depth)) {
+		return true;
+	}
+	return (depth != GPU_DEPTH_15BPP) && (y == e->clut_y) &&
+	       cols_overlap(x_beg, x_end, e->clut_x, 16U << (depth * 4));
+}
+
+/// @brief Draws the rest of a span with the scalar kernel, from its n-th
+/// pixel on.
+static void span_rest(u16 *const vram, const struct gpu_prim *const p,
+		      const uint y, const uint x, const uint x_end,
+		      const s32 val[GPU_ATTRS_NUM],
+		      const s32 step[GPU_ATTRS_NUM], const uint n)
+{
+	s32 v[GPU_ATTRS_NUM];
+
+	for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+		v[i] = (s32)((u32)val[i] + ((u32)step[i] * n));
+	}
+	span_scalar(vram, p, y, x, x_end, v, step);
+}
+
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+attr_avx2(const __m256i val)
+{
+	const __m256i v = _mm256_srai_epi32(val, GPU_SPAN_FRAC_SHIFT);
+
+	return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()),
+				_mm256_set1_epi32(0xFF));
+}
+
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+chan_avx2(const __m256i c, const __m256i d)
+{
+	const __m256i v = _mm256_add_epi32(c, d);
+
+	return _mm256_srli_epi32(
+		_mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()),
+				 _mm256_set1_epi32(0xFF)),
+		3);
+}
+
+/// @brief Modulates 5-bit texel channels by 8-bit colour channels.
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+modulate_avx2(const __m256i t, const __m256i c, const __m256i d)
+{
+	// Both factors fit in 16 bits, and so does their product.
+	return chan_avx2(_mm256_srli_epi32(_mm256_mullo_epi16(t, c), 4), d);
+}
+
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+blend_avx2(const __m256i back, const __m256i front, const uint mode)
+{
+	const __m256i max = _mm256_set1_epi32(31);
+
+	switch (mode) {
+	case 0:
+		return _mm256_srli_epi32(_mm256_add_epi32(back, front), 1);
+
+	case 1:
+		return _mm256_min_epi32(_mm256_add_epi32(back, front), max);
+
+	case 2:
+		return _mm256_max_epi32(_mm256_sub_epi32(back, front),
+					_mm256_setzero_si256());
+
+	default:
+		return _mm256_min_epi32(
+			_mm256_add_epi32(back, _mm256_srli_epi32(front, 2)),
+			max);
+	}
+}
+
+/// @brief Gathers the halfwords at a set of indices into an array. The words
+/// holding them are gathered instead, so that nothing past the end of the
+/// array is read.
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+gather16_avx2(const u16 *const base, const __m256i idx)
+{
+	const __m256i w = _mm256_i32gather_epi32(
+		(const int *)(const void *)base, _mm256_srli_epi32(idx, 1), 4);
+	const __m256i shift = _mm256_slli_epi32(
+		_mm256_and_si256(idx, _mm256_set1_epi32(1)), 4);
+
+	return _mm256_and_si256(_mm256_srlv_epi32(w, shift),
+				_mm256_set1_epi32(0xFFFF));
+}
+
+__attribute__((target("avx2"))) static ALWAYS_INLINE NODISCARD __m256i
+texel_avx2(const u16 *const vram, const struct gpu_env *const e, __m256i u,
+	   __m256i v, const uint kind)
+{
+	const __m256i x_mask = _mm256_set1_epi32(GPU_VRAM_X_MASK);
+	const __m256i tp_x = _mm256_set1_epi32(e->tp_x);
+
+	u = _mm256_or_si256(_mm256_and_si256(u, _mm256_set1_epi32(e->tw_and_u)),
+			    _mm256_set1_epi32(e->tw_or_u));
+	v = _mm256_or_si256(_mm256_and_si256(v, _mm256_set1_epi32(e->tw_and_v)),
+			    _mm256_set1_epi32(e->tw_or_v));
+
+	if (kind == GPU_SPAN_DECODED) {
+		const __m256i idx = _mm256_or_si256(_mm256_slli_epi32(v, 8), u);
+
+		return gather16_avx2(e->tex, idx);
+	}
+
+	const __m256i tp_y = _mm256_set1_epi32(e->tp_y);
+	const __m256i row = _mm256_slli_epi32(
+		_mm256_and_si256(_mm256_add_epi32(v, tp_y),
+				 _mm256_set1_epi32(GPU_VRAM_Y_MASK)),
+		ROW_SHIFT);
+
+	__m256i col;
+	__m256i shift;
+	__m256i idx_mask;
+
+	switch (kind - GPU_SPAN_TEX) {
+	case GPU_DEPTH_4BPP:
+		col = _mm256_srli_epi32(u, 2);
+		shift = _mm256_slli_epi32(
+			_mm256_and_si256(u, _mm256_set1_epi32(3)), 2);
+		idx_mask = _mm256_set1_epi32(0xF);
+		break;
+
+	case GPU_DEPTH_8BPP:
+		col = _mm256_srli_epi32(u, 1);
+		shift = _mm256_slli_epi32(
+			_mm256_and_si256(u, _mm256_set1_epi32(1)), 3);
+		idx_mask = _mm256_set1_epi32(0xFF);
+		break;
+
+	default:
+		col = _mm256_and_si256(_mm256_add_epi32(tp_x, u), x_mask);
+		return gather16_avx2(vram, _mm256_add_epi32(row, col));
+	}
+
+	col = _mm256_and_si256(_mm256_add_epi32(tp_x, col), x_mask);
+
+	const __m256i word = gather16_avx2(vram, _mm256_add_epi32(row, col));
+	const __m256i idx =
+		_mm256_and_si256(_mm256_srlv_epi32(word, shift), idx_mask);
+	const __m256i clut = _mm256_set1_epi32(e->clut_y << ROW_SHIFT);
+
+	col = _mm256_and_si256(
+		_mm256_add_epi32(_mm256_set1_epi32(e->clut_x), idx), x_mask);
+	return gather16_avx2(vram, _mm256_add_epi32(clut, col));
+}
+
+__attribute__((target("avx2"))) static ALWAYS_INLINE void
+span_avx2(u16 *const vram, const struct gpu_prim *const p, const uint y,
+	  const uint x_beg, const uint x_end, const s32 val[GPU_ATTRS_NUM],
+	  const s32 step[GPU_ATTRS_NUM], const uint kind)
+{
+	const struct gpu_env *const e = &p->env;
+
+	if (self_read(e, y, x_beg, x_end, kind)) {
+		span_scalar(vram, p, y, x_beg, x_end, val, step);
+		return;
+	}
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i chan_mask = _mm256_set1_epi32(31);
+	const __m256i mask_bit = _mm256_set1_epi32(GPU_MASK_BIT);
+	const __m256i mask_check = _mm256_set1_epi32(e->mask_check);
+	const __m256i mask_set = _mm256_set1_epi32(e->mask_set);
+	const bool semi = p->flags & GPU_PRIM_SEMI;
+
+	// Groups are a multiple of 4 pixels wide, so every group of a span
+	// is dithered the same way.
+	const s32 *const dw = &dither_wide[y % 4][x_beg % 4];
+	const __m256i d =
+		(p->flags & GPU_PRIM_DITHER) ?
+			_mm256_loadu_si256((const __m256i *)(const void *)dw) :
+			zero;
+
+	__m256i a[GPU_ATTRS_NUM];
+	__m256i a_step[GPU_ATTRS_NUM];
+
+	for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+		a[i] = _mm256_add_epi32(
+			_mm256_set1_epi32(val[i]),
+			_mm256_mullo_epi32(lanes, _mm256_set1_epi32(step[i])));
+		a_step[i] = _mm256_set1_epi32((s32)((u32)step[i] * AVX2_LANES));
+	}
+
+	const __m256i flat_r = chan_avx2(attr_avx2(a[GPU_ATTR_R]), d);
+	const __m256i flat_g = chan_avx2(attr_avx2(a[GPU_ATTR_G]), d);
+	const __m256i flat_b = chan_avx2(attr_avx2(a[GPU_ATTR_B]), d);
+
+	uint x = x_beg;
+
+	for (; (x < x_end) && ((x + AVX2_LANES) <= PSYCHO_GPU_VRAM_WIDTH);
+	     x += AVX2_LANES) {
+		u16 *const dst = &vram[(y * PSYCHO_GPU_VRAM_WIDTH) + x];
+		const __m256i back = _mm256_cvtepu16_epi32(
+			_mm_loadu_si128((const __m128i *)(void *)dst));
+		const __m256i left = _mm256_set1_epi32((s32)(x_end - x));
+
+		__m256i draw = _mm256_and_si256(
+			_mm256_cmpgt_epi32(left, lanes),
+			_mm256_cmpeq_epi32(_mm256_and_si256(back, mask_check),
+					   zero));
+		__m256i blended = semi ? _mm256_set1_epi32(-1) : zero;
+		__m256i mask = zero;
+		__m256i r;
+		__m256i g;
+		__m256i b;
+
+		if (kind == GPU_SPAN_FLAT) {
+			r = flat_r;
+			g = flat_g;
+			b = flat_b;
+		} else if (kind == GPU_SPAN_GOURAUD) {
+			r = chan_avx2(attr_avx2(a[GPU_ATTR_R]), d);
+			g = chan_avx2(attr_avx2(a[GPU_ATTR_G]), d);
+			b = chan_avx2(attr_avx2(a[GPU_ATTR_B]), d);
+		} else {
+			const __m256i u = attr_avx2(a[GPU_ATTR_U]);
+			const __m256i v = attr_avx2(a[GPU_ATTR_V]);
+			const __m256i t = texel_avx2(vram, e, u, v, kind);
+			const __m256i tr = _mm256_and_si256(t, chan_mask);
+			const __m256i tg = _mm256_and_si256(
+				_mm256_srli_epi32(t, 5), chan_mask);
+			const __m256i tb = _mm256_and_si256(
+				_mm256_srli_epi32(t, 10), chan_mask);
+
+			draw = _mm256_andnot_si256(_mm256_cmpeq_epi32(t, zero),
+						   draw);
+
+			// Only texels with the mask bit set are
+			// semi-transparent.
+			mask = _mm256_and_si256(t, mask_bit);
+			blended = _mm256_and_si256(
+				blended, _mm256_cmpeq_epi32(mask, mask_bit));
+
+			if (p->flags & GPU_PRIM_RAW) {
+				r = tr;
+				g = tg;
+				b = tb;
+			} else {
+				const __m256i cr = attr_avx2(a[GPU_ATTR_R]);
+				const __m256i cg = attr_avx2(a[GPU_ATTR_G]);
+				const __m256i cb = attr_avx2(a[GPU_ATTR_B]);
+
+				r = modulate_avx2(tr, cr, d);
+				g = modulate_avx2(tg, cg, d);
+				b = modulate_avx2(tb, cb, d);
+			}
+		}
+
+		if (semi) {
+			const __m256i br = _mm256_and_si256(back, chan_mask);
+			const __m256i bg = _mm256_and_si256(
+				_mm256_srli_epi32(back, 5), chan_mask);
+			const __m256i bb = _mm256_and_si256(
+				_mm256_srli_epi32(back, 10), chan_mask);
+
+			r = _mm256_blendv_epi8(r, blend_avx2(br, r, e->semi),
+					       blended);
+			g = _mm256_blendv_epi8(g, blend_avx2(bg, g, e->semi),
+					       blended);
+			b = _mm256_blendv_epi8(b, blend_avx2(bb, b, e->semi),
+					       blended);
+		}
+
+		const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi32(g, 5));
+		const __m256i rgb =
+			_mm256_or_si256(rg, _mm256_slli_epi32(b, 10));
+		const __m256i px =
+			_mm256_or_si256(rgb, _mm256_or_si256(mask, mask_set));
+		const __m256i out = _mm256_blendv_epi8(back, px, draw);
+
+		_mm_storeu_si128((__m128i *)(void *)dst,
+				 _mm_packus_epi32(
+					 _mm256_castsi256_si128(out),
+					 _mm256_extracti128_si256(out, 1)));
+
+		for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+			a[i] = _mm256_add_epi32(a[i], a_step[i]);
+		}
+	}
+
+	if (x < x_end) {
+		span_rest(vram, p, y, x, x_end, val, step, x - x_beg);
+	}
+}
+
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE NODISCARD __m128i
+attr_sse41(const __m128i val)
+{
+	const __m128i v = _mm_srai_epi32(val, GPU_SPAN_FRAC_SHIFT);
+
+	return _mm_min_epi32(_mm_max_epi32(v, _mm_setzero_si128()),
+			     _mm_set1_epi32(0xFF));
+}
+
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE NODISCARD __m128i
+chan_sse41(const __m128i c, const __m128i d)
+{
+	const __m128i v = _mm_add_epi32(c, d);
+
+	return _mm_srli_epi32(_mm_min_epi32(_mm_max_epi32(v,
+							  _mm_setzero_si128()),
+					    _mm_set1_epi32(0xFF)),
+			      3);
+}
+
+/// @brief Modulates 5-bit texel channels by 8-bit colour channels.
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE NODISCARD __m128i
+modulate_sse41(const __m128i t, const __m128i c, const __m128i d)
+{
+	// Both factors fit in 16 bits, and so does their product.
+	return chan_sse41(_mm_srli_epi32(_mm_mullo_epi16(t, c), 4), d);
+}
+
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE NODISCARD __m128i
+blend_sse41(const __m128i back, const __m128i front, const uint mode)
+{
+	const __m128i max = _mm_set1_epi32(31);
+
+	switch (mode) {
+	case 0:
+		return _mm_srli_epi32(_mm_add_epi32(back, front), 1);
+
+	case 1:
+		return _mm_min_epi32(_mm_add_epi32(back, front), max);
+
+	case 2:
+		return _mm_max_epi32(_mm_sub_epi32(back, front),
+				     _mm_setzero_si128());
+
+	default:
+		return _mm_min_epi32(
+			_mm_add_epi32(back, _mm_srli_epi32(front, 2)), max);
+	}
+}
+
+/// @brief Fetches the texels of a group. SSE4.1 has no gathers, so they are
+/// fetched one at a time.
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE NODISCARD __m128i
+texel_sse41(const u16 *const vram, const struct gpu_env *const e,
+	    const __m128i u, const __m128i v)
+{
+	s32 us[SSE41_LANES];
+	s32 vs[SSE41_LANES];
+
+	_mm_storeu_si128((__m128i *)(void *)us, u);
+	_mm_storeu_si128((__m128i *)(void *)vs, v);
+
+	return _mm_setr_epi32(texel_get(vram, e, (uint)us[0], (uint)vs[0]),
+			      texel_get(vram, e, (uint)us[1], (uint)vs[1]),
+			      texel_get(vram, e, (uint)us[2], (uint)vs[2]),
+			      texel_get(vram, e, (uint)us[3], (uint)vs[3]));
+}
+
+__attribute__((target("sse4.1"))) static ALWAYS_INLINE void
+span_sse41(u16 *const vram, const struct gpu_prim *const p, const uint y,
+	   const uint x_beg, const uint x_end, const s32 val[GPU_ATTRS_NUM],
+	   const s32 step[GPU_ATTRS_NUM], const uint kind)
+{
+	const struct gpu_env *const e = &p->env;
+
+	if (self_read(e, y, x_beg, x_end, kind)) {
+		span_scalar(vram, p, y, x_beg, x_end, val, step);
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i chan_mask = _mm_set1_epi32(31);
+	const __m128i mask_bit = _mm_set1_epi32(GPU_MASK_BIT);
+	const __m128i mask_check = _mm_set1_epi32(e->mask_check);
+	const __m128i mask_set = _mm_set1_epi32(e->mask_set);
+	const bool semi = p->flags & GPU_PRIM_SEMI;
+
+	// Groups are 4 pixels wide, so every group of a span is dithered the
+	// same way.
+	const s32 *const dw = &dither_wide[y % 4][x_beg % 4];
+	const __m128i d =
+		(p->flags & GPU_PRIM_DITHER) ?
+			_mm_loadu_si128((const __m128i *)(const void *)dw) :
+			zero;
+
+	__m128i a[GPU_ATTRS_NUM];
+	__m128i a_step[GPU_ATTRS_NUM];
+
+	for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+		a[i] = _mm_add_epi32(_mm_set1_epi32(val[i]),
+				     _mm_mullo_epi32(lanes,
+						     _mm_set1_epi32(step[i])));
+		a_step[i] = _mm_set1_epi32((s32)((u32)step[i] * SSE41_LANES));
+	}
+
+	const __m128i flat_r = chan_sse41(attr_sse41(a[GPU_ATTR_R]), d);
+	const __m128i flat_g = chan_sse41(attr_sse41(a[GPU_ATTR_G]), d);
+	const __m128i flat_b = chan_sse41(attr_sse41(a[GPU_ATTR_B]), d);
+
+	uint x = x_beg;
+
+	for (; (x < x_end) && ((x + SSE41_LANES) <= PSYCHO_GPU_VRAM_WIDTH);
+	     x += SSE41_LANES) {
+		u16 *const dst = &vram[(y * PSYCHO_GPU_VRAM_WIDTH) + x];
+		const __m128i back = _mm_cvtepu16_epi32(
+			_mm_loadl_epi64((const __m128i *)(void *)dst));
+		const __m128i left = _mm_set1_epi32((s32)(x_end - x));
+
+		__m128i draw = _mm_and_si128(
+			_mm_cmpgt_epi32(left, lanes),
+			_mm_cmpeq_epi32(_mm_and_si128(back, mask_check), zero));
+		__m128i blended = semi ? _mm_set1_epi32(-1) : zero;
+		__m128i mask = zero;
+		__m128i r;
+		__m128i g;
+		__m128i b;
+
+		if (kind == GPU_SPAN_FLAT) {
+			r = flat_r;
+			g = flat_g;
+			b = flat_b;
+		} else if (kind == GPU_SPAN_GOURAUD) {
+			r = chan_sse41(attr_sse41(a[GPU_ATTR_R]), d);
+			g = chan_sse41(attr_sse41(a[GPU_ATTR_G]), d);
+			b = chan_sse41(attr_sse41(a[GPU_ATTR_B]), d);
+		} else {
+			const __m128i u = attr_sse41(a[GPU_ATTR_U]);
+			const __m128i v = attr_sse41(a[GPU_ATTR_V]);
+			const __m128i t = texel_sse41(vram, e, u, v);
+			const __m128i tr = _mm_and_si128(t, chan_mask);
+			const __m128i tg =
+				_mm_and_si128(_mm_srli_epi32(t, 5), chan_mask);
+			const __m128i tb =
+				_mm_and_si128(_mm_srli_epi32(t, 10), chan_mask);
+
+			draw = _mm_andnot_si128(_mm_cmpeq_epi32(t, zero), draw);
+
+			// Only texels with the mask bit set are
+			// semi-transparent.
+			mask = _mm_and_si128(t, mask_bit);
+			blended = _mm_and_si128(
+				blended, _mm_cmpeq_epi32(mask, mask_bit));
+
+			if (p->flags & GPU_PRIM_RAW) {
+				r = tr;
+				g = tg;
+				b = tb;
+			} else {
+				const __m128i cr = attr_sse41(a[GPU_ATTR_R]);
+				const __m128i cg = attr_sse41(a[GPU_ATTR_G]);
+				const __m128i cb = attr_sse41(a[GPU_ATTR_B]);
+
+				r = modulate_sse41(tr, cr, d);
+				g = modulate_sse41(tg, cg, d);
+				b = modulate_sse41(tb, cb, d);
+			}
+		}
+
+		if (semi) {
+			const __m128i br = _mm_and_si128(back, chan_mask);
+			const __m128i bg = _mm_and_si128(
+				_mm_srli_epi32(back, 5), chan_mask);
+			const __m128i bb = _mm_and_si128(
+				_mm_srli_epi32(back, 10), chan_mask);
+
+			r = _mm_blendv_epi8(r, blend_sse41(br, r, e->semi),
+					    blended);
+			g = _mm_blendv_epi8(g, blend_sse41(bg, g, e->semi),
+					    blended);
+			b = _mm_blendv_epi8(b, blend_sse41(bb, b, e->semi),
+					    blended);
+		}
+
+		const __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 5));
+		const __m128i rgb = _mm_or_si128(rg, _mm_slli_epi32(b, 10));
+		const __m128i px =
+			_mm_or_si128(rgb, _mm_or_si128(mask, mask_set));
+		const __m128i out = _mm_blendv_epi8(back, px, draw);
+
+		_mm_storel_epi64((__m128i *)(void *)dst,
+				 _mm_packus_epi32(out, out));
+
+		for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+			a[i] = _mm_add_epi32(a[i], a_step[i]);
+		}
+	}
+
+	if (x < x_end) {
+		span_rest(vram, p, y, x, x_end, val, step, x - x_beg);
+	}
+}
+
+/// @brief Defines the kernel for a kind of span.
+#define SPAN_DEFINE(isa, feature, name, kind)                                  \
+	__attribute__((target(feature))) static void                           \
+	span_##name##_##isa(u16 *const vram, const struct gpu_prim *const p,   \
+			    const uint y, const uint x_beg,                    \
+			    const uint x_end, const s32 val[GPU_ATTRS_NUM],    \
+			    const s32 step[GPU_ATTRS_NUM])                     \
+	{                                                                      \
+		span_##isa(vram, p, y, x_beg, x_end, val, step, kind);         \
+	}
+
+/// @brief Defines the kernels for an instruction set, one for each kind of
+/// span, and the table of them.
+#define SPANS_DEFINE(isa, feature)                                             \
+	SPAN_DEFINE(isa, feature, flat, GPU_SPAN_FLAT)                         \
+	SPAN_DEFINE(isa, feature, gouraud, GPU_SPAN_GOURAUD)                   \
+	SPAN_DEFINE(isa, feature, tex4, GPU_SPAN_TEX + GPU_DEPTH_4BPP)         \
+	SPAN_DEFINE(isa, feature, tex8, GPU_SPAN_TEX + GPU_DEPTH_8BPP)         \
+	SPAN_DEFINE(isa, feature, tex15, GPU_SPAN_TEX + GPU_DEPTH_15BPP)       \
+	SPAN_DEFINE(isa, feature, decoded, GPU_SPAN_DECODED)                   \
+                                                                               \
+	static const gpu_span_fn spans_##isa[GPU_SPANS_NUM] = {                \
+		span_flat_##isa, span_gouraud_##isa, span_tex4_##isa,          \
+		span_tex8_##isa, span_tex15_##isa, span_decoded_##isa,         \
+	};
+
+SPANS_DEFINE(sse41, "sse4.1")
+SPANS_DEFINE(avx2, "avx2")
+
+#endif // defined(PSYCHO_GPU_SIMD) && defined(__x86_64__)
+
+NODISCARD PURE const gpu_span_fn *gpu_span_get(const uint isa)
+{
+	switch (isa) {
+	case GPU_SPAN_ISA_SCALAR:
+		return spans_scalar;
+
+#if defined(PSYCHO_GPU_SIMD) && defined(__x86_64__)
+	case GPU_SPAN_ISA_SSE41:
+		return __builtin_cpu_supports("sse4.1") ? spans_sse41 : NULL;
+
+	case GPU_SPAN_ISA_AVX2:
+		return __builtin_cpu_supports("avx2") ? spans_avx2 : NULL;
+#endif
+
+	default:
+		return NULL;
+	}
+}
+
+NODISCARD PURE uint gpu_span_isa_best(void)
+{
+	uint isa = GPU_SPAN_ISAS_NUM - 1;
+
+	while (!gpu_span_get(isa)) {
+		isa--;
+	}
+	return isa;
+}
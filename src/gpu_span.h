@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_span.h Provides the span kernels, which draw the pixels of a row
+/// of a triangle or a rectangle.
+
+#pragma once
+
+#include "compiler.h"
+#include "psycho/types.h"
+
+struct gpu_prim;
+
+// clang-format off
+
+/// @brief The number of fractional bits of the values interpolated across a
+/// span.
+#define GPU_SPAN_FRAC_SHIFT	(16)
+
+///@{
+/// @brief The values interpolated across a span.
+#define GPU_ATTR_R	(0)
+#define GPU_ATTR_G	(1)
+#define GPU_ATTR_B	(2)
+#define GPU_ATTR_U	(3)
+#define GPU_ATTR_V	(4)
+#define GPU_ATTRS_NUM	(5)
+///@}
+
+///@{
+/// @brief The kinds of spans, each with a kernel of its own. A span textured
+/// from VRAM is GPU_SPAN_TEX plus the depth of its texture page, one of
+/// GPU_DEPTH_*; one textured from a decoded page is GPU_SPAN_DECODED.
+#define GPU_SPAN_FLAT		(0)
+#define GPU_SPAN_GOURAUD	(1)
+#define GPU_SPAN_TEX		(2)
+#define GPU_SPAN_DECODED	(5)
+#define GPU_SPANS_NUM		(6)
+///@}
+
+///@{
+/// @brief The instruction sets the kernels are written for.
+#define GPU_SPAN_ISA_SCALAR	(0)
+#define GPU_SPAN_ISA_SSE41	(1)
+#define GPU_SPAN_ISA_AVX2	(2)
+#define GPU_SPAN_ISAS_NUM	(3)
+///@}
+
+// clang-format on
+
+/// @brief Draws the pixels of a row of a primitive from x_beg up to x_end.
+///
+/// Whichever the instruction set, a kernel leaves VRAM exactly as the scalar
+/// one would.
+///
+/// @param val The values interpolated across the span at x_beg, in fixed
+/// point with GPU_SPAN_FRAC_SHIFT fractional bits.
+/// @param step What the values change by from one pixel to the next. A flat
+/// span must not change its colour.
+typedef void (*gpu_span_fn)(u16 *vram, const struct gpu_prim *p, uint y,
+			    uint x_beg, uint x_end,
+			    const s32 val[GPU_ATTRS_NUM],
+			    const s32 step[GPU_ATTRS_NUM]);
+
+/// @brief Retrieves the kernels written for an instruction set.
+///
+/// @param isa One of GPU_SPAN_ISA_*.
+/// @returns The kernels, indexed by GPU_SPAN_*, or NULL if the host lacks
+/// @p isa or the kernels for it were not built.
+NODISCARD PURE const gpu_span_fn *gpu_span_get(uint isa);
+
+/// @brief Picks the fastest instruction set the host has kernels for.
+///
+/// @returns One of GPU_SPAN_ISA_*.
+NODISCARD PURE uint gpu_span_isa_best(void);
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_tex.c Implements the texture cache.
+///
+/// A 4 or 8 bpp texel takes two dependent reads of VRAM: its index, then the
+/// CLUT entry the index selects. Scenes draw most of their primitives from a
+/// handful of texture pages, so a page is decoded through its CLUT once, and
+/// those primitives read direct texels from it instead.
+///
+/// VRAM is split into blocks of 64x64 pixels, each stamped with the epoch it
+/// was last written to in. A page is decoded as of an epoch, and goes stale
+/// once any block it was decoded from is written to in a later one.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu.h"
+#include "gpu_tex.h"
+
+// clang-format off
+
+/// @brief The size of a block (in pixels) along either axis, expressed as a
+/// shift.
+#define BLOCK_SHIFT	(6)
+
+#define BLOCK_COLS	(PSYCHO_GPU_VRAM_WIDTH >> BLOCK_SHIFT)
+#define BLOCK_ROWS	(PSYCHO_GPU_VRAM_HEIGHT >> BLOCK_SHIFT)
+#define BLOCKS_NUM	(BLOCK_COLS * BLOCK_ROWS)
+
+/// @brief The number of words in a set of blocks, and the number of rows of
+/// blocks in each word.
+#define BLOCKS_WORDS	(BLOCKS_NUM / 64)
+#define WORD_ROWS	(64 / BLOCK_COLS)
+
+/// @brief The number of pages kept decoded.
+#define ENTRIES_NUM	(8)
+
+/// @brief The number of pages whose use is tracked before they are decoded.
+#define SEEN_NUM	(64)
+
+/// @brief The area a page must be drawn to from VRAM before it is decoded, so
+/// that decoding it costs a small multiple of what it saves.
+#define DECODE_AREA	(GPU_TEX_PAGE_DIM * GPU_TEX_PAGE_DIM / 4)
+
+// clang-format on
+
+struct entry {
+	u16 texels[GPU_TEX_PAGE_DIM * GPU_TEX_PAGE_DIM];
+
+	/// @brief The blocks the page was decoded from.
+	u64 deps[BLOCKS_WORDS];
+
+	/// @brief The epoch the page was decoded as of.
+	u64 epoch;
+
+	/// @brief The batch which last used the page. It is not replaced while
+	/// that batch is pending.
+	u64 batch;
+
+	/// @brief When the page was last used, to replace the least recently
+	/// used one.
+	u64 tick;
+
+	u32 key;
+	bool valid;
+	u8 pad[3];
+};
+
+/// @brief A page which has not been decoded yet, and how much has been drawn
+/// from it since.
+struct seen {
+	u32 key;
+	u32 area;
+};
+
+struct gpu_tex {
+	struct entry entries[ENTRIES_NUM];
+	struct seen seen[SEEN_NUM];
+
+	/// @brief The epoch each block was last written to in.
+	u64 block_epoch[BLOCKS_NUM];
+
+	/// @brief The blocks batched primitives draw to.
+	u64 batch_blocks[BLOCKS_WORDS];
+
+	u64 epoch;
+	u64 batch;
+	u64 tick;
+};
+
+/// @brief Returns the blocks along an axis which n pixels from pos cover,
+/// wrapping around.
+///
+/// @param cells The number of blocks along the axis.
+static NODISCARD uint cells_get(const uint pos, const uint n, const uint cells)
+{
+	const uint beg = pos >> BLOCK_SHIFT;
+	const uint end = (pos + n - 1) >> BLOCK_SHIFT;
+	uint bits = 0;
+
+	if ((end - beg) >= (cells - 1)) {
+		return (1U << cells) - 1;
+	}
+
+	for (uint c = beg; c <= end; ++c) {
+		bits |= 1U << (c % cells);
+	}
+	return bits;
+}
+
+/// @brief Adds the blocks a rectangle covers to a set of blocks.
+static void blocks_add(u64 blocks[BLOCKS_WORDS], const uint x, const uint y,
+		       const uint w, const uint h)
+{
+	const uint cols = cells_get(x, w, BLOCK_COLS);
+	const uint rows = cells_get(y, h, BLOCK_ROWS);
+
+	for (uint row = 0; row < BLOCK_ROWS; ++row) {
+		if (rows & (1U << row)) {
+			blocks[row / WORD_ROWS] |= (u64)cols
+						   << ((row % WORD_ROWS) *
+						       BLOCK_COLS);
+		}
+	}
+}
+
+static NODISCARD bool blocks_overlap(const u64 a[BLOCKS_WORDS],
+				     const u64 b[BLOCKS_WORDS])
+{
+	u64 any = 0;
+
+	for (uint i = 0; i < BLOCKS_WORDS; ++i) {
+		any |= a[i] & b[i];
+	}
+	return any != 0;
+}
+
+/// @brief Returns whether any block a page was decoded from was written to
+/// since.
+static NODISCARD bool entry_stale(const struct gpu_tex *const t,
+				  const struct entry *const n)
+{
+	for (uint i = 0; i < BLOCKS_WORDS; ++i) {
+		for (u64 bits = n->deps[i]; bits != 0; bits &= bits - 1) {
+			const uint b = (i * 64) + (uint)__builtin_ctzll(bits);
+
+			if (t->block_epoch[b] > n->epoch) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/// @brief Returns a key for the texture page and CLUT of an environment.
+static NODISCARD u32 key_get(const struct gpu_env *const e)
+{
+	return (u32)(e->tp_x >> 6) | ((u32)(e->tp_y >> 8) << 4) |
+	       ((u32)e->depth << 5) | ((u32)(e->clut_x >> 4) << 6) |
+	       ((u32)e->clut_y << 12);
+}
+
+/// @brief Adds to the area drawn from a page which is not decoded.
+///
+/// @returns Whether enough was drawn from the page to decode it.
+static NODISCARD bool seen_add(struct gpu_tex *const t, const u32 key,
+			       const u32 area)
+{
+	struct seen *const s = &t->seen[(key * 2654435761U) >> 26];
+
+	if (s->key != key) {
+		s->key = key;
+		s->area = 0;
+	}
+	s->area += area;
+
+	if (s->area < DECODE_AREA) {
+		return false;
+	}
+	s->area = 0;
+	return true;
+}
+
+static void page_decode(u16 *const dst, const u16 *const vram,
+			const struct gpu_env *const e)
+{
+	const u16 *const row = &vram[e->clut_y * PSYCHO_GPU_VRAM_WIDTH];
+	const uint entries = 16U << (e->depth * 4);
+	u16 clut[256];
+
+	for (uint i = 0; i < entries; ++i) {
+		clut[i] = row[(e->clut_x + i) & GPU_VRAM_X_MASK];
+	}
+
+	for (uint v = 0; v < GPU_TEX_PAGE_DIM; ++v) {
+		const uint y = (e->tp_y + v) & GPU_VRAM_Y_MASK;
+		const u16 *const src = &vram[y * PSYCHO_GPU_VRAM_WIDTH];
+		u16 *const d = &dst[v * GPU_TEX_PAGE_DIM];
+
+		if (e->depth == GPU_DEPTH_4BPP) {
+			for (uint i = 0; i < (GPU_TEX_PAGE_DIM / 4); ++i) {
+				const uint w = src[(e->tp_x + i) &
+						   GPU_VRAM_X_MASK];
+
+				d[(i * 4) + 0] = clut[w & 0xF];
+				d[(i * 4) + 1] = clut[(w >> 4) & 0xF];
+				d[(i * 4) + 2] = clut[(w >> 8) & 0xF];
+				d[(i * 4) + 3] = clut[w >> 12];
+			}
+		} else {
+			for (uint i = 0; i < (GPU_TEX_PAGE_DIM / 2); ++i) {
+				const uint w = src[(e->tp_x + i) &
+						   GPU_VRAM_X_MASK];
+
+				d[(i * 2) + 0] = clut[w & 0xFF];
+				d[(i * 2) + 1] = clut[w >> 8];
+			}
+		}
+	}
+}
+
+NODISCARD MALLOC struct gpu_tex *gpu_tex_new(void)
+{
+	return calloc(1, sizeof(struct gpu_tex));
+}
+
+void gpu_tex_free(struct gpu_tex *const t)
+{
+	free(t);
+}
+
+NODISCARD const u16 *gpu_tex_get(struct gpu_tex *const t,
+				 const u16 *const vram,
+				 const struct gpu_env *const e, const uint x,
+				 const uint y, const uint w, const uint h)
+{
+	const u32 key = key_get(e);
+	u64 deps[BLOCKS_WORDS] = { 0 };
+	u64 drawn[BLOCKS_WORDS] = { 0 };
+
+	// A page is 256 texels square, of 4 or 8 bits each.
+	blocks_add(deps, e->tp_x, e->tp_y, 64U << e->depth, GPU_TEX_PAGE_DIM);
+	blocks_add(deps, e->clut_x, e->clut_y, 16U << (e->depth * 4), 1);
+	blocks_add(drawn, x, y, w, h);
+
+	if (blocks_overlap(deps, drawn)) {
+		return NULL;
+	}
+
+	struct entry *n = NULL;
+	struct entry *victim = NULL;
+
+	for (uint i = 0; i < ENTRIES_NUM; ++i) {
+		struct entry *const c = &t->entries[i];
+
+		if (c->valid && (c->key == key)) {
+			n = c;
+			break;
+		}
+
+		if (c->valid && (c->batch == t->batch)) {
+			continue;
+		}
+
+		if (!victim || !c->valid ||
+		    (victim->valid && (c->tick < victim->tick))) {
+			victim = c;
+		}
+	}
+
+	if (n && !entry_stale(t, n)) {
+		n->batch = t->batch;
+		n->tick = ++t->tick;
+		return n->texels;
+	}
+
+	// Decoding the page now would miss what the batch draws to it.
+	if (blocks_overlap(deps, t->batch_blocks) ||
+	    !seen_add(t, key, w * h)) {
+		return NULL;
+	}
+
+	if (!n) {
+		n = victim;
+	}
+
+	if (!n || (n->valid && (n->batch == t->batch))) {
+		return NULL;
+	}
+
+	page_decode(n->texels, vram, e);
+	memcpy(n->deps, deps, sizeof(deps));
+	n->epoch = t->epoch;
+	n->batch = t->batch;
+	n->tick = ++t->tick;
+	n->key = key;
+	n->valid = true;
+	return n->texels;
+}
+
+void gpu_tex_written(struct gpu_tex *const t, const uint x, const uint y,
+		     const uint w, const uint h, const bool batched)
+{
+	u64 blocks[BLOCKS_WORDS] = { 0 };
+
+	blocks_add(blocks, x, y, w, h);
+	t->epoch++;
+
+	for (uint i = 0; i < BLOCKS_WORDS; ++i) {
+		for (u64 bits = blocks[i]; bits != 0; bits &= bits - 1) {
+			const uint b = (i * 64) + (uint)__builtin_ctzll(bits);
+
+			t->block_epoch[b] = t->epoch;
+		}
+
+		if (batched) {
+			t->batch_blocks[i] |= blocks[i];
+		}
+	}
+}
+
+void gpu_tex_flushed(struct gpu_tex *const t)
+{
+	memset(t->batch_blocks, 0, sizeof(t->batch_blocks));
+	t->batch++;
+}
+
+void gpu_tex_invalidate(struct gpu_tex *const t)
+{
+	for (uint i = 0; i < ENTRIES_NUM; ++i) {
+		t->entries[i].valid = false;
+	}
+	memset(t->seen, 0, sizeof(t->seen));
+	gpu_tex_flushed(t);
+}
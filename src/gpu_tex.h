@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gpu_tex.h Provides the texture cache, which keeps 4 and 8 bpp texture
+/// pages decoded through their CLUTs.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "gpu_draw.h"
+#include "psycho/types.h"
+
+// clang-format off
+
+/// @brief The size of a decoded texture page (in texels) along either axis.
+#define GPU_TEX_PAGE_DIM	(256)
+
+// clang-format on
+
+struct gpu_tex;
+
+/// @brief Allocates an empty texture cache.
+///
+/// @returns The cache, or NULL if memory could not be allocated.
+NODISCARD MALLOC struct gpu_tex *gpu_tex_new(void);
+
+void gpu_tex_free(struct gpu_tex *t);
+
+/// @brief Retrieves the decoded texture page for a primitive about to be
+/// batched, decoding it if that is worth it.
+///
+/// A page is only handed out if it matches VRAM for as long as the primitive
+/// is drawn: the primitive must not draw to the blocks it reads texels from,
+/// and no primitive batched before it may either.
+///
+/// @param e The environment of the primitive, with a 4 or 8 bpp texture page.
+/// @param x, y, w, h The rectangle the primitive draws to, which wraps around
+/// the edges of VRAM.
+/// @returns The page, GPU_TEX_PAGE_DIM texels square and indexed by (v, u),
+/// or NULL if the primitive must read its texels from VRAM.
+NODISCARD const u16 *gpu_tex_get(struct gpu_tex *t, const u16 *vram,
+				 const struct gpu_env *e, uint x, uint y,
+				 uint w, uint h);
+
+/// @brief Records that a rectangle of VRAM is written to, which wraps around
+/// the edges of VRAM.
+///
+/// @param batched Whether the rectangle is drawn to by a batched primitive,
+/// rather than written to already.
+void gpu_tex_written(struct gpu_tex *t, uint x, uint y, uint w, uint h,
+		     bool batched);
+
+/// @brief Records that the batch was drawn, so that the pages its primitives
+/// read from may be replaced.
+void gpu_tex_flushed(struct gpu_tex *t);
+
+/// @brief Drops every decoded page, after VRAM was replaced as a whole.
+void gpu_tex_invalidate(struct gpu_tex *t);
@@ -0,0 +1,861 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gte.c Implements the Geometry Transformation Engine (coprocessor 2).
+///
+/// Every command is written as the hardware computes it, down to the order in
+/// which it checks and saturates intermediate results, as FLAG reports on each
+/// of those steps. The matrix products are handed to the vectorized kernels in
+/// gte_simd.c where possible; they give up whenever a partial sum would have
+/// to be flagged, so the scalar code here remains the reference for both.
+
+#include <string.h>
+
+#include "cpu_defs.h"
+#include "gte.h"
+#include "gte_simd.h"
+
+// clang-format off
+
+#define CPR	(ctx->cpu.cp2_cpr)
+#define CCR	(ctx->cpu.cp2_ccr)
+#define FLAG	(CCR[CPU_CP2_CCR_FLAG])
+
+#define MAC(i)	(CPR[CPU_CP2_CPR_MAC0 + (i)])
+#define IR(i)	(CPR[CPU_CP2_CPR_IR0 + (i)])
+
+///@{
+/// @brief Command fields.
+#define CMD_SF	(1U << 19)	// Shift the results right by 12 bits
+#define CMD_LM	(1U << 10)	// Saturate IR1..3 to 0, not to -0x8000
+///@}
+
+///@{
+/// @brief FLAG bits. MAC1..3, IR1..3 and the colors are numbered from 1.
+#define FLAG_ERR		(1U << 31)
+#define FLAG_MAC_POS(i)		(1U << (31 - (i)))
+#define FLAG_MAC_NEG(i)		(1U << (28 - (i)))
+#define FLAG_IR(i)		(1U << (25 - (i)))
+#define FLAG_COLOR(i)		(1U << (22 - (i)))
+#define FLAG_SZ			(1U << 18)
+#define FLAG_DIV		(1U << 17)
+#define FLAG_MAC0_POS		(1U << 16)
+#define FLAG_MAC0_NEG		(1U << 15)
+#define FLAG_SX			(1U << 14)
+#define FLAG_SY			(1U << 13)
+#define FLAG_IR0		(1U << 12)
+#define FLAG_WRITABLE		(0x7FFFF000U)
+///@}
+
+/// @brief The bits of FLAG which also set FLAG_ERR.
+#define FLAG_ERRORS	(0x7F87E000U)
+
+///@{
+/// @brief The range of MAC1..3, which are 44 bits wide internally.
+#define MAC_MIN	(-(INT64_C(1) << 43))
+#define MAC_MAX	((INT64_C(1) << 43) - 1)
+///@}
+
+///@{
+/// @brief How the lighting commands color the light they compute.
+#define LIGHT_NONE	(0)	// NCS, NCT
+#define LIGHT_COLOR	(1)	// NCCS, NCCT, CC
+#define LIGHT_DEPTH	(2)	// NCDS, NCDT, CDP
+///@}
+
+// clang-format on
+
+/// @brief The table of reciprocals which seeds the Newton-Raphson division of
+/// the perspective transformation; entry i is
+/// max(0, ((0x40000 / (i + 0x100)) + 1) / 2 - 0x101).
+static const u8 unr_table[0x101] = {
+	0xFF, 0xFD, 0xFB, 0xF9, 0xF7, 0xF5, 0xF3, 0xF1, 0xEF, 0xEE, 0xEC, 0xEA,
+	0xE8, 0xE6, 0xE4, 0xE3, 0xE1, 0xDF, 0xDD, 0xDC, 0xDA, 0xD8, 0xD6, 0xD5,
+	0xD3, 0xD1, 0xD0, 0xCE, 0xCD, 0xCB, 0xC9, 0xC8, 0xC6, 0xC5, 0xC3, 0xC1,
+	0xC0, 0xBE, 0xBD, 0xBB, 0xBA, 0xB8, 0xB7, 0xB5, 0xB4, 0xB2, 0xB1, 0xB0,
+	0xAE, 0xAD, 0xAB, 0xAA, 0xA9, 0xA7, 0xA6, 0xA4, 0xA3, 0xA2, 0xA0, 0x9F,
+	0x9E, 0x9C, 0x9B, 0x9A, 0x99, 0x97, 0x96, 0x95, 0x94, 0x92, 0x91, 0x90,
+	0x8F, 0x8D, 0x8C, 0x8B, 0x8A, 0x89, 0x87, 0x86, 0x85, 0x84, 0x83, 0x82,
+	0x81, 0x7F, 0x7E, 0x7D, 0x7C, 0x7B, 0x7A, 0x79, 0x78, 0x77, 0x75, 0x74,
+	0x73, 0x72, 0x71, 0x70, 0x6F, 0x6E, 0x6D, 0x6C, 0x6B, 0x6A, 0x69, 0x68,
+	0x67, 0x66, 0x65, 0x64, 0x63, 0x62, 0x61, 0x60, 0x5F, 0x5E, 0x5D, 0x5D,
+	0x5C, 0x5B, 0x5A, 0x59, 0x58, 0x57, 0x56, 0x55, 0x54, 0x53, 0x53, 0x52,
+	0x51, 0x50, 0x4F, 0x4E, 0x4D, 0x4D, 0x4C, 0x4B, 0x4A, 0x49, 0x48, 0x48,
+	0x47, 0x46, 0x45, 0x44, 0x43, 0x43, 0x42, 0x41, 0x40, 0x3F, 0x3F, 0x3E,
+	0x3D, 0x3C, 0x3C, 0x3B, 0x3A, 0x39, 0x39, 0x38, 0x37, 0x36, 0x36, 0x35,
+	0x34, 0x33, 0x33, 0x32, 0x31, 0x31, 0x30, 0x2F, 0x2E, 0x2E, 0x2D, 0x2C,
+	0x2C, 0x2B, 0x2A, 0x2A, 0x29, 0x28, 0x28, 0x27, 0x26, 0x26, 0x25, 0x24,
+	0x24, 0x23, 0x22, 0x22, 0x21, 0x20, 0x20, 0x1F, 0x1E, 0x1E, 0x1D, 0x1D,
+	0x1C, 0x1B, 0x1B, 0x1A, 0x19, 0x19, 0x18, 0x18, 0x17, 0x16, 0x16, 0x15,
+	0x15, 0x14, 0x14, 0x13, 0x12, 0x12, 0x11, 0x11, 0x10, 0x0F, 0x0F, 0x0E,
+	0x0E, 0x0D, 0x0D, 0x0C, 0x0C, 0x0B, 0x0A, 0x0A, 0x09, 0x09, 0x08, 0x08,
+	0x07, 0x07, 0x06, 0x06, 0x05, 0x05, 0x04, 0x04, 0x03, 0x03, 0x02, 0x02,
+	0x01, 0x01, 0x00, 0x00, 0x00,
+};
+
+/// @brief Returns the low half of a register, as a signed value.
+static ALWAYS_INLINE NODISCARD s16 lo(const u32 reg)
+{
+	return (s16)(u16)reg;
+}
+
+/// @brief Returns the high half of a register, as a signed value.
+static ALWAYS_INLINE NODISCARD s16 hi(const u32 reg)
+{
+	return (s16)(u16)(reg >> 16);
+}
+
+static ALWAYS_INLINE NODISCARD s32 clamp(const s64 value, const s32 min,
+					 const s32 max)
+{
+	if (value < min) {
+		return min;
+	}
+	return (value > max) ? max : (s32)value;
+}
+
+/// @brief Saturates a value to [min, max], raising @p flag if it had to be.
+static ALWAYS_INLINE NODISCARD s32 sat(struct psycho_ctx *const ctx,
+				       const s64 value, const s32 min,
+				       const s32 max, const u32 flag)
+{
+	if ((value < min) || (value > max)) {
+		FLAG |= flag;
+	}
+	return clamp(value, min, max);
+}
+
+/// @brief Flags a value of MAC1..3 which leaves the 44-bit range, and returns
+/// it wrapped to that range.
+static ALWAYS_INLINE NODISCARD s64 mac_wrap(struct psycho_ctx *const ctx,
+					    const uint i, const s64 value)
+{
+	if (value > MAC_MAX) {
+		FLAG |= FLAG_MAC_POS(i);
+	} else if (value < MAC_MIN) {
+		FLAG |= FLAG_MAC_NEG(i);
+	}
+	return (s64)((u64)value << 20) >> 20;
+}
+
+/// @brief Flags a value of MAC0 which leaves the 32-bit range.
+static ALWAYS_INLINE void mac0_chk(struct psycho_ctx *const ctx,
+				   const s64 value)
+{
+	if (value > INT32_MAX) {
+		FLAG |= FLAG_MAC0_POS;
+	} else if (value < INT32_MIN) {
+		FLAG |= FLAG_MAC0_NEG;
+	}
+}
+
+static ALWAYS_INLINE void mac_set(struct psycho_ctx *const ctx, const uint i,
+				  const s64 value, const uint shift)
+{
+	MAC(i) = (u32)(mac_wrap(ctx, i, value) >> shift);
+}
+
+static ALWAYS_INLINE void ir_set(struct psycho_ctx *const ctx, const uint i,
+				 const s32 value, const bool lm)
+{
+	IR(i) = (u32)sat(ctx, value, lm ? 0 : -0x8000, 0x7FFF, FLAG_IR(i));
+}
+
+/// @brief Sets MACi to a value shifted right by @p shift, and IRi to MACi
+/// saturated.
+static void mac_ir_set(struct psycho_ctx *const ctx, const uint i,
+		       const s64 value, const uint shift, const bool lm)
+{
+	mac_set(ctx, i, value, shift);
+	ir_set(ctx, i, (s32)MAC(i), lm);
+}
+
+static void mat_get(const struct psycho_ctx *const ctx, const uint reg,
+		    struct gte_mat *const m)
+{
+	for (uint k = 0; k < 9; ++k) {
+		const u32 pair = CCR[reg + (k / 2)];
+		m->e[k / 3][k % 3] = (k & 1) ? hi(pair) : lo(pair);
+	}
+}
+
+static void tr_get(const struct psycho_ctx *const ctx, const uint reg,
+		   s32 t[3])
+{
+	for (uint i = 0; i < 3; ++i) {
+		t[i] = (s32)CCR[reg + i];
+	}
+}
+
+/// @brief Returns the vector Vn.
+static NODISCARD struct gte_vec v_get(const struct psycho_ctx *const ctx,
+				      const uint n)
+{
+	const u32 xy = CPR[CPU_CP2_CPR_VXY0 + (n * 2)];
+	const u32 z = CPR[CPU_CP2_CPR_VZ0 + (n * 2)];
+
+	return (struct gte_vec){ { lo(xy), hi(xy), lo(z) } };
+}
+
+/// @brief Returns the vector [IR1, IR2, IR3].
+static NODISCARD struct gte_vec ir_get(const struct psycho_ctx *const ctx)
+{
+	return (struct gte_vec){ { lo(IR(1)), lo(IR(2)), lo(IR(3)) } };
+}
+
+/// @brief Computes (T SHL 12) + M * V for each vector, flagging and wrapping
+/// each partial sum which leaves the range of MAC1..3.
+static void sums_get(struct psycho_ctx *const ctx,
+		     const struct gte_mat *const m, const s32 t[3],
+		     const struct gte_vec *const v, const uint n,
+		     s64 (*const out)[3])
+{
+#ifdef PSYCHO_GTE_SIMD
+	// A single vector is not worth the call into a kernel.
+	if ((n > 1) && gte_simd_mat_vec(m, t, v, n, out)) {
+		return;
+	}
+#endif // PSYCHO_GTE_SIMD
+
+	for (uint i = 0; i < n; ++i) {
+		for (uint row = 0; row < 3; ++row) {
+			s64 sum = (s64)t[row] * 0x1000;
+
+			for (uint k = 0; k < 3; ++k) {
+				sum += m->e[row][k] * v[i].e[k];
+				sum = mac_wrap(ctx, row + 1, sum);
+			}
+			out[i][row] = sum;
+		}
+	}
+}
+
+/// @brief Sets MAC1..3 to ((T SHL 12) + M * V) SAR (sf * 12), and IR1..3 to
+/// MAC1..3 saturated.
+static void mat_vec(struct psycho_ctx *const ctx, const struct gte_mat *const m,
+		    const s32 t[3], const struct gte_vec *const v,
+		    const uint shift, const bool lm)
+{
+	s64 sums[1][3];
+	sums_get(ctx, m, t, v, 1, sums);
+
+	for (uint i = 0; i < 3; ++i) {
+		mac_ir_set(ctx, i + 1, sums[0][i], shift, lm);
+	}
+}
+
+/// @brief Pushes MAC1..3 SAR 4, saturated, and the code of RGBC to the color
+/// FIFO.
+static void rgb_push(struct psycho_ctx *const ctx)
+{
+	u32 rgb = CPR[CPU_CP2_CPR_RGB] & 0xFF000000;
+
+	for (uint i = 0; i < 3; ++i) {
+		const s32 c = sat(ctx, (s32)MAC(i + 1) >> 4, 0, 0xFF,
+				  FLAG_COLOR(i + 1));
+
+		rgb |= (u32)c << (i * 8);
+	}
+
+	CPR[CPU_CP2_CPR_RGB0] = CPR[CPU_CP2_CPR_RGB1];
+	CPR[CPU_CP2_CPR_RGB1] = CPR[CPU_CP2_CPR_RGB2];
+	CPR[CPU_CP2_CPR_RGB2] = rgb;
+}
+
+/// @brief Interpolates between a color and the far color by IR0, leaving the
+/// result in MAC1..3 and IR1..3.
+static void interpolate(struct psycho_ctx *const ctx, const s64 in[3],
+			const uint shift, const bool lm)
+{
+	for (uint i = 0; i < 3; ++i) {
+		const s64 fc = (s64)(s32)CCR[CPU_CP2_CCR_RFC + i] * 0x1000;
+		mac_ir_set(ctx, i + 1, fc - in[i], shift, false);
+	}
+
+	const s32 ir0 = lo(IR(0));
+
+	for (uint i = 0; i < 3; ++i) {
+		const s64 p = lo(IR(i + 1)) * ir0;
+		mac_ir_set(ctx, i + 1, p + in[i], shift, lm);
+	}
+}
+
+/// @brief Returns the color of RGBC multiplied by IR1..3, SHL 4.
+static void tint_get(const struct psycho_ctx *const ctx, s64 out[3])
+{
+	const u32 rgb = CPR[CPU_CP2_CPR_RGB];
+
+	for (uint i = 0; i < 3; ++i) {
+		out[i] = (s64)((rgb >> (i * 8)) & 0xFF) * lo(IR(i + 1)) * 16;
+	}
+}
+
+/// @brief Computes the perspective division (H * 0x20000 / SZ3 + 1) / 2 the
+/// way the hardware does; with a reciprocal refined from unr_table.
+static NODISCARD u32 unr_div(struct psycho_ctx *const ctx, const u32 h,
+			     const u32 sz3)
+{
+	if ((sz3 * 2) <= h) {
+		FLAG |= FLAG_DIV;
+		return 0x1FFFF;
+	}
+
+	const uint z = (uint)__builtin_clz(sz3) - 16;
+	const u64 n = (u64)h << z;
+	const u32 d = sz3 << z;
+	const u32 u = unr_table[(d - 0x7FC0) >> 7] + 0x101U;
+	const u32 r = (0x0000080 + (((0x2000080 - (d * u)) >> 8) * u)) >> 8;
+	const u64 q = ((n * r) + 0x8000) >> 16;
+
+	return (q > 0x1FFFF) ? 0x1FFFF : (u32)q;
+}
+
+/// @brief Finishes the perspective transformation of one vertex, given the
+/// sums (TR SHL 12) + RT * V.
+static void rtp(struct psycho_ctx *const ctx, const s64 sums[3],
+		const uint shift, const bool lm, const bool last)
+{
+	const s32 z = (s32)(sums[2] >> 12);
+
+	for (uint i = 0; i < 3; ++i) {
+		mac_set(ctx, i + 1, sums[i], shift);
+	}
+
+	ir_set(ctx, 1, (s32)MAC(1), lm);
+	ir_set(ctx, 2, (s32)MAC(2), lm);
+
+	// IR3 is saturated from MAC3 as usual, but it is only flagged if
+	// MAC3 SAR 12 had to be, whether or not sf is set.
+	if ((z < -0x8000) || (z > 0x7FFF)) {
+		FLAG |= FLAG_IR(3);
+	}
+	IR(3) = (u32)clamp((s32)MAC(3), lm ? 0 : -0x8000, 0x7FFF);
+
+	CPR[CPU_CP2_CPR_SZ0] = CPR[CPU_CP2_CPR_SZ1];
+	CPR[CPU_CP2_CPR_SZ1] = CPR[CPU_CP2_CPR_SZ2];
+	CPR[CPU_CP2_CPR_SZ2] = CPR[CPU_CP2_CPR_SZ3];
+	CPR[CPU_CP2_CPR_SZ3] = (u32)sat(ctx, z, 0, 0xFFFF, FLAG_SZ);
+
+	const s64 q = unr_div(ctx, (u16)CCR[CPU_CP2_CCR_H],
+			      CPR[CPU_CP2_CPR_SZ3]);
+
+	const s64 sx = (q * lo(IR(1))) + (s32)CCR[CPU_CP2_CCR_OFX];
+	const s64 sy = (q * lo(IR(2))) + (s32)CCR[CPU_CP2_CCR_OFY];
+
+	mac0_chk(ctx, sx);
+	mac0_chk(ctx, sy);
+
+	const s32 x = sat(ctx, (s32)(sx >> 16), -0x400, 0x3FF, FLAG_SX);
+	const s32 y = sat(ctx, (s32)(sy >> 16), -0x400, 0x3FF, FLAG_SY);
+
+	CPR[CPU_CP2_CPR_SXY0] = CPR[CPU_CP2_CPR_SXY1];
+	CPR[CPU_CP2_CPR_SXY1] = CPR[CPU_CP2_CPR_SXY2];
+	CPR[CPU_CP2_CPR_SXY2] = (u16)x | ((u32)(u16)y << 16);
+
+	// Depth cueing is only done for the last vertex.
+	if (last) {
+		const s64 p = (q * lo(CCR[CPU_CP2_CCR_DQA])) +
+			      (s32)CCR[CPU_CP2_CCR_DQB];
+
+		mac0_chk(ctx, p);
+		MAC(0) = (u32)p;
+		IR(0) = (u32)sat(ctx, p >> 12, 0, 0x1000, FLAG_IR0);
+	}
+}
+
+/// @brief RTPS and RTPT: the perspective transformation of V0, or of V0..V2.
+static void rtp_cmd(struct psycho_ctx *const ctx, const uint n,
+		    const uint shift, const bool lm)
+{
+	struct gte_mat rt;
+	struct gte_vec v[3];
+	s32 tr[3];
+	s64 sums[3][3];
+
+	mat_get(ctx, CPU_CP2_CCR_R11R12, &rt);
+	tr_get(ctx, CPU_CP2_CCR_TRX, tr);
+
+	for (uint i = 0; i < n; ++i) {
+		v[i] = v_get(ctx, i);
+	}
+
+	// The vertices do not depend on each other, so their sums can be
+	// computed at once.
+	sums_get(ctx, &rt, tr, v, n, sums);
+
+	for (uint i = 0; i < n; ++i) {
+		rtp(ctx, sums[i], shift, lm, i == (n - 1));
+	}
+}
+
+/// @brief Lights the normal in IR1..3 with the light color matrix and the
+/// background color, colors the light as @p mode says, and pushes it to the
+/// color FIFO.
+static void light(struct psycho_ctx *const ctx, const uint mode,
+		  const uint shift, const bool lm)
+{
+	struct gte_mat lcm;
+	s32 bk[3];
+
+	mat_get(ctx, CPU_CP2_CCR_LR1LR2, &lcm);
+	tr_get(ctx, CPU_CP2_CCR_RBK, bk);
+
+	const struct gte_vec ir = ir_get(ctx);
+	mat_vec(ctx, &lcm, bk, &ir, shift, lm);
+
+	if (mode != LIGHT_NONE) {
+		s64 tint[3];
+		tint_get(ctx, tint);
+
+		if (mode == LIGHT_COLOR) {
+			for (uint i = 0; i < 3; ++i) {
+				mac_ir_set(ctx, i + 1, tint[i], shift, lm);
+			}
+		} else {
+			interpolate(ctx, tint, shift, lm);
+		}
+	}
+	rgb_push(ctx);
+}
+
+/// @brief The normal color commands: NCS, NCT, NCCS, NCCT, NCDS and NCDT,
+/// which light V0, or V0..V2.
+static void nc_cmd(struct psycho_ctx *const ctx, const uint n, const uint mode,
+		   const uint shift, const bool lm)
+{
+	static const s32 none[3] = { 0, 0, 0 };
+
+	struct gte_mat llm;
+	struct gte_vec v[3];
+	s64 sums[3][3];
+
+	mat_get(ctx, CPU_CP2_CCR_L11L12, &llm);
+
+	for (uint i = 0; i < n; ++i) {
+		v[i] = v_get(ctx, i);
+	}
+	sums_get(ctx, &llm, none, v, n, sums);
+
+	for (uint i = 0; i < n; ++i) {
+		for (uint j = 0; j < 3; ++j) {
+			mac_ir_set(ctx, j + 1, sums[i][j], shift, lm);
+		}
+		light(ctx, mode, shift, lm);
+	}
+}
+
+static void mvmva(struct psycho_ctx *const ctx, const u32 instr,
+		  const uint shift, const bool lm)
+{
+	static const uint mats[3] = { CPU_CP2_CCR_R11R12, CPU_CP2_CCR_L11L12,
+				      CPU_CP2_CCR_LR1LR2 };
+	static const uint trs[3] = { CPU_CP2_CCR_TRX, CPU_CP2_CCR_RBK,
+				     CPU_CP2_CCR_RFC };
+
+	const uint mx = (instr >> 17) & 3;
+	const uint vx = (instr >> 15) & 3;
+	const uint cv = (instr >> 13) & 3;
+
+	struct gte_mat m;
+	s32 t[3] = { 0, 0, 0 };
+
+	if (mx == 3) {
+		// There is no fourth matrix; the hardware makes one up from
+		// other registers.
+		const s16 r = (s16)((CPR[CPU_CP2_CPR_RGB] & 0xFF) << 4);
+		const s16 rt13 = lo(CCR[CPU_CP2_CCR_R13R21]);
+		const s16 rt22 = lo(CCR[CPU_CP2_CCR_R22R23]);
+
+		m = (struct gte_mat){ { { (s16)-r, r, lo(IR(0)) },
+					{ rt13, rt13, rt13 },
+					{ rt22, rt22, rt22 } } };
+	} else {
+		mat_get(ctx, mats[mx], &m);
+	}
+
+	const struct gte_vec v = (vx == 3) ? ir_get(ctx) : v_get(ctx, vx);
+
+	if (cv != 3) {
+		tr_get(ctx, trs[cv], t);
+	}
+
+	if (cv != 2) {
+		mat_vec(ctx, &m, t, &v, shift, lm);
+		return;
+	}
+
+	// Translating by the far color is broken: only the products of the
+	// last two columns make it to the result, although the first one
+	// still raises flags.
+	for (uint i = 0; i < 3; ++i) {
+		const s64 tr = (s64)t[i] * 0x1000;
+		const s64 first = mac_wrap(ctx, i + 1,
+					   tr + (m.e[i][0] * v.e[0]));
+
+		ir_set(ctx, i + 1, (s32)(first >> shift), false);
+
+		const s64 rest = mac_wrap(ctx, i + 1, m.e[i][1] * v.e[1]) +
+				 (m.e[i][2] * v.e[2]);
+
+		mac_ir_set(ctx, i + 1, rest, shift, lm);
+	}
+}
+
+static void nclip(struct psycho_ctx *const ctx)
+{
+	const u32 xy0 = CPR[CPU_CP2_CPR_SXY0];
+	const u32 xy1 = CPR[CPU_CP2_CPR_SXY1];
+	const u32 xy2 = CPR[CPU_CP2_CPR_SXY2];
+
+	const s64 p = ((s64)lo(xy0) * hi(xy1)) + ((s64)lo(xy1) * hi(xy2)) +
+		      ((s64)lo(xy2) * hi(xy0)) - ((s64)lo(xy0) * hi(xy2)) -
+		      ((s64)lo(xy1) * hi(xy0)) - ((s64)lo(xy2) * hi(xy1));
+
+	mac0_chk(ctx, p);
+	MAC(0) = (u32)p;
+}
+
+/// @brief AVSZ3 and AVSZ4: averages SZ1..SZ3 or SZ0..SZ3, scaled by @p zsf,
+/// into OTZ.
+static void avsz(struct psycho_ctx *const ctx, const uint zsf,
+		 const uint first)
+{
+	u32 sum = 0;
+
+	for (uint reg = first; reg <= CPU_CP2_CPR_SZ3; ++reg) {
+		sum += CPR[reg];
+	}
+
+	const s64 p = (s64)lo(CCR[zsf]) * sum;
+
+	mac0_chk(ctx, p);
+	MAC(0) = (u32)p;
+	CPR[CPU_CP2_CPR_OTZ] = (u32)sat(ctx, p >> 12, 0, 0xFFFF, FLAG_SZ);
+}
+
+/// @brief OP: the outer product of IR1..3 and the diagonal of the rotation
+/// matrix.
+static void op(struct psycho_ctx *const ctx, const uint shift, const bool lm)
+{
+	const s64 d1 = lo(CCR[CPU_CP2_CCR_R11R12]);
+	const s64 d2 = lo(CCR[CPU_CP2_CCR_R22R23]);
+	const s64 d3 = lo(CCR[CPU_CP2_CCR_R33]);
+	const struct gte_vec ir = ir_get(ctx);
+
+	mac_ir_set(ctx, 1, (ir.e[2] * d2) - (ir.e[1] * d3), shift, lm);
+	mac_ir_set(ctx, 2, (ir.e[0] * d3) - (ir.e[2] * d1), shift, lm);
+	mac_ir_set(ctx, 3, (ir.e[1] * d1) - (ir.e[0] * d2), shift, lm);
+}
+
+/// @brief DPCS and DPCT: depth cues a color.
+static void dpc(struct psycho_ctx *const ctx, const u32 rgb, const uint shift,
+		const bool lm)
+{
+	s64 in[3];
+
+	for (uint i = 0; i < 3; ++i) {
+		in[i] = (s64)((rgb >> (i * 8)) & 0xFF) * 0x10000;
+	}
+
+	interpolate(ctx, in, shift, lm);
+	rgb_push(ctx);
+}
+
+static void intpl(struct psycho_ctx *const ctx, const uint shift,
+		  const bool lm)
+{
+	s64 in[3];
+
+	for (uint i = 0; i < 3; ++i) {
+		in[i] = (s64)lo(IR(i + 1)) * 0x1000;
+	}
+
+	interpolate(ctx, in, shift, lm);
+	rgb_push(ctx);
+}
+
+static void dcpl(struct psycho_ctx *const ctx, const uint shift,
+		 const bool lm)
+{
+	s64 tint[3];
+
+	tint_get(ctx, tint);
+	interpolate(ctx, tint, shift, lm);
+	rgb_push(ctx);
+}
+
+static void sqr(struct psycho_ctx *const ctx, const uint shift, const bool lm)
+{
+	for (uint i = 1; i <= 3; ++i) {
+		const s32 ir = lo(IR(i));
+		mac_ir_set(ctx, i, ir * ir, shift, lm);
+	}
+}
+
+/// @brief GPF and GPL: general purpose interpolation, which adds IR1..3 * IR0
+/// to nothing or to MAC1..3.
+static void gp(struct psycho_ctx *const ctx, const bool base, const uint shift,
+	       const bool lm)
+{
+	const s32 ir0 = lo(IR(0));
+
+	for (uint i = 1; i <= 3; ++i) {
+		const s64 mac = base ? ((s64)(s32)MAC(i) * (1 << shift)) : 0;
+		mac_ir_set(ctx, i, mac + (lo(IR(i)) * ir0), shift, lm);
+	}
+	rgb_push(ctx);
+}
+
+/// @brief Returns the value of IRGB and ORGB: IR1..3 saturated to 5 bits.
+static NODISCARD u32 orgb_get(const struct psycho_ctx *const ctx)
+{
+	u32 rgb = 0;
+
+	for (uint i = 0; i < 3; ++i) {
+		rgb |= (u32)clamp(lo(IR(i + 1)) >> 7, 0, 0x1F) << (i * 5);
+	}
+	return rgb;
+}
+
+/// @brief Returns the number of leading bits of a value equal to its sign bit.
+static NODISCARD u32 lzc(const u32 data)
+{
+	const u32 bits = (data & 0x80000000) ? ~data : data;
+	return bits ? (u32)__builtin_clz(bits) : 32;
+}
+
+void gte_reset(struct psycho_ctx *const ctx)
+{
+	memset(CPR, 0, sizeof(CPR));
+	memset(CCR, 0, sizeof(CCR));
+}
+
+NODISCARD PURE u32 gte_data_read(const struct psycho_ctx *const ctx,
+				 const uint reg)
+{
+	switch (reg) {
+	case CPU_CP2_CPR_SXYP:
+		return CPR[CPU_CP2_CPR_SXY2];
+
+	case CPU_CP2_CPR_IRGB:
+	case CPU_CP2_CPR_ORGB:
+		return orgb_get(ctx);
+
+	default:
+		return CPR[reg];
+	}
+}
+
+void gte_data_write(struct psycho_ctx *const ctx, const uint reg,
+		    const u32 data)
+{
+	switch (reg) {
+	case CPU_CP2_CPR_VZ0:
+	case CPU_CP2_CPR_VZ1:
+	case CPU_CP2_CPR_VZ2:
+	case CPU_CP2_CPR_IR0:
+	case CPU_CP2_CPR_IR1:
+	case CPU_CP2_CPR_IR2:
+	case CPU_CP2_CPR_IR3:
+		CPR[reg] = (u32)lo(data);
+		return;
+
+	case CPU_CP2_CPR_OTZ:
+	case CPU_CP2_CPR_SZ0:
+	case CPU_CP2_CPR_SZ1:
+	case CPU_CP2_CPR_SZ2:
+	case CPU_CP2_CPR_SZ3:
+		CPR[reg] = data & 0xFFFF;
+		return;
+
+	case CPU_CP2_CPR_SXYP:
+		CPR[CPU_CP2_CPR_SXY0] = CPR[CPU_CP2_CPR_SXY1];
+		CPR[CPU_CP2_CPR_SXY1] = CPR[CPU_CP2_CPR_SXY2];
+		CPR[CPU_CP2_CPR_SXY2] = data;
+
+		return;
+
+	case CPU_CP2_CPR_IRGB:
+		for (uint i = 0; i < 3; ++i) {
+			IR(i + 1) = ((data >> (i * 5)) & 0x1F) << 7;
+		}
+		return;
+
+	case CPU_CP2_CPR_ORGB:
+	case CPU_CP2_CPR_LZCR:
+		return;
+
+	case CPU_CP2_CPR_LZCS:
+		CPR[CPU_CP2_CPR_LZCS] = data;
+		CPR[CPU_CP2_CPR_LZCR] = lzc(data);
+
+		return;
+
+	default:
+		CPR[reg] = data;
+		return;
+	}
+}
+
+NODISCARD PURE u32 gte_ctrl_read(const struct psycho_ctx *const ctx,
+				 const uint reg)
+{
+	return CCR[reg];
+}
+
+void gte_ctrl_write(struct psycho_ctx *const ctx, const uint reg,
+		    const u32 data)
+{
+	switch (reg) {
+	case CPU_CP2_CCR_R33:
+	case CPU_CP2_CCR_L33:
+	case CPU_CP2_CCR_LB3:
+	case CPU_CP2_CCR_H:
+	case CPU_CP2_CCR_DQA:
+	case CPU_CP2_CCR_ZSF3:
+	case CPU_CP2_CCR_ZSF4:
+		// H is unsigned, but it still reads back sign-extended.
+		CCR[reg] = (u32)lo(data);
+		return;
+
+	case CPU_CP2_CCR_FLAG:
+		FLAG = data & FLAG_WRITABLE;
+
+		if (FLAG & FLAG_ERRORS) {
+			FLAG |= FLAG_ERR;
+		}
+		return;
+
+	default:
+		CCR[reg] = data;
+		return;
+	}
+}
+
+void gte_cmd(struct psycho_ctx *const ctx, const u32 instr)
+{
+	const uint shift = (instr & CMD_SF) ? 12 : 0;
+	const bool lm = instr & CMD_LM;
+
+	FLAG = 0;
+
+	switch (cpu_instr_funct_get(instr)) {
+	case CPU_OP_RTPS:
+		rtp_cmd(ctx, 1, shift, lm);
+		break;
+
+	case CPU_OP_RTPT:
+		rtp_cmd(ctx, 3, shift, lm);
+		break;
+
+	case CPU_OP_NCLIP:
+		nclip(ctx);
+		break;
+
+	case CPU_OP_OP:
+		op(ctx, shift, lm);
+		break;
+
+	case CPU_OP_DPCS:
+		dpc(ctx, CPR[CPU_CP2_CPR_RGB], shift, lm);
+		break;
+
+	case CPU_OP_DPCT:
+		// Each pass takes the oldest color of the FIFO, which the one
+		// before it pushed out.
+		for (uint i = 0; i < 3; ++i) {
+			dpc(ctx, CPR[CPU_CP2_CPR_RGB0], shift, lm);
+		}
+		break;
+
+	case CPU_OP_INTPL:
+		intpl(ctx, shift, lm);
+		break;
+
+	case CPU_OP_MVMVA:
+		mvmva(ctx, instr, shift, lm);
+		break;
+
+	case CPU_OP_NCDS:
+		nc_cmd(ctx, 1, LIGHT_DEPTH, shift, lm);
+		break;
+
+	case CPU_OP_NCDT:
+		nc_cmd(ctx, 3, LIGHT_DEPTH, shift, lm);
+		break;
+
+	case CPU_OP_CDP:
+		light(ctx, LIGHT_DEPTH, shift, lm);
+		break;
+
+	case CPU_OP_NCCS:
+		nc_cmd(ctx, 1, LIGHT_COLOR, shift, lm);
+		break;
+
+	case CPU_OP_NCCT:
+		nc_cmd(ctx, 3, LIGHT_COLOR, shift, lm);
+		break;
+
+	case CPU_OP_CC:
+		light(ctx, LIGHT_COLOR, shift, lm);
+		break;
+
+	case CPU_OP_NCS:
+		nc_cmd(ctx, 1, LIGHT_NONE, shift, lm);
+		break;
+
+	case CPU_OP_NCT:
+		nc_cmd(ctx, 3, LIGHT_NONE, shift, lm);
+		break;
+
+	case CPU_OP_SQR:
+		sqr(ctx, shift, lm);
+		break;
+
+	case CPU_OP_DCPL:
+		dcpl(ctx, shift, lm);
+		break;
+
+	case CPU_OP_AVSZ3:
+		avsz(ctx, CPU_CP2_CCR_ZSF3, CPU_CP2_CPR_SZ1);
+		break;
+
+	case CPU_OP_AVSZ4:
+		avsz(ctx, CPU_CP2_CCR_ZSF4, CPU_CP2_CPR_SZ0);
+		break;
+
+	case CPU_OP_GPF:
+		gp(ctx, false, shift, lm);
+		break;
+
+	case CPU_OP_GPL:
+		gp(ctx, true, shift, lm);
+		break;
+
+	default:
+		break;
+	}
+
+	if (FLAG & FLAG_ERRORS) {
+		FLAG |= FLAG_ERR;
+	}
+}
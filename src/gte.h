@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gte.h Provides the Geometry Transformation Engine (coprocessor 2).
+
+#pragma once
+
+#include "compiler.h"
+#include "psycho/ctx.h"
+
+void gte_reset(struct psycho_ctx *ctx);
+
+/// @brief Reads a data register, as MFC2 and SWC2 do.
+NODISCARD PURE u32 gte_data_read(const struct psycho_ctx *ctx, uint reg);
+
+/// @brief Writes a data register, as MTC2 and LWC2 do.
+void gte_data_write(struct psycho_ctx *ctx, uint reg, u32 data);
+
+/// @brief Reads a control register, as CFC2 does.
+NODISCARD PURE u32 gte_ctrl_read(const struct psycho_ctx *ctx, uint reg);
+
+/// @brief Writes a control register, as CTC2 does.
+void gte_ctrl_write(struct psycho_ctx *ctx, uint reg, u32 data);
+
+/// @brief Executes a command; any of the COP2 instructions with the CO bit
+/// set.
+void gte_cmd(struct psycho_ctx *ctx, u32 instr);
@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gte_simd.c Implements the vectorized GTE kernels.
+///
+/// Each row of the matrix occupies a 64-bit lane, so that the three sums of a
+/// vector are computed at once. Every product of two 16-bit elements fits in
+/// 32 bits, and PMULDQ widens it to 64, so the sums are exact; the kernels
+/// only have to notice when one of them leaves the range of MAC1..3.
+
+#include "gte_simd.h"
+
+#ifdef __x86_64__
+
+#include <immintrin.h>
+
+// clang-format off
+
+/// @brief Moves the range of MAC1..3 to [0, 2^44) when added to a sum.
+#define MAC_BIAS	(INT64_C(1) << 43)
+
+/// @brief The bits of a biased sum which are clear if and only if the sum is
+/// in range.
+#define MAC_OVF_MASK	(-(INT64_C(1) << 44))
+
+// clang-format on
+
+__attribute__((target("avx2"))) static NODISCARD bool
+mat_vec_avx2(const struct gte_mat *const m, const s32 t[3],
+	     const struct gte_vec *const v, const uint n, s64 (*const out)[3])
+{
+	const __m256i bias = _mm256_set1_epi64x(MAC_BIAS);
+	const __m256i tr = _mm256_slli_epi64(
+		_mm256_set_epi64x(0, t[2], t[1], t[0]), 12);
+
+	__m256i cols[3];
+	__m256i ovf = _mm256_setzero_si256();
+
+	for (uint k = 0; k < 3; ++k) {
+		cols[k] = _mm256_set_epi64x(0, m->e[2][k], m->e[1][k],
+					    m->e[0][k]);
+	}
+
+	for (uint i = 0; i < n; ++i) {
+		__m256i sum = tr;
+
+		for (uint k = 0; k < 3; ++k) {
+			const __m256i e = _mm256_set1_epi64x(v[i].e[k]);
+			const __m256i p = _mm256_mul_epi32(cols[k], e);
+
+			sum = _mm256_add_epi64(sum, p);
+			ovf = _mm256_or_si256(ovf, _mm256_add_epi64(sum, bias));
+		}
+		// A masked store would not forward to the loads which follow.
+		_mm_storeu_si128((__m128i *)out[i],
+				 _mm256_castsi256_si128(sum));
+		out[i][2] = _mm_cvtsi128_si64(_mm256_extracti128_si256(sum, 1));
+	}
+	return _mm256_testz_si256(ovf, _mm256_set1_epi64x(MAC_OVF_MASK));
+}
+
+__attribute__((target("sse4.1"))) static NODISCARD bool
+mat_vec_sse41(const struct gte_mat *const m, const s32 t[3],
+	      const struct gte_vec *const v, const uint n, s64 (*const out)[3])
+{
+	// The first two rows share a register, and the third one takes the low
+	// lane of another.
+	const __m128i bias = _mm_set1_epi64x(MAC_BIAS);
+	const __m128i tr01 = _mm_slli_epi64(_mm_set_epi64x(t[1], t[0]), 12);
+	const __m128i tr2 = _mm_slli_epi64(_mm_set_epi64x(0, t[2]), 12);
+
+	__m128i cols01[3];
+	__m128i cols2[3];
+	__m128i ovf = _mm_setzero_si128();
+
+	for (uint k = 0; k < 3; ++k) {
+		cols01[k] = _mm_set_epi64x(m->e[1][k], m->e[0][k]);
+		cols2[k] = _mm_set_epi64x(0, m->e[2][k]);
+	}
+
+	for (uint i = 0; i < n; ++i) {
+		__m128i sum01 = tr01;
+		__m128i sum2 = tr2;
+
+		for (uint k = 0; k < 3; ++k) {
+			const __m128i e = _mm_set1_epi64x(v[i].e[k]);
+			const __m128i p01 = _mm_mul_epi32(cols01[k], e);
+			const __m128i p2 = _mm_mul_epi32(cols2[k], e);
+
+			sum01 = _mm_add_epi64(sum01, p01);
+			sum2 = _mm_add_epi64(sum2, p2);
+
+			ovf = _mm_or_si128(ovf, _mm_add_epi64(sum01, bias));
+			ovf = _mm_or_si128(ovf, _mm_add_epi64(sum2, bias));
+		}
+		_mm_storeu_si128((__m128i *)out[i], sum01);
+		out[i][2] = _mm_cvtsi128_si64(sum2);
+	}
+	return _mm_testz_si128(ovf, _mm_set1_epi64x(MAC_OVF_MASK));
+}
+
+NODISCARD bool gte_simd_mat_vec(const struct gte_mat *const m, const s32 t[3],
+				const struct gte_vec *const v, const uint n,
+				s64 (*const out)[3])
+{
+	if (__builtin_cpu_supports("avx2")) {
+		return mat_vec_avx2(m, t, v, n, out);
+	}
+
+	if (__builtin_cpu_supports("sse4.1")) {
+		return mat_vec_sse41(m, t, v, n, out);
+	}
+	return false;
+}
+
+NODISCARD PURE gte_simd_mat_vec_fn gte_simd_get(const uint isa)
+{
+	switch (isa) {
+	case GTE_SIMD_ISA_SSE41:
+		return __builtin_cpu_supports("sse4.1") ? &mat_vec_sse41 : NULL;
+
+	case GTE_SIMD_ISA_AVX2:
+		return __builtin_cpu_supports("avx2") ? &mat_vec_avx2 : NULL;
+
+	default:
+		return NULL;
+	}
+}
+
+#else // __x86_64__
+
+NODISCARD bool gte_simd_mat_vec(const struct gte_mat *const m, const s32 t[3],
+				const struct gte_vec *const v, const uint n,
+				s64 (*const out)[3])
+{
+	(void)m;
+	(void)t;
+	(void)v;
+	(void)n;
+	(void)out;
+
+	return false;
+}
+
+NODISCARD PURE gte_simd_mat_vec_fn gte_simd_get(const uint isa)
+{
+	(void)isa;
+	return NULL;
+}
+
+#endif // __x86_64__
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file gte_simd.h Provides vectorized kernels for the matrix products of the
+/// GTE.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "psycho/types.h"
+
+// clang-format off
+
+///@{
+/// @brief The instruction sets the kernels are written for.
+#define GTE_SIMD_ISA_SSE41	(0)
+#define GTE_SIMD_ISA_AVX2	(1)
+#define GTE_SIMD_ISAS_NUM	(2)
+///@}
+
+// clang-format on
+
+/// @brief A 3x3 matrix (rotation, light or light color) of signed 1.3.12 fixed
+/// point elements, by rows.
+struct gte_mat {
+	s16 e[3][3];
+};
+
+/// @brief A vector of 16-bit elements.
+struct gte_vec {
+	s16 e[3];
+};
+
+/// @brief Computes (T SHL 12) + M * V for each of a set of vectors, which is
+/// the sum every matrix command is built on.
+///
+/// The hardware checks every partial sum against the 44-bit range of MAC1..3,
+/// flagging and wrapping those which leave it. The kernels only compute sums
+/// which never leave it, and otherwise leave it to the scalar reference.
+///
+/// @param m The matrix.
+/// @param t The translation vector.
+/// @param v The vectors; at most 3.
+/// @param n The number of vectors.
+/// @param out Receives the sums for each vector.
+/// @returns true if @p out was filled in, false if the host has no suitable
+/// kernel or any partial sum left the range of MAC1..3.
+NODISCARD bool gte_simd_mat_vec(const struct gte_mat *m, const s32 t[3],
+				const struct gte_vec *v, uint n,
+				s64 (*out)[3]);
+
+/// @brief A kernel for gte_simd_mat_vec(), written for one instruction set.
+typedef bool (*gte_simd_mat_vec_fn)(const struct gte_mat *m, const s32 t[3],
+				    const struct gte_vec *v, uint n,
+				    s64 (*out)[3]);
+
+/// @brief Retrieves the kernel written for an instruction set.
+/// gte_simd_mat_vec() picks the fastest one itself; this is for testing each.
+///
+/// @param isa One of GTE_SIMD_ISA_*.
+/// @returns The kernel, or NULL if the host lacks @p isa or the kernel for it
+/// was not built.
+NODISCARD PURE gte_simd_mat_vec_fn gte_simd_get(uint isa);
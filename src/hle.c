@@ -0,0 +1,1144 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file hle.c Implements high-level emulation of the BIOS kernel calls.
+///
+/// Each routine follows what the BIOS does rather than what the C library
+/// does where the two differ, such as memcpy() copying forwards one byte at a
+/// time even if the buffers overlap.
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cpu_cache.h"
+#include "cpu_defs.h"
+#include "cpu_mem.h"
+#include "dbg_log.h"
+#include "hle.h"
+
+// clang-format off
+
+#define ARG(n)		(ctx->cpu.gpr[CPU_GPR_a0 + (n)])
+
+/// @brief The size of a heap block header (in bytes). The header holds the
+/// size of the block, header included, with bit 0 set if it is in use.
+#define HEAP_HDR	((u32)sizeof(u32))
+#define HEAP_USED	(1U)
+
+///@{
+/// @brief The kernel's event states and modes.
+#define EV_ST_UNUSED	(0x0000)
+#define EV_ST_DISABLED	(0x1000)
+#define EV_ST_ACTIVE	(0x2000)
+#define EV_ST_ALREADY	(0x4000)
+
+#define EV_MD_NOINTR	(0x2000)
+///@}
+
+/// @brief The handle of the first event; the rest follow it.
+#define EV_HANDLE_BASE	(0xF1000000)
+
+/// @brief The longest string printf() reads for a single "%s" (in bytes).
+#define PRINTF_STR_MAX	(512)
+
+#define STDOUT_FD	(1)
+
+/// @brief The seed of rand() before any call to srand(), as the BIOS sets it.
+#define RAND_SEED_INIT	(0x24040001)
+
+// clang-format on
+
+typedef u32 (*hle_fn)(struct psycho_ctx *ctx);
+
+struct hle_call_def {
+	hle_fn fn;
+	const char *name;
+
+	/// @brief The PSYCHO_HLE_* flag which enables this call.
+	uint flags;
+	u32 pad;
+};
+
+/// @brief Returns argument n of a call, including those passed on the stack.
+static NODISCARD u32 arg_get(struct psycho_ctx *const ctx, const uint n)
+{
+	if (n < 4) {
+		return ARG(n);
+	}
+
+	const u32 sp = ctx->cpu.gpr[CPU_GPR_sp];
+	return cpu_mem_lw(ctx, sp + (u32)(n * sizeof(u32)));
+}
+
+/// @brief Returns the host memory backing len bytes from vaddr, or NULL if
+/// they do not all lie in RAM. The caller must report writes through
+/// ram_written().
+static NODISCARD u8 *ram_span(struct psycho_ctx *const ctx, const u32 vaddr,
+			      const u32 len)
+{
+	const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+
+	if (cpu_vaddr_scratchpad(vaddr) ||
+	    (paddr >= PSYCHO_BUS_RAM_MIRRORS_SIZE)) {
+		return NULL;
+	}
+
+	const u32 off = paddr & BUS_RAM_MASK;
+
+	if (len > (PSYCHO_BUS_RAM_SIZE - off)) {
+		return NULL;
+	}
+	return &ctx->bus.ram[off];
+}
+
+static void ram_written(struct psycho_ctx *const ctx, const u8 *const p,
+			const u32 len)
+{
+	const u32 beg = (u32)(p - ctx->bus.ram);
+	const u32 end = beg + len;
+
+	for (u32 page = beg >> PSYCHO_CPU_CACHE_PAGE_SHIFT;
+	     page <= ((end - 1) >> PSYCHO_CPU_CACHE_PAGE_SHIFT); ++page) {
+		bus_ram_written(ctx, page << PSYCHO_CPU_CACHE_PAGE_SHIFT);
+	}
+}
+
+/// @brief Copies len bytes forwards, one at a time, so that an overlapping
+/// destination above the source repeats the bytes in between.
+static void mem_copy(struct psycho_ctx *const ctx, const u32 dst,
+		     const u32 src, const u32 len)
+{
+	if (len == 0) {
+		return;
+	}
+
+	u8 *const d = ram_span(ctx, dst, len);
+	const u8 *const s = ram_span(ctx, src, len);
+
+	if (d && s && ((d <= s) || (d >= (s + len)))) {
+		memmove(d, s, len);
+		ram_written(ctx, d, len);
+		return;
+	}
+
+	for (u32 i = 0; i != len; ++i) {
+		cpu_mem_sb(ctx, dst + i, cpu_mem_lb(ctx, src + i));
+	}
+}
+
+static void mem_move(struct psycho_ctx *const ctx, const u32 dst,
+		     const u32 src, const u32 len)
+{
+	if ((dst <= src) || (dst >= (src + len))) {
+		mem_copy(ctx, dst, src, len);
+		return;
+	}
+
+	u8 *const d = ram_span(ctx, dst, len);
+	const u8 *const s = ram_span(ctx, src, len);
+
+	if (d && s) {
+		memmove(d, s, len);
+		ram_written(ctx, d, len);
+		return;
+	}
+
+	for (u32 i = len; i != 0; --i) {
+		cpu_mem_sb(ctx, dst + i - 1, cpu_mem_lb(ctx, src + i - 1));
+	}
+}
+
+static void mem_set(struct psycho_ctx *const ctx, const u32 dst, const u8 fill,
+		    const u32 len)
+{
+	if (len == 0) {
+		return;
+	}
+
+	u8 *const d = ram_span(ctx, dst, len);
+
+	if (d) {
+		memset(d, fill, len);
+		ram_written(ctx, d, len);
+		return;
+	}
+
+	for (u32 i = 0; i != len; ++i) {
+		cpu_mem_sb(ctx, dst + i, fill);
+	}
+}
+
+static NODISCARD u32 str_len(struct psycho_ctx *const ctx, const u32 s)
+{
+	const u8 *const p = ram_span(ctx, s, 1);
+
+	if (p) {
+		const u32 max = (u32)(&ctx->bus.ram[PSYCHO_BUS_RAM_SIZE] - p);
+		const u8 *const nul = memchr(p, 0, max);
+
+		if (nul) {
+			return (u32)(nul - p);
+		}
+	}
+
+	u32 len = 0;
+
+	while (cpu_mem_lb(ctx, s + len) != 0) {
+		len++;
+	}
+	return len;
+}
+
+static void tty_put(struct psycho_ctx *const ctx, const char c)
+{
+	if (ctx->hle.tty_cb) {
+		ctx->hle.tty_cb(ctx->hle.udata, c);
+	}
+}
+
+/// @brief Lengths are signed in the BIOS; anything not positive does nothing.
+static NODISCARD u32 len_get(const u32 len)
+{
+	return ((s32)len > 0) ? len : 0;
+}
+
+static u32 hle_abs(struct psycho_ctx *const ctx)
+{
+	const s32 x = (s32)ARG(0);
+	return (x < 0) ? -(u32)x : (u32)x;
+}
+
+static u32 hle_strcat(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+	const u32 src = ARG(1);
+
+	if (!dst || !src) {
+		return 0;
+	}
+
+	mem_copy(ctx, dst + str_len(ctx, dst), src, str_len(ctx, src) + 1);
+	return dst;
+}
+
+static u32 hle_strncat(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+	const u32 src = ARG(1);
+	const u32 max = len_get(ARG(2));
+
+	if (!dst || !src) {
+		return 0;
+	}
+
+	u32 len = str_len(ctx, src);
+
+	if (len > max) {
+		len = max;
+	}
+
+	const u32 end = dst + str_len(ctx, dst);
+
+	mem_copy(ctx, end, src, len);
+	cpu_mem_sb(ctx, end + len, 0);
+
+	return dst;
+}
+
+static NODISCARD u32 str_cmp(struct psycho_ctx *const ctx, const u32 s1,
+			     const u32 s2, const u32 max)
+{
+	if (!s1 || !s2) {
+		return (s1 == s2) ? 0 : (!s1 ? (u32)-1 : 1);
+	}
+
+	for (u32 i = 0; i != max; ++i) {
+		const u8 c1 = cpu_mem_lb(ctx, s1 + i);
+		const u8 c2 = cpu_mem_lb(ctx, s2 + i);
+
+		if ((c1 != c2) || (c1 == 0)) {
+			return (u32)(c1 - c2);
+		}
+	}
+	return 0;
+}
+
+static u32 hle_strcmp(struct psycho_ctx *const ctx)
+{
+	return str_cmp(ctx, ARG(0), ARG(1), UINT32_MAX);
+}
+
+static u32 hle_strncmp(struct psycho_ctx *const ctx)
+{
+	return str_cmp(ctx, ARG(0), ARG(1), len_get(ARG(2)));
+}
+
+static u32 hle_strcpy(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+	const u32 src = ARG(1);
+
+	if (!dst || !src) {
+		return 0;
+	}
+
+	mem_copy(ctx, dst, src, str_len(ctx, src) + 1);
+	return dst;
+}
+
+static u32 hle_strncpy(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+	const u32 src = ARG(1);
+	const u32 max = len_get(ARG(2));
+
+	if (!dst || !src) {
+		return 0;
+	}
+
+	u32 len = str_len(ctx, src);
+
+	if (len > max) {
+		len = max;
+	}
+
+	// Like the C library, the rest of the destination is zeroed.
+	mem_copy(ctx, dst, src, len);
+	mem_set(ctx, dst + len, 0, max - len);
+
+	return dst;
+}
+
+static u32 hle_strlen(struct psycho_ctx *const ctx)
+{
+	const u32 s = ARG(0);
+	return s ? str_len(ctx, s) : 0;
+}
+
+static u32 hle_strchr(struct psycho_ctx *const ctx)
+{
+	const u8 c = (u8)ARG(1);
+
+	for (u32 s = ARG(0); s != 0; ++s) {
+		const u8 cur = cpu_mem_lb(ctx, s);
+
+		if (cur == c) {
+			return s;
+		}
+
+		if (cur == 0) {
+			break;
+		}
+	}
+	return 0;
+}
+
+static u32 hle_strrchr(struct psycho_ctx *const ctx)
+{
+	const u8 c = (u8)ARG(1);
+	u32 found = 0;
+
+	for (u32 s = ARG(0); s != 0; ++s) {
+		const u8 cur = cpu_mem_lb(ctx, s);
+
+		if (cur == c) {
+			found = s;
+		}
+
+		if (cur == 0) {
+			break;
+		}
+	}
+	return found;
+}
+
+static u32 hle_toupper(struct psycho_ctx *const ctx)
+{
+	const u8 c = (u8)ARG(0);
+	return ((c >= 'a') && (c <= 'z')) ? (u32)(c - 'a' + 'A') : c;
+}
+
+static u32 hle_tolower(struct psycho_ctx *const ctx)
+{
+	const u8 c = (u8)ARG(0);
+	return ((c >= 'A') && (c <= 'Z')) ? (u32)(c - 'A' + 'a') : c;
+}
+
+static u32 hle_bcopy(struct psycho_ctx *const ctx)
+{
+	if (ARG(0) && ARG(1)) {
+		mem_copy(ctx, ARG(1), ARG(0), len_get(ARG(2)));
+	}
+	return 0;
+}
+
+static u32 hle_bzero(struct psycho_ctx *const ctx)
+{
+	if (ARG(0)) {
+		mem_set(ctx, ARG(0), 0, len_get(ARG(1)));
+	}
+	return 0;
+}
+
+static NODISCARD u32 mem_cmp(struct psycho_ctx *const ctx, const u32 s1,
+			     const u32 s2, const u32 len)
+{
+	for (u32 i = 0; i != len; ++i) {
+		const u8 c1 = cpu_mem_lb(ctx, s1 + i);
+		const u8 c2 = cpu_mem_lb(ctx, s2 + i);
+
+		if (c1 != c2) {
+			return (u32)(c1 - c2);
+		}
+	}
+	return 0;
+}
+
+static u32 hle_bcmp(struct psycho_ctx *const ctx)
+{
+	if (!ARG(0) || !ARG(1)) {
+		return 0;
+	}
+	return mem_cmp(ctx, ARG(0), ARG(1), len_get(ARG(2)));
+}
+
+static u32 hle_memcpy(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+
+	if (!dst || !ARG(1)) {
+		return 0;
+	}
+
+	mem_copy(ctx, dst, ARG(1), len_get(ARG(2)));
+	return dst;
+}
+
+static u32 hle_memset(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+
+	if (!dst) {
+		return 0;
+	}
+
+	mem_set(ctx, dst, (u8)ARG(1), len_get(ARG(2)));
+	return dst;
+}
+
+static u32 hle_memmove(struct psycho_ctx *const ctx)
+{
+	const u32 dst = ARG(0);
+
+	if (!dst || !ARG(1)) {
+		return 0;
+	}
+
+	mem_move(ctx, dst, ARG(1), len_get(ARG(2)));
+	return dst;
+}
+
+static u32 hle_memcmp(struct psycho_ctx *const ctx)
+{
+	if (!ARG(0) || !ARG(1)) {
+		return 0;
+	}
+	return mem_cmp(ctx, ARG(0), ARG(1), len_get(ARG(2)));
+}
+
+static u32 hle_memchr(struct psycho_ctx *const ctx)
+{
+	const u32 s = ARG(0);
+	const u8 c = (u8)ARG(1);
+	const u32 len = len_get(ARG(2));
+
+	if (!s) {
+		return 0;
+	}
+
+	for (u32 i = 0; i != len; ++i) {
+		if (cpu_mem_lb(ctx, s + i) == c) {
+			return s + i;
+		}
+	}
+	return 0;
+}
+
+static u32 hle_rand(struct psycho_ctx *const ctx)
+{
+	ctx->hle.rand_seed = (ctx->hle.rand_seed * 0x41C64E6D) + 0x3039;
+	return (ctx->hle.rand_seed >> 16) & 0x7FFF;
+}
+
+static u32 hle_srand(struct psycho_ctx *const ctx)
+{
+	ctx->hle.rand_seed = ARG(0);
+	return 0;
+}
+
+/// @brief Allocates a block from the heap, first fit. Adjacent free blocks are
+/// merged as they are walked past.
+///
+/// @returns The block, or 0 if there is no room.
+static NODISCARD u32 heap_alloc(struct psycho_ctx *const ctx, const u32 size)
+{
+	const u32 beg = ctx->hle.heap_beg;
+	const u32 end = ctx->hle.heap_end;
+
+	if ((size == 0) || (size > (end - beg))) {
+		return 0;
+	}
+
+	const u32 need = ((size + 3) & ~3U) + HEAP_HDR;
+
+	for (u32 p = beg; (end - p) >= HEAP_HDR;) {
+		const u32 hdr = cpu_mem_lw(ctx, p);
+		u32 len = hdr & ~3U;
+
+		if ((len < HEAP_HDR) || (len > (end - p))) {
+			LOG_WARN("HLE: heap corrupted at 0x%08X", p);
+			return 0;
+		}
+
+		if (hdr & HEAP_USED) {
+			p += len;
+			continue;
+		}
+
+		while ((end - p - len) >= HEAP_HDR) {
+			const u32 next = cpu_mem_lw(ctx, p + len);
+			const u32 next_len = next & ~3U;
+
+			if ((next & HEAP_USED) || (next_len < HEAP_HDR) ||
+			    (next_len > (end - p - len))) {
+				break;
+			}
+			len += next_len;
+		}
+
+		if (len >= need) {
+			if ((len - need) >= (2 * HEAP_HDR)) {
+				cpu_mem_sw(ctx, p + need, len - need);
+				len = need;
+			}
+
+			cpu_mem_sw(ctx, p, len | HEAP_USED);
+			return p + HEAP_HDR;
+		}
+
+		cpu_mem_sw(ctx, p, len);
+		p += len;
+	}
+	return 0;
+}
+
+static void heap_free(struct psycho_ctx *const ctx, const u32 ptr)
+{
+	if ((ptr < (ctx->hle.heap_beg + HEAP_HDR)) ||
+	    (ptr >= ctx->hle.heap_end)) {
+		return;
+	}
+
+	const u32 hdr = cpu_mem_lw(ctx, ptr - HEAP_HDR);
+	cpu_mem_sw(ctx, ptr - HEAP_HDR, hdr & ~HEAP_USED);
+}
+
+static u32 hle_malloc(struct psycho_ctx *const ctx)
+{
+	return heap_alloc(ctx, ARG(0));
+}
+
+static u32 hle_free(struct psycho_ctx *const ctx)
+{
+	heap_free(ctx, ARG(0));
+	return 0;
+}
+
+static u32 hle_calloc(struct psycho_ctx *const ctx)
+{
+	const u64 size = (u64)ARG(0) * ARG(1);
+
+	if (size > UINT32_MAX) {
+		return 0;
+	}
+
+	const u32 ptr = heap_alloc(ctx, (u32)size);
+
+	if (ptr) {
+		mem_set(ctx, ptr, 0, (u32)size);
+	}
+	return ptr;
+}
+
+static u32 hle_realloc(struct psycho_ctx *const ctx)
+{
+	const u32 old = ARG(0);
+	const u32 size = ARG(1);
+
+	if (!old) {
+		return heap_alloc(ctx, size);
+	}
+
+	if (size == 0) {
+		heap_free(ctx, old);
+		return 0;
+	}
+
+	const u32 ptr = heap_alloc(ctx, size);
+
+	if (ptr) {
+		const u32 old_size =
+			(cpu_mem_lw(ctx, old - HEAP_HDR) & ~3U) - HEAP_HDR;
+
+		mem_copy(ctx, ptr, old, (old_size < size) ? old_size : size);
+		heap_free(ctx, old);
+	}
+	return ptr;
+}
+
+static u32 hle_init_heap(struct psycho_ctx *const ctx)
+{
+	const u32 beg = (ARG(0) + 3) & ~3U;
+	const u32 end = (ARG(0) + ARG(1)) & ~3U;
+
+	ctx->hle.heap_beg = beg;
+	ctx->hle.heap_end = beg;
+
+	if ((end > beg) && ((end - beg) >= (2 * HEAP_HDR))) {
+		ctx->hle.heap_end = end;
+		cpu_mem_sw(ctx, beg, end - beg);
+	}
+	return 0;
+}
+
+static u32 hle_putchar(struct psycho_ctx *const ctx)
+{
+	tty_put(ctx, (char)ARG(0));
+	return ARG(0);
+}
+
+static void str_put(struct psycho_ctx *const ctx, u32 s)
+{
+	for (u8 c; (c = cpu_mem_lb(ctx, s)) != 0; ++s) {
+		tty_put(ctx, (char)c);
+	}
+}
+
+static u32 hle_puts(struct psycho_ctx *const ctx)
+{
+	const u32 s = ARG(0);
+
+	if (s) {
+		str_put(ctx, s);
+	} else {
+		for (const char *p = "<NULL>"; *p; ++p) {
+			tty_put(ctx, *p);
+		}
+	}
+	tty_put(ctx, '\n');
+
+	return 0;
+}
+
+/// @brief The flags, field width and precision of a printf() conversion.
+struct fmt_spec {
+	bool left;
+	bool zero;
+	bool plus;
+	bool space;
+	bool alt;
+	u8 pad[3];
+
+	int width;
+
+	/// @brief The precision, or -1 if there is none.
+	int prec;
+};
+
+/// @brief Writes a converted field, padded to its width.
+///
+/// @param prefix The sign or base prefix, which goes before any zero padding.
+/// @param numeric Whether zero padding applies.
+/// @returns The number of characters written.
+static u32 field_put(struct psycho_ctx *const ctx,
+		     const struct fmt_spec *const spec,
+		     const char *const prefix, const char *const body,
+		     const size_t len, const bool numeric)
+{
+	const size_t prefix_len = strlen(prefix);
+	const size_t total = prefix_len + len;
+	const size_t pad =
+		(spec->width > (int)total) ? ((size_t)spec->width - total) : 0;
+	const bool zero_pad = numeric && spec->zero && !spec->left &&
+			      (spec->prec < 0);
+
+	if (!spec->left && !zero_pad) {
+		for (size_t i = 0; i != pad; ++i) {
+			tty_put(ctx, ' ');
+		}
+	}
+
+	for (size_t i = 0; i != prefix_len; ++i) {
+		tty_put(ctx, prefix[i]);
+	}
+
+	if (zero_pad) {
+		for (size_t i = 0; i != pad; ++i) {
+			tty_put(ctx, '0');
+		}
+	}
+
+	for (size_t i = 0; i != len; ++i) {
+		tty_put(ctx, body[i]);
+	}
+
+	if (spec->left) {
+		for (size_t i = 0; i != pad; ++i) {
+			tty_put(ctx, ' ');
+		}
+	}
+	return (u32)(total + pad);
+}
+
+/// @brief Converts an integer for printf().
+static u32 int_put(struct psycho_ctx *const ctx,
+		   const struct fmt_spec *const spec, const char conv,
+		   const u32 arg)
+{
+	static const char digits_lower[] = "0123456789abcdef";
+	static const char digits_upper[] = "0123456789ABCDEF";
+
+	const char *const digits = (conv == 'X') ? digits_upper : digits_lower;
+	const bool is_signed = (conv == 'd') || (conv == 'i');
+	const u32 base = ((conv == 'x') || (conv == 'X') || (conv == 'p')) ?
+				 16 :
+				 ((conv == 'o') ? 8 : 10);
+
+	const char *prefix = "";
+	u32 val = arg;
+
+	if (is_signed) {
+		if ((s32)arg < 0) {
+			prefix = "-";
+			val = -arg;
+		} else if (spec->plus) {
+			prefix = "+";
+		} else if (spec->space) {
+			prefix = " ";
+		}
+	} else if (spec->alt && (arg != 0)) {
+		if (base == 16) {
+			prefix = (conv == 'X') ? "0X" : "0x";
+		} else if (base == 8) {
+			prefix = "0";
+		}
+	}
+
+	// 32 digits covers base 8 with any precision we accept.
+	char buf[64];
+	size_t len = 0;
+
+	for (; val != 0; val /= base) {
+		buf[sizeof(buf) - ++len] = digits[val % base];
+	}
+
+	const size_t prec = (spec->prec < 0) ? 1 : (size_t)spec->prec;
+
+	while ((len < prec) && (len < sizeof(buf))) {
+		buf[sizeof(buf) - ++len] = '0';
+	}
+	return field_put(ctx, spec, prefix, &buf[sizeof(buf) - len], len, true);
+}
+
+/// @brief Parses a field width or precision, which may be passed as an
+/// argument.
+static NODISCARD int fmt_num_get(struct psycho_ctx *const ctx, u32 *const fmt,
+				 uint *const argn)
+{
+	if (cpu_mem_lb(ctx, *fmt) == '*') {
+		(*fmt)++;
+		return (int)(s32)arg_get(ctx, (*argn)++);
+	}
+
+	int num = 0;
+
+	for (u8 c; ((c = cpu_mem_lb(ctx, *fmt)) >= '0') && (c <= '9');
+	     (*fmt)++) {
+		if (num < 1000) {
+			num = (num * 10) + (c - '0');
+		}
+	}
+	return num;
+}
+
+static u32 hle_printf(struct psycho_ctx *const ctx)
+{
+	u32 fmt = ARG(0);
+	uint argn = 1;
+	u32 written = 0;
+
+	if (!fmt) {
+		return 0;
+	}
+
+	for (u8 c; (c = cpu_mem_lb(ctx, fmt++)) != 0;) {
+		if (c != '%') {
+			tty_put(ctx, (char)c);
+			written++;
+			continue;
+		}
+
+		struct fmt_spec spec = { .prec = -1 };
+
+		for (;; fmt++) {
+			c = cpu_mem_lb(ctx, fmt);
+
+			if (c == '-') {
+				spec.left = true;
+			} else if (c == '0') {
+				spec.zero = true;
+			} else if (c == '+') {
+				spec.plus = true;
+			} else if (c == ' ') {
+				spec.space = true;
+			} else if (c == '#') {
+				spec.alt = true;
+			} else {
+				break;
+			}
+		}
+
+		spec.width = fmt_num_get(ctx, &fmt, &argn);
+
+		if (spec.width < 0) {
+			spec.left = true;
+			spec.width = -spec.width;
+		}
+
+		if (cpu_mem_lb(ctx, fmt) == '.') {
+			fmt++;
+			spec.prec = fmt_num_get(ctx, &fmt, &argn);
+
+			if (spec.prec > 32) {
+				spec.prec = 32;
+			}
+		}
+
+		// Every argument is a word, so length modifiers change nothing.
+		while (((c = cpu_mem_lb(ctx, fmt)) == 'h') || (c == 'l')) {
+			fmt++;
+		}
+
+		const char conv = (char)cpu_mem_lb(ctx, fmt++);
+
+		switch (conv) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+		case 'p':
+			written += int_put(ctx, &spec, conv,
+					   arg_get(ctx, argn++));
+			break;
+
+		case 'c': {
+			const char ch = (char)arg_get(ctx, argn++);
+
+			written += field_put(ctx, &spec, "", &ch, 1, false);
+			break;
+		}
+
+		case 's': {
+			const u32 s = arg_get(ctx, argn++);
+			const size_t max = (spec.prec < 0) ? PRINTF_STR_MAX :
+							     (size_t)spec.prec;
+			char buf[PRINTF_STR_MAX];
+			size_t len = 0;
+
+			for (u8 ch; s && (len != max) &&
+				    ((ch = cpu_mem_lb(ctx, s + (u32)len)) != 0);
+			     ++len) {
+				buf[len] = (char)ch;
+			}
+			written += field_put(ctx, &spec, "", buf, len, false);
+			break;
+		}
+
+		case '%':
+			tty_put(ctx, '%');
+			written++;
+			break;
+
+		case '\0':
+			return written;
+
+		default:
+			tty_put(ctx, '%');
+			tty_put(ctx, conv);
+			written += 2;
+			break;
+		}
+	}
+	return written;
+}
+
+/// @brief Returns the event a handle refers to, or NULL if it is not open.
+static NODISCARD struct psycho_hle_event *event_get(struct psycho_ctx *ctx,
+						    const u32 handle)
+{
+	const u32 idx = handle - EV_HANDLE_BASE;
+
+	if ((idx >= PSYCHO_HLE_EVENTS_NUM) ||
+	    (ctx->hle.events[idx].status == EV_ST_UNUSED)) {
+		return NULL;
+	}
+	return &ctx->hle.events[idx];
+}
+
+static u32 hle_deliver_event(struct psycho_ctx *const ctx)
+{
+	for (uint i = 0; i < PSYCHO_HLE_EVENTS_NUM; ++i) {
+		struct psycho_hle_event *const ev = &ctx->hle.events[i];
+
+		if ((ev->status != EV_ST_ACTIVE) || (ev->cls != ARG(0)) ||
+		    (ev->spec != ARG(1))) {
+			continue;
+		}
+
+		// Events which call a handler are left alone, as there is no
+		// way to run guest code from here.
+		if (ev->mode == EV_MD_NOINTR) {
+			ev->status = EV_ST_ALREADY;
+		}
+	}
+	return 0;
+}
+
+static u32 hle_open_event(struct psycho_ctx *const ctx)
+{
+	for (uint i = 0; i < PSYCHO_HLE_EVENTS_NUM; ++i) {
+		struct psycho_hle_event *const ev = &ctx->hle.events[i];
+
+		if (ev->status == EV_ST_UNUSED) {
+			ev->cls = ARG(0);
+			ev->spec = ARG(1);
+			ev->mode = ARG(2);
+			ev->status = EV_ST_DISABLED;
+
+			return EV_HANDLE_BASE + i;
+		}
+	}
+	return (u32)-1;
+}
+
+static u32 hle_close_event(struct psycho_ctx *const ctx)
+{
+	struct psycho_hle_event *const ev = event_get(ctx, ARG(0));
+
+	if (ev) {
+		ev->status = EV_ST_UNUSED;
+	}
+	return ev != NULL;
+}
+
+/// @brief Services both TestEvent() and WaitEvent(). Nothing delivers events
+/// while the caller waits, so WaitEvent() cannot block as it would on a real
+/// kernel; it returns 0 instead.
+static u32 hle_test_event(struct psycho_ctx *const ctx)
+{
+	struct psycho_hle_event *const ev = event_get(ctx, ARG(0));
+
+	if (ev && (ev->status == EV_ST_ALREADY)) {
+		ev->status = EV_ST_ACTIVE;
+		return 1;
+	}
+	return 0;
+}
+
+static u32 hle_enable_event(struct psycho_ctx *const ctx)
+{
+	struct psycho_hle_event *const ev = event_get(ctx, ARG(0));
+
+	if (ev && (ev->status == EV_ST_DISABLED)) {
+		ev->status = EV_ST_ACTIVE;
+	}
+	return ev != NULL;
+}
+
+static u32 hle_disable_event(struct psycho_ctx *const ctx)
+{
+	struct psycho_hle_event *const ev = event_get(ctx, ARG(0));
+
+	if (ev) {
+		ev->status = EV_ST_DISABLED;
+	}
+	return ev != NULL;
+}
+
+/// @brief Services the file calls which need a device. There are none, so
+/// they fail.
+static u32 hle_file_fail(struct psycho_ctx *const ctx)
+{
+	(void)ctx;
+	return (u32)-1;
+}
+
+static u32 hle_write(struct psycho_ctx *const ctx)
+{
+	if (ARG(0) != STDOUT_FD) {
+		return (u32)-1;
+	}
+
+	const u32 len = len_get(ARG(2));
+
+	for (u32 i = 0; i != len; ++i) {
+		tty_put(ctx, (char)cpu_mem_lb(ctx, ARG(1) + i));
+	}
+	return len;
+}
+
+// clang-format off
+
+#define LIB(fn, name)		{ (fn), (name), PSYCHO_HLE_LIB }
+#define KERNEL(fn, name)	{ (fn), (name), PSYCHO_HLE_KERNEL }
+
+static const struct hle_call_def a0_calls[] = {
+	[0x00] = KERNEL(hle_file_fail,	"open"),
+	[0x01] = KERNEL(hle_file_fail,	"lseek"),
+	[0x02] = KERNEL(hle_file_fail,	"read"),
+	[0x03] = KERNEL(hle_write,	"write"),
+	[0x04] = KERNEL(hle_file_fail,	"close"),
+	[0x0E] = LIB(hle_abs,		"abs"),
+	[0x0F] = LIB(hle_abs,		"labs"),
+	[0x15] = LIB(hle_strcat,	"strcat"),
+	[0x16] = LIB(hle_strncat,	"strncat"),
+	[0x17] = LIB(hle_strcmp,	"strcmp"),
+	[0x18] = LIB(hle_strncmp,	"strncmp"),
+	[0x19] = LIB(hle_strcpy,	"strcpy"),
+	[0x1A] = LIB(hle_strncpy,	"strncpy"),
+	[0x1B] = LIB(hle_strlen,	"strlen"),
+	[0x1C] = LIB(hle_strchr,	"index"),
+	[0x1D] = LIB(hle_strrchr,	"rindex"),
+	[0x1E] = LIB(hle_strchr,	"strchr"),
+	[0x1F] = LIB(hle_strrchr,	"strrchr"),
+	[0x25] = LIB(hle_toupper,	"toupper"),
+	[0x26] = LIB(hle_tolower,	"tolower"),
+	[0x27] = LIB(hle_bcopy,		"bcopy"),
+	[0x28] = LIB(hle_bzero,		"bzero"),
+	[0x29] = LIB(hle_bcmp,		"bcmp"),
+	[0x2A] = LIB(hle_memcpy,	"memcpy"),
+	[0x2B] = LIB(hle_memset,	"memset"),
+	[0x2C] = LIB(hle_memmove,	"memmove"),
+	[0x2D] = LIB(hle_memcmp,	"memcmp"),
+	[0x2E] = LIB(hle_memchr,	"memchr"),
+	[0x2F] = LIB(hle_rand,		"rand"),
+	[0x30] = LIB(hle_srand,		"srand"),
+	[0x33] = LIB(hle_malloc,	"malloc"),
+	[0x34] = LIB(hle_free,		"free"),
+	[0x37] = LIB(hle_calloc,	"calloc"),
+	[0x38] = LIB(hle_realloc,	"realloc"),
+	[0x39] = LIB(hle_init_heap,	"InitHeap"),
+	[0x3C] = LIB(hle_putchar,	"putchar"),
+	[0x3E] = LIB(hle_puts,		"puts"),
+	[0x3F] = LIB(hle_printf,	"printf")
+};
+
+static const struct hle_call_def b0_calls[] = {
+	[0x07] = KERNEL(hle_deliver_event,	"DeliverEvent"),
+	[0x08] = KERNEL(hle_open_event,		"OpenEvent"),
+	[0x09] = KERNEL(hle_close_event,	"CloseEvent"),
+	[0x0A] = KERNEL(hle_test_event,		"WaitEvent"),
+	[0x0B] = KERNEL(hle_test_event,		"TestEvent"),
+	[0x0C] = KERNEL(hle_enable_event,	"EnableEvent"),
+	[0x0D] = KERNEL(hle_disable_event,	"DisableEvent"),
+	[0x32] = KERNEL(hle_file_fail,		"open"),
+	[0x33] = KERNEL(hle_file_fail,		"lseek"),
+	[0x34] = KERNEL(hle_file_fail,		"read"),
+	[0x35] = KERNEL(hle_write,		"write"),
+	[0x36] = KERNEL(hle_file_fail,		"close"),
+	[0x3D] = LIB(hle_putchar,		"putchar"),
+	[0x3F] = LIB(hle_puts,			"puts")
+};
+
+#undef LIB
+#undef KERNEL
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+// clang-format on
+
+void hle_reset(struct psycho_ctx *const ctx)
+{
+	struct psycho_hle *const hle = &ctx->hle;
+
+	hle->heap_beg = 0;
+	hle->heap_end = 0;
+	hle->rand_seed = RAND_SEED_INIT;
+	memset(hle->events, 0, sizeof(hle->events));
+}
+
+NODISCARD bool hle_call(struct psycho_ctx *const ctx)
+{
+	const struct hle_call_def *table;
+	size_t num;
+	char vec;
+
+	switch (cpu_vaddr_to_paddr(ctx->cpu.pc)) {
+	case HLE_VEC_A:
+		table = a0_calls;
+		num = ARRAY_SIZE(a0_calls);
+		vec = 'A';
+		break;
+
+	case HLE_VEC_B:
+		table = b0_calls;
+		num = ARRAY_SIZE(b0_calls);
+		vec = 'B';
+		break;
+
+	// Nothing in the C table is serviced yet; it is mostly the kernel's
+	// own setup.
+	default:
+		return false;
+	}
+
+	const u32 fn = ctx->cpu.gpr[CPU_GPR_t1];
+
+	if ((fn >= num) || !table[fn].fn ||
+	    !(table[fn].flags & ctx->hle.flags)) {
+		return false;
+	}
+
+	LOG_TRACE("HLE: %c(%02Xh) %s", vec, fn, table[fn].name);
+
+	ctx->cpu.gpr[CPU_GPR_v0] = table[fn].fn(ctx);
+
+	ctx->cpu.pc = ctx->cpu.gpr[CPU_GPR_ra];
+	ctx->cpu.npc = ctx->cpu.pc + sizeof(u32);
+	ctx->cpu.instr = cpu_instr_fetch(ctx);
+
+	return true;
+}
@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file hle.h Provides high-level emulation of the BIOS kernel calls.
+///
+/// Programs call the kernel by jumping to one of three vectors in low RAM with
+/// the function number in t1. When a call is serviced natively, execution
+/// continues at the return address as if the BIOS had run it.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "cpu_defs.h"
+#include "psycho/ctx.h"
+
+// clang-format off
+
+#define HLE_VEC_A	(0xA0)
+#define HLE_VEC_B	(0xB0)
+#define HLE_VEC_C	(0xC0)
+
+// clang-format on
+
+/// @brief Returns whether an address is one of the kernel call vectors.
+/// Translated blocks are never linked to these, so that every call comes back
+/// to psycho_ctx_run() whether or not it is serviced.
+static ALWAYS_INLINE NODISCARD bool hle_vector(const u32 vaddr)
+{
+	const u32 paddr = cpu_vaddr_to_paddr(vaddr);
+
+	return (paddr == HLE_VEC_A) || (paddr == HLE_VEC_B) ||
+	       (paddr == HLE_VEC_C);
+}
+
+/// @brief Returns whether execution has to stop at the program counter to give
+/// a kernel call the chance to be serviced.
+static ALWAYS_INLINE NODISCARD bool
+hle_pending(const struct psycho_ctx *const ctx)
+{
+	return ctx->hle.flags && hle_vector(ctx->cpu.pc);
+}
+
+/// @brief Forgets the heap and every open event, and seeds rand() as the BIOS
+/// does at boot. Which calls are serviced, and where standard output goes, are
+/// left as the frontend set them.
+void hle_reset(struct psycho_ctx *ctx);
+
+/// @brief Services the kernel call at the program counter, if it is enabled
+/// and implemented, and returns to the caller.
+///
+/// @returns true if the call was serviced, false if the BIOS must run it.
+NODISCARD bool hle_call(struct psycho_ctx *ctx);
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file irq.c Implements the interrupt controller.
+///
+/// The controller drives a single interrupt line of the CPU, which is active
+/// while any interrupt is both requested and unmasked. The CPU does not take
+/// interrupts yet; the line is only reflected in the Cause register.
+
+#include "bus.h"
+#include "cpu_defs.h"
+#include "irq.h"
+
+/// @brief Drives the CPU's interrupt line from I_STAT and I_MASK.
+static void line_update(struct psycho_ctx *const ctx)
+{
+	u32 *const cause = &ctx->cpu.cp0_cpr[CPU_CP0_CPR_Cause];
+
+	if (ctx->irq.stat & ctx->irq.mask) {
+		*cause |= CPU_CP0_CPR_REG_Cause_IP2;
+	} else {
+		*cause &= ~(u32)CPU_CP0_CPR_REG_Cause_IP2;
+	}
+}
+
+static u32 reg_read(struct psycho_ctx *const ctx, const u32 paddr)
+{
+	const u32 reg = ((paddr & ~3U) == PSYCHO_IRQ_STAT_ADDR) ?
+				ctx->irq.stat :
+				ctx->irq.mask;
+
+	return reg >> ((paddr & 3) * 8);
+}
+
+/// @brief Writes the bytes of a register selected by @p bits.
+static void reg_write(struct psycho_ctx *const ctx, const u32 paddr,
+		      const u32 data, const u32 bits)
+{
+	const uint shift = (paddr & 3) * 8;
+	const u32 val = data << shift;
+	const u32 keep = ~(bits << shift);
+
+	// Writing 0 to a bit of I_STAT acknowledges the interrupt.
+	if ((paddr & ~3U) == PSYCHO_IRQ_STAT_ADDR) {
+		ctx->irq.stat &= val | keep;
+	} else {
+		ctx->irq.mask = ((ctx->irq.mask & keep) | val) &
+				PSYCHO_IRQ_LINES;
+	}
+	line_update(ctx);
+}
+
+static void reg_write_b(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFF);
+}
+
+static void reg_write_h(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFFFF);
+}
+
+static void reg_write_w(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFFFFFFFF);
+}
+
+static const struct psycho_bus_io io = {
+	.read = { reg_read, reg_read, reg_read },
+	.write = { reg_write_b, reg_write_h, reg_write_w },
+};
+
+void irq_init(struct psycho_ctx *const ctx)
+{
+	bus_io_register(ctx, PSYCHO_IRQ_STAT_ADDR, PSYCHO_IRQ_MASK_ADDR + 3,
+			&io);
+}
+
+void irq_reset(struct psycho_ctx *const ctx)
+{
+	ctx->irq.stat = 0;
+	ctx->irq.mask = 0;
+	line_update(ctx);
+}
+
+void irq_raise(struct psycho_ctx *const ctx, const u32 lines)
+{
+	ctx->irq.stat |= lines;
+	line_update(ctx);
+}
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file lz.c Implements a fast LZ77 compressor in the style of LZ4's block
+/// format.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lz.h"
+
+// clang-format off
+
+#define MIN_MATCH	(4)
+
+/// @brief The last bytes of a block are always literals, and no match starts
+/// within this many bytes of its end, so that copies can run ahead safely.
+#define LAST_LITERALS	(5)
+#define MATCH_LIMIT	(12)
+
+#define OFFSET_MAX	(0xFFFF)
+
+#define HASH_BITS	(13)
+
+/// @brief The number of failed attempts after which the compressor starts
+/// skipping ahead through data which does not compress, as a shift.
+#define SKIP_SHIFT	(6)
+
+#define RUN_MASK	(15)
+
+/// @brief How far wild_copy() may write past what it was asked to copy.
+#define WILD_COPY	(16)
+
+// clang-format on
+
+static ALWAYS_INLINE NODISCARD u32 read32(const u8 *const p)
+{
+	u32 v;
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static ALWAYS_INLINE NODISCARD u64 read64(const u8 *const p)
+{
+	u64 v;
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static ALWAYS_INLINE NODISCARD uint hash(const u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/// @brief Returns how far two runs of bytes match, up to limit.
+static ALWAYS_INLINE NODISCARD size_t match_len(const u8 *a, const u8 *b,
+						const u8 *const limit)
+{
+	const u8 *const beg = a;
+
+	while ((a + sizeof(u64)) <= limit) {
+		const u64 diff = read64(a) ^ read64(b);
+
+		if (diff) {
+			return (size_t)(a - beg) +
+			       ((uint)__builtin_ctzll(diff) / 8);
+		}
+		a += sizeof(u64);
+		b += sizeof(u64);
+	}
+
+	while ((a < limit) && (*a == *b)) {
+		a++;
+		b++;
+	}
+	return (size_t)(a - beg);
+}
+
+/// @brief Writes the part of a length which does not fit in its token nibble.
+static ALWAYS_INLINE NODISCARD u8 *len_put(u8 *p, size_t len)
+{
+	for (; len >= 255; len -= 255) {
+		*p++ = 255;
+	}
+	*p++ = (u8)len;
+
+	return p;
+}
+
+/// @brief Writes a sequence; a match length of 0 ends the block.
+///
+/// @returns Where the next sequence goes, or NULL if it did not fit.
+static NODISCARD u8 *seq_put(u8 *p, const u8 *const end, const u8 *const lit,
+			     const size_t lit_len, const size_t off,
+			     const size_t mlen)
+{
+	// The worst case: the token, both length continuations and the
+	// offset.
+	const size_t worst = 1 + (lit_len / 255) + 1 + lit_len + 2 +
+			     (mlen / 255) + 1;
+
+	if ((size_t)(end - p) < worst) {
+		return NULL;
+	}
+
+	u8 *const token = p++;
+	const size_t mcode = (mlen != 0) ? (mlen - MIN_MATCH) : 0;
+
+	*token = (u8)(((lit_len < RUN_MASK) ? lit_len : RUN_MASK) << 4);
+
+	if (lit_len >= RUN_MASK) {
+		p = len_put(p, lit_len - RUN_MASK);
+	}
+
+	memcpy(p, lit, lit_len);
+	p += lit_len;
+
+	if (mlen == 0) {
+		return p;
+	}
+
+	*p++ = (u8)off;
+	*p++ = (u8)(off >> 8);
+
+	*token |= (u8)((mcode < RUN_MASK) ? mcode : RUN_MASK);
+
+	if (mcode >= RUN_MASK) {
+		p = len_put(p, mcode - RUN_MASK);
+	}
+	return p;
+}
+
+NODISCARD CONST size_t lz_bound(const size_t len)
+{
+	return len + (len / 255) + 16;
+}
+
+NODISCARD size_t lz_compress(u8 *const dst, const size_t cap,
+			     const u8 *const src, const size_t len)
+{
+	u32 table[1 << HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	u8 *p = dst;
+	const u8 *const end = dst + cap;
+
+	size_t anchor = 0;
+	size_t i = 0;
+
+	if (len >= MATCH_LIMIT) {
+		const size_t limit = len - MATCH_LIMIT;
+		const u8 *const match_end = &src[len - LAST_LITERALS];
+		size_t misses = 1U << SKIP_SHIFT;
+
+		while (i <= limit) {
+			const u32 seq = read32(&src[i]);
+			const uint h = hash(seq);
+			const size_t ref = table[h];
+
+			table[h] = (u32)i;
+
+			if ((ref >= i) || ((i - ref) > OFFSET_MAX) ||
+			    (read32(&src[ref]) != seq)) {
+				i += misses++ >> SKIP_SHIFT;
+				continue;
+			}
+
+			const size_t mlen =
+				MIN_MATCH + match_len(&src[i + MIN_MATCH],
+						      &src[ref + MIN_MATCH],
+						      match_end);
+
+			p = seq_put(p, end, &src[anchor], i - anchor, i - ref,
+				    mlen);
+
+			if (!p) {
+				return 0;
+			}
+
+			i += mlen;
+			anchor = i;
+			misses = 1U << SKIP_SHIFT;
+		}
+	}
+
+	p = seq_put(p, end, &src[anchor], len - anchor, 0, 0);
+	return p ? (size_t)(p - dst) : 0;
+}
+
+/// @brief Copies at least len bytes, in words, writing up to WILD_COPY bytes
+/// beyond. The source may overlap the destination if it is at least a word
+/// behind it.
+static ALWAYS_INLINE void wild_copy(u8 *d, const u8 *s, const size_t len)
+{
+	u8 *const end = d + len;
+
+	do {
+		memcpy(d, s, sizeof(u64));
+		memcpy(d + sizeof(u64), s + sizeof(u64), sizeof(u64));
+		d += 2 * sizeof(u64);
+		s += 2 * sizeof(u64);
+	} while (d < end);
+}
+
+/// @brief Reads the part of a length which did not fit in its token nibble.
+static NODISCARD bool len_get(const u8 **const p, const u8 *const end,
+			      size_t *const len)
+{
+	u8 b;
+
+	do {
+		if (*p == end) {
+			return false;
+		}
+		b = *(*p)++;
+		*len += b;
+	} while (b == 255);
+
+	return true;
+}
+
+NODISCARD PURE bool lz_valid(const size_t len, const u8 *const src,
+			    const size_t src_len)
+{
+	const u8 *p = src;
+	const u8 *const end = src + src_len;
+	size_t pos = 0;
+
+	while (p != end) {
+		const uint token = *p++;
+		size_t lit_len = token >> 4;
+
+		if ((lit_len == RUN_MASK) && !len_get(&p, end, &lit_len)) {
+			return false;
+		}
+
+		if ((lit_len > (size_t)(end - p)) || (lit_len > (len - pos))) {
+			return false;
+		}
+		p += lit_len;
+		pos += lit_len;
+
+		if (p == end) {
+			break;
+		}
+
+		if ((end - p) < 2) {
+			return false;
+		}
+
+		const size_t off = (size_t)p[0] | ((size_t)p[1] << 8);
+		p += 2;
+
+		size_t mlen = token & RUN_MASK;
+
+		if ((mlen == RUN_MASK) && !len_get(&p, end, &mlen)) {
+			return false;
+		}
+		mlen += MIN_MATCH;
+
+		if ((off == 0) || (off > pos) || (mlen > (len - pos))) {
+			return false;
+		}
+		pos += mlen;
+	}
+	return pos == len;
+}
+
+NODISCARD bool lz_decompress(u8 *const dst, const size_t len,
+			     const u8 *const src, const size_t src_len)
+{
+	const u8 *p = src;
+	const u8 *const end = src + src_len;
+	u8 *d = dst;
+	const u8 *const d_end = dst + len;
+
+	while (p != end) {
+		const uint token = *p++;
+		size_t lit_len = token >> 4;
+
+		if ((lit_len == RUN_MASK) && !len_get(&p, end, &lit_len)) {
+			return false;
+		}
+
+		if ((lit_len > (size_t)(end - p)) ||
+		    (lit_len > (size_t)(d_end - d))) {
+			return false;
+		}
+
+		// Short runs are copied in whole words where both buffers have
+		// room to spare, which is far cheaper than an exact copy.
+		if ((lit_len <= WILD_COPY) &&
+		    ((size_t)(end - p) >= WILD_COPY) &&
+		    ((size_t)(d_end - d) >= WILD_COPY)) {
+			wild_copy(d, p, WILD_COPY);
+		} else {
+			memcpy(d, p, lit_len);
+		}
+		p += lit_len;
+		d += lit_len;
+
+		// The last sequence has no match.
+		if (p == end) {
+			break;
+		}
+
+		if ((end - p) < 2) {
+			return false;
+		}
+
+		const size_t off = (size_t)p[0] | ((size_t)p[1] << 8);
+		p += 2;
+
+		size_t mlen = token & RUN_MASK;
+
+		if ((mlen == RUN_MASK) && !len_get(&p, end, &mlen)) {
+			return false;
+		}
+		mlen += MIN_MATCH;
+
+		if ((off == 0) || (off > (size_t)(d - dst)) ||
+		    (mlen > (size_t)(d_end - d))) {
+			return false;
+		}
+
+		const u8 *const m = d - off;
+
+		if ((off >= sizeof(u64)) &&
+		    ((size_t)(d_end - d) >= (mlen + WILD_COPY))) {
+			wild_copy(d, m, mlen);
+			d += mlen;
+			continue;
+		}
+
+		// An overlapping match repeats the bytes between it and the
+		// output; copying what is already there doubles the run each
+		// time.
+		while (mlen != 0) {
+			size_t n = (size_t)(d - m);
+
+			if (n > mlen) {
+				n = mlen;
+			}
+
+			memcpy(d, m, n);
+			d += n;
+			mlen -= n;
+		}
+	}
+	return d == d_end;
+}
@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file lz.h Provides a fast LZ77 compressor in the style of LZ4's block
+/// format, used for save states.
+///
+/// A compressed block is a series of sequences, each made of a token, a run of
+/// literals, a 16-bit offset and a match length. The token holds the lengths
+/// of both runs in its two nibbles, and a nibble of 15 continues in bytes of
+/// 255 and a final byte below that. The last sequence has literals only.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "compiler.h"
+#include "psycho/types.h"
+
+/// @brief Returns the most a block of len bytes can grow to when compressed.
+NODISCARD CONST size_t lz_bound(size_t len);
+
+/// @brief Compresses a block.
+///
+/// @param dst Receives the compressed block.
+/// @param cap The size of dst; lz_bound() bytes are always enough.
+/// @returns The size of the compressed block, or 0 if it did not fit.
+NODISCARD size_t lz_compress(u8 *dst, size_t cap, const u8 *src, size_t len);
+
+/// @brief Returns whether a block is well-formed and decompresses to exactly
+/// len bytes, without decompressing it.
+NODISCARD PURE bool lz_valid(size_t len, const u8 *src, size_t src_len);
+
+/// @brief Decompresses a block, checking every length and offset against both
+/// buffers.
+///
+/// @param len The exact size the block decompresses to.
+/// @returns true if the block decompressed to exactly len bytes, false if it
+/// is malformed.
+NODISCARD bool lz_decompress(u8 *dst, size_t len, const u8 *src,
+			     size_t src_len);
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file mem.c Allocates the host memory backing the emulated memories.
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+#include "psycho/bus.h"
+
+// clang-format off
+
+#define RAM_SIZE		(PSYCHO_BUS_RAM_SIZE)
+#define RAM_MIRRORS_SIZE	(PSYCHO_BUS_RAM_MIRRORS_SIZE)
+
+#define HUGE_MASK		((size_t)MEM_HUGE_SIZE - 1)
+
+// clang-format on
+
+/// @brief Rounds a size up to a whole number of huge pages.
+static ALWAYS_INLINE NODISCARD size_t huge_round(const size_t size)
+{
+	return (size + HUGE_MASK) & ~HUGE_MASK;
+}
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/// @brief Maps anonymous memory aligned to a huge page, by mapping a huge page
+/// more than needed and trimming both ends.
+static NODISCARD u8 *aligned_map(const size_t size, const int prot)
+{
+	const size_t len = size + MEM_HUGE_SIZE;
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS |
+			  ((prot == PROT_NONE) ? MAP_NORESERVE : 0);
+	u8 *const p = mmap(NULL, len, prot, flags, -1, 0);
+
+	if (p == MAP_FAILED) {
+		return NULL;
+	}
+
+	u8 *const aligned =
+		(u8 *)(((uintptr_t)p + HUGE_MASK) & ~(uintptr_t)HUGE_MASK);
+	const size_t head = (size_t)(aligned - p);
+
+	if (head) {
+		munmap(p, head);
+	}
+	munmap(&aligned[size], len - head - size);
+
+	return aligned;
+}
+
+NODISCARD u8 *mem_huge_alloc(const size_t size)
+{
+	const size_t len = huge_round(size);
+
+	// Reserved huge pages are guaranteed, but few hosts set any aside.
+	u8 *const p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+	if (p != MAP_FAILED) {
+		return p;
+	}
+
+	u8 *const aligned = aligned_map(len, PROT_READ | PROT_WRITE);
+
+	if (aligned) {
+		madvise(aligned, len, MADV_HUGEPAGE);
+	}
+	return aligned;
+}
+
+void mem_huge_free(u8 *const p, const size_t size)
+{
+	munmap(p, huge_round(size));
+}
+
+NODISCARD u8 *mem_reserve(const size_t size)
+{
+	return aligned_map(huge_round(size), PROT_NONE);
+}
+
+void mem_release(u8 *const p, const size_t size)
+{
+	munmap(p, huge_round(size));
+}
+
+/// @brief Creates the memfd backing RAM.
+///
+/// @param huge Whether to back it with reserved huge pages.
+/// @returns The memfd, or -1 if the host does not support it.
+static NODISCARD int ram_fd_create(const bool huge)
+{
+	const int fd = memfd_create("psycho-ram",
+				    MFD_CLOEXEC | (huge ? MFD_HUGETLB : 0));
+
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (ftruncate(fd, RAM_SIZE) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+NODISCARD bool mem_ram_map(const int fd, u8 *const at)
+{
+	for (u32 off = 0; off < RAM_MIRRORS_SIZE; off += RAM_SIZE) {
+		if (mmap(&at[off], RAM_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+			return false;
+		}
+
+		// Only honoured if the host allows huge pages for shared
+		// memory.
+		madvise(&at[off], RAM_SIZE, MADV_HUGEPAGE);
+	}
+	return true;
+}
+
+/// @brief Creates a memfd for RAM and maps it into a new window.
+static NODISCARD u8 *ram_window_alloc(int *const fd, const bool huge)
+{
+	*fd = ram_fd_create(huge);
+
+	if (*fd < 0) {
+		return NULL;
+	}
+
+	// Reserve the window first, so that nothing else can be mapped between
+	// the mirrors.
+	u8 *const ram = mem_reserve(RAM_MIRRORS_SIZE);
+
+	if (ram && mem_ram_map(*fd, ram)) {
+		return ram;
+	}
+
+	if (ram) {
+		mem_release(ram, RAM_MIRRORS_SIZE);
+	}
+
+	close(*fd);
+	*fd = -1;
+
+	return NULL;
+}
+
+NODISCARD u8 *mem_ram_alloc(int *const fd, const bool shared)
+{
+	u8 *const ram = ram_window_alloc(fd, true);
+
+	if (ram) {
+		return ram;
+	}
+
+	if (!shared) {
+		*fd = -1;
+		return mem_huge_alloc(RAM_SIZE);
+	}
+	return ram_window_alloc(fd, false);
+}
+
+void mem_ram_free(u8 *const ram, const int fd)
+{
+	if (fd >= 0) {
+		mem_release(ram, RAM_MIRRORS_SIZE);
+		close(fd);
+	} else {
+		mem_huge_free(ram, RAM_SIZE);
+	}
+}
+
+#else // __linux__
+
+NODISCARD u8 *mem_huge_alloc(const size_t size)
+{
+	const size_t len = huge_round(size);
+	u8 *const p = aligned_alloc(MEM_HUGE_SIZE, len);
+
+	if (p) {
+		memset(p, 0, len);
+	}
+	return p;
+}
+
+void mem_huge_free(u8 *const p, const size_t size)
+{
+	(void)size;
+	free(p);
+}
+
+NODISCARD u8 *mem_reserve(const size_t size)
+{
+	(void)size;
+	return NULL;
+}
+
+void mem_release(u8 *const p, const size_t size)
+{
+	(void)p;
+	(void)size;
+}
+
+NODISCARD bool mem_ram_map(const int fd, u8 *const at)
+{
+	(void)fd;
+	(void)at;
+
+	return false;
+}
+
+NODISCARD u8 *mem_ram_alloc(int *const fd, const bool shared)
+{
+	*fd = -1;
+	return shared ? NULL : mem_huge_alloc(RAM_SIZE);
+}
+
+void mem_ram_free(u8 *const ram, const int fd)
+{
+	(void)fd;
+	mem_huge_free(ram, RAM_SIZE);
+}
+
+#endif // __linux__
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file mem.h Provides the host memory backing the emulated memories.
+///
+/// Everything is allocated in 2 MiB-aligned blocks, and backed by huge pages
+/// where the host provides them: explicitly reserved ones first, then
+/// transparent ones. Random guest accesses across RAM then miss the host's TLB
+/// far less often.
+///
+/// Where the host allows it, RAM is a memfd mapped once per mirror into one
+/// contiguous 8 MiB window, so a mirrored address reaches the same host memory
+/// without being masked first. This is only needed if something else maps RAM
+/// as well, like fastmem does; otherwise, RAM is plain memory, which the host
+/// backs with transparent huge pages more readily.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "compiler.h"
+#include "psycho/types.h"
+
+/// @brief The size of a huge page (in bytes), to which every block is
+/// aligned.
+#define MEM_HUGE_SIZE (UINT32_C(1) << 21)
+
+/// @brief Allocates a block of memory, zeroed, preferring huge pages.
+///
+/// @returns The block, or NULL if no memory could be allocated.
+NODISCARD u8 *mem_huge_alloc(size_t size);
+
+/// @brief Releases a block allocated by mem_huge_alloc() of the same size.
+void mem_huge_free(u8 *p, size_t size);
+
+/// @brief Reserves inaccessible address space aligned to a huge page, for
+/// mappings to be placed into.
+///
+/// @returns The reservation, or NULL if it could not be made.
+NODISCARD u8 *mem_reserve(size_t size);
+
+/// @brief Releases a reservation made by mem_reserve() of the same size,
+/// along with anything mapped into it.
+void mem_release(u8 *p, size_t size);
+
+/// @brief Maps RAM once per mirror, contiguously, over existing mappings.
+///
+/// @param fd The memfd backing RAM.
+/// @param at Where the window starts, aligned to a huge page.
+/// @returns true if the window was mapped, false otherwise.
+NODISCARD bool mem_ram_map(int fd, u8 *at);
+
+/// @brief Allocates RAM, zeroed.
+///
+/// @param fd Receives the memfd backing RAM, or -1 if RAM is plain memory the
+/// size of RAM (without mirrors).
+/// @param shared Whether RAM must be backed by a memfd, so that it can be
+/// mapped elsewhere with mem_ram_map().
+/// @returns RAM, or NULL if no memory could be allocated.
+NODISCARD u8 *mem_ram_alloc(int *fd, bool shared);
+
+/// @brief Releases RAM allocated by mem_ram_alloc().
+void mem_ram_free(u8 *ram, int fd);
@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file rcnt.c Implements the root counters.
+///
+/// A counter is never counted up as the CPU runs. Each access brings it up to
+/// date from the number of cycles elapsed since the last one, so that a
+/// program spinning on a counter costs one division per read. The next
+/// interrupt a counter raises is scheduled as an event, which is moved
+/// whenever the counter is written.
+///
+/// A clock source ticks mul times every div cycles; psycho_rcnt::frac carries
+/// the part of a tick left over between updates, in units of 1/div ticks.
+/// There is no video timing yet, so the dot clock assumes a 320 pixel wide
+/// display, the horizontal blank assumes NTSC, and only counter 2 honours its
+/// synchronization modes.
+
+#include <assert.h>
+
+#include "bus.h"
+#include "irq.h"
+#include "rcnt.h"
+#include "sched.h"
+
+// clang-format off
+
+///@{
+/// @brief The registers of a counter, as offsets from its first one.
+#define REG_VALUE	(0x0)
+#define REG_MODE	(0x4)
+#define REG_TARGET	(0x8)
+///@}
+
+///@{
+/// @brief The bits of the mode register.
+#define MODE_SYNC		(1 << 0)
+#define MODE_SYNC_MODE_SHIFT	(1)
+#define MODE_RESET_TARGET	(1 << 3)
+#define MODE_IRQ_TARGET		(1 << 4)
+#define MODE_IRQ_MAX		(1 << 5)
+#define MODE_IRQ_REPEAT		(1 << 6)
+#define MODE_IRQ_TOGGLE		(1 << 7)
+#define MODE_SRC_SHIFT		(8)
+
+/// @brief Clear while an interrupt is requested.
+#define MODE_IRQ_N		(1 << 10)
+
+#define MODE_REACHED_TARGET	(1 << 11)
+#define MODE_REACHED_MAX	(1 << 12)
+
+/// @brief The bits which are written; the rest are read-only.
+#define MODE_WRITABLE		(0x3FFU)
+///@}
+
+#define VALUE_MAX	(0xFFFF)
+
+/// @brief The number of cycles between two ticks of a clock source which never
+/// ticks, or an event which never happens.
+#define NEVER		(UINT64_MAX)
+
+///@{
+/// @brief The clock sources, in ticks per cycle as mul / div. The GPU runs at
+/// 11/7 of the CPU's clock; a dot is 8 GPU cycles wide at 320 pixels, and a
+/// scanline is 3413 GPU cycles long.
+#define SRC_SYS_MUL	(1)
+#define SRC_SYS_DIV	(1)
+#define SRC_SYS8_MUL	(1)
+#define SRC_SYS8_DIV	(8)
+#define SRC_DOT_MUL	(11)
+#define SRC_DOT_DIV	(8 * 7)
+#define SRC_HBLANK_MUL	(11)
+#define SRC_HBLANK_DIV	(3413 * 7)
+///@}
+
+// clang-format on
+
+struct src {
+	u32 mul;
+	u32 div;
+};
+
+/// @brief Returns the clock source a counter currently counts.
+static NODISCARD struct src src_get(const uint id, const uint mode)
+{
+	const uint src = (mode >> MODE_SRC_SHIFT) & 3;
+
+	switch (id) {
+	case 0:
+		if (src & 1) {
+			return (struct src){ SRC_DOT_MUL, SRC_DOT_DIV };
+		}
+		break;
+
+	case 1:
+		if (src & 1) {
+			return (struct src){ SRC_HBLANK_MUL, SRC_HBLANK_DIV };
+		}
+		break;
+
+	default: {
+		// Synchronization modes 0 and 3 stop counter 2.
+		const uint sync = (mode >> MODE_SYNC_MODE_SHIFT) & 3;
+
+		if ((mode & MODE_SYNC) && ((sync == 0) || (sync == 3))) {
+			return (struct src){ 0, 1 };
+		}
+
+		if (src & 2) {
+			return (struct src){ SRC_SYS8_MUL, SRC_SYS8_DIV };
+		}
+		break;
+	}
+	}
+	return (struct src){ SRC_SYS_MUL, SRC_SYS_DIV };
+}
+
+/// @brief Raises a counter's interrupt, if the mode allows it.
+static void irq(struct psycho_ctx *const ctx, const uint id)
+{
+	struct psycho_rcnt *const c = &ctx->rcnt[id];
+
+	if (!(c->mode & MODE_IRQ_REPEAT) && c->irq_done) {
+		return;
+	}
+	c->irq_done = true;
+
+	// In toggle mode, only every other condition requests an interrupt;
+	// in pulse mode, the request is too short to be seen.
+	if (c->mode & MODE_IRQ_TOGGLE) {
+		c->mode ^= MODE_IRQ_N;
+
+		if (c->mode & MODE_IRQ_N) {
+			return;
+		}
+	}
+	irq_raise(ctx, (u32)PSYCHO_IRQ_RCNT0 << id);
+}
+
+/// @brief Returns the value a counter wraps to 0 after, starting from @p v.
+static ALWAYS_INLINE NODISCARD uint lim_get(const struct psycho_rcnt *const c,
+					    const uint v)
+{
+	return ((c->mode & MODE_RESET_TARGET) && (v <= c->target)) ? c->target :
+								     VALUE_MAX;
+}
+
+/// @brief Counts a counter up by a number of ticks, setting the reached flags
+/// and raising interrupts for the values it passes.
+static void advance(struct psycho_ctx *const ctx, const uint id, u64 n)
+{
+	struct psycho_rcnt *const c = &ctx->rcnt[id];
+	const uint tgt = c->target;
+	uint v = c->value;
+	uint hits = 0;
+
+	while (n != 0) {
+		const uint lim = lim_get(c, v);
+		const u64 to_lim = lim - v;
+
+		if ((v < tgt) && (tgt <= lim) && (n >= (tgt - v))) {
+			hits |= MODE_REACHED_TARGET;
+		}
+
+		if (n <= to_lim) {
+			v += (uint)n;
+
+			if (v == VALUE_MAX) {
+				hits |= MODE_REACHED_MAX;
+			}
+			break;
+		}
+
+		if ((lim == VALUE_MAX) && (v < lim)) {
+			hits |= MODE_REACHED_MAX;
+		}
+
+		// Wrap to 0, then skip whole periods, each of which passes
+		// every value up to the limit.
+		n -= to_lim + 1;
+		v = 0;
+
+		if (tgt == 0) {
+			hits |= MODE_REACHED_TARGET;
+		}
+
+		const uint period_lim = lim_get(c, 0);
+		const u64 period = (u64)period_lim + 1;
+
+		if (n >= period) {
+			hits |= MODE_REACHED_TARGET;
+
+			if (period_lim == VALUE_MAX) {
+				hits |= MODE_REACHED_MAX;
+			}
+			n %= period;
+		}
+	}
+
+	c->value = (u16)v;
+	c->mode |= (u16)hits;
+
+	if (((hits & MODE_REACHED_TARGET) && (c->mode & MODE_IRQ_TARGET)) ||
+	    ((hits & MODE_REACHED_MAX) && (c->mode & MODE_IRQ_MAX))) {
+		irq(ctx, id);
+	}
+}
+
+/// @brief Brings a counter up to date with the current cycle.
+static void update(struct psycho_ctx *const ctx, const uint id)
+{
+	struct psycho_rcnt *const c = &ctx->rcnt[id];
+	const struct src src = src_get(id, c->mode);
+	const u64 now = sched_now(ctx);
+
+	assert(now >= c->base);
+
+	const u64 scaled = ((now - c->base) * src.mul) + c->frac;
+
+	c->base = now;
+	c->frac = (u32)(scaled % src.div);
+	advance(ctx, id, scaled / src.div);
+}
+
+/// @brief Returns the number of ticks until a counter next arrives at a value,
+/// or NEVER if it does not.
+static NODISCARD u64 ticks_until(const struct psycho_rcnt *const c,
+				 const uint x)
+{
+	const uint v = c->value;
+	const uint lim = lim_get(c, v);
+
+	if ((x > v) && (x <= lim)) {
+		return x - v;
+	}
+
+	// Past the limit, the counter starts over from 0.
+	return (x <= lim_get(c, 0)) ? ((u64)(lim - v) + 1 + x) : NEVER;
+}
+
+/// @brief Schedules the event for the next interrupt a counter raises, or
+/// cancels it if there is none.
+static void schedule(struct psycho_ctx *const ctx, const uint id)
+{
+	const struct psycho_rcnt *const c = &ctx->rcnt[id];
+	const struct src src = src_get(id, c->mode);
+	const uint ev = SCHED_EVENT_RCNT0 + id;
+	u64 ticks = NEVER;
+
+	if (c->irq_done && !(c->mode & MODE_IRQ_REPEAT)) {
+		sched_event_cancel(ctx, ev);
+		return;
+	}
+
+	if (c->mode & MODE_IRQ_TARGET) {
+		ticks = ticks_until(c, c->target);
+	}
+
+	if (c->mode & MODE_IRQ_MAX) {
+		const u64 max = ticks_until(c, VALUE_MAX);
+
+		ticks = (max < ticks) ? max : ticks;
+	}
+
+	if ((ticks == NEVER) || (src.mul == 0)) {
+		sched_event_cancel(ctx, ev);
+		return;
+	}
+
+	// The tick happens once mul * cycles + frac reaches ticks * div.
+	const u64 need = (ticks * src.div) - c->frac;
+	const u64 cycles = (need + src.mul - 1) / src.mul;
+
+	sched_event_schedule(ctx, ev, c->base + cycles);
+}
+
+static void event(struct psycho_ctx *const ctx, const uint id)
+{
+	update(ctx, id);
+	schedule(ctx, id);
+}
+
+static void event_rcnt0(struct psycho_ctx *const ctx, const u64 when)
+{
+	(void)when;
+	event(ctx, 0);
+}
+
+static void event_rcnt1(struct psycho_ctx *const ctx, const u64 when)
+{
+	(void)when;
+	event(ctx, 1);
+}
+
+static void event_rcnt2(struct psycho_ctx *const ctx, const u64 when)
+{
+	(void)when;
+	event(ctx, 2);
+}
+
+static u32 reg_read(struct psycho_ctx *const ctx, const u32 paddr)
+{
+	const uint id = (paddr - PSYCHO_RCNT_BEG) / PSYCHO_RCNT_STRIDE;
+	struct psycho_rcnt *const c = &ctx->rcnt[id];
+	const uint shift = (paddr & 3) * 8;
+	u32 val = 0;
+
+	switch ((paddr - PSYCHO_RCNT_BEG) & 0xC) {
+	case REG_VALUE:
+		update(ctx, id);
+		val = c->value;
+		break;
+
+	case REG_MODE:
+		// The reached flags are cleared by reading them.
+		update(ctx, id);
+		val = c->mode;
+		c->mode &= (u16)~(MODE_REACHED_TARGET | MODE_REACHED_MAX);
+		break;
+
+	case REG_TARGET:
+		val = c->target;
+		break;
+
+	default:
+		break;
+	}
+	return val >> shift;
+}
+
+/// @brief Writes the bytes of a register selected by @p bits.
+static void reg_write(struct psycho_ctx *const ctx, const u32 paddr,
+		      const u32 data, const u32 bits)
+{
+	const uint id = (paddr - PSYCHO_RCNT_BEG) / PSYCHO_RCNT_STRIDE;
+	struct psycho_rcnt *const c = &ctx->rcnt[id];
+	const uint shift = (paddr & 3) * 8;
+	const u32 mask = bits << shift;
+	const u32 val = data << shift;
+
+	update(ctx, id);
+
+	switch ((paddr - PSYCHO_RCNT_BEG) & 0xC) {
+	case REG_VALUE:
+		c->value = (u16)((c->value & ~mask) | (val & mask));
+		break;
+
+	case REG_MODE: {
+		const u32 mode = (c->mode & ~mask) | (val & mask);
+
+		// Writing the mode also resets the counter and its clock
+		// source, and withdraws any interrupt request.
+		c->mode = (u16)((c->mode & ~MODE_WRITABLE) |
+				(mode & MODE_WRITABLE) | MODE_IRQ_N);
+		c->value = 0;
+		c->frac = 0;
+		c->irq_done = false;
+		break;
+	}
+
+	case REG_TARGET:
+		c->target = (u16)((c->target & ~mask) | (val & mask));
+		break;
+
+	default:
+		return;
+	}
+	schedule(ctx, id);
+}
+
+static void reg_write_b(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFF);
+}
+
+static void reg_write_h(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFFFF);
+}
+
+static void reg_write_w(struct psycho_ctx *const ctx, const u32 paddr,
+			const u32 data)
+{
+	reg_write(ctx, paddr, data, 0xFFFFFFFF);
+}
+
+static const struct psycho_bus_io io = {
+	.read = { reg_read, reg_read, reg_read },
+	.write = { reg_write_b, reg_write_h, reg_write_w },
+	.timed = true,
+};
+
+void rcnt_init(struct psycho_ctx *const ctx)
+{
+	bus_io_register(ctx, PSYCHO_RCNT_BEG, PSYCHO_RCNT_END, &io);
+
+	sched_event_register(ctx, SCHED_EVENT_RCNT0, event_rcnt0);
+	sched_event_register(ctx, SCHED_EVENT_RCNT1, event_rcnt1);
+	sched_event_register(ctx, SCHED_EVENT_RCNT2, event_rcnt2);
+}
+
+void rcnt_reset(struct psycho_ctx *const ctx)
+{
+	for (uint id = 0; id < PSYCHO_RCNT_NUM; ++id) {
+		ctx->rcnt[id] = (struct psycho_rcnt){
+			.base = sched_now(ctx),
+			.mode = MODE_IRQ_N,
+		};
+	}
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file sched.c Implements the event scheduler.
+
+#include <string.h>
+
+#include "sched.h"
+
+/// @brief Returns whether event a is due before event b. Ties are broken by
+/// the event number, so that events fire in the same order every run.
+static ALWAYS_INLINE NODISCARD bool before(const struct psycho_sched *const s,
+					   const uint a, const uint b)
+{
+	const u64 wa = s->events[a].when;
+	const u64 wb = s->events[b].when;
+
+	return (wa < wb) || ((wa == wb) && (a < b));
+}
+
+static ALWAYS_INLINE void heap_set(struct psycho_sched *const s, const uint i,
+				   const uint id)
+{
+	s->heap[i] = (u8)id;
+	s->pos[id] = (u8)(i + 1);
+}
+
+static void sift_up(struct psycho_sched *const s, uint i)
+{
+	const uint id = s->heap[i];
+
+	while (i != 0) {
+		const uint parent = (i - 1) / 2;
+
+		if (!before(s, id, s->heap[parent])) {
+			break;
+		}
+		heap_set(s, i, s->heap[parent]);
+		i = parent;
+	}
+	heap_set(s, i, id);
+}
+
+static void sift_down(struct psycho_sched *const s, uint i)
+{
+	const uint id = s->heap[i];
+
+	for (;;) {
+		uint child = (i * 2) + 1;
+
+		if (child >= s->heap_len) {
+			break;
+		}
+
+		if (((child + 1) < s->heap_len) &&
+		    before(s, s->heap[child + 1], s->heap[child])) {
+			child++;
+		}
+
+		if (!before(s, s->heap[child], id)) {
+			break;
+		}
+		heap_set(s, i, s->heap[child]);
+		i = child;
+	}
+	heap_set(s, i, id);
+}
+
+void sched_reset(struct psycho_ctx *const ctx)
+{
+	struct psycho_sched *const s = &ctx->sched;
+
+	s->cycles = 0;
+	s->slice = 0;
+	s->heap_len = 0;
+	memset(s->pos, 0, sizeof(s->pos));
+
+	ctx->cpu.run_left = 0;
+}
+
+void sched_event_register(struct psycho_ctx *const ctx, const uint id,
+			  void (*const cb)(struct psycho_ctx *ctx, u64 when))
+{
+	ctx->sched.events[id].cb = cb;
+}
+
+void sched_event_schedule(struct psycho_ctx *const ctx, const uint id,
+			  const u64 when)
+{
+	struct psycho_sched *const s = &ctx->sched;
+
+	s->events[id].when = when;
+
+	if (s->pos[id] == 0) {
+		s->heap[s->heap_len] = (u8)id;
+		s->pos[id] = (u8)++s->heap_len;
+		sift_up(s, s->heap_len - 1);
+	} else {
+		sift_up(s, s->pos[id] - 1U);
+		sift_down(s, s->pos[id] - 1U);
+	}
+
+	// Cut the slice short, keeping the current cycle as it is.
+	const u64 now = sched_now(ctx);
+	const u64 end = s->cycles + (u64)s->slice;
+	const u64 at = (when < now) ? now : when;
+
+	if (at < end) {
+		const s64 cut = (s64)(end - at);
+
+		s->slice -= cut;
+		ctx->cpu.run_left -= cut;
+		ctx->cpu.block_exit = true;
+	}
+}
+
+void sched_event_cancel(struct psycho_ctx *const ctx, const uint id)
+{
+	struct psycho_sched *const s = &ctx->sched;
+
+	if (s->pos[id] == 0) {
+		return;
+	}
+
+	const uint i = s->pos[id] - 1U;
+	const uint last = s->heap[--s->heap_len];
+
+	s->pos[id] = 0;
+
+	if (i == s->heap_len) {
+		return;
+	}
+
+	// The slice is left as it is; ending it early is harmless.
+	heap_set(s, i, last);
+	sift_up(s, i);
+	sift_down(s, s->pos[last] - 1U);
+}
+
+void sched_slice_begin(struct psycho_ctx *const ctx, const u64 end)
+{
+	struct psycho_sched *const s = &ctx->sched;
+	const u64 now = sched_now(ctx);
+
+	// Start an empty slice, so that events scheduled by callbacks see the
+	// right cycle.
+	s->cycles = now;
+	s->slice = 0;
+	ctx->cpu.run_left = 0;
+
+	while (s->heap_len != 0) {
+		const uint id = s->heap[0];
+		const u64 when = s->events[id].when;
+
+		if (when > now) {
+			break;
+		}
+		sched_event_cancel(ctx, id);
+		s->events[id].cb(ctx, when);
+	}
+
+	u64 until = end;
+
+	if ((s->heap_len != 0) && (s->events[s->heap[0]].when < until)) {
+		until = s->events[s->heap[0]].when;
+	}
+
+	s->slice = (until > now) ? (s64)(until - now) : 0;
+	ctx->cpu.run_left = s->slice;
+}
+
+void sched_slice_end(struct psycho_ctx *const ctx, const u64 end)
+{
+	struct psycho_sched *const s = &ctx->sched;
+	const u64 now = sched_now(ctx);
+
+	s->cycles = now;
+	s->slice = (end > now) ? (s64)(end - now) : 0;
+	ctx->cpu.run_left = s->slice;
+}
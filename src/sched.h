@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+/// @file sched.h Provides the event scheduler.
+///
+/// Devices schedule events at the cycles something happens, rather than being
+/// polled. psycho_ctx_run() executes the CPU in slices which end when the
+/// earliest event is due, and fires it between them.
+
+#pragma once
+
+#include "compiler.h"
+#include "psycho/ctx.h"
+
+// clang-format off
+
+///@{
+/// @brief The event slots, one per source of events.
+#define SCHED_EVENT_RCNT0	(0)
+#define SCHED_EVENT_RCNT1	(1)
+#define SCHED_EVENT_RCNT2	(2)
+///@}
+
+// clang-format on
+
+/// @brief Returns the current cycle. While the CPU runs, it is the number of
+/// instructions executed before the current one, whichever mode executes it.
+/// Translated blocks are charged for up front, so the part not executed yet is
+/// taken back out.
+static ALWAYS_INLINE NODISCARD u64 sched_now(const struct psycho_ctx *const ctx)
+{
+	return ctx->sched.cycles + (u64)(ctx->sched.slice - ctx->cpu.run_left) -
+	       ctx->cpu.jit_ahead;
+}
+
+/// @brief Cancels every event and resets the cycle counter.
+void sched_reset(struct psycho_ctx *ctx);
+
+/// @brief Sets the function an event calls once it is due.
+void sched_event_register(struct psycho_ctx *ctx, uint id,
+			  void (*cb)(struct psycho_ctx *ctx, u64 when));
+
+/// @brief Schedules an event, moving it if it is already pending. If it is due
+/// before the current slice ends, the slice is cut short, and the block being
+/// executed stops after the current instruction, so that the event fires at the
+/// same instruction in every mode. An event which is already due ends the
+/// slice after the current instruction.
+void sched_event_schedule(struct psycho_ctx *ctx, uint id, u64 when);
+
+/// @brief Cancels an event if it is pending.
+void sched_event_cancel(struct psycho_ctx *ctx, uint id);
+
+/// @brief Returns whether an event is pending.
+static ALWAYS_INLINE NODISCARD bool
+sched_event_pending(const struct psycho_ctx *const ctx, const uint id)
+{
+	return ctx->sched.pos[id] != 0;
+}
+
+/// @brief Fires every event which is due, then starts a slice which ends at
+/// the next event due, or at @p end if that is sooner. The length of the slice
+/// is loaded into psycho_cpu::run_left for the CPU to count down.
+void sched_slice_begin(struct psycho_ctx *ctx, u64 end);
+
+/// @brief Ends the current slice early, making psycho_cpu::run_left the number
+/// of cycles left until @p end.
+void sched_slice_end(struct psycho_ctx *ctx, u64 end);
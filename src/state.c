@@ -0,0 +1,620 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file state.c Implements save states.
+///
+/// A state is a header followed by tagged sections, one per region of machine
+/// state, and ends with an empty section tagged "END ". Every field is stored
+/// in host byte order. Large regions are written and read with a single copy,
+/// or compressed with lz_compress() on request; a section which does not
+/// shrink is stored as is.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "cpu_cache.h"
+#include "dbg_log.h"
+#include "gpu.h"
+#include "lz.h"
+#include "sched.h"
+
+#include "psycho/ctx.h"
+
+// clang-format off
+
+#define STATE_MAGIC	("PSYCHOST")
+#define STATE_VERSION	(5)
+
+#define TAG(a, b, c, d)	\
+	((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#define TAG_CPU		(TAG('C', 'P', 'U', ' '))
+#define TAG_RAM		(TAG('R', 'A', 'M', ' '))
+#define TAG_SPAD	(TAG('S', 'P', 'A', 'D'))
+#define TAG_HLE		(TAG('H', 'L', 'E', ' '))
+#define TAG_SCHED	(TAG('S', 'C', 'H', 'D'))
+#define TAG_IRQ		(TAG('I', 'R', 'Q', ' '))
+#define TAG_RCNT	(TAG('R', 'C', 'N', 'T'))
+#define TAG_GPU		(TAG('G', 'P', 'U', ' '))
+#define TAG_VRAM	(TAG('V', 'R', 'A', 'M'))
+#define TAG_END		(TAG('E', 'N', 'D', ' '))
+
+/// @brief The section's payload is compressed.
+#define SECTION_LZ	(1 << 0)
+
+/// @brief The number of sections, excluding the end marker.
+#define SECTIONS_NUM	(9)
+
+// clang-format on
+
+struct state_hdr {
+	char magic[8];
+	u32 version;
+
+	/// @brief The size of the whole state, header included.
+	u32 size;
+};
+
+struct section_hdr {
+	u32 tag;
+	u32 flags;
+
+	/// @brief The size of the region the section restores.
+	u32 raw_len;
+
+	/// @brief The size of the payload which follows.
+	u32 len;
+};
+
+struct state_cpu {
+	u32 gpr[PSYCHO_CPU_GPR_REGS_NUM];
+	u32 cp0_cpr[PSYCHO_CPU_CP0_CPR_REGS_NUM];
+	u32 cp2_cpr[PSYCHO_CPU_CP2_CPR_REGS_NUM];
+	u32 cp2_ccr[PSYCHO_CPU_CP2_CCR_REGS_NUM];
+
+	u32 instr;
+	u32 pc;
+	u32 npc;
+
+	u32 hi;
+	u32 lo;
+};
+
+struct state_hle {
+	u32 heap_beg;
+	u32 heap_end;
+	u32 rand_seed;
+
+	struct psycho_hle_event events[PSYCHO_HLE_EVENTS_NUM];
+};
+
+struct state_sched {
+	u64 cycles;
+	u64 when[PSYCHO_SCHED_EVENTS_NUM];
+
+	/// @brief A bit per pending event.
+	u32 pending;
+	u32 pad;
+};
+
+struct state_irq {
+	u32 stat;
+	u32 mask;
+};
+
+struct state_rcnt {
+	u64 base;
+	u32 frac;
+
+	u16 value;
+	u16 mode;
+	u16 target;
+	u16 irq_done;
+	u32 pad;
+};
+
+struct state_gpu {
+	u32 stat;
+	u32 draw_mode;
+	u32 tex_window;
+	u32 area_tl;
+	u32 area_br;
+	u32 offset;
+	u32 mask;
+	u32 disp_start;
+	u32 disp_h;
+	u32 disp_v;
+	u32 disp_mode;
+	u32 read;
+
+	u32 pkt[PSYCHO_GPU_PKT_MAX];
+	u32 pkt_len;
+	u16 polyline;
+	u16 tex_disable;
+
+	struct psycho_gpu_xfer upload;
+	struct psycho_gpu_xfer download;
+};
+
+/// @brief The parts of a state which are staged rather than copied from the
+/// context directly, so that their layout does not depend on the public
+/// structures.
+struct state_staged {
+	struct state_cpu cpu;
+	struct state_hle hle;
+	struct state_sched sched;
+	struct state_irq irq;
+	struct state_rcnt rcnt[PSYCHO_RCNT_NUM];
+	struct state_gpu gpu;
+};
+
+/// @brief Describes the region of machine state a section holds.
+struct section {
+	u32 tag;
+	u32 pad;
+	void *data;
+	size_t len;
+};
+
+/// @brief Lists the sections of a state.
+static void sections_get(struct psycho_ctx *const ctx,
+			 struct state_staged *const st,
+			 struct section sections[SECTIONS_NUM])
+{
+	sections[0] = (struct section){ .tag = TAG_CPU,
+					 .data = &st->cpu,
+					 .len = sizeof(st->cpu) };
+	sections[1] = (struct section){ .tag = TAG_RAM,
+					 .data = ctx->bus.ram,
+					 .len = PSYCHO_BUS_RAM_SIZE };
+	sections[2] = (struct section){ .tag = TAG_SPAD,
+					 .data = ctx->bus.scratchpad,
+					 .len = sizeof(ctx->bus.scratchpad) };
+	sections[3] = (struct section){ .tag = TAG_HLE,
+					 .data = &st->hle,
+					 .len = sizeof(st->hle) };
+	sections[4] = (struct section){ .tag = TAG_SCHED,
+					 .data = &st->sched,
+					 .len = sizeof(st->sched) };
+	sections[5] = (struct section){ .tag = TAG_IRQ,
+					 .data = &st->irq,
+					 .len = sizeof(st->irq) };
+	sections[6] = (struct section){ .tag = TAG_RCNT,
+					 .data = st->rcnt,
+					 .len = sizeof(st->rcnt) };
+	sections[7] = (struct section){ .tag = TAG_GPU,
+					 .data = &st->gpu,
+					 .len = sizeof(st->gpu) };
+	sections[8] = (struct section){ .tag = TAG_VRAM,
+					 .data = ctx->gpu.vram,
+					 .len = PSYCHO_GPU_VRAM_SIZE };
+}
+
+/// @brief Stages the parts of the context which are not copied directly.
+static void staged_get(const struct psycho_ctx *const ctx,
+		       struct state_staged *const st)
+{
+	memset(st, 0, sizeof(*st));
+
+	memcpy(st->cpu.gpr, ctx->cpu.gpr, sizeof(st->cpu.gpr));
+	memcpy(st->cpu.cp0_cpr, ctx->cpu.cp0_cpr, sizeof(st->cpu.cp0_cpr));
+	memcpy(st->cpu.cp2_cpr, ctx->cpu.cp2_cpr, sizeof(st->cpu.cp2_cpr));
+	memcpy(st->cpu.cp2_ccr, ctx->cpu.cp2_ccr, sizeof(st->cpu.cp2_ccr));
+	st->cpu.instr = ctx->cpu.instr;
+	st->cpu.pc = ctx->cpu.pc;
+	st->cpu.npc = ctx->cpu.npc;
+	st->cpu.hi = ctx->cpu.hi;
+	st->cpu.lo = ctx->cpu.lo;
+
+	st->hle.heap_beg = ctx->hle.heap_beg;
+	st->hle.heap_end = ctx->hle.heap_end;
+	st->hle.rand_seed = ctx->hle.rand_seed;
+	memcpy(st->hle.events, ctx->hle.events, sizeof(st->hle.events));
+
+	st->sched.cycles = sched_now(ctx);
+
+	for (uint id = 0; id < PSYCHO_SCHED_EVENTS_NUM; ++id) {
+		st->sched.when[id] = ctx->sched.events[id].when;
+
+		if (sched_event_pending(ctx, id)) {
+			st->sched.pending |= 1U << id;
+		}
+	}
+
+	st->irq.stat = ctx->irq.stat;
+	st->irq.mask = ctx->irq.mask;
+
+	for (uint id = 0; id < PSYCHO_RCNT_NUM; ++id) {
+		const struct psycho_rcnt *const c = &ctx->rcnt[id];
+
+		st->rcnt[id] = (struct state_rcnt){ .base = c->base,
+						    .frac = c->frac,
+						    .value = c->value,
+						    .mode = c->mode,
+						    .target = c->target,
+						    .irq_done = c->irq_done };
+	}
+
+	const struct psycho_gpu *const gpu = &ctx->gpu;
+
+	st->gpu = (struct state_gpu){ .stat = gpu->stat,
+				      .draw_mode = gpu->draw_mode,
+				      .tex_window = gpu->tex_window,
+				      .area_tl = gpu->area_tl,
+				      .area_br = gpu->area_br,
+				      .offset = gpu->offset,
+				      .mask = gpu->mask,
+				      .disp_start = gpu->disp_start,
+				      .disp_h = gpu->disp_h,
+				      .disp_v = gpu->disp_v,
+				      .disp_mode = gpu->disp_mode,
+				      .read = gpu->read,
+				      .pkt_len = gpu->pkt_len,
+				      .polyline = gpu->polyline,
+				      .tex_disable = gpu->tex_disable,
+				      .upload = gpu->upload,
+				      .download = gpu->download };
+	memcpy(st->gpu.pkt, gpu->pkt, sizeof(st->gpu.pkt));
+}
+
+/// @brief Restores the parts of the context staged by staged_get().
+static void staged_put(struct psycho_ctx *const ctx,
+		       const struct state_staged *const st)
+{
+	memcpy(ctx->cpu.gpr, st->cpu.gpr, sizeof(st->cpu.gpr));
+	memcpy(ctx->cpu.cp0_cpr, st->cpu.cp0_cpr, sizeof(st->cpu.cp0_cpr));
+	memcpy(ctx->cpu.cp2_cpr, st->cpu.cp2_cpr, sizeof(st->cpu.cp2_cpr));
+	memcpy(ctx->cpu.cp2_ccr, st->cpu.cp2_ccr, sizeof(st->cpu.cp2_ccr));
+	ctx->cpu.instr = st->cpu.instr;
+	ctx->cpu.pc = st->cpu.pc;
+	ctx->cpu.npc = st->cpu.npc;
+	ctx->cpu.hi = st->cpu.hi;
+	ctx->cpu.lo = st->cpu.lo;
+	ctx->cpu.halted = false;
+
+	ctx->hle.heap_beg = st->hle.heap_beg;
+	ctx->hle.heap_end = st->hle.heap_end;
+	ctx->hle.rand_seed = st->hle.rand_seed;
+	memcpy(ctx->hle.events, st->hle.events, sizeof(st->hle.events));
+
+	sched_reset(ctx);
+	ctx->sched.cycles = st->sched.cycles;
+
+	for (uint id = 0; id < PSYCHO_SCHED_EVENTS_NUM; ++id) {
+		if (st->sched.pending & (1U << id)) {
+			sched_event_schedule(ctx, id, st->sched.when[id]);
+		}
+	}
+
+	ctx->irq.stat = st->irq.stat;
+	ctx->irq.mask = st->irq.mask;
+
+	for (uint id = 0; id < PSYCHO_RCNT_NUM; ++id) {
+		const struct state_rcnt *const c = &st->rcnt[id];
+
+		ctx->rcnt[id] = (struct psycho_rcnt){ .base = c->base,
+						      .frac = c->frac,
+						      .value = c->value,
+						      .mode = c->mode,
+						      .target = c->target,
+						      .irq_done = c->irq_done };
+	}
+
+	struct psycho_gpu *const gpu = &ctx->gpu;
+
+	gpu->stat = st->gpu.stat;
+	gpu->draw_mode = st->gpu.draw_mode;
+	gpu->tex_window = st->gpu.tex_window;
+	gpu->area_tl = st->gpu.area_tl;
+	gpu->area_br = st->gpu.area_br;
+	gpu->offset = st->gpu.offset;
+	gpu->mask = st->gpu.mask;
+	gpu->disp_start = st->gpu.disp_start;
+	gpu->disp_h = st->gpu.disp_h;
+	gpu->disp_v = st->gpu.disp_v;
+	gpu->disp_mode = st->gpu.disp_mode;
+	gpu->read = st->gpu.read;
+	memcpy(gpu->pkt, st->gpu.pkt, sizeof(gpu->pkt));
+	gpu->pkt_len = st->gpu.pkt_len;
+	gpu->polyline = st->gpu.polyline;
+	gpu->tex_disable = st->gpu.tex_disable;
+	gpu->upload = st->gpu.upload;
+	gpu->download = st->gpu.download;
+
+	// Never let a bogus state write past the command or divide by 0.
+	if (gpu->pkt_len >= gpu_pkt_len(gpu->pkt[0])) {
+		gpu->pkt_len = 0;
+	}
+
+	if (gpu->upload.w == 0) {
+		gpu->upload.left = 0;
+	}
+
+	if (gpu->download.w == 0) {
+		gpu->download.left = 0;
+	}
+	gpu_restore(ctx);
+}
+
+/// @brief Writes a section.
+///
+/// @returns Where the next section goes, or NULL if it did not fit.
+static NODISCARD u8 *section_put(u8 *const p, const u8 *const end,
+				 const struct section *const sec,
+				 const bool compress)
+{
+	struct section_hdr hdr = { .tag = sec->tag,
+				   .flags = 0,
+				   .raw_len = (u32)sec->len,
+				   .len = (u32)sec->len };
+
+	if ((size_t)(end - p) < sizeof(hdr)) {
+		return NULL;
+	}
+
+	u8 *const payload = p + sizeof(hdr);
+	const size_t room = (size_t)(end - payload);
+
+	if (compress && (sec->len != 0)) {
+		const size_t len = lz_compress(payload,
+					       (room < sec->len) ? room :
+								   sec->len,
+					       sec->data, sec->len);
+
+		if ((len != 0) && (len < sec->len)) {
+			hdr.flags = SECTION_LZ;
+			hdr.len = (u32)len;
+		}
+	}
+
+	if (!(hdr.flags & SECTION_LZ)) {
+		if (room < sec->len) {
+			return NULL;
+		}
+
+		// The end marker has no data at all.
+		if (sec->len != 0) {
+			memcpy(payload, sec->data, sec->len);
+		}
+	}
+
+	memcpy(p, &hdr, sizeof(hdr));
+	return payload + hdr.len;
+}
+
+NODISCARD CONST size_t psycho_ctx_state_size_max(void)
+{
+	// Sections are never stored larger than the regions they hold.
+	return sizeof(struct state_hdr) +
+	       ((SECTIONS_NUM + 1) * sizeof(struct section_hdr)) +
+	       sizeof(struct state_staged) + PSYCHO_BUS_RAM_SIZE +
+	       PSYCHO_BUS_SCRATCHPAD_SIZE + PSYCHO_GPU_VRAM_SIZE;
+}
+
+NODISCARD size_t psycho_ctx_save(struct psycho_ctx *const ctx, void *const buf,
+				 const size_t size, const uint flags)
+{
+	struct state_staged st;
+	struct section sections[SECTIONS_NUM];
+
+	// VRAM must be drawn to before it is saved.
+	gpu_sync(ctx);
+	staged_get(ctx, &st);
+	sections_get(ctx, &st, sections);
+
+	u8 *const beg = buf;
+	u8 *const end = beg + size;
+	u8 *p = beg + sizeof(struct state_hdr);
+
+	if (size < sizeof(struct state_hdr)) {
+		return 0;
+	}
+
+	for (uint i = 0; i < SECTIONS_NUM; ++i) {
+		p = section_put(p, end, &sections[i],
+				flags & PSYCHO_CTX_STATE_COMPRESS);
+
+		if (!p) {
+			return 0;
+		}
+	}
+
+	const struct section marker = { .tag = TAG_END };
+
+	p = section_put(p, end, &marker, false);
+
+	if (!p) {
+		return 0;
+	}
+
+	struct state_hdr hdr = { .version = STATE_VERSION,
+				 .size = (u32)(p - beg) };
+
+	memcpy(hdr.magic, STATE_MAGIC, sizeof(hdr.magic));
+	memcpy(beg, &hdr, sizeof(hdr));
+
+	return (size_t)(p - beg);
+}
+
+/// @brief Finds the section of a state which restores a region.
+///
+/// @returns true if the state holds exactly one well-formed section for the
+/// region, false otherwise.
+static NODISCARD bool section_find(const u8 *const beg, const u8 *const end,
+				   const struct section *const sec,
+				   struct section_hdr *const hdr,
+				   const u8 **const payload)
+{
+	bool found = false;
+
+	for (const u8 *p = beg + sizeof(struct state_hdr);;) {
+		struct section_hdr cur;
+
+		if ((size_t)(end - p) < sizeof(cur)) {
+			return false;
+		}
+
+		memcpy(&cur, p, sizeof(cur));
+		p += sizeof(cur);
+
+		if (cur.len > (size_t)(end - p)) {
+			return false;
+		}
+
+		if (cur.tag == TAG_END) {
+			return found;
+		}
+
+		if (cur.tag == sec->tag) {
+			if (found || (cur.raw_len != sec->len) ||
+			    (!(cur.flags & SECTION_LZ) &&
+			     (cur.len != cur.raw_len))) {
+				return false;
+			}
+
+			found = true;
+			*hdr = cur;
+			*payload = p;
+		}
+		p += cur.len;
+	}
+}
+
+/// @brief Copies the dirty pages of RAM back from the payload of an
+/// uncompressed RAM section, dropping any code cached from them.
+static void ram_dirty_restore(struct psycho_ctx *const ctx,
+			      const u8 *const src)
+{
+	for (uint i = 0; i < (PSYCHO_BUS_RAM_DIRTY_NUM / 64); ++i) {
+		for (u64 dirty = ctx->bus.ram_dirty[i]; dirty;
+		     dirty &= dirty - 1) {
+			const uint page =
+				(i * 64) + (uint)__builtin_ctzll(dirty);
+			const size_t off = (size_t)page
+					   << PSYCHO_BUS_RAM_DIRTY_SHIFT;
+
+			memcpy(&ctx->bus.ram[off], &src[off],
+			       1U << PSYCHO_BUS_RAM_DIRTY_SHIFT);
+
+			if (ctx->cpu.cache_pages[page]) {
+				cpu_cache_page_flush(ctx, page);
+			}
+		}
+	}
+}
+
+static NODISCARD bool load(struct psycho_ctx *const ctx, const void *const buf,
+			   const size_t size, const bool dirty_only)
+{
+	struct state_hdr hdr;
+
+	if (size < sizeof(hdr)) {
+		return false;
+	}
+
+	memcpy(&hdr, buf, sizeof(hdr));
+
+	if ((memcmp(hdr.magic, STATE_MAGIC, sizeof(hdr.magic)) != 0) ||
+	    (hdr.version != STATE_VERSION) || (hdr.size < sizeof(hdr)) ||
+	    (hdr.size > size)) {
+		LOG_WARN("Not a save state this version can load");
+		return false;
+	}
+
+	const u8 *const beg = buf;
+	const u8 *const end = beg + hdr.size;
+
+	struct state_staged st;
+	struct section sections[SECTIONS_NUM];
+	struct section_hdr hdrs[SECTIONS_NUM];
+	const u8 *payloads[SECTIONS_NUM];
+
+	sections_get(ctx, &st, sections);
+
+	// Nothing may be drawn to VRAM while it is restored.
+	gpu_sync(ctx);
+
+	// Check every section before touching the context.
+	for (uint i = 0; i < SECTIONS_NUM; ++i) {
+		if (!section_find(beg, end, &sections[i], &hdrs[i],
+				  &payloads[i])) {
+			LOG_WARN("Save state is malformed");
+			return false;
+		}
+
+		if ((hdrs[i].flags & SECTION_LZ) &&
+		    !lz_valid(sections[i].len, payloads[i], hdrs[i].len)) {
+			LOG_WARN("Save state is corrupt");
+			return false;
+		}
+	}
+
+	// Only an uncompressed RAM section can be restored page by page.
+	bool partial = false;
+
+	for (uint i = 0; i < SECTIONS_NUM; ++i) {
+		if (dirty_only && (sections[i].tag == TAG_RAM) &&
+		    !(hdrs[i].flags & SECTION_LZ)) {
+			ram_dirty_restore(ctx, payloads[i]);
+			partial = true;
+		} else if (!(hdrs[i].flags & SECTION_LZ)) {
+			memcpy(sections[i].data, payloads[i], sections[i].len);
+		} else {
+			// The block was checked above, so this cannot fail.
+			const bool ok = lz_decompress(sections[i].data,
+						      sections[i].len,
+						      payloads[i], hdrs[i].len);
+			(void)ok;
+		}
+	}
+
+	staged_put(ctx, &st);
+	ctx->ps_x_exe = NULL;
+
+	// Code cached from RAM no longer matches it.
+	for (uint page = 0;
+	     !partial &&
+	     (page < (PSYCHO_BUS_RAM_SIZE >> PSYCHO_CPU_CACHE_PAGE_SHIFT));
+	     ++page) {
+		if (ctx->cpu.cache_pages[page]) {
+			cpu_cache_page_flush(ctx, page);
+		}
+	}
+
+	// RAM now matches the state.
+	psycho_ctx_ram_dirty_clear(ctx);
+	return true;
+}
+
+NODISCARD bool psycho_ctx_load(struct psycho_ctx *const ctx,
+			       const void *const buf, const size_t size)
+{
+	return load(ctx, buf, size, false);
+}
+
+NODISCARD bool psycho_ctx_load_dirty(struct psycho_ctx *const ctx,
+				     const void *const buf, const size_t size)
+{
+	return load(ctx, buf, size, true);
+}
@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file cpu_modes.c Checks that every CPU mode leaves the same state behind,
+/// by running the benchmark's programs in each of them.
+///
+/// The interpreter without fastmem is the reference. Each program is run in
+/// slices of an odd budget, so that slices end in the middle of blocks, and
+/// some of the random programs read root counter 0, which only agrees if every
+/// mode charges cycles the same way by the time a device is accessed.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prog.h"
+#include "psycho/ctx.h"
+
+// clang-format off
+
+/// @brief The number of times the tight loop goes around.
+#define LOOP_ITERS	(20000)
+
+/// @brief The number of times a random program's body is repeated.
+#define RAND_ITERS	(500)
+
+/// @brief The number of random programs, each of which is run with and
+/// without reads of root counter 0.
+#define RAND_SEEDS_NUM	(4)
+
+/// @brief The budget of each call to psycho_ctx_run().
+#define SLICE_BUDGET	(100003)
+
+/// @brief The most slices a program may take before it is considered stuck.
+#define SLICES_MAX	(1000)
+
+#define MODES_NUM	(3)
+
+// clang-format on
+
+/// @brief What a program leaves behind.
+struct state {
+	u8 *ram;
+	u64 cycles;
+	uint stop;
+	u32 gpr[PSYCHO_CPU_GPR_REGS_NUM];
+	u32 hi;
+	u32 lo;
+	u32 pad;
+};
+
+static const char *const mode_names[MODES_NUM] = {
+	[PSYCHO_CPU_MODE_INTERP] = "interp",
+	[PSYCHO_CPU_MODE_CACHED] = "cached",
+	[PSYCHO_CPU_MODE_JIT] = "jit",
+};
+
+/// @brief Runs the program in a BIOS image until it ends, and records the
+/// state it leaves behind in @p s.
+///
+/// @returns false if a context could not be created.
+static bool prog_run(const struct psycho_bios *const bios, const u32 end,
+		     const uint mode, const bool fastmem, struct state *const s)
+{
+	struct psycho_ctx *const ctx = psycho_ctx_new(bios, NULL, mode);
+
+	if (!ctx) {
+		return false;
+	}
+
+	// Not every host has fastmem; the page tables are checked regardless.
+	if (fastmem) {
+		psycho_ctx_fastmem_enable(ctx);
+	}
+
+	psycho_ctx_reset(ctx);
+
+	ctx->cpu.exc_halt = (1 << PSYCHO_CPU_EXC_CODE_RI);
+	ctx->stop_pc = end;
+	ctx->stop_pc_enabled = true;
+
+	s->stop = PSYCHO_CTX_STOP_BUDGET;
+
+	for (uint i = 0; i < SLICES_MAX; ++i) {
+		s->stop = psycho_ctx_run(ctx, SLICE_BUDGET);
+
+		if (s->stop != PSYCHO_CTX_STOP_BUDGET) {
+			break;
+		}
+	}
+
+	memcpy(s->ram, ctx->bus.ram, PSYCHO_BUS_RAM_SIZE);
+	memcpy(s->gpr, ctx->cpu.gpr, sizeof(s->gpr));
+	s->hi = ctx->cpu.hi;
+	s->lo = ctx->cpu.lo;
+	s->cycles = psycho_ctx_cycles(ctx);
+
+	psycho_ctx_free(ctx);
+	return true;
+}
+
+/// @brief Compares the state a program left behind in some mode against the
+/// reference, and reports the differences.
+static bool state_check(const struct state *const ref,
+			const struct state *const s, const char *const name)
+{
+	bool ok = true;
+
+	if (s->stop != ref->stop) {
+		printf("%s: stopped with %u, expected %u\n", name, s->stop,
+		       ref->stop);
+		ok = false;
+	}
+
+	if (s->cycles != ref->cycles) {
+		printf("%s: %lu cycles, expected %lu\n", name,
+		       (ulong)s->cycles, (ulong)ref->cycles);
+		ok = false;
+	}
+
+	for (uint reg = 0; reg < PSYCHO_CPU_GPR_REGS_NUM; ++reg) {
+		if (s->gpr[reg] != ref->gpr[reg]) {
+			printf("%s: GPR %u is 0x%08X, expected 0x%08X\n", name,
+			       reg, s->gpr[reg], ref->gpr[reg]);
+			ok = false;
+		}
+	}
+
+	if ((s->hi != ref->hi) || (s->lo != ref->lo)) {
+		printf("%s: hi:lo is 0x%08X:0x%08X, expected "
+		       "0x%08X:0x%08X\n",
+		       name, s->hi, s->lo, ref->hi, ref->lo);
+		ok = false;
+	}
+
+	if (memcmp(s->ram, ref->ram, PSYCHO_BUS_RAM_SIZE)) {
+		printf("%s: RAM differs\n", name);
+		ok = false;
+	}
+	return ok;
+}
+
+/// @brief Runs a program in every mode, with and without fastmem, and checks
+/// that they all agree with the interpreter.
+static bool prog_check(u8 *const image, const char *const name,
+		       const u32 end, struct state *const ref,
+		       struct state *const s)
+{
+	struct psycho_bios bios;
+
+	if (!psycho_bios_create(&bios, image)) {
+		return false;
+	}
+
+	bool ok = prog_run(&bios, end, PSYCHO_CPU_MODE_INTERP, false, ref);
+
+	if (ok && (ref->stop != PSYCHO_CTX_STOP_PC)) {
+		printf("%s: interp stopped with %u before the end\n", name,
+		       ref->stop);
+		ok = false;
+	}
+
+	for (uint i = 1; ok && (i < (MODES_NUM * 2)); ++i) {
+		const uint mode = i % MODES_NUM;
+		const bool fastmem = i >= MODES_NUM;
+		char run_name[64];
+
+		snprintf(run_name, sizeof(run_name), "%s, %s%s", name,
+			 mode_names[mode], fastmem ? " with fastmem" : "");
+
+		ok = prog_run(&bios, end, mode, fastmem, s) &&
+		     state_check(ref, s, run_name);
+	}
+
+	psycho_bios_close(&bios);
+	return ok;
+}
+
+int main(void)
+{
+	u8 *const image = malloc(PSYCHO_BUS_BIOS_SIZE);
+	struct state ref = { .ram = malloc(PSYCHO_BUS_RAM_SIZE) };
+	struct state s = { .ram = malloc(PSYCHO_BUS_RAM_SIZE) };
+
+	bool ok = image && ref.ram && s.ram;
+
+	if (ok) {
+		struct prog prog = { .image = image };
+
+		memset(image, 0, PSYCHO_BUS_BIOS_SIZE);
+		const u32 end = prog_loop_assemble(&prog, LOOP_ITERS);
+
+		ok = prog_check(image, "tight loop", end, &ref, &s);
+	}
+
+	for (uint i = 0; ok && (i < (RAND_SEEDS_NUM * 2)); ++i) {
+		const u32 seed = 1 + (i / 2);
+		struct prog prog = { .image = image, .io = i & 1 };
+		char name[64];
+
+		memset(image, 0, PSYCHO_BUS_BIOS_SIZE);
+		const u32 end = prog_rand_assemble(&prog, seed, RAND_ITERS);
+
+		snprintf(name, sizeof(name), "random program %u%s", seed,
+			 prog.io ? " reading root counter 0" : "");
+
+		ok = prog_check(image, name, end, &ref, &s);
+	}
+
+	free(s.ram);
+	free(ref.ram);
+	free(image);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
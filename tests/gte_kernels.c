@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file gte_kernels.c Checks the GTE matrix kernels of every instruction set
+/// the host has against a scalar reference, for random operands.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gte_simd.h"
+
+// clang-format off
+
+/// @brief The number of random products computed with each instruction set.
+#define PRODUCTS_NUM	(1000000)
+
+/// @brief The number of mismatches reported before giving up.
+#define REPORTS_MAX	(8)
+
+/// @brief The range of MAC1..3 is [-MAC_MAX, MAC_MAX).
+#define MAC_MAX		(INT64_C(1) << 43)
+
+// clang-format on
+
+static u64 rng = UINT64_C(0x9E3779B97F4A7C15);
+
+/// @brief Returns the next number of a xorshift sequence, so that every run
+/// computes the same products.
+static u32 rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+
+	return (u32)(rng >> 32);
+}
+
+/// @brief Returns a random translation. Only those near the ends of the range
+/// of s32 can take a sum out of the range of MAC1..3, so a quarter of them are.
+static s32 tr_random(void)
+{
+	if (rnd() % 4) {
+		return (s32)rnd();
+	}
+
+	const s32 off = (s32)(rnd() % (1U << 21));
+	return (rnd() & 1) ? (INT32_MAX - off) : (INT32_MIN + off);
+}
+
+/// @brief Computes the sums as the hardware does, one partial sum at a time.
+///
+/// @returns true if every partial sum was in the range of MAC1..3.
+static bool mat_vec_ref(const struct gte_mat *const m, const s32 t[3],
+			const struct gte_vec *const v, const uint n,
+			s64 (*const out)[3])
+{
+	bool in_range = true;
+
+	for (uint i = 0; i < n; ++i) {
+		for (uint row = 0; row < 3; ++row) {
+			s64 sum = (s64)t[row] * 0x1000;
+
+			for (uint k = 0; k < 3; ++k) {
+				sum += m->e[row][k] * v[i].e[k];
+				in_range = in_range && (sum >= -MAC_MAX) &&
+					   (sum < MAC_MAX);
+			}
+			out[i][row] = sum;
+		}
+	}
+	return in_range;
+}
+
+/// @brief Computes a random product with the reference and with a kernel, and
+/// compares the results.
+///
+/// @returns true if the kernel agreed with the reference, false otherwise.
+static bool product_check(const gte_simd_mat_vec_fn kernel, const uint isa)
+{
+	struct gte_mat m;
+	struct gte_vec v[3];
+	s32 t[3];
+
+	for (uint row = 0; row < 3; ++row) {
+		for (uint k = 0; k < 3; ++k) {
+			m.e[row][k] = (s16)rnd();
+		}
+		t[row] = tr_random();
+	}
+
+	for (uint i = 0; i < 3; ++i) {
+		for (uint k = 0; k < 3; ++k) {
+			v[i].e[k] = (s16)rnd();
+		}
+	}
+
+	const uint n = 1 + (rnd() % 3);
+	s64 expected[3][3];
+	s64 out[3][3];
+
+	const bool in_range = mat_vec_ref(&m, t, v, n, expected);
+	const bool filled = kernel(&m, t, v, n, out);
+
+	// Sums which leave the range are left to the scalar code.
+	if (filled != in_range) {
+		printf("ISA %u: %s a product out of range\n", isa,
+		       filled ? "accepted" : "rejected");
+		return false;
+	}
+
+	if (filled && memcmp(out, expected, n * sizeof(out[0]))) {
+		printf("ISA %u: the sums of %u vectors differ\n", isa, n);
+		return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	uint bad = 0;
+
+	for (uint isa = 0; isa < GTE_SIMD_ISAS_NUM; ++isa) {
+		const gte_simd_mat_vec_fn kernel = gte_simd_get(isa);
+
+		if (!kernel) {
+			printf("ISA %u: unavailable, skipped\n", isa);
+			continue;
+		}
+
+		for (uint i = 0; (i < PRODUCTS_NUM) && (bad < REPORTS_MAX);
+		     ++i) {
+			bad += !product_check(kernel, isa);
+		}
+		printf("ISA %u: checked\n", isa);
+	}
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file span_kernels.c Checks that the span kernels of every instruction set
+/// the host has draw exactly what the scalar ones do, for random spans.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_draw.h"
+#include "gpu_span.h"
+#include "gpu_tex.h"
+#include "psycho/gpu.h"
+
+// clang-format off
+
+/// @brief The number of random spans drawn with each instruction set.
+#define SPANS_NUM	(100000)
+
+/// @brief The number of mismatches reported before giving up.
+#define REPORTS_MAX	(8)
+
+// clang-format on
+
+static u64 rng = UINT64_C(0x9E3779B97F4A7C15);
+
+/// @brief Returns the next number of a xorshift sequence, so that every run
+/// draws the same spans.
+static u32 rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+
+	return (u32)(rng >> 32);
+}
+
+/// @brief Fills a buffer of pixels with random values.
+static void pixels_random(u16 *const pixels, const size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		pixels[i] = (u16)rnd();
+	}
+}
+
+/// @brief Returns a random step for an interpolated value: none, small, or
+/// large enough to overflow the values of long spans.
+static s32 step_random(void)
+{
+	switch (rnd() % 4) {
+	case 0:
+		return 0;
+
+	case 1:
+		return (s32)(rnd() % (1 << 17)) - (1 << 16);
+
+	case 2:
+		return (s32)(rnd() % (1 << 12)) - (1 << 11);
+
+	default:
+		return (s32)(rnd() % (1 << 20)) - (1 << 19);
+	}
+}
+
+/// @brief Sets up a random primitive to draw a span of a kind with.
+static void prim_random(struct gpu_prim *const p, const uint kind,
+			const u16 *const page)
+{
+	struct gpu_env *const e = &p->env;
+
+	memset(p, 0, sizeof(*p));
+
+	e->tp_x = (u16)((rnd() % 16) * 64);
+	e->tp_y = (u16)((rnd() % 2) * 256);
+	e->clut_x = (u16)((rnd() % 64) * 16);
+	e->clut_y = (u16)(rnd() % PSYCHO_GPU_VRAM_HEIGHT);
+
+	// Most primitives leave the texture window alone.
+	e->tw_and_u = (rnd() & 1) ? 0xFF : (u8)rnd();
+	e->tw_and_v = (rnd() & 1) ? 0xFF : (u8)rnd();
+	e->tw_or_u = (rnd() & 1) ? 0 : (u8)rnd();
+	e->tw_or_v = (rnd() & 1) ? 0 : (u8)rnd();
+
+	e->semi = (u8)(rnd() % 4);
+	e->mask_check = (rnd() & 1) ? GPU_MASK_BIT : 0;
+	e->mask_set = (rnd() & 1) ? GPU_MASK_BIT : 0;
+
+	p->flags = (u8)(rnd() & (GPU_PRIM_RAW | GPU_PRIM_SEMI |
+				 GPU_PRIM_DITHER));
+
+	if ((kind >= GPU_SPAN_TEX) && (kind < GPU_SPAN_DECODED)) {
+		p->flags |= GPU_PRIM_TEXTURED;
+		e->depth = (u8)(kind - GPU_SPAN_TEX);
+	} else if (kind == GPU_SPAN_DECODED) {
+		p->flags |= GPU_PRIM_TEXTURED;
+		e->depth = (u8)(rnd() % GPU_DEPTH_15BPP);
+		e->tex = page;
+	}
+}
+
+/// @brief Makes a span read the texels it draws over, which the kernels must
+/// see as they are drawn, pixel by pixel.
+static void span_self(struct gpu_prim *const p, const uint y, const uint x_beg,
+		      s32 val[GPU_ATTRS_NUM], s32 step[GPU_ATTRS_NUM])
+{
+	struct gpu_env *const e = &p->env;
+	const uint shift = GPU_DEPTH_15BPP - e->depth;
+	const uint u = rnd() % 8;
+
+	e->tp_x = (u16)((x_beg - 1 - (u >> shift)) % PSYCHO_GPU_VRAM_WIDTH);
+	e->tp_y = (u16)y;
+	e->tw_and_u = 0xFF;
+	e->tw_and_v = 0xFF;
+	e->tw_or_u = 0;
+	e->tw_or_v = 0;
+
+	val[GPU_ATTR_U] = (s32)(u << GPU_SPAN_FRAC_SHIFT);
+	val[GPU_ATTR_V] = 0;
+	step[GPU_ATTR_U] = 1 << GPU_SPAN_FRAC_SHIFT;
+	step[GPU_ATTR_V] = 0;
+
+	if ((e->depth != GPU_DEPTH_15BPP) && (rnd() & 1)) {
+		e->clut_x = (u16)(x_beg & ~15U);
+		e->clut_y = (u16)y;
+	}
+}
+
+/// @brief Draws a random span with the scalar kernels and those of an
+/// instruction set, and compares the results.
+///
+/// @returns true if both drew the same pixels, false otherwise.
+static bool span_check(const gpu_span_fn *const spans, const uint isa,
+		       u16 *const vram, const u16 *const page)
+{
+	const uint kind = rnd() % GPU_SPANS_NUM;
+	struct gpu_prim p;
+	prim_random(&p, kind, page);
+
+	const uint y = rnd() % PSYCHO_GPU_VRAM_HEIGHT;
+	u16 *const row = &vram[y * PSYCHO_GPU_VRAM_WIDTH];
+
+	// Spans are either short, or long enough to run to the right edge.
+	const uint x_beg = rnd() % PSYCHO_GPU_VRAM_WIDTH;
+	const uint len = (rnd() & 1) ? (rnd() % 16) : (rnd() % 1100);
+	const uint x_end = ((x_beg + len) > PSYCHO_GPU_VRAM_WIDTH) ?
+				   PSYCHO_GPU_VRAM_WIDTH :
+				   (x_beg + len);
+
+	s32 val[GPU_ATTRS_NUM];
+	s32 step[GPU_ATTRS_NUM];
+
+	for (uint i = 0; i < GPU_ATTRS_NUM; ++i) {
+		val[i] = (s32)(rnd() % (300 << 16)) - (20 << 16);
+		step[i] = (kind == GPU_SPAN_FLAT) ? 0 : step_random();
+	}
+
+	if ((kind >= GPU_SPAN_TEX) && (kind < GPU_SPAN_DECODED) &&
+	    ((rnd() % 4) == 0)) {
+		span_self(&p, y, x_beg, val, step);
+	}
+
+	u16 before[PSYCHO_GPU_VRAM_WIDTH];
+	u16 expected[PSYCHO_GPU_VRAM_WIDTH];
+
+	memcpy(before, row, sizeof(before));
+	gpu_span_get(GPU_SPAN_ISA_SCALAR)[kind](vram, &p, y, x_beg, x_end, val,
+						 step);
+	memcpy(expected, row, sizeof(expected));
+
+	memcpy(row, before, sizeof(before));
+	spans[kind](vram, &p, y, x_beg, x_end, val, step);
+
+	const bool same = !memcmp(row, expected, sizeof(expected));
+	memcpy(row, before, sizeof(before));
+
+	if (!same) {
+		printf("ISA %u: kind %u, flags 0x%02X, depth %u, semi %u, "
+		       "row %u, x %u to %u differs\n",
+		       isa, kind, p.flags, p.env.depth, p.env.semi, y, x_beg,
+		       x_end);
+	}
+	return same;
+}
+
+int main(void)
+{
+	u16 *const vram = malloc(PSYCHO_GPU_VRAM_SIZE);
+	u16 *const page =
+		malloc(GPU_TEX_PAGE_DIM * GPU_TEX_PAGE_DIM * sizeof(u16));
+
+	if (!vram || !page) {
+		return EXIT_FAILURE;
+	}
+
+	pixels_random(vram, PSYCHO_GPU_VRAM_SIZE / sizeof(u16));
+	pixels_random(page, GPU_TEX_PAGE_DIM * GPU_TEX_PAGE_DIM);
+
+	uint bad = 0;
+
+	for (uint isa = GPU_SPAN_ISA_SCALAR + 1; isa < GPU_SPAN_ISAS_NUM;
+	     ++isa) {
+		const gpu_span_fn *const spans = gpu_span_get(isa);
+
+		if (!spans) {
+			printf("ISA %u: unavailable, skipped\n", isa);
+			continue;
+		}
+
+		for (uint i = 0; (i < SPANS_NUM) && (bad < REPORTS_MAX); ++i) {
+			bad += !span_check(spans, isa, vram, page);
+		}
+		printf("ISA %u: checked\n", isa);
+	}
+
+	free(page);
+	free(vram);
+
+	return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
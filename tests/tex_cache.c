@@ -0,0 +1,273 @@
+// SPDX-License-Identifier: MIT
+//
+// Copyright 2024 lunaspis
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the “Software”), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+/// @file tex_cache.c Checks that the texture cache only hands out pages which
+/// match VRAM, by replaying random batches of primitives and transfers.
+///
+/// Two copies of VRAM are kept: the one the cache is given, and the one the
+/// batch leaves behind once it is drawn. A page handed out to a primitive must
+/// match the latter as it stands when the primitive is batched, since the
+/// primitives batched before it are drawn first; and it must not change until
+/// the batch is drawn.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu.h"
+#include "gpu_draw.h"
+#include "gpu_tex.h"
+#include "psycho/gpu.h"
+
+// clang-format off
+
+/// @brief The number of batches replayed.
+#define BATCHES_NUM	(2000)
+
+/// @brief The most primitives in a batch.
+#define BATCH_MAX	(32)
+
+/// @brief The number of texture pages and CLUTs a batch picks from, so that
+/// pages are used often enough to be decoded.
+#define ENVS_NUM	(4)
+
+/// @brief The number of texels in a page.
+#define PAGE_TEXELS	(GPU_TEX_PAGE_DIM * GPU_TEX_PAGE_DIM)
+
+// clang-format on
+
+/// @brief A page handed out while the batch is pending.
+struct handout {
+	const u16 *page;
+	u64 hash;
+};
+
+static u64 rng = UINT64_C(0x9E3779B97F4A7C15);
+
+/// @brief Returns the next number of a xorshift sequence, so that every run
+/// replays the same batches.
+static u32 rnd(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+
+	return (u32)(rng >> 32);
+}
+
+static u64 page_hash(const u16 *const page)
+{
+	u64 hash = UINT64_C(14695981039346656037);
+
+	for (uint i = 0; i < PAGE_TEXELS; ++i) {
+		hash = (hash ^ page[i]) * UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+/// @brief Fills a rectangle of VRAM, which wraps around the edges, with random
+/// pixels.
+static void rect_fill(u16 *const vram, const uint x, const uint y,
+		      const uint w, const uint h)
+{
+	for (uint row = 0; row < h; ++row) {
+		u16 *const dst = &vram[((y + row) & GPU_VRAM_Y_MASK) *
+				       PSYCHO_GPU_VRAM_WIDTH];
+
+		for (uint col = 0; col < w; ++col) {
+			dst[(x + col) & GPU_VRAM_X_MASK] = (u16)rnd();
+		}
+	}
+}
+
+/// @brief Returns a texel of a 4 or 8 bpp texture page, looked up through its
+/// CLUT in VRAM.
+static u16 texel_get(const u16 *const vram, const struct gpu_env *const e,
+		     const uint u, const uint v)
+{
+	const uint shift = 2 - e->depth;
+	const uint bits = 4U << e->depth;
+	const uint x = (e->tp_x + (u >> shift)) & GPU_VRAM_X_MASK;
+	const uint y = (e->tp_y + v) & GPU_VRAM_Y_MASK;
+	const uint word = vram[(y * PSYCHO_GPU_VRAM_WIDTH) + x];
+	const uint index = (word >> ((u & ((1U << shift) - 1)) * bits)) &
+			   ((1U << bits) - 1);
+
+	return vram[(e->clut_y * PSYCHO_GPU_VRAM_WIDTH) +
+		    ((e->clut_x + index) & GPU_VRAM_X_MASK)];
+}
+
+/// @brief Checks a decoded page against VRAM.
+///
+/// @returns true if every texel matches, false otherwise.
+static bool page_check(const u16 *const page, const u16 *const vram,
+		       const struct gpu_env *const e)
+{
+	for (uint v = 0; v < GPU_TEX_PAGE_DIM; ++v) {
+		for (uint u = 0; u < GPU_TEX_PAGE_DIM; ++u) {
+			if (page[(v * GPU_TEX_PAGE_DIM) + u] !=
+			    texel_get(vram, e, u, v)) {
+				printf("Texel (%u, %u) of page (%u, %u), "
+				       "CLUT (%u, %u), depth %u differs\n",
+				       u, v, e->tp_x, e->tp_y, e->clut_x,
+				       e->clut_y, e->depth);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/// @brief Picks a random 4 or 8 bpp texture page and CLUT.
+static void env_random(struct gpu_env *const e)
+{
+	memset(e, 0, sizeof(*e));
+
+	e->depth = (u8)(rnd() % GPU_DEPTH_15BPP);
+	e->tp_x = (u16)((rnd() % 16) * 64);
+	e->tp_y = (u16)((rnd() % 2) * 256);
+	e->clut_x = (u16)((rnd() % 64) * 16);
+	e->clut_y = (u16)(rnd() % PSYCHO_GPU_VRAM_HEIGHT);
+}
+
+/// @brief Batches a primitive drawing to a random rectangle from one of the
+/// environments, as the renderer would.
+///
+/// @param drawn VRAM as the batch leaves it, which the primitive draws to.
+/// @returns false if a page was handed out which does not match VRAM.
+static bool prim_batch(struct gpu_tex *const t, const u16 *const vram,
+		       u16 *const drawn, const struct gpu_env envs[ENVS_NUM],
+		       struct handout *const handouts, uint *const handouts_num)
+{
+	const struct gpu_env *const e = &envs[rnd() % ENVS_NUM];
+	const uint x = rnd() % PSYCHO_GPU_VRAM_WIDTH;
+	const uint y = rnd() % PSYCHO_GPU_VRAM_HEIGHT;
+	const uint w = 1 + (rnd() % 128);
+	const uint h = 1 + (rnd() % 128);
+
+	const u16 *const page = gpu_tex_get(t, vram, e, x, y, w, h);
+
+	if (page) {
+		if (!page_check(page, drawn, e)) {
+			return false;
+		}
+
+		handouts[*handouts_num].page = page;
+		handouts[*handouts_num].hash = page_hash(page);
+		(*handouts_num)++;
+	}
+
+	gpu_tex_written(t, x, y, w, h, true);
+	rect_fill(drawn, x, y, w, h);
+
+	return true;
+}
+
+/// @brief Replays a random batch of primitives, then draws it.
+///
+/// @returns false if the texture cache handed out a page which did not match
+/// VRAM, or changed it while the batch was pending.
+static bool batch_run(struct gpu_tex *const t, u16 *const vram,
+		      u16 *const drawn)
+{
+	struct gpu_env envs[ENVS_NUM];
+	struct handout handouts[BATCH_MAX];
+	uint handouts_num = 0;
+
+	for (uint i = 0; i < ENVS_NUM; ++i) {
+		env_random(&envs[i]);
+	}
+
+	const uint len = 1 + (rnd() % BATCH_MAX);
+
+	for (uint i = 0; i < len; ++i) {
+		if (!prim_batch(t, vram, drawn, envs, handouts,
+				&handouts_num)) {
+			return false;
+		}
+	}
+
+	for (uint i = 0; i < handouts_num; ++i) {
+		if (page_hash(handouts[i].page) != handouts[i].hash) {
+			printf("A page changed while its batch was pending\n");
+			return false;
+		}
+	}
+
+	memcpy(vram, drawn, PSYCHO_GPU_VRAM_SIZE);
+	gpu_tex_flushed(t);
+
+	return true;
+}
+
+/// @brief Writes to VRAM between batches: a transfer from the CPU, or, now and
+/// then, a state being loaded.
+static void vram_write(struct gpu_tex *const t, u16 *const vram,
+		       u16 *const drawn)
+{
+	if ((rnd() % 64) == 0) {
+		rect_fill(vram, 0, 0, PSYCHO_GPU_VRAM_WIDTH,
+			  PSYCHO_GPU_VRAM_HEIGHT);
+		gpu_tex_invalidate(t);
+	} else {
+		const uint x = rnd() % PSYCHO_GPU_VRAM_WIDTH;
+		const uint y = rnd() % PSYCHO_GPU_VRAM_HEIGHT;
+		const uint w = 1 + (rnd() % 256);
+		const uint h = 1 + (rnd() % 256);
+
+		rect_fill(vram, x, y, w, h);
+		gpu_tex_written(t, x, y, w, h, false);
+	}
+	memcpy(drawn, vram, PSYCHO_GPU_VRAM_SIZE);
+}
+
+int main(void)
+{
+	struct gpu_tex *const t = gpu_tex_new();
+	u16 *const vram = malloc(PSYCHO_GPU_VRAM_SIZE);
+	u16 *const drawn = malloc(PSYCHO_GPU_VRAM_SIZE);
+
+	if (!t || !vram || !drawn) {
+		return EXIT_FAILURE;
+	}
+
+	rect_fill(vram, 0, 0, PSYCHO_GPU_VRAM_WIDTH, PSYCHO_GPU_VRAM_HEIGHT);
+	memcpy(drawn, vram, PSYCHO_GPU_VRAM_SIZE);
+
+	bool ok = true;
+
+	for (uint i = 0; ok && (i < BATCHES_NUM); ++i) {
+		ok = batch_run(t, vram, drawn);
+
+		if (rnd() & 1) {
+			vram_write(t, vram, drawn);
+		}
+	}
+
+	free(drawn);
+	free(vram);
+	gpu_tex_free(t);
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}